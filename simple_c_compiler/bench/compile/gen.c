@@ -0,0 +1,290 @@
+// 编译器压力输入生成器
+// usage: gen kind [bytes] > out.c
+// kind: idents nesting comments strings exprs structs numbers prelude
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+unsigned long long rnd_state = 0x9e3779b97f4a7c15ULL;
+long long out_bytes = 0;
+
+unsigned int rnd(unsigned int n) {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return (unsigned int) (rnd_state >> 11) % n;
+}
+
+void out(char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    out_bytes += vprintf(fmt, ap);
+    va_end(ap);
+}
+
+// 随机标识符, 长度 4..24, 以序号结尾保证唯一
+void ident(char *buf, char *prefix, int id) {
+    static char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+    int n = 4 + rnd(20), i, p = (int) strlen(prefix);
+
+    strcpy(buf, prefix);
+    for (i = 0; i < n; i++) {
+        buf[p + i] = chars[rnd(i ? 63 : 53)];
+    }
+    sprintf(buf + p + n, "_%d", id);
+}
+
+void main_func(char *body) {
+    out("int main() {\n%s    return 0;\n}\n", body);
+}
+
+// 大量全局标识符, 每个函数引用其中一部分
+void gen_idents(long long size) {
+    char (*names)[64];
+    int n = (int) (size / 60) + 16, i, j, k;
+
+    names = malloc(sizeof(*names) * n);
+    for (i = 0; i < n; i++) {
+        ident(names[i], "g", i);
+        out("int %s;\n", names[i]);
+    }
+    for (i = 0, k = 0; out_bytes < size; i++) {
+        out("int use_%d(int a) {\n    int local_%d;\n    local_%d = a;\n", i, i, i);
+        for (j = 0; j < 8; j++, k++) {
+            out("    %s = local_%d + %s;\n", names[k % n], i, names[rnd(n)]);
+        }
+        out("    return local_%d;\n}\n", i);
+    }
+    main_func("    printf(\"%d\\n\", use_0(1));\n");
+}
+
+// 深层嵌套的语句块和括号表达式
+void gen_nesting(long long size) {
+    int f, d, depth;
+
+    for (f = 0; out_bytes < size; f++) {
+        depth = 32 + rnd(96);
+        out("int nest_%d(int a) {\n    int i;\n    int s;\n    s = 0;\n", f);
+        for (d = 0; d < depth; d++) {
+            switch (d % 3) {
+                case 0:
+                    out("%*s{\n", 4 + d, "");
+                    break;
+                case 1:
+                    out("%*sif (a > %d) {\n", 4 + d, "", d);
+                    break;
+                default:
+                    out("%*sfor (i = 0; i < 2; i = i + 1) {\n", 4 + d, "");
+                    break;
+            }
+        }
+        out("%*ss = s + ", 4 + depth, "");
+        for (d = 0; d < depth; d++) {
+            out("(a + ");
+        }
+        out("1");
+        for (d = 0; d < depth; d++) {
+            out(")");
+        }
+        out(";\n");
+        for (d = depth - 1; d >= 0; d--) {
+            out("%*s}\n", 4 + d, "");
+        }
+        out("    return s;\n}\n");
+    }
+    main_func("    printf(\"%d\\n\", nest_0(1000));\n");
+}
+
+// 代码之间夹着长注释
+void gen_comments(long long size) {
+    int f, i, n;
+
+    for (f = 0; out_bytes < size; f++) {
+        n = 1 + rnd(40);
+        out("/*\n");
+        for (i = 0; i < n; i++) {
+            out(" * comment line %d of function %d: the quick brown fox jumps over the lazy dog; { } ( ) \" ' *\n",
+                i, f);
+        }
+        out(" */\n");
+        out("int commented_%d(int a) { // trailing comment with /* nested */ markers\n", f);
+        for (i = 0; i < 4; i++) {
+            out("    // step %d: %s\n    a = a + %d; /* inline %d */\n", i,
+                "line comment that runs to the end of the line without any code on it", i, i);
+        }
+        out("    return a;\n}\n");
+    }
+    main_func("    printf(\"%d\\n\", commented_0(1));\n");
+}
+
+// 大量字符串常量, 像生成代码那样反复使用同几个格式串和错误信息
+void gen_strings(long long size) {
+    static char *msgs[] = {"error: out of memory\\n", "error: index out of range\\n", "warning: %s\\n", "%s\\n"};
+    int i, j, n;
+
+    for (i = 0; out_bytes < size; i++) {
+        n = 8 + rnd(120);
+        out("char *str_%d = \"", i);
+        for (j = 0; j < n; j++) {
+            out("%c", j % 17 == 16 ? ' ' : 'a' + rnd(26));
+        }
+        out("\\n\";\n");
+        if (i % 16 == 15) {
+            out("int print_%d() {\n", i / 16);
+            for (j = 0; j < 4; j++) {
+                out("    printf(\"string %d.%d: %%s\", str_%d);\n", i, j, i - j);
+            }
+            out("    printf(\"%s\", str_%d);\n", msgs[rnd(4)], i);
+            out("    return %d;\n}\n", i);
+        }
+    }
+    main_func("    printf(\"%s\", str_0);\n");
+}
+
+// 表达式密集的函数
+void gen_exprs(long long size) {
+    static char *ops[] = {"+", "-", "*", "+", "-"};
+    int f, i, j, n;
+
+    for (f = 0; out_bytes < size; f++) {
+        out("int expr_%d(int a, int b, int c) {\n    int x;\n    int y;\n    int z;\n", f);
+        out("    x = a;\n    y = b;\n    z = c;\n");
+        for (i = 0; i < 12; i++) {
+            n = 4 + rnd(24);
+            out("    %c = ", "xyz"[i % 3]);
+            for (j = 0; j < n; j++) {
+                if (j) {
+                    out(" %s ", ops[rnd(5)]);
+                }
+                switch (rnd(4)) {
+                    case 0:
+                        out("%d", rnd(1000));
+                        break;
+                    case 1:
+                        out("(%c %s %d)", "abcxyz"[rnd(6)], ops[rnd(5)], 1 + rnd(9));
+                        break;
+                    default:
+                        out("%c", "abcxyz"[rnd(6)]);
+                        break;
+                }
+            }
+            out(";\n");
+            if (i % 4 == 3) {
+                out("    if (x > y) x = x %% 1000 - y / %d; else y = y %% 997 + z;\n", 1 + rnd(50));
+            }
+        }
+        out("    return x + y + z;\n}\n");
+    }
+    main_func("    printf(\"%d\\n\", expr_0(1, 2, 3));\n");
+}
+
+// 大量带 __align 成员的结构体
+void gen_structs(long long size) {
+    static char *types[] = {"char", "short", "int", "char *", "int *"};
+    int s, i, n;
+
+    for (s = 0; out_bytes < size; s++) {
+        n = 2 + rnd(12);
+        out("struct rec_%d {\n", s);
+        for (i = 0; i < n; i++) {
+            if (rnd(3) == 0) {
+                out("    %s __align(%d) f%d;\n", types[rnd(5)], 1 << rnd(4), i);
+            } else {
+                out("    %s f%d;\n", types[rnd(5)], i);
+            }
+        }
+        if (s) {
+            out("    struct rec_%d inner;\n    struct rec_%d *link;\n", s - 1, rnd(s));
+        }
+        out("};\n");
+        out("int touch_%d(struct rec_%d *p) {\n    p->f0 = %d;\n", s, s, rnd(100));
+        if (s) {
+            out("    p->inner.f0 = p->f0;\n    p->link = 0;\n");
+        }
+        out("    return sizeof(struct rec_%d);\n}\n", s);
+    }
+    main_func("    struct rec_0 r;\n    printf(\"%d\\n\", touch_0(&r));\n");
+}
+
+// 大量数字常量, 像生成的查找表: 十进制为主, 夹杂十六进制 八进制和后缀
+void gen_numbers(long long size) {
+    int f, i;
+
+    for (f = 0; out_bytes < size; f++) {
+        out("int table_%d(int i) {\n    int v;\n    v = 0;\n", f);
+        for (i = 0; i < 64; i++) {
+            switch (rnd(8)) {
+                case 0:
+                    out("    if (i == %d) v = 0x%x;\n", i, rnd(0x7fffffff));
+                    break;
+                case 1:
+                    out("    if (i == %d) v = 0%o;\n", i, rnd(0x7fffffff));
+                    break;
+                case 2:
+                    out("    if (i == %d) v = %uu;\n", i, rnd(0x7fffffff));
+                    break;
+                default:
+                    out("    if (i == %d) v = %u;\n", i, rnd(0x7fffffff) >> rnd(28));
+                    break;
+            }
+        }
+        out("    return v;\n}\n");
+    }
+    main_func("    printf(\"%d\\n\", table_0(3));\n");
+}
+
+// 公共前缀头文件: 包含保护 宏 结构体 原型 全局变量 小函数, 没有 main
+void gen_prelude(long long size) {
+    int i, j, n;
+
+    out("#ifndef PRELUDE_H\n#define PRELUDE_H\n");
+    for (i = 0; out_bytes < size; i++) {
+        out("#define LIMIT_%d %d\n#define SCALE_%d(x) ((x) * %d + LIMIT_%d)\n", i, rnd(1000), i, 1 + rnd(9), i);
+        n = 2 + rnd(6);
+        out("struct obj_%d {\n", i);
+        for (j = 0; j < n; j++) {
+            out("    %s field_%d;\n", j % 3 ? "int" : "char *", j);
+        }
+        if (i) {
+            out("    struct obj_%d *parent;\n", rnd(i));
+        }
+        out("};\n");
+        out("int obj_%d_count;\n", i);
+        out("int obj_%d_init(struct obj_%d *p, int v);\n", i, i);
+        if (i % 4 == 0) {
+            out("int obj_%d_size() {\n    return sizeof(struct obj_%d) + SCALE_%d(obj_%d_count);\n}\n", i, i, i, i);
+        }
+    }
+    out("#endif\n");
+}
+
+int main(int argc, char **argv) {
+    long long size = argc > 2 ? atoll(argv[2]) : 4 << 20;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s idents|nesting|comments|strings|exprs|structs|numbers|prelude [bytes]\n", argv[0]);
+        return 1;
+    }
+    if (!strcmp(argv[1], "idents")) {
+        gen_idents(size);
+    } else if (!strcmp(argv[1], "nesting")) {
+        gen_nesting(size);
+    } else if (!strcmp(argv[1], "comments")) {
+        gen_comments(size);
+    } else if (!strcmp(argv[1], "strings")) {
+        gen_strings(size);
+    } else if (!strcmp(argv[1], "exprs")) {
+        gen_exprs(size);
+    } else if (!strcmp(argv[1], "structs")) {
+        gen_structs(size);
+    } else if (!strcmp(argv[1], "numbers")) {
+        gen_numbers(size);
+    } else if (!strcmp(argv[1], "prelude")) {
+        gen_prelude(size);
+    } else {
+        fprintf(stderr, "unknown kind %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
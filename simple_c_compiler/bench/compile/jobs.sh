@@ -0,0 +1,39 @@
+#!/bin/bash
+# 并行编译基准: 函数体多的大文件分别串行和 -j n 编译, 比较墙钟时间, 并确认目标文件相同
+# 用法: bash bench/compile/jobs.sh [sc可执行文件] [gen可执行文件]
+# 环境变量: SIZE 每个输入的字节数 (默认 4MB), RUNS 每项取最好的几次 (默认 5), JOBS 工作进程数列表 (默认 1 2 4 ... 到 CPU 数)
+dir=$(dirname "$0")
+sc=${1:-./sc}
+gen=${2:-$dir/gen}
+size=${SIZE:-4194304}
+runs=${RUNS:-5}
+tmp=${TMPDIR:-/tmp}/sc_jobs.$$
+kinds="exprs nesting numbers"
+
+if [ -z "$JOBS" ]; then
+    n=$(nproc)
+    JOBS=1
+    for ((j = 2; j < n; j *= 2)); do
+        JOBS="$JOBS $j"
+    done
+    [ "$n" -gt 1 ] && JOBS="$JOBS $n"
+fi
+
+mkdir -p "$tmp"
+trap 'rm -rf "$tmp"' EXIT
+
+. "$dir/lib.sh"
+
+echo "cpus: $(nproc)"
+printf "%-9s %-6s %9s %7s\n" input jobs ms speedup
+for k in $kinds; do
+    "$gen" $k $size > "$tmp/$k.c" || exit 1
+    best "$sc" -c "$tmp/$k.c" -o "$tmp/serial.o"
+    serial=$t_best
+    printf "%-9s %-6s %9.1f %7s\n" $k serial $(awk -v t=$serial 'BEGIN { print t / 1e3 }') -
+    for j in $JOBS; do
+        best "$sc" -j $j -c "$tmp/$k.c" -o "$tmp/par.o"
+        cmp -s "$tmp/serial.o" "$tmp/par.o" || { echo "object files differ with -j $j" >&2; exit 1; }
+        awk -v k=$k -v j=$j -v t=$t_best -v s=$serial 'BEGIN { printf "%-9s %-6s %9.1f %6.2fx\n", k, j, t / 1e3, s / t }'
+    done
+done
@@ -0,0 +1,31 @@
+# 基准脚本共用的计时函数, 用 . "$dir/lib.sh" 引入 (bash)
+# 调用前设好 runs (每项取最好的几次) 和 tmp (临时目录); clock=cpu 时计子进程的 CPU 时间 (user + sys),
+# 不受同机其他进程排队的影响, 否则计墙钟时间
+
+# 运行一次, 用时 (微秒) 存入 t_run
+bench_run() {
+    local s TIMEFORMAT='%3U %3S'
+
+    if [ "$clock" = cpu ]; then
+        { time "$@" > /dev/null 2> "$tmp/stderr"; } 2> "$tmp/time" || { cat "$tmp/stderr" >&2; return 1; }
+        t_run=$(awk '{ printf "%.0f", ($1 + $2) * 1e6 }' "$tmp/time")
+    else
+        s=$(date +%s%N)
+        "$@" > /dev/null || return 1
+        t_run=$(( ($(date +%s%N) - s) / 1000 ))
+    fi
+}
+
+# 运行 runs 次, 最好的一次 (微秒) 存入 t_best; 失败时退出
+best() {
+    local i=0
+
+    t_best=0
+    while [ $i -lt "$runs" ]; do
+        bench_run "$@" || { echo "failed: $*" >&2; exit 1; }
+        if [ $t_best -eq 0 ] || [ $t_run -lt $t_best ]; then
+            t_best=$t_run
+        fi
+        i=$((i + 1))
+    done
+}
@@ -0,0 +1,33 @@
+#!/bin/bash
+# 预编译头基准: 同一个程序分别 #include 公共前缀头文件和 -pch 装入快照, 比较编译时间, 并确认目标文件相同
+# 用法: bash bench/compile/pch.sh [sc可执行文件] [gen可执行文件]
+# 环境变量: SIZE 前缀头文件的字节数 (默认 1.5MB, 约 6 万行), RUNS 每项取最好的几次 (默认 5)
+dir=$(dirname "$0")
+sc=${1:-./sc}
+gen=${2:-$dir/gen}
+size=${SIZE:-1500000}
+runs=${RUNS:-5}
+tmp=${TMPDIR:-/tmp}/sc_pch.$$
+
+mkdir -p "$tmp"
+trap 'rm -rf "$tmp"' EXIT
+
+. "$dir/lib.sh"
+
+"$gen" prelude $size > "$tmp/prelude.h" || exit 1
+printf 'int main() {\n    printf("%%d\\n", obj_0_size());\n    return 0;\n}\n' > "$tmp/main.c"
+{ echo '#include "prelude.h"'; cat "$tmp/main.c"; } > "$tmp/inc.c"
+echo "prelude: $(wc -l < "$tmp/prelude.h") lines, $(wc -c < "$tmp/prelude.h") bytes"
+
+best "$sc" -pch-out "$tmp/prelude.pch" "$tmp/prelude.h"
+create=$t_best
+best "$sc" -c "$tmp/inc.c" -o "$tmp/inc.o"
+inc=$t_best
+best "$sc" -pch "$tmp/prelude.pch" -c "$tmp/main.c" -o "$tmp/pch.o"
+pch=$t_best
+cmp -s "$tmp/inc.o" "$tmp/pch.o" || { echo "object files differ" >&2; exit 1; }
+
+echo "snapshot: $(wc -c < "$tmp/prelude.pch") bytes, created in $((create / 1000)).$((create % 1000 / 100)) ms"
+awk -v inc=$inc -v pch=$pch 'BEGIN {
+    printf "#include   %9.1f ms\n-pch       %9.1f ms   %.1fx\n", inc / 1e3, pch / 1e3, inc / pch
+}'
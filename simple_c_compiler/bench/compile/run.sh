@@ -0,0 +1,79 @@
+#!/bin/bash
+# 编译吞吐量基准: 生成各类压力输入, 分阶段报告 MB/s 和 Mtok/s, 并与 baseline.txt 比较
+# 用法: bash bench/compile/run.sh [sc可执行文件] [gen可执行文件] [-update]
+# 语法分析 语义检查 代码生成在同一遍里完成, 所以分成三段计时:
+#   lex   只做词法分析 (sc -lex)
+#   parse 语法分析 + 语义检查 + 生成字节码 (sc 减去 lex)
+#   emit  输出目标文件 (sc -c 减去 parse)
+# 时间取子进程的 CPU 时间 (user + sys), 不受同机其他进程排队的影响; 本次或基线不足 20ms 的阶段只报告不比较,
+# 不足 1ms 的 (如没有多少代码要输出的 emit) 测不出, 不写进基线
+# 环境变量: SIZE 每个输入的字节数 (默认 4MB), RUNS 每项取最好的几次 (默认 5), THRESHOLD 低于基线多少算退化 (默认 0.8)
+dir=$(dirname "$0")
+sc=${1:-./sc}
+gen=${2:-$dir/gen}
+update=$3
+size=${SIZE:-4194304}
+runs=${RUNS:-5}
+threshold=${THRESHOLD:-0.8}
+baseline=$dir/baseline.txt
+tmp=${TMPDIR:-/tmp}/sc_bench.$$
+kinds="idents nesting comments strings exprs structs numbers"
+
+mkdir -p "$tmp"
+trap 'rm -rf "$tmp"' EXIT
+
+clock=cpu
+. "$dir/lib.sh"
+
+: > "$tmp/result"
+printf "%-9s %-6s %9s %9s %9s %9s %7s\n" input phase ms MB/s Mtok/s base ratio
+for k in $kinds; do
+    f=$tmp/$k.c
+    "$gen" $k $size > "$f" || exit 1
+    bytes=$(wc -c < "$f")
+    tokens=$("$sc" -lex "$f" | awk '{print $2}')
+    best "$sc" -lex "$f"
+    lex=$t_best
+    best "$sc" "$f"
+    parse=$t_best
+    best "$sc" -c "$f" -o "$tmp/out.o"
+    emit=$t_best
+    for p in lex parse emit; do
+        case $p in
+            lex) t=$lex ;;
+            parse) t=$((parse - lex)) ;;
+            emit) t=$((emit - parse)) ;;
+        esac
+        echo "$k $p $bytes $tokens $t" >> "$tmp/result"
+    done
+done
+
+# 与基线比较, 基线每行: 输入 阶段 MB/s 微秒
+awk -v threshold="$threshold" -v update="$update" -v baseline="$baseline" '
+FILENAME == baseline { base[$1 " " $2] = $3; base_us[$1 " " $2] = $4; next }
+$5 < 1000 {
+    printf "%-9s %-6s %9.1f %9s %9s %9s %7s\n", $1, $2, $5 / 1e3, "-", "-", "-", "~"
+    next
+}
+{
+    mbs = $3 / $5; mtok = $4 / $5
+    key = $1 " " $2
+    if (key in base && base[key] > 0 && $5 >= 20000 && base_us[key] >= 20000) {
+        ratio = mbs / base[key]
+        printf "%-9s %-6s %9.1f %9.1f %9.2f %9.1f %7.2f%s\n", $1, $2, $5 / 1e3, mbs, mtok, base[key], ratio,
+               ratio < threshold ? "  REGRESSION" : ""
+        if (ratio < threshold) regress++
+    } else {
+        printf "%-9s %-6s %9.1f %9.1f %9.2f %9s %7s\n", $1, $2, $5 / 1e3, mbs, mtok, key in base ? base[key] : "-", "~"
+    }
+    out = out sprintf("%s %s %.1f %d\n", $1, $2, mbs, $5)
+}
+END {
+    if (update == "-update") {
+        printf "%s", out > baseline
+        print "baseline updated: " baseline
+    } else if (regress) {
+        print regress " regression(s) below " threshold " of baseline"
+        exit 1
+    }
+}' $( [ -f "$baseline" ] && echo "$baseline" ) "$tmp/result"
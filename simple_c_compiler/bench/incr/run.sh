@@ -0,0 +1,44 @@
+#!/bin/sh
+# 增量编译: 在约100万行的源文件中改一行, 比较全量编译和增量编译的耗时
+# usage: sh bench/incr/run.sh ./sc [lines]
+sc=${1:-./sc}
+lines=${2:-1000000}
+dir=${TMPDIR:-/tmp}/sc_incr.$$
+mkdir -p "$dir"
+src=$dir/big.c
+
+# 每个函数10行
+awk -v n=$((lines / 10)) 'BEGIN {
+    print "int seed = 7;"
+    for (i = 0; i < n; i++) {
+        printf "int f%d(int a) {\n    int b;\n    int i;\n    b = a * %d + seed;\n", i, i % 97
+        printf "    for (i = 0; i < 3; i = i + 1)\n        b = b + i;\n"
+        printf "    if (b > 1000)\n        b = b %% 1000;\n    return b;\n}\n"
+    }
+    printf "int main() {\n    printf(\"%%d\\n\", f0(1) + f%d(2) + f%d(3));\n    return 0;\n}\n", n / 2, n - 1
+}' > "$src"
+echo "source: $(wc -l < "$src") lines, $(wc -c < "$src") bytes"
+
+now() { date +%s.%N; }
+t() { s=$(now); "$@" > /dev/null; e=$(now); awk "BEGIN { printf \"%.3f\", $e - $s }"; }
+
+echo "full compile:          $(t "$sc" -c "$src" -o "$dir/full.o") s"
+echo "incremental (cold):    $(t "$sc" -incremental -c "$src" -o "$dir/incr.o") s"
+# 改中间一个函数的一行
+mid=$((lines / 20))
+sed -i "/^int f$mid(int a) {\$/{n;n;n;s/seed/seed + 1/}" "$src"
+echo "incremental (1 line):  $(t "$sc" -v -incremental -c "$src" -o "$dir/incr.o") s"
+"$sc" -c "$src" -o "$dir/full.o" > /dev/null
+if cmp -s "$dir/incr.o" "$dir/full.o"; then
+    echo "object: identical to full compile"
+else
+    echo "object MISMATCH"
+fi
+"$sc" -incremental -run "$src" > "$dir/incr.out"
+"$sc" -run "$src" > "$dir/full.out"
+if cmp -s "$dir/incr.out" "$dir/full.out"; then
+    echo "output: $(cat "$dir/full.out") (matches full compile)"
+else
+    echo "output MISMATCH"
+fi
+rm -rf "$dir"
@@ -0,0 +1,66 @@
+// 数组核心循环: 求和 点积 带系数的累加 复制 矩阵乘
+int a[1024];
+int b[1024];
+int c[1024];
+int m1[1024];
+int m2[1024];
+int m3[1024];
+
+int sum(int *p, int n) {
+    int i;
+    int s;
+    s = 0;
+    for (i = 0; i < n; i = i + 1) {
+        s = s + p[i];
+    }
+    return s;
+}
+
+int main() {
+    int i;
+    int j;
+    int k;
+    int r;
+    int s;
+    int t;
+    int k3;
+
+    for (i = 0; i < 1024; i = i + 1) {
+        a[i] = i % 13;
+        b[i] = i % 7 - 3;
+        m1[i] = i % 5;
+        m2[i] = i % 3 - 1;
+    }
+    s = 0;
+    k3 = 3;
+    for (r = 0; r < 2000; r = r + 1) {
+        // 点积
+        for (i = 0; i < 1024; i = i + 1) {
+            s = s + a[i] * b[i];
+        }
+        // c = a * k3 + b
+        for (i = 0; i < 1024; i = i + 1) {
+            c[i] = a[i] * k3 + b[i];
+        }
+        // 复制
+        for (i = 0; i < 1024; i = i + 1) {
+            b[i] = c[i] - a[i] * k3;
+        }
+        s = (s + sum(c, 1024)) % 1000003;
+    }
+    // 32x32 矩阵乘
+    for (r = 0; r < 20; r = r + 1) {
+        for (i = 0; i < 32; i = i + 1) {
+            for (j = 0; j < 32; j = j + 1) {
+                t = 0;
+                for (k = 0; k < 32; k = k + 1) {
+                    t = t + m1[i * 32 + k] * m2[k * 32 + j];
+                }
+                m3[i * 32 + j] = t;
+            }
+        }
+        s = (s + m3[r] + m3[1023 - r]) % 1000003;
+    }
+    printf("array: %d\n", s);
+    return 0;
+}
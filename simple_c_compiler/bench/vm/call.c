@@ -0,0 +1,35 @@
+// 调用密集: 递归 + 小函数
+struct pair {
+    int a;
+    int b;
+};
+
+int fib(int n) {
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+int get_a(struct pair *p) {
+    return p->a;
+}
+
+int add(int x, int y) {
+    return x + y;
+}
+
+int main() {
+    int i;
+    int s;
+    struct pair p;
+
+    p.a = 3;
+    p.b = 4;
+    s = fib(30);
+    for (i = 0; i < 5000000; i = i + 1) {
+        s = add(s, get_a(&p)) % 1000003;
+    }
+    printf("call: %d\n", s);
+    return 0;
+}
@@ -0,0 +1,20 @@
+// 循环密集: 数组遍历 + 算术 + 比较跳转
+int a[1000];
+
+int main() {
+    int i;
+    int j;
+    int s;
+
+    for (i = 0; i < 1000; i = i + 1) {
+        a[i] = i % 7;
+    }
+    s = 0;
+    for (j = 0; j < 20000; j = j + 1) {
+        for (i = 0; i < 1000; i = i + 1) {
+            s = s + a[i] * 3 - j % 5;
+        }
+    }
+    printf("loop: %d\n", s);
+    return 0;
+}
@@ -0,0 +1,20 @@
+// 另一个文件里的小函数和配置常量, 不用 -flto 时每次都是真正的调用和装入
+int table_size = 4096;
+int scale = 3;
+int verbose = 0;
+int hits;
+
+int clamp(int v, int hi) {
+    if (v < 0) return 0;
+    if (v > hi) return hi;
+    return v;
+}
+
+int mix(int h, int v) {
+    return (h * 31 + v * scale) % 1000003;
+}
+
+void note(int v) {
+    if (verbose) printf("note %d\n", v);
+    hits = hits + 1;
+}
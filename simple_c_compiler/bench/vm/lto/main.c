@@ -0,0 +1,22 @@
+// 跨文件调用的热循环: sh bench/vm/lto/run.sh 比较分别编译与 -flto
+int table_size;
+int clamp(int v, int hi);
+int mix(int h, int v);
+void note(int v);
+int hits;
+
+int main() {
+    int i;
+    int h;
+    int r;
+
+    h = 7;
+    for (r = 0; r < 200; r = r + 1) {
+        for (i = 0; i < table_size; i = i + 1) {
+            h = mix(h, clamp(i - 100, table_size - 50));
+            note(h);
+        }
+    }
+    printf("%d %d\n", h, hits);
+    return 0;
+}
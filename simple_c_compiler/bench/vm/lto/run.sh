@@ -0,0 +1,17 @@
+#!/bin/sh
+# 链接时优化基准: 两个文件分别编译后链接, 与 -flto 编译后链接比较指令数和时间
+# 用法: sh bench/vm/lto/run.sh [sc可执行文件]
+dir=$(dirname "$0")
+sc=${1:-./sc}
+tmp=${TMPDIR:-/tmp}/sc_lto.$$
+mkdir -p "$tmp"
+trap 'rm -rf "$tmp"' EXIT
+for mode in plain lto; do
+    flags=
+    [ $mode = lto ] && flags=-flto
+    "$sc" -c $flags "$dir/main.c" -o "$tmp/main.o" > /dev/null || exit 1
+    "$sc" -c $flags "$dir/lib.c" -o "$tmp/lib.o" > /dev/null || exit 1
+    "$sc" "$tmp/main.o" "$tmp/lib.o" -o "$tmp/$mode" || exit 1
+    echo "== $mode"
+    "$sc" -bench "$tmp/$mode" || exit 1
+done
@@ -0,0 +1,9 @@
+#!/bin/sh
+# 解释器基准: 报告每个程序的指令数与每秒指令数
+# 用法: sh bench/vm/run.sh [sc可执行文件]
+dir=$(dirname "$0")
+sc=${1:-./sc}
+for f in "$dir"/*.c; do
+    echo "== $(basename "$f")"
+    "$sc" -bench "$f" || exit 1
+done
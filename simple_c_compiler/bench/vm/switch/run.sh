@@ -0,0 +1,64 @@
+#!/bin/sh
+# switch 分派吞吐量: 10 到 10000 个 case, 值密集 (跳转表) 稀疏 (二分查找) 和成段 (分簇) 三种分布,
+# 与同样判断的 if 链比较指令数和时间
+# 用法: sh bench/vm/switch/run.sh [sc可执行文件] [每个程序的分派次数]
+sc=${1:-./sc}
+iters=${2:-100000}
+tmp=${TMPDIR:-/tmp}/sc_switch.$$
+mkdir -p "$tmp"
+trap 'rm -rf "$tmp"' EXIT
+
+# gen 分布 case数 switch|if
+# 第 k 个 case 的值: dense k, sparse k * 1009, mixed 每 8 个连续值一段, 段间隔 100; 每 8 次分派有 1 次不命中
+gen() {
+    awk -v shape="$1" -v n="$2" -v form="$3" -v iters="$iters" '
+    function val(k) {
+        return shape == "dense" ? k : shape == "sparse" ? k * 1009 : int(k / 8) * 100 + k % 8
+    }
+    BEGIN {
+        expr["dense"] = "k"
+        expr["sparse"] = "k * 1009"
+        expr["mixed"] = "k / 8 * 100 + k % 8"
+        print "int pick(int x) {"
+        if (form == "switch") {
+            print "    switch (x) {"
+        }
+        for (k = 0; k < n; k++) {
+            if (form == "switch") {
+                printf "        case %d: return %d;\n", val(k), k % 251
+            } else {
+                printf "    if (x == %d) return %d;\n", val(k), k % 251
+            }
+        }
+        if (form == "switch") {
+            print "    }"
+        }
+        print "    return -1;"
+        print "}"
+        print ""
+        print "int main() {"
+        print "    int i;"
+        print "    int k;"
+        print "    int s;"
+        print ""
+        print "    s = 0;"
+        printf "    for (i = 0; i < %d; i = i + 1) {\n", iters
+        printf "        k = i * 7919 %% %d;\n", n
+        printf "        s = s + pick(%s + (i %% 8 == 7) * %d);\n", expr[shape], val(n) + 1
+        print "    }"
+        print "    printf(\"%d\\n\", s);"
+        print "    return 0;"
+        print "}"
+    }' > "$tmp/$1_$2_$3.c"
+}
+
+for shape in dense sparse mixed; do
+    for n in 10 100 1000 10000; do
+        for form in switch if; do
+            gen $shape $n $form
+            printf "== %s %d %s: " $shape $n $form
+            "$sc" -bench "$tmp/${shape}_${n}_$form.c" 2>&1 | tr '\n' ' ' | sed 's/\[VM\] //'
+            echo
+        done
+    done
+done
@@ -2,6 +2,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
+#include <stddef.h>
+#include <elf.h>
+#include <ar.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/time.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <malloc.h>
+#include <errno.h>
+#include <limits.h>
 
 //#if _WIN32
 //#define CH_EOF '\n\r'
@@ -14,10 +34,12 @@
 
 int token;
 char ch;
-FILE *fin;
 int tkvalue;
 char *filename = "";
-int line_num = 0;
+typedef unsigned int SrcLoc;
+SrcLoc tok_loc;             // 当前单词的源位置, 0 表示不知道
+
+int src_where(SrcLoc loc, char **name, long long *line, long long *col);
 
 void get_token();
 
@@ -44,22 +66,49 @@ enum e_ErrorLevel {
 enum e_WorkStage {
     STAGE_COMPILER,
     STAGE_LINK,
+    STAGE_RUN,
+    STAGE_MEMORY,
 };
 
+void mem_report(FILE *fp);
+
+// 并行编译的工作进程序号, 主进程为 -1; 见后文
+int par_self = -1;
+void par_report(int level, char *msg);
+
 void handle_exception(int stage, int level, char *fmt, va_list ap) {
-    char buf[1024];
+    char buf[1024], where[PATH_MAX + 64], msg[PATH_MAX + 1200], *name;
+    long long line, col;
 
     vsprintf(buf, fmt, ap);
     if (stage == STAGE_COMPILER) {
-        if (level == LEVEL_WARNING) {
-            printf("[WARNING][COMPILER]%s(line:%d): %s!\n", filename, line_num, buf);
+        if (src_where(tok_loc, &name, &line, &col)) {
+            snprintf(where, sizeof(where), "%s(line:%lld, col:%lld)", name, line, col);
         } else {
-            printf("[ERROR][COMPILER]%s(line:%d): %s!\n", filename, line_num, buf);
+            snprintf(where, sizeof(where), "%s", filename);
+        }
+        snprintf(msg, sizeof(msg), "[%s][COMPILER]%s: %s!\n", level == LEVEL_WARNING ? "WARNING" : "ERROR",
+                 where, buf);
+        if (par_self >= 0) {
+            // 工作进程的诊断随函数的结果交给主进程, 按源码顺序输出; 出错时不返回
+            par_report(level, msg);
+            return;
+        }
+        printf("%s", msg);
+        if (level == LEVEL_ERROR) {
             exit(-1);
         }
-    } else {
+    } else if (stage == STAGE_LINK) {
         printf("LNK: %s!\n", buf);
         exit(-1);
+    } else if (stage == STAGE_MEMORY) {
+        printf("[ERROR][MEMORY]: %s!\n", buf);
+        fflush(stdout);
+        mem_report(stderr);
+        exit(-1);
+    } else {
+        printf("[ERROR][VM]: %s!\n", buf);
+        exit(-1);
     }
 }
 
@@ -95,6 +144,20 @@ void link_error(char *fmt, ...) {
     va_end(ap);
 }
 
+void vm_error(char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    handle_exception(STAGE_RUN, LEVEL_ERROR, fmt, ap);
+    va_end(ap);
+}
+
+void mem_error(char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    handle_exception(STAGE_MEMORY, LEVEL_ERROR, fmt, ap);
+    va_end(ap);
+}
+
 // Token code
 enum e_TokenCode {
     TK_PLUS,
@@ -119,6 +182,7 @@ enum e_TokenCode {
     TK_BEGIN,
     TK_END,
     TK_SEMICOLON,
+    TK_COLON,
     TK_COMMA,
     TK_ELLIPSIS,
     TK_EOF,
@@ -139,6 +203,9 @@ enum e_TokenCode {
     KW_CONTINUE,
     KW_BREAK,
     KW_RETURN,
+    KW_SWITCH,
+    KW_CASE,
+    KW_DEFAULT,
     KW_SIZEOF,
     KW_CDECL,
     KW_STDCALL,
@@ -147,16 +214,226 @@ enum e_TokenCode {
     TK_IDENT,
 };
 
+// 统计 (-stats)
+// 计数器始终累加; 计时只在 -stats 时进行, 词法分析按单词计墙钟时间, CPU 时间只在粗粒度阶段之间取
+enum e_Phase {
+    PH_INIT,
+    PH_CACHE,
+    PH_LEX,
+    PH_PARSE,               // 语法分析 语义检查 生成字节码 (同一遍)
+    PH_EMIT,
+    PH_LINK,
+    PH_RUN,
+    PH_NUM,
+};
+
+char *phase_names[] = {"init", "cache", "lex", "parse", "emit", "link", "run"};
+
+typedef struct Stats {
+    double wall[PH_NUM];
+    double cpu[PH_NUM];
+    long long tokens[TK_IDENT + 1];     // 按单词编码计数, 标识符都计入 TK_IDENT
+    long long getch_calls;
+    long long tk_lookups;               // tkWord_find 次数
+    long long tk_probes;                // 其中比较过的哈希链结点数
+    long long dynstring_reallocs, dynstring_moved;
+    long long dynarray_reallocs, dynarray_moved;
+    long long pp_directives, pp_expansions;
+    long long pp_includes, pp_include_skips;    // 后者: 因包含保护或 #pragma once 跳过
+    long long pp_include_bytes;                 // 实际分析的包含文件字节数
+    long long str_literals, str_unique, str_merged;     // 字符串常量: 出现次数 不同内容数 并入其他串尾部的数
+    long long str_bytes, str_pool_bytes;                // .rodata 合并前后的字节数
+    long long type_lookups, type_nodes;                 // 构造派生类型的次数 其中新建的类型结点数
+    long long switches, switch_cases, switch_tables, switch_compares; // switch: 语句数 case 数 跳转表数 分派的比较跳转数
+    long long par_jobs, par_funcs;                      // 并行编译: 工作进程数 由其编译的函数体数
+    double par_wait;                                    // 主进程等待工作进程结果的墙钟时间
+    long long peep_insns, peep_removed, peep_threaded;  // 窥孔优化: 输入指令数 删去的指令数 穿透或取反的跳转数
+    long long inline_calls, inline_sites;               // 函数内联: 直接和间接调用处数 其中内联的个数
+    long long loops, loop_hoisted, loop_ivs, loop_unrolled; // 循环优化: 循环数 外提的不变量 派生归纳变量 展开的循环
+    long long vec_loops, vec_done, vec_checks;          // 向量化: 分析的最内层循环数 向量化的个数 运行时别名检查数
+    long long prof_counters, prof_funcs, prof_swapped, prof_cold; // PGO: 插入的计数器 用上计数的函数 对调的 if 移出的冷代码
+    long long link_funcs, link_funcs_kept, link_data, link_data_kept; // 链接: 函数和数据符号数 其中可达保留的
+    long long link_text, link_text_kept;                // 链接前后的指令数
+    long long tail_calls;                               // 改为 TCALL/TCALLI 的尾调用
+    long long lto_objs, lto_funcs, lto_folded, lto_parts; // 链接时优化: 合并的目标文件 函数 改为常数的全局变量读 分区数
+} Stats;
+
+Stats stats;
+int opt_stats = 0;                      // 1 文本, 2 JSON
+int phase_cur = -1, phase_cpu_cur = -1;
+double phase_wall0, phase_cpu0;
+
+double clock_sec(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// 切换墙钟计时的阶段, 返回原阶段
+int phase_switch(int ph) {
+    int prev = phase_cur;
+    double now = clock_sec(CLOCK_MONOTONIC);
+
+    if (prev >= 0) {
+        stats.wall[prev] += now - phase_wall0;
+    }
+    phase_wall0 = now;
+    phase_cur = ph;
+    return prev;
+}
+
+// 粗粒度阶段, 同时计 CPU 时间; -1 结束计时
+void phase_begin(int ph) {
+    double now;
+
+    if (!opt_stats) {
+        return;
+    }
+    now = clock_sec(CLOCK_PROCESS_CPUTIME_ID);
+    if (phase_cpu_cur >= 0) {
+        stats.cpu[phase_cpu_cur] += now - phase_cpu0;
+    }
+    phase_cpu0 = now;
+    phase_cpu_cur = ph;
+    phase_switch(ph);
+}
+
+// 内存记账 (-mem-report / -mem-limit)
+// 所有堆分配都带子系统标签; 按 malloc_usable_size 记字节数, 不加头部, 释放时按指针取回大小
+enum e_MemTag {
+    MEM_LEX,                // 单词表 单词串
+    MEM_PP,                 // 宏 包含文件 展开文本
+    MEM_SYMBOL,             // 符号 符号栈
+    MEM_CODE,               // 函数 指令数组
+    MEM_MODULE,             // 模块符号 数据段
+    MEM_LINK,               // 目标文件 链接器
+    MEM_CACHE,              // 编译缓存 增量编译
+    MEM_SERVER,             // 编译服务器 命令行
+    MEM_VM,                 // 虚拟机 及被运行程序的 malloc
+    MEM_NUM,
+};
+
+char *mem_names[] = {"lex", "pp", "symbol", "code", "module", "link", "cache", "server", "vm"};
+
+typedef struct MemStat {
+    long long cur, peak;
+    long long allocs;
+} MemStat;
+
+MemStat mem_stats[MEM_NUM];
+long long mem_cur, mem_peak;
+long long mem_limit = 0;                // 0 不限制
+int opt_mem_report = 0;
+
+// 链接器多线程分配, 计数用原子操作
+void mem_peak_update(long long *peak, long long cur) {
+    long long old;
+    while ((old = *peak) < cur && !__sync_bool_compare_and_swap(peak, old, cur)) {
+    }
+}
+
+void mem_account(int tag, long long delta) {
+    long long cur = __sync_add_and_fetch(&mem_stats[tag].cur, delta);
+    mem_peak_update(&mem_stats[tag].peak, cur);
+    cur = __sync_add_and_fetch(&mem_cur, delta);
+    mem_peak_update(&mem_peak, cur);
+}
+
+void mem_check(size_t size, int tag) {
+    if (mem_limit && mem_cur + (long long) size > mem_limit) {
+        mem_error("超出内存限制 %lld 字节: 子系统 %s 申请 %lld 字节时已用 %lld 字节",
+                  mem_limit, mem_names[tag], (long long) size, mem_cur);
+    }
+}
+
+void *mem_alloc(size_t size, int tag) {
+    void *p;
+
+    mem_check(size, tag);
+    p = malloc(size ? size : 1);
+    if (!p) {
+        mem_error("内存不足: 子系统 %s 申请 %lld 字节", mem_names[tag], (long long) size);
+    }
+    __sync_add_and_fetch(&mem_stats[tag].allocs, 1);
+    mem_account(tag, malloc_usable_size(p));
+    return p;
+}
+
+void *mem_realloc(void *p, size_t size, int tag) {
+    size_t old = p ? malloc_usable_size(p) : 0;
+
+    if (size > old) {
+        mem_check(size - old, tag);
+    }
+    p = realloc(p, size ? size : 1);
+    if (!p) {
+        mem_error("内存不足: 子系统 %s 申请 %lld 字节", mem_names[tag], (long long) size);
+    }
+    __sync_add_and_fetch(&mem_stats[tag].allocs, 1);
+    mem_account(tag, (long long) malloc_usable_size(p) - (long long) old);
+    return p;
+}
+
+void mem_free(void *p, int tag) {
+    if (p) {
+        mem_account(tag, -(long long) malloc_usable_size(p));
+        free(p);
+    }
+}
+
+char *mem_strdup(char *s, int tag) {
+    size_t n = strlen(s) + 1;
+    return (char *) memcpy(mem_alloc(n, tag), s, n);
+}
+
+// 形如 64M 512K 1G 的字节数
+long long mem_parse_size(char *s) {
+    char *end;
+    long long n = strtoll(s, &end, 10);
+
+    switch (*end) {
+        case 'k':
+        case 'K':
+            n <<= 10;
+            break;
+        case 'm':
+        case 'M':
+            n <<= 20;
+            break;
+        case 'g':
+        case 'G':
+            n <<= 30;
+            break;
+    }
+    return n;
+}
+
+void mem_report(FILE *fp) {
+    int i;
+
+    fprintf(fp, "[MEM] %-8s %14s %14s %10s\n", "subsys", "current", "peak", "allocs");
+    for (i = 0; i < MEM_NUM; i++) {
+        fprintf(fp, "[MEM] %-8s %14lld %14lld %10lld\n", mem_names[i],
+                mem_stats[i].cur, mem_stats[i].peak, mem_stats[i].allocs);
+    }
+    fprintf(fp, "[MEM] %-8s %14lld %14lld\n", "total", mem_cur, mem_peak);
+    if (mem_limit) {
+        fprintf(fp, "[MEM] limit    %14lld\n", mem_limit);
+    }
+}
+
 // 动态字符串
 typedef struct DynString {
-    int count;
-    int capacity;
+    long long count;
+    long long capacity;
+    int tag;                // 内存子系统
     char *data;
 } DynString;
 
-void dynstring_init(DynString *pstr, int initsize) {
+void dynstring_init(DynString *pstr, long long initsize, int tag) {
     if (pstr != NULL) {
-        pstr->data = (char *) malloc(sizeof(char) * initsize);
+        pstr->data = (char *) mem_alloc(sizeof(char) * initsize, tag);
+        pstr->tag = tag;
         pstr->count = 0;
         pstr->capacity = initsize;
     }
@@ -165,7 +442,7 @@ void dynstring_init(DynString *pstr, int initsize) {
 void dynstring_free(DynString *pstr) {
     if (pstr != NULL) {
         if (pstr->data) {
-            free(pstr->data);
+            mem_free(pstr->data, pstr->tag);
         }
         pstr->count = 0;
         pstr->capacity = 0;
@@ -174,12 +451,12 @@ void dynstring_free(DynString *pstr) {
 
 void dynstring_reset(DynString *pstr) {
     dynstring_free(pstr);
-    dynstring_init(pstr, 8);
+    dynstring_init(pstr, 8, pstr->tag);
 }
 
-void dynstring_realloc(DynString *pstr, int new_size) {
-    int cap;
-    char *data;
+void dynstring_realloc(DynString *pstr, long long new_size) {
+    long long cap;
+    char *data, *old = pstr->data;
 
     cap = pstr->capacity;
 
@@ -189,16 +466,17 @@ void dynstring_realloc(DynString *pstr, int new_size) {
     }
 
     cap = new_size;
-    data = realloc(pstr->data, new_size * sizeof(char));
-    if (!data) {
-        perror("alloc error");
+    data = mem_realloc(pstr->data, new_size * sizeof(char), pstr->tag);
+    stats.dynstring_reallocs++;
+    if (data != old) {
+        stats.dynstring_moved += pstr->count;
     }
     pstr->capacity = cap;
     pstr->data = data;
 }
 
 void dynstring_chcat(DynString *pstr, char ch) {
-    int count = pstr->count + 1;
+    long long count = pstr->count + 1;
     if (count >= (pstr->capacity * 0.75)) {
         dynstring_realloc(pstr, pstr->capacity * 2);
     }
@@ -208,14 +486,16 @@ void dynstring_chcat(DynString *pstr, char ch) {
 
 // 动态数组
 typedef struct DynArray {
-    int count;
-    int capacity;
+    long long count;
+    long long capacity;
+    int tag;                // 内存子系统, 元素也按此记账
     void **data;
 } DynArray;
 
-void dynArray_init(DynArray *parr, int initsize) {
+void dynArray_init(DynArray *parr, long long initsize, int tag) {
     if (parr != NULL) {
-        parr->data = (void **) malloc(sizeof(void *) * initsize);
+        parr->data = (void **) mem_alloc(sizeof(void *) * initsize, tag);
+        parr->tag = tag;
         parr->count = 0;
         parr->capacity = initsize;
     }
@@ -227,10 +507,10 @@ void dynArray_free(DynArray *parr) {
             void **p;
             for (p = parr->data; parr->count; ++p, --parr->count) {
                 if (*p) {
-                    free(*p);
+                    mem_free(*p, parr->tag);
                 }
             }
-            free(parr->data);
+            mem_free(parr->data, parr->tag);
             parr->data = NULL;
         }
         parr->count = 0;
@@ -238,9 +518,9 @@ void dynArray_free(DynArray *parr) {
     }
 }
 
-void dynArray_realloc(DynArray *parr, int new_size) {
-    int cap;
-    void *data;
+void dynArray_realloc(DynArray *parr, long long new_size) {
+    long long cap;
+    void *data, *old = parr->data;
 
     cap = parr->capacity;
 
@@ -250,16 +530,17 @@ void dynArray_realloc(DynArray *parr, int new_size) {
     }
 
     cap = new_size;
-    data = realloc(parr->data, sizeof(void *) * new_size);
-    if (!data) {
-        perror("alloc error");
+    data = mem_realloc(parr->data, sizeof(void *) * new_size, parr->tag);
+    stats.dynarray_reallocs++;
+    if (data != old) {
+        stats.dynarray_moved += sizeof(void *) * parr->count;
     }
     parr->capacity = cap;
     parr->data = data;
 }
 
 void dynArray_add(DynArray *parr, void *data) {
-    int count = parr->count + 1;
+    long long count = parr->count + 1;
     if (count >= (parr->capacity * 0.75)) {
         dynArray_realloc(parr, parr->capacity * 2);
     }
@@ -278,8 +559,9 @@ int dynArray_search(DynArray *parr, int key) {
 }
 
 
-// 计算hash
-#define MAXKEY 1024
+// 计算hash; 低位只随最后几个字符变化, 乘奇数常数后取高位, f1 f2 ... 这样成批的名字也能散开
+#define MAXKEY_BITS 14
+#define MAXKEY (1 << MAXKEY_BITS)
 
 int elf_hash(char *key) {
     int h = 0, g;
@@ -291,11 +573,24 @@ int elf_hash(char *key) {
         }
         h &= ~g;
     }
-    return h % MAXKEY;
+    return (int) (((unsigned int) h * 2654435761u) >> (32 - MAXKEY_BITS));
 }
 
-struct Symbol {
-};
+// 数据类型
+typedef struct Type {
+    int t;                  // 类型编码 T_xxx
+    struct Symbol *ref;     // 指针/数组/函数/结构体关联的符号
+} Type;
+
+// 符号
+typedef struct Symbol {
+    int v;                  // 单词编码 (可带SC_STRUCT/SC_MEMBER/SC_PARAMS/SC_ANOM)
+    int r;                  // 存储类型
+    int c;                  // 关联值: 栈偏移/模块符号索引/结构体尺寸/数组长度
+    Type type;
+    struct Symbol *next;    // 结构体成员 或 函数参数链
+    struct Symbol *prev_tok;// 同名的上一个符号
+} Symbol;
 
 typedef struct TkWord {
     int tkcode;
@@ -303,11 +598,13 @@ typedef struct TkWord {
     char *spelling;
     struct Symbol *sym_struct;
     struct Symbol *sym_identifier;
+    struct Macro *macro;    // 宏定义
 } TkWord;
 
 TkWord *tk_hashtable[MAXKEY];
 DynArray tktable;
 int token;
+long long tk_count;         // 已读入的单词数
 DynString tkstr, sourcestr;
 
 TkWord *tkWord_direct_insert(TkWord *tp) {
@@ -322,7 +619,9 @@ TkWord *tkWord_direct_insert(TkWord *tp) {
 TkWord *tkWord_find(char *p) {
     int keyno = elf_hash(p);
     TkWord *tp = NULL, *tpl;
+    stats.tk_lookups++;
     for (tpl = tk_hashtable[keyno]; tpl; tpl = tpl->next) {
+        stats.tk_probes++;
         if (!strcmp(p, tpl->spelling)) {
             token = tpl->tkcode;
             tp = tpl;
@@ -342,9 +641,12 @@ TkWord *tkWord_insert(char *p) {
     tp = tkWord_find(p);
     if (tp == NULL) {
         length = strlen(p);
-        tp = (TkWord *) malloc(sizeof(TkWord) + length + 1);
+        tp = (TkWord *) mem_alloc(sizeof(TkWord) + length + 1, MEM_LEX);
         tp->next = tk_hashtable[keyno];
         tk_hashtable[keyno] = tp;
+        tp->sym_struct = NULL;
+        tp->sym_identifier = NULL;
+        tp->macro = NULL;
 
         dynArray_add(&tktable, tp);
         tp->tkcode = tktable.count - 1;
@@ -358,21 +660,24 @@ TkWord *tkWord_insert(char *p) {
     return tp;
 }
 
-void *mallocz(int size) {
+void *mallocz(int size, int tag) {
     if (size <= 0) {
         perror("size must > 0");
         return NULL;
     }
     void *ptr;
-    ptr = malloc(size);
-    if (!ptr && size) {
-        perror("size must > 0");
-        return NULL;
-    }
+    ptr = mem_alloc(size, tag);
     memset(ptr, 0, size);
     return ptr;
 }
 
+// 装入的预编译头映像的地址范围, 其中的对象随映像存在, 不能释放 (见预编译头)
+char *pch_lo, *pch_hi;
+
+int pch_owns(void *p) {
+    return (char *) p >= pch_lo && (char *) p < pch_hi;
+}
+
 char *get_tkstr(int v) {
     if (v >= tktable.count) {
         return NULL;
@@ -383,1065 +688,12325 @@ char *get_tkstr(int v) {
     }
 }
 
+// 源文件输入: 固定大小的环形缓冲区, 直接 read(), 管道和 stdin 也能流式读入, 内存与源文件大小无关
+// 词法分析最多向前看一个字符 (src_peek), 不需要 ungetc
+// 包含文件和宏展开的文本整块在内存中, 作为输入源压栈 (见预处理)
+#define SRC_BUF_SIZE (1 << 16)
+#define SRC_BUF_MASK (SRC_BUF_SIZE - 1)
+
+typedef struct SrcBuf {
+    int fd;
+    int eof;
+    long long pos;          // 下一个字符的绝对偏移
+    long long end;          // 已读入数据的末尾
+    long long mask;         // 环形缓冲区为 SRC_BUF_MASK, 内存中的文本为 -1
+    char *data;
+    int owned;              // 弹出时释放 data
+    struct Macro *macro;    // 宏展开
+    struct IncFile *inc;    // 包含文件
+    int cond_base;          // 进入时条件栈的深度
+    int guard;              // 可能的包含保护宏
+    long long guard_end;    // 包含保护的 #endif 所在的偏移
+    long long base;         // 偏移 0 的源位置; 宏展开为展开处的位置
+    long long limit;        // 分到的源位置个数, 超出的偏移没有位置
+    int file;               // 在 src_files 中的序号
+    int live;               // 读入时就建行表 (管道)
+} SrcBuf;
+
+int src_pop();
+
+SrcBuf src = {-1};
+
+// 源位置: 32 位整数, 主文件和每次进入的包含文件依次分到一段, 位置 = 起点 + 文件内偏移;
+// 宏展开出的单词用展开处的位置. 词法分析只记单词的位置, 不数行; 报错时才找出所在文件,
+// 第一次用到时建行首表 (SWAR 一次数 8 个字节里的换行符), 二分查找得到行号和列号.
+// 管道读过的内容不能再读, 也不建表 (内存与输入大小无关): 读入时只数换行符, 报错时从环形缓冲区里
+// 还在的内容往回数; 已经移出缓冲区的位置只有事先钉住 (src_pin) 的才能报出行号
+typedef struct SrcFile {
+    char *name;
+    struct IncFile *inc;    // 包含文件, 内容在内存中; NULL 为主文件
+    int live;               // 主文件是管道, 读入时只计数
+    long long base, size;
+    unsigned int *lines;    // 行首偏移, lines[0] = 0
+    long long nlines, cap;  // 管道: nlines 为已读入的行数
+    long long scanned;      // 已建表的字节数
+    long long line_start;   // 管道: 最后一行的行首偏移
+} SrcFile;
+
+// 钉住的源位置: 管道输入里以后还要报的位置, 趁还在缓冲区里先算出行列
+typedef struct SrcPin {
+    SrcLoc loc;
+    unsigned int line, col;
+} SrcPin;
+
+#define SRC_LOC_MAX 0xffffffffLL
+#define SRC_PIPE_LOCS 0x80000000LL
+
+SrcFile *src_files;
+int src_nfiles, src_capfiles;
+long long src_next_loc = 1;
+
+// 分一段源位置, 用完时 size 为 0 (其中的单词没有位置)
+int src_file_add(char *name, struct IncFile *inc, long long size) {
+    SrcFile *f;
+
+    if (src_nfiles == src_capfiles) {
+        src_capfiles = src_capfiles ? src_capfiles * 2 : 16;
+        src_files = (SrcFile *) mem_realloc(src_files, sizeof(SrcFile) * src_capfiles, MEM_LEX);
+    }
+    f = &src_files[src_nfiles];
+    memset(f, 0, sizeof(*f));
+    f->name = name;
+    f->inc = inc;
+    f->base = src_next_loc;
+    // 多留一个位置给文件末尾
+    f->size = src_next_loc + size + 1 <= SRC_LOC_MAX ? size + 1 : 0;
+    src_next_loc += f->size;
+    return src_nfiles++;
+}
+
+// 8 个字节中的换行符: 对应字节的最高位置 1, 没有误报
+unsigned long long swar_newlines(unsigned long long x) {
+    unsigned long long t = x ^ 0x0a0a0a0a0a0a0a0aULL;
+    return ~(((t & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | t | 0x7f7f7f7f7f7f7f7fULL);
+}
+
+// [p, p + n) 是文件偏移 off 开始的一段, 先数换行符再把行首偏移追加到行表
+void src_file_scan(SrcFile *f, char *p, long long n, long long off) {
+    unsigned long long x, m;
+    long long i = 0, k = 0;
+
+    if (!f->lines) {
+        f->cap = 1024;
+        f->lines = (unsigned int *) mem_alloc(sizeof(unsigned int) * f->cap, MEM_LEX);
+        f->lines[f->nlines++] = 0;
+    }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 8 <= n; i += 8) {
+        memcpy(&x, p + i, 8);
+        k += __builtin_popcountll(swar_newlines(x));
+    }
+#endif
+    for (; i < n; i++) {
+        k += p[i] == '\n';
+    }
+    if (f->nlines + k > f->cap) {
+        while (f->nlines + k > f->cap) {
+            f->cap *= 2;
+        }
+        f->lines = (unsigned int *) mem_realloc(f->lines, sizeof(unsigned int) * f->cap, MEM_LEX);
+    }
+    i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 8 <= n; i += 8) {
+        memcpy(&x, p + i, 8);
+        for (m = swar_newlines(x); m; m &= m - 1) {
+            f->lines[f->nlines++] = (unsigned int) (off + i + (__builtin_ctzll(m) >> 3) + 1);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (p[i] == '\n') {
+            f->lines[f->nlines++] = (unsigned int) (off + i + 1);
+        }
+    }
+    f->scanned = off + n;
+}
+
+// 管道读入的一段: 只数换行符, 记下最后一行的行首
+void src_file_count(SrcFile *f, char *p, long long n, long long off) {
+    unsigned long long x;
+    long long i = 0, k = 0;
+
+    if (!f->nlines) {
+        f->nlines = 1;
+    }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 8 <= n; i += 8) {
+        memcpy(&x, p + i, 8);
+        k += __builtin_popcountll(swar_newlines(x));
+    }
+#endif
+    for (; i < n; i++) {
+        k += p[i] == '\n';
+    }
+    if (k) {
+        f->nlines += k;
+        for (i = n - 1; p[i] != '\n'; i--);
+        f->line_start = off + i + 1;
+    }
+    f->scanned = off + n;
+}
+
+// 当前字符 ch 的源位置
+SrcLoc src_loc();
+
+// "-" 表示 stdin
+int src_open(char *path) {
+    struct stat st;
+
+    src.fd = strcmp(path, "-") ? open(path, O_RDONLY) : 0;
+    if (src.fd < 0) {
+        return 0;
+    }
+    if (!src.data) {
+        src.data = (char *) mem_alloc(SRC_BUF_SIZE, MEM_LEX);
+    }
+    src.pos = src.end = 0;
+    src.eof = 0;
+    src.mask = SRC_BUF_MASK;
+    // 管道读过的内容不能再读, 读入时就数行; stdin 即使重定向自文件也没有文件名可以重新打开
+    src.live = !src.fd || fstat(src.fd, &st) || !S_ISREG(st.st_mode);
+    src.file = src_file_add(src.fd ? path : "<stdin>", NULL, src.live ? SRC_PIPE_LOCS : st.st_size);
+    src_files[src.file].live = src.live;
+    src.base = src_files[src.file].base;
+    src.limit = src_files[src.file].size;
+    return 1;
+}
+
+void src_close() {
+    if (src.fd > 0) {
+        close(src.fd);
+    }
+    src.fd = -1;
+}
+
+// 读入更多数据, 不覆盖未读的部分和刚读过的一个字符 (压栈时退回); 返回读入的字节数, 0 表示到达末尾
+int src_fill() {
+    long long off, room;
+    ssize_t n;
+
+    while (src.eof) {
+        // 读完的包含文件或宏展开弹出, 接着读外层
+        if (!src_pop()) {
+            return 0;
+        }
+        if (src.pos < src.end) {
+            return 1;
+        }
+    }
+    off = src.end & SRC_BUF_MASK;
+    room = SRC_BUF_SIZE - 1 - (src.end - src.pos);
+    if (room > SRC_BUF_SIZE - off) {
+        room = SRC_BUF_SIZE - off;
+    }
+    if (room <= 0) {
+        return 0;
+    }
+    do {
+        n = read(src.fd, src.data + off, room);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        src.eof = 1;
+        return 0;
+    }
+    if (src.live) {
+        src_file_count(&src_files[src.file], src.data + off, n, src.end);
+    }
+    src.end += n;
+    return (int) n;
+}
+
+// 下一个字符, 不前进
+char src_peek() {
+    if (src.pos == src.end && !src_fill()) {
+        return CH_EOF;
+    }
+    return src.data[src.pos & src.mask];
+}
+
+// 从当前字符 ch 开始的 8 个字符, 不够或跨过环形缓冲区末尾时返回 0 (数字常量的快速路径)
+int src_peek8(unsigned long long *x) {
+    long long off = (src.pos - 1) & src.mask;
+
+    if (ch == CH_EOF || src.end - src.pos < 7 || (src.mask != -1 && off + 8 > SRC_BUF_SIZE)) {
+        return 0;
+    }
+    memcpy(x, src.data + off, 8);
+    return 1;
+}
+
+// 当前字符 ch 的偏移
+long long src_tell() {
+    return src.pos - (ch != CH_EOF);
+}
+
+SrcLoc src_loc() {
+    long long off;
+
+    if (src.macro) {
+        return (SrcLoc) src.base;
+    }
+    off = src_tell();
+    return off < src.limit ? (SrcLoc) (src.base + off) : 0;
+}
+
+// 只用于普通文件 (增量编译); 目标还在已读入的数据里时不重新读
+void src_seek(long long pos) {
+    if (pos >= src.pos && pos <= src.end) {
+        src.pos = pos;
+        return;
+    }
+    lseek(src.fd, pos, SEEK_SET);
+    src.pos = src.end = pos;
+    src.eof = 0;
+}
+
 void getch() {
-    int i = getc(fin);
-    ch = i;
+    if (src.pos == src.end && !src_fill()) {
+        ch = CH_EOF;
+    } else {
+        ch = src.data[src.pos++ & src.mask];
+    }
+    stats.getch_calls++;
 }
 
+void next_token();
+
 void get_token() {
-    preprocess();
-    switch (ch) {
-        case 'a' :
-        case 'b' :
-        case 'c' :
-        case 'd' :
-        case 'e' :
-        case 'f' :
-        case 'g' :
-        case 'h' :
-        case 'i' :
-        case 'j' :
-        case 'k' :
-        case 'l' :
-        case 'm' :
-        case 'n' :
-        case 'o' :
-        case 'p' :
-        case 'q' :
-        case 'r' :
-        case 's' :
-        case 't' :
-        case 'u' :
-        case 'v' :
-        case 'w' :
-        case 'x' :
-        case 'y' :
-        case 'z' :
-        case 'A' :
-        case 'B' :
-        case 'C' :
-        case 'D' :
-        case 'E' :
-        case 'F' :
-        case 'G' :
-        case 'H' :
-        case 'I' :
-        case 'J' :
-        case 'K' :
-        case 'L' :
-        case 'M' :
-        case 'N' :
-        case 'O' :
-        case 'P' :
-        case 'Q' :
-        case 'R' :
-        case 'S' :
-        case 'T' :
-        case 'U' :
-        case 'V' :
-        case 'W' :
-        case 'X' :
-        case 'Y' :
-        case 'Z' :
-        case '_': {
-            TkWord *tp;
-            parse_identifier();
-            tp = tkWord_insert(tkstr.data);
-            token = tp->tkcode;
-            break;
-        }
-        case '0' :
-        case '1' :
-        case '2' :
-        case '3' :
-        case '4' :
-        case '5' :
-        case '6' :
-        case '7' :
-        case '8' :
-        case '9': {
-            parse_num();
-            token = TK_CINT;
-            break;
+    int prev;
+
+    if (opt_stats) {
+        prev = phase_switch(PH_LEX);
+        next_token();
+        phase_switch(prev);
+    } else {
+        next_token();
+    }
+    tk_count++;
+    stats.tokens[token < TK_IDENT ? token : TK_IDENT]++;
+}
+
+int is_nodigit(char c);
+
+int is_digit(char c);
+
+// 预处理
+// #include #define #undef #if #ifdef #ifndef #elif #else #endif #error #warning #pragma once
+// 宏展开在字符层面进行: 实参先展开再替换, 替换文本作为新的输入源压栈, 读完弹出; 展开期间该宏被禁用, 不会无限递归
+// 包含文件每次运行只读入一次; 整个文件被 #ifndef X ... #endif 包住 (包含保护) 或有 #pragma once 时,
+// 再次包含直接跳过, 不再做词法分析
+#define PP_MAX_DEPTH 256
+#define PP_MAX_COND 256
+#define PP_MAX_ARGS 64
+
+typedef struct Macro {
+    int nparams;            // -1: 对象式宏
+    char **params;
+    char *body;             // 替换文本, 末尾加一个空格, 不和后面的字符连成一个单词
+    int paste;              // 替换文本含 # 或 ##
+    int busy;               // 正在展开
+} Macro;
+
+typedef struct IncFile {
+    char *path;             // 真实路径, 作为缓存的键
+    char *name;             // 找到时的路径, 用于报错
+    char *data;             // 全部内容, 保证以换行结尾
+    long long size;
+    unsigned long long hash;// 文件内容的散列, 编译缓存用来校验
+    long long fsize, mtime; // 文件长度和修改时间 (纳秒), 预编译头用来校验
+    int once;               // #pragma once
+    int guard;              // 包含保护宏的单词编码, 0 表示没有
+    struct IncFile *next;
+} IncFile;
+
+// 行表至少覆盖到偏移 off; 主文件是普通文件, 重新读一遍
+void src_file_need(SrcFile *f, long long off) {
+    char buf[SRC_BUF_SIZE];
+    ssize_t n;
+    int fd;
+
+    if (f->scanned > off || (f->lines && f->inc)) {
+        return;
+    }
+    if (f->inc) {
+        src_file_scan(f, f->inc->data, f->inc->size, 0);
+        return;
+    }
+    if (f->live || (fd = open(f->name, O_RDONLY)) < 0) {
+        return;
+    }
+    while (f->scanned <= off && (n = pread(fd, buf, sizeof(buf), f->scanned)) > 0) {
+        src_file_scan(f, buf, n, f->scanned);
+    }
+    close(fd);
+}
+
+int src_live_where(int file, long long off, long long *line, long long *col);
+
+int src_pin_where(SrcLoc loc, long long *line, long long *col);
+
+int src_where(SrcLoc loc, char **name, long long *line, long long *col) {
+    SrcFile *f;
+    long long off;
+    int lo = 0, hi = src_nfiles - 1, mid;
+
+    if (!loc || !src_nfiles) {
+        return 0;
+    }
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (src_files[mid].base <= loc) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
         }
-        case '+':
-            getch();
-            token = TK_PLUS;
-            break;
-        case '-':
-            getch();
-            if (ch == '>') {
-                token = TK_POINTSTO;
-                getch();
-            } else {
-                token = TK_MINUS;
+    }
+    f = &src_files[lo];
+    off = loc - f->base;
+    if (off >= f->size) {
+        return 0;
+    }
+    if (f->live) {
+        *name = f->name;
+        return src_live_where(lo, off, line, col) || src_pin_where(loc, line, col);
+    }
+    src_file_need(f, off);
+    if (!f->lines) {
+        return 0;
+    }
+    lo = 0;
+    hi = (int) f->nlines - 1;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (f->lines[mid] <= off) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    *name = f->name;
+    *line = lo + 1;
+    *col = off - f->lines[lo] + 1;
+    return 1;
+}
+
+typedef struct SrcFrame {
+    SrcBuf src;
+    char *filename;
+} SrcFrame;
+
+typedef struct PpCond {
+    int taken;              // 已有分支被选中
+    int has_else;
+    int guard;              // 包含保护的 #ifndef
+} PpCond;
+
+enum e_PpSkip {
+    PP_ELIF,
+    PP_ELSE,
+    PP_ENDIF,
+};
+
+SrcFrame pp_stack[PP_MAX_DEPTH];
+int pp_depth;
+SrcPin *src_pins;           // 按源位置有序
+int src_npins, src_cappins;
+PpCond pp_conds[PP_MAX_COND];
+int pp_ncond;
+int pp_bol = 1;             // 行首, 只有空白之后的 # 才是预处理指令
+IncFile *pp_incs;           // 本次编译读入过的包含文件
+char *pp_dirs[64];          // -I
+int pp_ndirs;
+char *pp_defs[64];          // -D
+int pp_ndefs;
+DynString pp_line, pp_buf, pp_args, pp_name;
+
+// 管道主文件的读入缓冲区, 可能压在包含文件和宏展开下面; 没有时返回 NULL
+SrcBuf *src_live_buf() {
+    int d;
+
+    if (src.live) {
+        return &src;
+    }
+    for (d = pp_depth - 1; d >= 0; d--) {
+        if (pp_stack[d].src.live) {
+            return &pp_stack[d].src;
+        }
+    }
+    return NULL;
+}
+
+// 管道主文件的偏移 off 还在环形缓冲区里时, 从读入的末尾往回数换行符得到行列
+int src_live_where(int file, long long off, long long *line, long long *col) {
+    SrcFile *f = &src_files[file];
+    SrcBuf *b = src_live_buf();
+    long long i, lo, k = 0;
+
+    lo = b && b->end > SRC_BUF_SIZE ? b->end - SRC_BUF_SIZE : 0;
+    if (!b || b->file != file || off < lo || off > b->end) {
+        return 0;
+    }
+    for (i = off; i < b->end; i++) {
+        k += b->data[i & b->mask] == '\n';
+    }
+    for (i = off - 1; k && i >= lo && b->data[i & b->mask] != '\n'; i--);
+    if (k && i < lo && lo > 0) {
+        // 这一行的开头已经移出缓冲区
+        return 0;
+    }
+    *line = f->nlines - k;
+    *col = off - (k ? i + 1 : f->line_start) + 1;
+    return 1;
+}
+
+int src_pin_where(SrcLoc loc, long long *line, long long *col) {
+    int lo = 0, hi = src_npins - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (src_pins[mid].loc == loc) {
+            *line = src_pins[mid].line;
+            *col = src_pins[mid].col;
+            return 1;
+        }
+        if (src_pins[mid].loc < loc) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return 0;
+}
+
+// 钉住以后还要报的位置; 只对管道输入有事可做, 其余文件随时能重新算出
+void src_pin(SrcLoc loc) {
+    SrcBuf *b = src_live_buf();
+    SrcFile *f;
+    long long line, col;
+    int i;
+
+    if (!b || !loc) {
+        return;
+    }
+    f = &src_files[b->file];
+    if (loc < f->base || loc - f->base >= f->size || src_pin_where(loc, &line, &col)
+        || !src_live_where(b->file, loc - f->base, &line, &col)) {
+        return;
+    }
+    if (src_npins == src_cappins) {
+        src_cappins = src_cappins * 2 + 64;
+        src_pins = (SrcPin *) mem_realloc(src_pins, sizeof(SrcPin) * src_cappins, MEM_LEX);
+    }
+    for (i = src_npins++; i > 0 && src_pins[i - 1].loc > loc; i--) {
+        src_pins[i] = src_pins[i - 1];
+    }
+    src_pins[i].loc = loc;
+    src_pins[i].line = (unsigned int) line;
+    src_pins[i].col = (unsigned int) col;
+}
+
+void incr_mix(char *p, long long n);
+int incr_scc_clean(int *members, int n);
+int incr_clean(int s);
+
+unsigned long long hash64(char *p, size_t n, unsigned long long seed);
+
+// 压入新的输入源; 当前字符退回外层, 弹出后重新读到
+void src_push(char *data, long long size, int owned, Macro *m, IncFile *inc) {
+    SrcFrame *f;
+
+    if (pp_depth >= PP_MAX_DEPTH) {
+        error("宏展开或文件包含嵌套太深");
+    }
+    src.pos -= ch != CH_EOF;
+    f = &pp_stack[pp_depth++];
+    f->src = src;
+    f->filename = filename;
+    memset(&src, 0, sizeof(src));
+    src.fd = -1;
+    src.eof = 1;
+    src.end = size;
+    src.mask = -1;
+    src.data = data;
+    src.owned = owned;
+    src.macro = m;
+    src.inc = inc;
+    src.cond_base = pp_ncond;
+    if (m) {
+        m->busy = 1;
+        src.base = tok_loc;
+    }
+    if (inc) {
+        filename = inc->name;
+        src.file = src_file_add(inc->name, inc, size);
+        src.base = src_files[src.file].base;
+        src.limit = src_files[src.file].size;
+        pp_bol = 1;
+    }
+    getch();
+}
+
+// 只有空白和注释
+int pp_blank(char *p, char *end) {
+    while (p < end) {
+        if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            p++;
+        } else if (p + 1 < end && p[0] == '/' && p[1] == '/') {
+            while (p < end && *p != '\n') {
+                p++;
             }
-            break;
-        case '/':
-            token = TK_DIVIDE;
-            getch();
-            break;
-        case '%':
-            token = TK_MOD;
+        } else if (p + 1 < end && p[0] == '/' && p[1] == '*') {
+            for (p += 2; p + 1 < end && !(p[0] == '*' && p[1] == '/'); p++);
+            p += 2;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int src_pop() {
+    SrcFrame *f;
+    IncFile *inc = src.inc;
+
+    if (!pp_depth) {
+        return 0;
+    }
+    if (src.macro) {
+        src.macro->busy = 0;
+    }
+    if (inc) {
+        if (pp_ncond != src.cond_base) {
+            error("#if 没有匹配的 #endif");
+        }
+        // #endif 之后只剩空白, 确认是包含保护
+        if (src.guard && src.guard_end && pp_blank(src.data + src.guard_end, src.data + src.end)) {
+            inc->guard = src.guard;
+        }
+    }
+    if (src.owned) {
+        mem_free(src.data, MEM_PP);
+    }
+    f = &pp_stack[--pp_depth];
+    src = f->src;
+    if (inc) {
+        filename = f->filename;
+    }
+    return 1;
+}
+
+// 按拼写查单词表, 不改变当前单词
+TkWord *pp_find(char *s, int n) {
+    int save = token;
+    TkWord *tp;
+
+    dynstring_reset(&pp_name);
+    while (n--) {
+        dynstring_chcat(&pp_name, *s++);
+    }
+    dynstring_chcat(&pp_name, '\0');
+    tp = tkWord_find(pp_name.data);
+    token = save;
+    return tp;
+}
+
+TkWord *pp_insert(char *s, int n) {
+    int save = token;
+    TkWord *tp = pp_find(s, n);
+
+    if (!tp) {
+        tp = tkWord_insert(pp_name.data);
+    }
+    token = save;
+    return tp;
+}
+
+char *pp_skip_space(char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') {
+        p++;
+    }
+    return p;
+}
+
+char *pp_skip_ident(char *p) {
+    while (is_nodigit(*p) || is_digit(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// 复制字符或字符串常量, p 指向起始的引号, 返回结束引号之后的位置
+char *pp_copy_literal(char *p, DynString *out) {
+    char q = *p;
+
+    dynstring_chcat(out, *p++);
+    while (*p && *p != q) {
+        if (*p == '\\' && p[1]) {
+            dynstring_chcat(out, *p++);
+        }
+        dynstring_chcat(out, *p++);
+    }
+    if (*p) {
+        dynstring_chcat(out, *p++);
+    }
+    return p;
+}
+
+void pp_append(DynString *out, char *s, long long n) {
+    while (n-- > 0) {
+        dynstring_chcat(out, *s++);
+    }
+}
+
+// 读入指令行的其余部分: 去掉注释, 拼接续行, 停在换行符上
+void pp_read_line() {
+    char q;
+
+    dynstring_reset(&pp_line);
+    while (ch != '\n' && ch != CH_EOF) {
+        if (ch == '\\' && src_peek() == '\n') {
             getch();
-            break;
-        case '=':
             getch();
-            if (ch == '=') {
-                token = TK_EQ;
+            continue;
+        }
+        if (ch == '/' && src_peek() == '/') {
+            while (ch != '\n' && ch != CH_EOF) {
                 getch();
-            } else {
-                token = TK_ASSIGN;
             }
             break;
-        case '!':
+        }
+        if (ch == '/' && src_peek() == '*') {
             getch();
-            if (ch == '=') {
-                token = TK_NEQ;
-                getch();
-            } else {
-                error("now we can't support '!'");
-            }
-            break;
-        case '<':
+            parse_comment();
+            dynstring_chcat(&pp_line, ' ');
+            continue;
+        }
+        if (ch == '"' || ch == '\'') {
+            q = ch;
+            dynstring_chcat(&pp_line, ch);
             getch();
-            if (ch == '=') {
-                token = TK_LEQ;
+            while (ch != q && ch != '\n' && ch != CH_EOF) {
+                if (ch == '\\') {
+                    dynstring_chcat(&pp_line, ch);
+                    getch();
+                }
+                dynstring_chcat(&pp_line, ch);
                 getch();
-            } else {
-                token = TK_LT;
             }
-            break;
-        case '>':
-            getch();
-            if (ch == '=') {
-                token = TK_GEQ;
-                getch();
+            if (ch != q) {
+                error("常量缺少结束的 %c", q);
+            }
+        }
+        dynstring_chcat(&pp_line, ch);
+        getch();
+    }
+    while (pp_line.count && (pp_line.data[pp_line.count - 1] == ' ' || pp_line.data[pp_line.count - 1] == '\t'
+                             || pp_line.data[pp_line.count - 1] == '\r')) {
+        pp_line.count--;
+    }
+    dynstring_chcat(&pp_line, '\0');
+}
+
+// 按顶层逗号切分实参, p 指向 '('; 实参去掉首尾空白后以 '\0' 结尾存入 buf, 返回 ')' 之后的位置
+char *pp_split_args(char *p, DynString *buf, long long *offs, int *nargs) {
+    int depth = 0, n = 0;
+
+    p = pp_skip_space(p + 1);
+    offs[0] = buf->count;
+    while (1) {
+        if (!*p) {
+            error("宏调用缺少 ')'");
+        }
+        if (depth == 0 && (*p == ',' || *p == ')')) {
+            while (buf->count > offs[n] && buf->data[buf->count - 1] == ' ') {
+                buf->count--;
+            }
+            dynstring_chcat(buf, '\0');
+            n++;
+            if (*p++ == ')') {
+                break;
+            }
+            if (n >= PP_MAX_ARGS) {
+                error("宏实参太多");
+            }
+            p = pp_skip_space(p);
+            offs[n] = buf->count;
+            continue;
+        }
+        if (*p == '"' || *p == '\'') {
+            p = pp_copy_literal(p, buf);
+            continue;
+        }
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')') {
+            depth--;
+        }
+        dynstring_chcat(buf, *p++);
+    }
+    *nargs = n;
+    return p;
+}
+
+int pp_param(Macro *m, char *s, int n) {
+    int i;
+
+    for (i = 0; i < m->nparams; i++) {
+        if ((int) strlen(m->params[i]) == n && !strncmp(m->params[i], s, n)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int pp_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// #x: 实参变成字符串常量, 常量中的 " 和 \ 转义; 引号外的一段空白变成一个空格, 首尾的空白去掉
+void pp_stringize(char *s, DynString *out) {
+    char q = 0;
+    long long start;
+
+    dynstring_chcat(out, '"');
+    start = out->count;
+    for (; *s; s++) {
+        if (!q && pp_is_space(*s)) {
+            while (pp_is_space(s[1])) {
+                s++;
+            }
+            if (s[1] && out->count > start) {
+                dynstring_chcat(out, ' ');
+            }
+            continue;
+        }
+        if (*s == '"' || (q && *s == '\\')) {
+            dynstring_chcat(out, '\\');
+        }
+        dynstring_chcat(out, *s);
+        if (q && *s == '\\' && s[1]) {
+            s++;
+            if (*s == '"' || *s == '\\') {
+                dynstring_chcat(out, '\\');
+            }
+            dynstring_chcat(out, *s);
+        } else if (*s == '"' || *s == '\'') {
+            q = !q ? *s : q == *s ? 0 : q;
+        }
+    }
+    dynstring_chcat(out, '"');
+}
+
+void pp_expand_text(char *p, DynString *out, int cond);
+
+// 用实参替换形参, 处理 # 和 ##; 其余的实参先完全展开再替换, # 和 ## 的操作数用原样的实参
+void pp_subst(Macro *m, char *args, long long *offs, DynString *out) {
+    char *p = m->body, *s;
+    DynString exp;
+    long long eoffs[PP_MAX_ARGS];
+    int i, paste = 0;
+
+    dynstring_init(&exp, 64, MEM_PP);
+    for (i = 0; i < m->nparams; i++) {
+        eoffs[i] = -1;
+    }
+    while (*p) {
+        if (p[0] == '#' && p[1] == '#') {
+            while (out->count && out->data[out->count - 1] == ' ') {
+                out->count--;
+            }
+            p = pp_skip_space(p + 2);
+            paste = 1;
+            continue;
+        } else if (*p == '#' && m->nparams >= 0) {
+            s = pp_skip_space(p + 1);
+            p = pp_skip_ident(s);
+            i = pp_param(m, s, (int) (p - s));
+            if (i < 0) {
+                error("# 后面应是宏参数");
+            }
+            pp_stringize(args + offs[i], out);
+        } else if (is_nodigit(*p)) {
+            s = p;
+            p = pp_skip_ident(p);
+            i = pp_param(m, s, (int) (p - s));
+            if (i < 0) {
+                pp_append(out, s, p - s);
+            } else if (paste || (pp_skip_space(p)[0] == '#' && pp_skip_space(p)[1] == '#')) {
+                s = args + offs[i];
+                pp_append(out, s, strlen(s));
             } else {
-                token = TK_GT;
+                if (eoffs[i] < 0) {
+                    eoffs[i] = exp.count;
+                    pp_expand_text(args + offs[i], &exp, 0);
+                    dynstring_chcat(&exp, '\0');
+                }
+                s = exp.data + eoffs[i];
+                pp_append(out, s, strlen(s));
             }
-            break;
-        case '.':
+        } else if (is_digit(*p)) {
+            s = p;
+            p = pp_skip_ident(p);
+            pp_append(out, s, p - s);
+        } else if (*p == '"' || *p == '\'') {
+            p = pp_copy_literal(p, out);
+        } else {
+            dynstring_chcat(out, *p++);
+        }
+        paste = 0;
+    }
+    dynstring_free(&exp);
+}
+
+// 宏调用的实参文本, 从 '(' 到匹配的 ')', 换行和注释换成空格
+void pp_read_args(TkWord *tp) {
+    int depth = 0;
+    char q;
+
+    dynstring_reset(&pp_buf);
+    do {
+        if (ch == CH_EOF) {
+            error("宏'%s'的调用缺少 ')'", tp->spelling);
+        }
+        if (ch == '\n') {
+            dynstring_chcat(&pp_buf, ' ');
             getch();
-            if (ch == '.') {
-                getch();
-                if (ch != '.') {
-                    error("is '...' you want to write");
-                } else {
-                    token = TK_ELLIPSIS;
+            continue;
+        }
+        if (ch == '/' && (src_peek() == '*' || src_peek() == '/')) {
+            getch();
+            parse_comment();
+            dynstring_chcat(&pp_buf, ' ');
+            continue;
+        }
+        if (ch == '"' || ch == '\'') {
+            q = ch;
+            do {
+                if (ch == '\\') {
+                    dynstring_chcat(&pp_buf, ch);
                     getch();
                 }
+                dynstring_chcat(&pp_buf, ch);
+                getch();
+            } while (ch != q && ch != '\n' && ch != CH_EOF);
+        }
+        if (ch == '(') {
+            depth++;
+        } else if (ch == ')') {
+            depth--;
+        }
+        dynstring_chcat(&pp_buf, ch);
+        getch();
+    } while (depth > 0);
+    dynstring_chcat(&pp_buf, '\0');
+}
+
+// 展开刚读到的宏名; 带参数的宏后面不是 '(' 时不展开, 返回 0
+int pp_expand(TkWord *tp) {
+    Macro *m = tp->macro;
+    DynString out;
+    long long offs[PP_MAX_ARGS];
+    int nargs = 0;
+
+    if (m->nparams < 0 && !m->paste) {
+        stats.pp_expansions++;
+        src_push(m->body, strlen(m->body), 0, m, NULL);
+        return 1;
+    }
+    dynstring_init(&out, 64, MEM_PP);
+    dynstring_reset(&pp_args);
+    if (m->nparams >= 0) {
+        while (ch == ' ' || ch == '\t' || ch == '\n' || (ch == '/' && (src_peek() == '*' || src_peek() == '/'))) {
+            if (ch == '/') {
                 getch();
+                parse_comment();
             } else {
-                token = TK_DOT;
+                skip_white_space();
             }
+        }
+        if (ch != '(') {
+            dynstring_free(&out);
+            return 0;
+        }
+        pp_read_args(tp);
+        pp_split_args(pp_buf.data, &pp_args, offs, &nargs);
+        if (nargs != m->nparams && !(m->nparams == 0 && nargs == 1 && !pp_args.data[offs[0]])) {
+            error("宏'%s'需要 %d 个实参", tp->spelling, m->nparams);
+        }
+    }
+    pp_subst(m, pp_args.data, offs, &out);
+    dynstring_chcat(&out, ' ');
+    stats.pp_expansions++;
+    src_push(out.data, out.count, 1, m, NULL);
+    return 1;
+}
+
+void pp_undef_macro(TkWord *tp) {
+    Macro *m = tp->macro;
+    int i;
+
+    if (!m) {
+        return;
+    }
+    tp->macro = NULL;
+    if (pch_owns(m)) {
+        return;
+    }
+    for (i = 0; i < m->nparams; i++) {
+        mem_free(m->params[i], MEM_PP);
+    }
+    mem_free(m->params, MEM_PP);
+    mem_free(m->body, MEM_PP);
+    mem_free(m, MEM_PP);
+}
+
+// NAME body 或 NAME(a, b) body
+void pp_define(char *p) {
+    char *s, *params[PP_MAX_ARGS];
+    int np = -1, i;
+    TkWord *tp;
+    Macro *m;
+
+    s = pp_skip_space(p);
+    if (!is_nodigit(*s)) {
+        error("#define 后面应是宏名");
+    }
+    p = pp_skip_ident(s);
+    tp = pp_insert(s, (int) (p - s));
+    if (*p == '(') {
+        np = 0;
+        p = pp_skip_space(p + 1);
+        while (*p != ')') {
+            s = p;
+            p = pp_skip_ident(p);
+            if (s == p || np >= PP_MAX_ARGS) {
+                error("宏'%s'的参数表有误", tp->spelling);
+            }
+            params[np] = (char *) mem_alloc(p - s + 1, MEM_PP);
+            memcpy(params[np], s, p - s);
+            params[np++][p - s] = '\0';
+            p = pp_skip_space(p);
+            if (*p == ',') {
+                p = pp_skip_space(p + 1);
+            } else if (*p != ')') {
+                error("宏'%s'的参数表有误", tp->spelling);
+            }
+        }
+        p++;
+    }
+    p = pp_skip_space(p);
+    m = (Macro *) mallocz(sizeof(Macro), MEM_PP);
+    m->nparams = np;
+    m->params = (char **) mem_alloc(sizeof(char *) * (np > 0 ? np : 1), MEM_PP);
+    for (i = 0; i < np; i++) {
+        m->params[i] = params[i];
+    }
+    m->body = (char *) mem_alloc(strlen(p) + 2, MEM_PP);
+    sprintf(m->body, "%s ", p);
+    m->paste = strchr(p, '#') != NULL;
+    if (tp->macro) {
+        if (strcmp(tp->macro->body, m->body) || tp->macro->nparams != np) {
+            warning("宏'%s'重定义", tp->spelling);
+        }
+        pp_undef_macro(tp);
+    }
+    tp->macro = m;
+}
+
+// -DNAME 或 -DNAME=value
+void pp_define_option(char *def) {
+    char *eq = strchr(def, '=');
+    DynString d;
+
+    dynstring_init(&d, 64, MEM_PP);
+    pp_append(&d, def, eq ? eq - def : (long long) strlen(def));
+    dynstring_chcat(&d, ' ');
+    eq = eq ? eq + 1 : "1";
+    pp_append(&d, eq, strlen(eq));
+    dynstring_chcat(&d, '\0');
+    pp_define(d.data);
+    dynstring_free(&d);
+}
+
+// 编译开始时定义 -D 给出的宏
+void pp_predefine() {
+    int i;
+
+    for (i = 0; i < pp_ndefs; i++) {
+        pp_define_option(pp_defs[i]);
+    }
+}
+
+int pp_defined(char *s, int n) {
+    TkWord *tp = pp_find(s, n);
+    return tp && tp->macro;
+}
+
+// 展开文本里的宏, 结果追加到 out; 用于实参在替换前的预先展开和 #if 表达式 (cond, 处理 defined).
+// 函数宏后面的 '(' 不在文本里时原样保留, 实参替换后整体重新扫描时再展开
+void pp_expand_text(char *p, DynString *out, int cond) {
+    char *s;
+    TkWord *tp;
+    Macro *m;
+    DynString args, body;
+    long long offs[PP_MAX_ARGS];
+    int nargs, paren;
+
+    while (*p) {
+        if (is_nodigit(*p)) {
+            s = p;
+            p = pp_skip_ident(p);
+            if (cond && p - s == 7 && !strncmp(s, "defined", 7)) {
+                p = pp_skip_space(p);
+                paren = *p == '(';
+                s = pp_skip_space(p + paren);
+                p = pp_skip_ident(s);
+                if (s == p) {
+                    error("defined 后面应是宏名");
+                }
+                dynstring_chcat(out, pp_defined(s, (int) (p - s)) ? '1' : '0');
+                p = pp_skip_space(p);
+                if (paren) {
+                    if (*p != ')') {
+                        error("defined 缺少 ')'");
+                    }
+                    p++;
+                }
+                continue;
+            }
+            tp = pp_find(s, (int) (p - s));
+            m = tp ? tp->macro : NULL;
+            if (m && !m->busy && (m->nparams < 0 || *pp_skip_space(p) == '(')) {
+                dynstring_init(&args, 64, MEM_PP);
+                dynstring_init(&body, 64, MEM_PP);
+                nargs = 0;
+                if (m->nparams >= 0) {
+                    p = pp_split_args(pp_skip_space(p), &args, offs, &nargs);
+                    if (nargs != m->nparams && !(m->nparams == 0 && nargs == 1 && !args.data[offs[0]])) {
+                        error("宏'%s'需要 %d 个实参", tp->spelling, m->nparams);
+                    }
+                }
+                pp_subst(m, args.data, offs, &body);
+                dynstring_chcat(&body, '\0');
+                stats.pp_expansions++;
+                m->busy = 1;
+                pp_expand_text(body.data, out, cond);
+                m->busy = 0;
+                dynstring_chcat(out, ' ');
+                dynstring_free(&args);
+                dynstring_free(&body);
+            } else {
+                pp_append(out, s, p - s);
+            }
+        } else if (is_digit(*p)) {
+            s = p;
+            p = pp_skip_ident(p);
+            pp_append(out, s, p - s);
+        } else if (*p == '"' || *p == '\'') {
+            p = pp_copy_literal(p, out);
+        } else {
+            dynstring_chcat(out, *p++);
+        }
+    }
+}
+
+char *pp_ep;                // #if 表达式的当前位置
+
+long long pp_eval_cond();
+
+long long pp_eval_primary() {
+    long long v;
+    char *s;
+
+    pp_ep = pp_skip_space(pp_ep);
+    switch (*pp_ep) {
+        case '(':
+            pp_ep++;
+            v = pp_eval_cond();
+            pp_ep = pp_skip_space(pp_ep);
+            if (*pp_ep++ != ')') {
+                error("#if 表达式缺少 ')'");
+            }
+            return v;
+        case '!':
+            pp_ep++;
+            return !pp_eval_primary();
+        case '~':
+            pp_ep++;
+            return ~pp_eval_primary();
+        case '-':
+            pp_ep++;
+            return -pp_eval_primary();
+        case '+':
+            pp_ep++;
+            return pp_eval_primary();
+        case '\'':
+            v = (unsigned char) pp_ep[1];
+            if (v == '\\') {
+                pp_ep++;
+                v = pp_ep[1] == 'n' ? '\n' : pp_ep[1] == 't' ? '\t' : pp_ep[1] == '0' ? 0 : pp_ep[1];
+            }
+            if (pp_ep[2] != '\'') {
+                error("#if 中的字符常量有误");
+            }
+            pp_ep += 3;
+            return v;
+        default:
             break;
-        case '&':
-            token = TK_AND;
-            getch();
-            break;
-        case ';':
-            token = TK_SEMICOLON;
-            getch();
-            break;
-        case ']':
-            token = TK_CLOSEBR;
-            getch();
-            break;
-        case '}':
-            token = TK_END;
-            getch();
-            break;
-        case ')':
-            token = TK_CLOSEPA;
-            getch();
-            break;
-        case '[':
-            token = TK_OPENBR;
-            getch();
-            break;
-        case '{':
-            token = TK_BEGIN;
-            getch();
-            break;
-        case '(':
-            token = TK_OPENPA;
-            getch();
-            break;
-        case ',':
-            token = TK_COMMA;
+    }
+    if (is_digit(*pp_ep)) {
+        v = strtoll(pp_ep, &s, 0);
+        pp_ep = pp_skip_ident(s);
+        return v;
+    }
+    if (is_nodigit(*pp_ep)) {
+        pp_ep = pp_skip_ident(pp_ep);
+        return 0;
+    }
+    error("#if 表达式有误");
+    return 0;
+}
+
+// 二元运算, 返回运算符序号, 优先级和长度存入 prec len
+int pp_binop(int *prec, int *len) {
+    static char *ops[] = {"||", "&&", "|", "^", "&", "==", "!=", "<=", ">=", "<<", ">>", "<", ">", "+", "-",
+                          "*", "/", "%", NULL};
+    static int precs[] = {1, 2, 3, 4, 5, 6, 6, 7, 7, 8, 8, 7, 7, 9, 9, 10, 10, 10};
+    int i, n;
+
+    pp_ep = pp_skip_space(pp_ep);
+    for (i = 0; ops[i]; i++) {
+        n = (int) strlen(ops[i]);
+        if (!strncmp(pp_ep, ops[i], n)) {
+            *prec = precs[i];
+            *len = n;
+            return i;
+        }
+    }
+    return -1;
+}
+
+long long pp_eval_binary(int min_prec) {
+    long long a = pp_eval_primary(), b;
+    int op, prec, len;
+
+    while ((op = pp_binop(&prec, &len)) >= 0 && prec >= min_prec) {
+        pp_ep += len;
+        b = pp_eval_binary(prec + 1);
+        switch (op) {
+            case 0:
+                a = a || b;
+                break;
+            case 1:
+                a = a && b;
+                break;
+            case 2:
+                a |= b;
+                break;
+            case 3:
+                a ^= b;
+                break;
+            case 4:
+                a &= b;
+                break;
+            case 5:
+                a = a == b;
+                break;
+            case 6:
+                a = a != b;
+                break;
+            case 7:
+                a = a <= b;
+                break;
+            case 8:
+                a = a >= b;
+                break;
+            case 9:
+                a <<= b;
+                break;
+            case 10:
+                a >>= b;
+                break;
+            case 11:
+                a = a < b;
+                break;
+            case 12:
+                a = a > b;
+                break;
+            case 13:
+                a += b;
+                break;
+            case 14:
+                a -= b;
+                break;
+            case 15:
+                a *= b;
+                break;
+            default:
+                if (!b) {
+                    error("#if 表达式除以 0");
+                }
+                a = op == 16 ? a / b : a % b;
+                break;
+        }
+    }
+    return a;
+}
+
+long long pp_eval_cond() {
+    long long c = pp_eval_binary(1), a, b;
+
+    pp_ep = pp_skip_space(pp_ep);
+    if (*pp_ep != '?') {
+        return c;
+    }
+    pp_ep++;
+    a = pp_eval_cond();
+    pp_ep = pp_skip_space(pp_ep);
+    if (*pp_ep++ != ':') {
+        error("#if 表达式缺少 ':'");
+    }
+    b = pp_eval_cond();
+    return c ? a : b;
+}
+
+int pp_eval(char *p) {
+    DynString out;
+    long long v;
+
+    dynstring_init(&out, 64, MEM_PP);
+    pp_expand_text(p, &out, 1);
+    dynstring_chcat(&out, '\0');
+    pp_ep = out.data;
+    if (!*pp_skip_space(pp_ep)) {
+        error("#if 后面缺少表达式");
+    }
+    v = pp_eval_cond();
+    if (*pp_skip_space(pp_ep)) {
+        error("#if 表达式有误: %s", out.data);
+    }
+    dynstring_free(&out);
+    return v != 0;
+}
+
+// 在输入流上读一个标识符, 用于跳过的分支里的指令名
+void pp_read_word(char *w, int size) {
+    int n = 0;
+
+    while (ch == ' ' || ch == '\t') {
+        getch();
+    }
+    while (is_nodigit(ch) || is_digit(ch)) {
+        if (n < size - 1) {
+            w[n++] = ch;
+        }
+        getch();
+    }
+    w[n] = '\0';
+}
+
+// 跳过条件为假的分支, 停在同一层的 #elif #else #endif 的指令名之后
+int pp_skip() {
+    int depth = 0, bol = 1;
+    char w[16], q;
+
+    while (ch != CH_EOF) {
+        if (ch == '\n') {
+            bol = 1;
             getch();
-            break;
-        case '*':
-            token = TK_STAR;
+        } else if (ch == ' ' || ch == '\t' || ch == '\r') {
             getch();
-            break;
-        case '\'':
-            parse_string(ch);
-            token = TK_CCHAR;
-            tkvalue = *(char *) tkstr.data;
-            break;
-        case '\"':
-            parse_string(ch);
-            token = TK_CSTR;
-            break;
-        case EOF:
-            token = TK_EOF;
-            break;
-        default:
-            error("understand this char: \\x%02x", ch);
+        } else if (ch == '/' && (src_peek() == '*' || src_peek() == '/')) {
             getch();
-            break;
+            bol = bol || ch == '/';
+            parse_comment();
+        } else if (ch == '\\' && src_peek() == '\n') {
+            getch();
+            getch();
+        } else if (ch == '#' && bol) {
+            getch();
+            pp_read_word(w, sizeof(w));
+            bol = 0;
+            if (!strcmp(w, "if") || !strcmp(w, "ifdef") || !strcmp(w, "ifndef")) {
+                depth++;
+            } else if (!strcmp(w, "endif")) {
+                if (!depth--) {
+                    return PP_ENDIF;
+                }
+            } else if (!depth && !strcmp(w, "else")) {
+                return PP_ELSE;
+            } else if (!depth && !strcmp(w, "elif")) {
+                return PP_ELIF;
+            }
+        } else if (ch == '"' || ch == '\'') {
+            q = ch;
+            getch();
+            while (ch != q && ch != '\n' && ch != CH_EOF) {
+                if (ch == '\\') {
+                    getch();
+                }
+                getch();
+            }
+            if (ch == q) {
+                getch();
+            }
+            bol = 0;
+        } else {
+            bol = 0;
+            getch();
+        }
+    }
+    error("#if 没有匹配的 #endif");
+    return PP_ENDIF;
+}
+
+void pp_endif() {
+    if (pp_conds[--pp_ncond].guard) {
+        src.guard_end = src_tell();
+    }
+}
+
+// 条件为假, 跳到被选中的分支或 #endif
+void pp_skip_branch() {
+    PpCond *c = &pp_conds[pp_ncond - 1];
+    int kind;
+
+    while (1) {
+        kind = pp_skip();
+        if (c->guard && kind != PP_ENDIF) {
+            src.guard = 0;
+        }
+        if (kind == PP_ENDIF) {
+            pp_read_line();
+            pp_endif();
+            return;
+        }
+        if (c->has_else) {
+            error("#else 之后不能再有 #%s", kind == PP_ELSE ? "else" : "elif");
+        }
+        pp_read_line();
+        if (kind == PP_ELSE) {
+            c->has_else = 1;
+        }
+        if (!c->taken && (kind == PP_ELSE || pp_eval(pp_line.data))) {
+            c->taken = 1;
+            return;
+        }
+    }
+}
+
+void pp_if(int cond, int guard) {
+    PpCond *c;
+
+    if (pp_ncond >= PP_MAX_COND) {
+        error("#if 嵌套太深");
+    }
+    c = &pp_conds[pp_ncond++];
+    c->taken = cond;
+    c->has_else = 0;
+    c->guard = guard;
+    if (!cond) {
+        pp_skip_branch();
+    }
+}
+
+// 按真实路径查缓存, 第一次包含时整个读入内存
+IncFile *pp_load(char *path) {
+    char real[PATH_MAX];
+    struct stat st;
+    IncFile *inc;
+    int fd;
+
+    if (!realpath(path, real)) {
+        return NULL;
+    }
+    for (inc = pp_incs; inc; inc = inc->next) {
+        if (!strcmp(inc->path, real)) {
+            return inc;
+        }
+    }
+    fd = open(real, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    inc = (IncFile *) mallocz(sizeof(IncFile), MEM_PP);
+    inc->path = mem_strdup(real, MEM_PP);
+    inc->name = mem_strdup(path, MEM_PP);
+    inc->data = (char *) mem_alloc(st.st_size + 1, MEM_PP);
+    if (read(fd, inc->data, st.st_size) != st.st_size) {
+        error("不能读包含文件 %s", path);
+    }
+    close(fd);
+    inc->size = inc->fsize = st.st_size;
+    inc->mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    inc->hash = hash64(inc->data, inc->size, 0);
+    if (!inc->size || inc->data[inc->size - 1] != '\n') {
+        inc->data[inc->size++] = '\n';
+    }
+    inc->next = pp_incs;
+    pp_incs = inc;
+    return inc;
+}
+
+// "file" 先在当前文件所在目录找, 再按 -I 的顺序找; <file> 只找 -I
+IncFile *pp_find_include(char *name, int quoted) {
+    char path[PATH_MAX * 2], *slash;
+    IncFile *inc;
+    int i;
+
+    if (name[0] == '/') {
+        return pp_load(name);
+    }
+    if (quoted) {
+        slash = strrchr(filename, '/');
+        snprintf(path, sizeof(path), "%.*s%s", slash ? (int) (slash - filename + 1) : 0, filename, name);
+        if ((inc = pp_load(path))) {
+            return inc;
+        }
+    }
+    for (i = 0; i < pp_ndirs; i++) {
+        snprintf(path, sizeof(path), "%s/%s", pp_dirs[i], name);
+        if ((inc = pp_load(path))) {
+            return inc;
+        }
+    }
+    return NULL;
+}
+
+void pp_include(char *p) {
+    char *end, name[PATH_MAX];
+    IncFile *inc;
+
+    p = pp_skip_space(p);
+    if (*p != '"' && *p != '<') {
+        error("#include 后面应是 \"文件\" 或 <文件>");
+    }
+    end = strchr(p + 1, *p == '"' ? '"' : '>');
+    if (!end || end - p - 1 >= PATH_MAX) {
+        error("#include 的文件名有误");
+    }
+    snprintf(name, sizeof(name), "%.*s", (int) (end - p - 1), p + 1);
+    inc = pp_find_include(name, *p == '"');
+    if (!inc) {
+        error("找不到包含文件 %s", name);
+    }
+    stats.pp_includes++;
+    if (inc->once || (inc->guard && ((TkWord *) tktable.data[inc->guard])->macro)) {
+        stats.pp_include_skips++;
+        return;
+    }
+    stats.pp_include_bytes += inc->size;
+    incr_mix(inc->data, inc->size);
+    src_push(inc->data, inc->size, 0, NULL, inc);
+}
+
+// ch 是行首的 '#'; 处理完停在行尾的换行符上
+void pp_directive() {
+    long long start = src_tell();
+    char *p, *w;
+    int n, def;
+    TkWord *tp;
+    PpCond *c;
+
+    stats.pp_directives++;
+    getch();
+    pp_read_line();
+    if (!pp_depth) {
+        incr_mix(pp_line.data, pp_line.count);
+    }
+    w = pp_skip_space(pp_line.data);
+    p = pp_skip_ident(w);
+    n = (int) (p - w);
+    if (n == 0) {
+        if (*w) {
+            error("不认识的预处理指令 #%s", w);
+        }
+    } else if (n == 6 && !strncmp(w, "define", n)) {
+        pp_define(p);
+    } else if (n == 7 && !strncmp(w, "include", n)) {
+        pp_include(p);
+    } else if (n == 5 && !strncmp(w, "undef", n)) {
+        p = pp_skip_space(p);
+        tp = pp_find(p, (int) (pp_skip_ident(p) - p));
+        if (tp) {
+            pp_undef_macro(tp);
+        }
+    } else if ((n == 5 && !strncmp(w, "ifdef", n)) || (n == 6 && !strncmp(w, "ifndef", n))) {
+        w = pp_skip_space(p);
+        p = pp_skip_ident(w);
+        if (w == p) {
+            error("#%s 后面应是宏名", n == 5 ? "ifdef" : "ifndef");
+        }
+        def = pp_defined(w, (int) (p - w));
+        // 文件开头的 #ifndef X 可能是包含保护, 到文件末尾再确认
+        if (n == 6 && src.inc && !src.guard && pp_ncond == src.cond_base && pp_blank(src.data, src.data + start)) {
+            src.guard = pp_insert(w, (int) (p - w))->tkcode;
+            pp_if(!def, 1);
+        } else {
+            pp_if(n == 5 ? def : !def, 0);
+        }
+    } else if (n == 2 && !strncmp(w, "if", n)) {
+        pp_if(pp_eval(p), 0);
+    } else if ((n == 4 && !strncmp(w, "elif", n)) || (n == 4 && !strncmp(w, "else", n))) {
+        if (pp_ncond <= src.cond_base) {
+            error("#%.*s 没有匹配的 #if", n, w);
+        }
+        c = &pp_conds[pp_ncond - 1];
+        if (c->has_else) {
+            error("#else 之后不能再有 #%.*s", n, w);
+        }
+        if (c->guard) {
+            src.guard = 0;
+        }
+        c->has_else = w[2] == 's';
+        // 已经选中了一个分支, 其余的都跳过
+        c->taken = 1;
+        pp_skip_branch();
+    } else if (n == 5 && !strncmp(w, "endif", n)) {
+        if (pp_ncond <= src.cond_base) {
+            error("#endif 没有匹配的 #if");
+        }
+        pp_endif();
+    } else if (n == 6 && !strncmp(w, "pragma", n)) {
+        p = pp_skip_space(p);
+        if (!strncmp(p, "once", 4) && src.inc) {
+            src.inc->once = 1;
+        }
+    } else if (n == 5 && !strncmp(w, "error", n)) {
+        error("#error%s", p);
+    } else if (n == 7 && !strncmp(w, "warning", n)) {
+        warning("#warning%s", p);
+    } else if (!(n == 4 && !strncmp(w, "line", n))) {
+        error("不认识的预处理指令 #%.*s", n, w);
+    }
+}
+
+void next_token() {
+    preprocess();
+    tok_loc = src_loc();
+    pp_bol = 0;
+    switch (ch) {
+        case 'a' :
+        case 'b' :
+        case 'c' :
+        case 'd' :
+        case 'e' :
+        case 'f' :
+        case 'g' :
+        case 'h' :
+        case 'i' :
+        case 'j' :
+        case 'k' :
+        case 'l' :
+        case 'm' :
+        case 'n' :
+        case 'o' :
+        case 'p' :
+        case 'q' :
+        case 'r' :
+        case 's' :
+        case 't' :
+        case 'u' :
+        case 'v' :
+        case 'w' :
+        case 'x' :
+        case 'y' :
+        case 'z' :
+        case 'A' :
+        case 'B' :
+        case 'C' :
+        case 'D' :
+        case 'E' :
+        case 'F' :
+        case 'G' :
+        case 'H' :
+        case 'I' :
+        case 'J' :
+        case 'K' :
+        case 'L' :
+        case 'M' :
+        case 'N' :
+        case 'O' :
+        case 'P' :
+        case 'Q' :
+        case 'R' :
+        case 'S' :
+        case 'T' :
+        case 'U' :
+        case 'V' :
+        case 'W' :
+        case 'X' :
+        case 'Y' :
+        case 'Z' :
+        case '_': {
+            TkWord *tp;
+            parse_identifier();
+            tp = tkWord_insert(tkstr.data);
+            if (tp->macro && !tp->macro->busy && pp_expand(tp)) {
+                next_token();
+                break;
+            }
+            token = tp->tkcode;
+            break;
+        }
+        case '0' :
+        case '1' :
+        case '2' :
+        case '3' :
+        case '4' :
+        case '5' :
+        case '6' :
+        case '7' :
+        case '8' :
+        case '9': {
+            parse_num();
+            token = TK_CINT;
+            break;
+        }
+        case '+':
+            getch();
+            token = TK_PLUS;
+            break;
+        case '-':
+            getch();
+            if (ch == '>') {
+                token = TK_POINTSTO;
+                getch();
+            } else {
+                token = TK_MINUS;
+            }
+            break;
+        case '/':
+            token = TK_DIVIDE;
+            getch();
+            break;
+        case '%':
+            token = TK_MOD;
+            getch();
+            break;
+        case '=':
+            getch();
+            if (ch == '=') {
+                token = TK_EQ;
+                getch();
+            } else {
+                token = TK_ASSIGN;
+            }
+            break;
+        case '!':
+            getch();
+            if (ch == '=') {
+                token = TK_NEQ;
+                getch();
+            } else {
+                error("now we can't support '!'");
+            }
+            break;
+        case '<':
+            getch();
+            if (ch == '=') {
+                token = TK_LEQ;
+                getch();
+            } else {
+                token = TK_LT;
+            }
+            break;
+        case '>':
+            getch();
+            if (ch == '=') {
+                token = TK_GEQ;
+                getch();
+            } else {
+                token = TK_GT;
+            }
+            break;
+        case '.':
+            getch();
+            if (ch == '.') {
+                getch();
+                if (ch != '.') {
+                    error("is '...' you want to write");
+                } else {
+                    token = TK_ELLIPSIS;
+                    getch();
+                }
+            } else {
+                token = TK_DOT;
+            }
+            break;
+        case '&':
+            token = TK_AND;
+            getch();
+            break;
+        case ';':
+            token = TK_SEMICOLON;
+            getch();
+            break;
+        case ':':
+            token = TK_COLON;
+            getch();
+            break;
+        case ']':
+            token = TK_CLOSEBR;
+            getch();
+            break;
+        case '}':
+            token = TK_END;
+            getch();
+            break;
+        case ')':
+            token = TK_CLOSEPA;
+            getch();
+            break;
+        case '[':
+            token = TK_OPENBR;
+            getch();
+            break;
+        case '{':
+            token = TK_BEGIN;
+            getch();
+            break;
+        case '(':
+            token = TK_OPENPA;
+            getch();
+            break;
+        case ',':
+            token = TK_COMMA;
+            getch();
+            break;
+        case '*':
+            token = TK_STAR;
+            getch();
+            break;
+        case '\'':
+            parse_string(ch);
+            token = TK_CCHAR;
+            tkvalue = *(char *) tkstr.data;
+            break;
+        case '\"':
+            parse_string(ch);
+            token = TK_CSTR;
+            break;
+        case EOF:
+            if (pp_ncond) {
+                error("#if 没有匹配的 #endif");
+            }
+            token = TK_EOF;
+            break;
+        default:
+            error("understand this char: \\x%02x", ch);
+            getch();
+            break;
+    }
+}
+
+void init_lex() {
+    TkWord *tp;
+    static TkWord keywords[] = {
+            {TK_PLUS,      NULL, "+",           NULL, NULL},
+            {TK_MINUS,     NULL, "-",           NULL, NULL},
+            {TK_STAR,      NULL, "*",           NULL, NULL},
+            {TK_DIVIDE,    NULL, "/",           NULL, NULL},
+            {TK_MOD,       NULL, "%",           NULL, NULL},
+            {TK_EQ,        NULL, "==",          NULL, NULL},
+            {TK_NEQ,       NULL, "!=",          NULL, NULL},
+            {TK_LT,        NULL, "<",           NULL, NULL},
+            {TK_LEQ,       NULL, "<=",          NULL, NULL},
+            {TK_GT,        NULL, ">",           NULL, NULL},
+            {TK_GEQ,       NULL, ">=",          NULL, NULL},
+            {TK_ASSIGN,    NULL, "=",           NULL, NULL},
+            {TK_POINTSTO,  NULL, "->",          NULL, NULL},
+            {TK_DOT,       NULL, ".",           NULL, NULL},
+            {TK_AND,       NULL, "&",           NULL, NULL},
+            {TK_OPENPA,    NULL, "(",           NULL, NULL},
+            {TK_CLOSEPA,   NULL, ")",           NULL, NULL},
+            {TK_OPENBR,    NULL, "[",           NULL, NULL},
+            {TK_CLOSEBR,   NULL, "]",           NULL, NULL},
+            {TK_BEGIN,     NULL, "{",           NULL, NULL},
+            {TK_END,       NULL, "}",           NULL, NULL},
+            {TK_SEMICOLON, NULL, ";",           NULL, NULL},
+            {TK_COLON,     NULL, ":",           NULL, NULL},
+            {TK_COMMA,     NULL, ",",           NULL, NULL},
+            {TK_ELLIPSIS,  NULL, "...",         NULL, NULL},
+            {TK_EOF,       NULL, "End_Of_File", NULL, NULL},
+
+            {TK_CINT,      NULL, "int",         NULL, NULL},
+            {TK_CCHAR,     NULL, "char",        NULL, NULL},
+            {TK_CSTR,      NULL, "string",      NULL, NULL},
+
+
+            {KW_CHAR,      NULL, "char",        NULL, NULL},
+            {KW_SHORT,     NULL, "short",       NULL, NULL},
+            {KW_INT,       NULL, "int",         NULL, NULL},
+            {KW_VOID,      NULL, "void",        NULL, NULL},
+            {KW_STRUCT,    NULL, "struct",      NULL, NULL},
+            {KW_IF,        NULL, "if",          NULL, NULL},
+            {KW_ELSE,      NULL, "else",        NULL, NULL},
+            {KW_FOR,       NULL, "for",         NULL, NULL},
+            {KW_CONTINUE,  NULL, "continue",    NULL, NULL},
+            {KW_BREAK,     NULL, "break",       NULL, NULL},
+            {KW_RETURN,    NULL, "return",      NULL, NULL},
+            {KW_SWITCH,    NULL, "switch",      NULL, NULL},
+            {KW_CASE,      NULL, "case",        NULL, NULL},
+            {KW_DEFAULT,   NULL, "default",     NULL, NULL},
+            {KW_SIZEOF,    NULL, "sizeof",      NULL, NULL},
+            {KW_CDECL,     NULL, "__cdecl",     NULL, NULL},
+            {KW_STDCALL,   NULL, "__stdcall",   NULL, NULL},
+            {KW_ALIGN,     NULL, "__align",     NULL, NULL},
+
+            {0,            NULL, NULL,          NULL, NULL},
+    };
+
+    dynArray_init(&tktable, 50, MEM_LEX);
+    for (tp = &keywords[0]; tp->spelling != NULL; tp++) {
+        tkWord_direct_insert(tp);
+    }
+}
+
+void preprocess() {
+    while (1) {
+        if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
+            skip_white_space();
+        } else if (ch == '/' && (src_peek() == '*' || src_peek() == '/')) {
+            getch();
+            parse_comment();
+        } else if (ch == '#' && pp_bol && !src.macro) {
+            tok_loc = src_loc();
+            pp_directive();
+        } else {
+            break;
+        }
+    }
+}
+
+void parse_comment() {
+    if (ch == '/') {
+        while (1) {
+            getch();
+            if (ch == '\n') {
+                pp_bol = 1;
+                getch();
+                return;
+            } else if (ch == CH_EOF) {
+                error("loss the right end-sign of '*/'");
+                return;
+            }
+        }
+    }
+    getch();
+    do {
+        do {
+            if (ch == '\n' || ch == '*' || (ch == CH_EOF)) {
+                break;
+            } else {
+                getch();
+            }
+        } while (1);
+        if (ch == '\n') {
+            getch();
+        } else if (ch == '*') {
+            getch();
+            if (ch == '/') {
+                getch();
+                return;
+            }
+        } else {
+            error("loss the right end-sign of '*/'");
+            return;
+        }
+    } while (1);
+}
+
+void skip_white_space() {
+    while (1) {
+        if (ch == ' ' || ch == '\t') {
+            getch();
+            continue;
+        }
+#if __APPLE__
+        if (ch == '\n') {
+            pp_bol = 1;
+            getch();
+            continue;
+        }
+#elif __linux__
+        if (ch == '\n') {
+            pp_bol = 1;
+            getch();
+            continue;
+        }
+#else
+        if (ch == '\r') {
+            getch();
+            if (ch != '\n') {
+                return;
+            }
+            pp_bol = 1;
+            getch();
+            continue;
+        }
+#endif
+        break;
+    }
+}
+
+int is_nodigit(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c == '_');
+}
+
+int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+void parse_identifier() {
+    dynstring_reset(&tkstr);
+    dynstring_chcat(&tkstr, ch);
+    getch();
+    while (is_nodigit(ch) || is_digit(ch)) {
+        dynstring_chcat(&tkstr, ch);
+        getch();
+    }
+    dynstring_chcat(&tkstr, '\0');
+}
+
+// SWAR: 一个 64 位字里的 8 个字符, 第一个字符在最低字节 (小端)
+// 8 个字符都是 '0'..'9': 高半字节是 3, 加 6 之后高半字节仍是 3
+int swar_is_digits8(unsigned long long x) {
+    return ((x & 0xF0F0F0F0F0F0F0F0ULL) | (((x + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+           == 0x3333333333333333ULL;
+}
+
+// 8 个数字字符的值: 相邻两位 两组 四组依次合并, 共三次乘法
+unsigned long long swar_digits8(unsigned long long x) {
+    x -= 0x3030303030303030ULL;
+    x = x * 10 + (x >> 8);
+    return ((x & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))
+            + ((x >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >> 32;
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+        return (c | 0x20) - 'a' + 10;
+    }
+    return -1;
+}
+
+// 整数常量: 十进制 0x十六进制 0八进制, 后缀 u/l; 直接累加数值, 不复制字符串
+// 十进制每次从输入缓冲区取 8 个字符用 SWAR 转换; 超出 32 位报错
+void parse_num() {
+    unsigned long long v = 0, x;
+    int base = 10, over = 0, u = 0, l = 0, d;
+
+    if (ch == '0') {
+        base = 8;
+        getch();
+        if (ch == 'x' || ch == 'X') {
+            base = 16;
+            getch();
+            if (hex_value(ch) < 0) {
+                error("十六进制常量缺少数字");
+            }
+        }
+    }
+    if (base == 10) {
+        while (is_digit(ch)) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            if (src_peek8(&x) && swar_is_digits8(x)) {
+                if (!over) {
+                    v = v * 100000000 + swar_digits8(x);
+                }
+                over |= v > 0xFFFFFFFFULL;
+                src.pos += 7;
+                getch();
+                continue;
+            }
+#endif
+            if (!over) {
+                v = v * 10 + ch - '0';
+            }
+            over |= v > 0xFFFFFFFFULL;
+            getch();
+        }
+    } else {
+        while ((d = hex_value(ch)) >= 0 && d < base) {
+            if (!over) {
+                v = v * base + d;
+            }
+            over |= v > 0xFFFFFFFFULL;
+            getch();
+        }
+        if (base == 8 && is_digit(ch)) {
+            error("八进制常量中有非法数字 '%c'", ch);
+        }
+    }
+    if (ch == '.') {
+        error("不支持浮点常量");
+    }
+    // 后缀 u 和 l (l L ll LL 之一, ll 须大小写相同且相邻) 各至多一个, 先后不限
+    while (ch == 'u' || ch == 'U' || ch == 'l' || ch == 'L') {
+        if ((ch | 0x20) == 'u' ? u++ : l++) {
+            error("整数常量的后缀有误");
+        }
+        d = ch;
+        getch();
+        if ((d | 0x20) == 'l' && ch == d) {
+            getch();
+        }
+    }
+    if (is_nodigit(ch) || is_digit(ch)) {
+        error("整数常量后面有非法字符 '%c'", ch);
+    }
+    if (over) {
+        error("整数常量溢出, 超出 32 位");
+    }
+    if (base == 10 && !u && v > 0x80000000ULL) {
+        // 0x80000000 本身留给 -2147483648
+        warning("整数常量超出 int 范围, 按 unsigned 处理");
+    }
+    tkvalue = (int) (unsigned int) v;
+}
+
+void parse_string(char sep) {
+    char c;
+    dynstring_reset(&tkstr);
+    dynstring_reset(&sourcestr);
+    dynstring_chcat(&sourcestr, sep);
+    getch();
+    while (1) {
+        if (ch == sep) {
+            break;
+        } else if (ch == '\\') {
+            // change mean
+            dynstring_chcat(&sourcestr, ch);
+            getch();
+            switch (ch) {
+                case '0':
+                    c = '\0';
+                    break;
+                case 'a':
+                    c = '\a';
+                    break;
+                case 'b':
+                    c = '\b';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'n':
+                    c = '\n';
+                    break;
+                case 'v':
+                    c = '\v';
+                    break;
+                case 'f':
+                    c = '\f';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case '\"':
+                    c = '\"';
+                    break;
+                case '\'':
+                    c = '\'';
+                    break;
+                case '\\':
+                    c = '\\';
+                    break;
+                default:
+                    c = ch;
+                    if (c >= '!' && c <= '~') {
+                        warning("it's illegal change mean: \'\\%c\'", c);
+                    } else {
+                        warning("it's illegal change mean: \'\\0x%x\'", c);
+                    }
+                    break;
+            }
+            dynstring_chcat(&tkstr, c);
+            dynstring_chcat(&sourcestr, ch);
+            getch();
+        } else {
+            dynstring_chcat(&tkstr, ch);
+            dynstring_chcat(&sourcestr, ch);
+            getch();
+        }
+    }
+    dynstring_chcat(&tkstr, '\0');
+    dynstring_chcat(&sourcestr, sep);
+    dynstring_chcat(&sourcestr, '\0');
+    getch();
+}
+
+int opt_run = 0, opt_dump = 0, opt_bench = 0, opt_verbose = 0;
+
+void init_codegen();
+
+// 编译服务器预先调用一次, 之后每个请求在 fork 出的子进程里直接沿用
+void init() {
+    static int inited = 0;
+
+    if (inited) {
+        return;
+    }
+    inited = 1;
+    init_lex();
+    init_codegen();
+}
+
+void cleanup() {
+    int i;
+    if (!opt_run) {
+        printf("\n tktable.count=%lld\n", tktable.count);
+    }
+    for (i = TK_IDENT; i < tktable.count; ++i) {
+        if (pch_owns(tktable.data[i])) {
+            continue;
+        }
+        mem_free(tktable.data[i], MEM_LEX);
+    }
+    mem_free(tktable.data, MEM_LEX);
+}
+
+// 句(语)法分析
+// 存储类型
+enum e_StorageClass {
+    SC_GLOBAL = 0x00f0,     // 常量 全局变量 函数
+    SC_LOCAL = 0x00f1,      // 栈中变量
+    SC_CMP = 0x00f3,        // 比较结果, 尚未写入寄存器
+    SC_VALMASK = 0x00ff,    // 存储类型掩码, 小于SC_GLOBAL时为寄存器号
+    SC_LVAL = 0x0100,       // 左值
+    SC_SYM = 0x0200,        // 模块符号
+
+    SC_PARAMS = 0x08000000, // 函数参数
+    SC_ANOM = 0x10000000,   // 匿名符号
+    SC_STRUCT = 0x20000000, // 结构体符号
+    SC_MEMBER = 0x40000000, // 结构成员变量
+};
+
+// 类型编码
+enum e_TypeCode {
+    T_INT = 0,
+    T_CHAR = 1,
+    T_SHORT = 2,
+    T_VOID = 3,
+    T_PTR = 4,
+    T_FUNC = 5,
+    T_STRUCT = 6,
+
+    T_BTYPE = 0x000f,
+    T_ARRAY = 0x0010,
+};
+
+#define ALIGN_SET 0x100
+#define PTR_SIZE 8
+
+// 符号表
+DynArray global_sym_stack, local_sym_stack;
+Type char_pointer_type, int_type, default_func_type;
+
+int sym_is_linked(int v) {
+    return (v & SC_STRUCT) || !(v & (SC_ANOM | SC_MEMBER | SC_PARAMS));
+}
+
+Symbol *sym_direct_push(DynArray *ss, int v, Type *type, int c) {
+    Symbol *s = (Symbol *) mallocz(sizeof(Symbol), MEM_SYMBOL);
+    s->v = v;
+    s->type.t = type->t;
+    s->type.ref = type->ref;
+    s->c = c;
+    dynArray_add(ss, s);
+    return s;
+}
+
+Symbol *sym_push(int v, Type *type, int r, int c) {
+    Symbol *ps, **pps;
+    TkWord *ts;
+    DynArray *ss;
+
+    if (local_sym_stack.count) {
+        ss = &local_sym_stack;
+    } else {
+        ss = &global_sym_stack;
+    }
+    ps = sym_direct_push(ss, v, type, c);
+    ps->r = r;
+    if (sym_is_linked(v)) {
+        ts = (TkWord *) tktable.data[v & ~SC_STRUCT];
+        if (v & SC_STRUCT) {
+            pps = &ts->sym_struct;
+        } else {
+            pps = &ts->sym_identifier;
+        }
+        ps->prev_tok = *pps;
+        *pps = ps;
+    }
+    return ps;
+}
+
+Symbol *sym_top(DynArray *ss) {
+    if (ss->count == 0) {
+        return NULL;
+    }
+    return (Symbol *) ss->data[ss->count - 1];
+}
+
+void sym_pop(DynArray *ss, Symbol *b) {
+    Symbol *s, **pps;
+    TkWord *ts;
+    int v;
+
+    while ((s = sym_top(ss)) != b && s != NULL) {
+        v = s->v;
+        if (sym_is_linked(v)) {
+            ts = (TkWord *) tktable.data[v & ~SC_STRUCT];
+            if (v & SC_STRUCT) {
+                pps = &ts->sym_struct;
+            } else {
+                pps = &ts->sym_identifier;
+            }
+            *pps = s->prev_tok;
+        }
+        // 结构体符号及其成员只出栈不释放: 类型结点以结构体符号的地址为键并缓存数组尺寸,
+        // 释放后分配在同一地址的新结构体会命中旧结点
+        if (!(v & (SC_STRUCT | SC_MEMBER))) {
+            mem_free(s, MEM_SYMBOL);
+        }
+        ss->count--;
+    }
+}
+
+Symbol *struct_search(int v) {
+    if (v >= tktable.count) {
+        return NULL;
+    }
+    return ((TkWord *) tktable.data[v])->sym_struct;
+}
+
+Symbol *sym_search(int v) {
+    if (v >= tktable.count) {
+        return NULL;
+    }
+    return ((TkWord *) tktable.data[v])->sym_identifier;
+}
+
+// 类型结点: 指针 数组 函数类型的 ref 指向全局唯一的结点, 同样的类型只建一次, 不随作用域释放;
+// 判断类型相同只比较 t 和 ref. 结点的 type 为指向/元素/返回类型, c 为数组长度 (指针为 -1) 或是否可变参数,
+// r 为调用约定, next 为不带名字的形参链; prev_tok 串起散列链. 数组的尺寸和对齐在元素类型完整后缓存
+typedef struct TypeNode {
+    Symbol s;
+    int size, align;        // align 为 0 表示尚未缓存
+    unsigned int hash;
+} TypeNode;
+
+Symbol **type_hash;         // 散列表, 结点数超过桶数时加倍
+int type_hash_cap;
+DynArray type_nodes;        // 按建立的顺序, 预编译头按序号引用初始化时建立的结点
+
+int calc_align(int n, int align) {
+    return (n + align - 1) & (~(align - 1));
+}
+
+// 基本类型的 ref 没有意义, 不参与比较
+int type_basic(Type *t) {
+    return (t->t & T_BTYPE) <= T_VOID;
+}
+
+int type_equal(Type *a, Type *b) {
+    return a->t == b->t && (type_basic(a) || a->ref == b->ref);
+}
+
+unsigned int type_hash_of(int t, Type *sub, int c, int r, Symbol *params) {
+    unsigned long long h = (unsigned int) t * 0x9e3779b97f4a7c15ULL;
+
+    for (;;) {
+        h = (h ^ (unsigned int) sub->t) * 0x100000001b3ULL;
+        h = (h ^ (type_basic(sub) ? 0 : (unsigned long long) sub->ref >> 4)) * 0x100000001b3ULL;
+        if (!params) {
+            break;
+        }
+        sub = &params->type;
+        params = params->next;
+    }
+    h = (h ^ (unsigned int) c ^ ((unsigned long long) (unsigned int) r << 32)) * 0x100000001b3ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    return (unsigned int) (h ^ (h >> 33));
+}
+
+int type_params_equal(Symbol *p, Symbol *q) {
+    for (; p && q; p = p->next, q = q->next) {
+        if (!type_equal(&p->type, &q->type)) {
+            return 0;
+        }
+    }
+    return p == q;
+}
+
+void type_link(Symbol *s) {
+    unsigned int h = ((TypeNode *) s)->hash & (type_hash_cap - 1);
+
+    s->prev_tok = type_hash[h];
+    type_hash[h] = s;
+}
+
+// 登记一个结点 (新建的或预编译头里的), 需要时扩大散列表
+void type_insert(Symbol *s) {
+    int i;
+
+    dynArray_add(&type_nodes, s);
+    if (type_nodes.count > type_hash_cap) {
+        if (type_hash) {
+            mem_free(type_hash, MEM_SYMBOL);
+        }
+        type_hash_cap = type_hash_cap ? type_hash_cap * 2 : 1024;
+        type_hash = (Symbol **) mallocz(sizeof(Symbol *) * type_hash_cap, MEM_SYMBOL);
+        for (i = 0; i < type_nodes.count - 1; i++) {
+            type_link(type_nodes.data[i]);
+        }
+    }
+    type_link(s);
+}
+
+// 查找或建立类型结点; t 为结点所表示类型的编码 (T_PTR, T_ARRAY | T_PTR, T_FUNC), 记在结点的 v 中
+// params 为形参链, 只比较类型, 新建时复制一份不带名字的
+Symbol *type_node(int t, Type *sub, int c, int r, Symbol *params) {
+    unsigned int h = type_hash_of(t, sub, c, r, params);
+    Symbol *s, **pp;
+    TypeNode *n;
+
+    stats.type_lookups++;
+    for (s = type_hash_cap ? type_hash[h & (type_hash_cap - 1)] : NULL; s; s = s->prev_tok) {
+        if (((TypeNode *) s)->hash == h && s->v == t && s->c == c && s->r == r && type_equal(&s->type, sub) && type_params_equal(s->next, params)) {
+            return s;
+        }
+    }
+    n = (TypeNode *) mallocz(sizeof(TypeNode), MEM_SYMBOL);
+    s = &n->s;
+    s->v = t;
+    s->r = r;
+    s->c = c;
+    s->type.t = sub->t;
+    s->type.ref = type_basic(sub) ? NULL : sub->ref;
+    for (pp = &s->next; params; params = params->next, pp = &(*pp)->next) {
+        *pp = (Symbol *) mallocz(sizeof(Symbol), MEM_SYMBOL);
+        (*pp)->v = SC_PARAMS;
+        (*pp)->type = params->type;
+    }
+    if (t == T_PTR || t == T_FUNC) {
+        n->size = t == T_PTR ? PTR_SIZE : 0;
+        n->align = t == T_PTR ? PTR_SIZE : 1;
+    }
+    n->hash = h;
+    type_insert(s);
+    stats.type_nodes++;
+    return s;
+}
+
+void mk_pointer(Type *t) {
+    t->ref = type_node(T_PTR, t, -1, 0, NULL);
+    t->t = T_PTR;
+}
+
+// n 个元素的数组, n 为 -1 表示长度未知
+void mk_array(Type *t, int n) {
+    t->ref = type_node(T_ARRAY | T_PTR, t, n, 0, NULL);
+    t->t = T_ARRAY | T_PTR;
+}
+
+void mk_func(Type *t, int fc, int variadic, Symbol *params) {
+    t->ref = type_node(T_FUNC, t, variadic, fc, params);
+    t->t = T_FUNC;
+}
+
+Type *pointed_type(Type *t) {
+    return &t->ref->type;
+}
+
+// 返回类型尺寸, a 返回对齐值; 尺寸未知时返回负数
+int type_size(Type *t, int *a) {
+    Symbol *s;
+    TypeNode *n;
+    int size;
+
+    switch (t->t & T_BTYPE) {
+        case T_STRUCT:
+            s = t->ref;
+            *a = s->r;
+            return s->c;
+        case T_PTR:
+            if (t->t & T_ARRAY) {
+                n = (TypeNode *) t->ref;
+                if (n->align) {
+                    *a = n->align;
+                    return n->size;
+                }
+                size = type_size(&n->s.type, a);
+                if (size < 0) {
+                    return -1;
+                }
+                size *= n->s.c;
+                if (size >= 0) {
+                    n->size = size;
+                    n->align = *a;
+                }
+                return size;
+            }
+            *a = PTR_SIZE;
+            return PTR_SIZE;
+        case T_INT:
+            *a = 4;
+            return 4;
+        case T_SHORT:
+            *a = 2;
+            return 2;
+        case T_CHAR:
+            *a = 1;
+            return 1;
+        default:
+            *a = 1;
+            return 0;
+    }
+}
+
+int pointed_size(Type *t) {
+    int align;
+    return type_size(pointed_type(t), &align);
+}
+
+// 字节码
+// 寄存器式字节码, 每条指令 op a b c; 跳转指令的目标统一放在 c
+//  MOVI   a b      r[a] = b                 MOV  a b     r[a] = r[b]
+//  ADD..  a b c    r[a] = r[b] op r[c]      ADDI a b c   r[a] = r[b] + c
+//  MULI   a b c    r[a] = r[b] * c          NEG  a b     r[a] = -r[b]
+//  EQ..GE a b c    r[a] = r[b] cmp r[c]
+//  LDn    a b c    r[a] = *(intn *)(r[b] + c)
+//  STn    a b c    *(intn *)(r[b] + c) = r[a]
+//  LDLn   a b      r[a] = *(intn *)(fp + b)   STLn a b    *(intn *)(fp + b) = r[a]
+//  LEAL   a b      r[a] = fp + b            LEAG a b c   r[a] = &sym[b] + c
+//  MCPY   a b c    memcpy(r[a], r[b], c)
+//  JMP    c        JZ/JNZ a c               Jcc a b c    if (r[a] cmp r[b]) goto c
+//  JccI   a b c    if (r[a] cmp b) goto c
+//  CALL   a b c    r[a-1] = sym[b](r[a] .. r[a+c-1])
+//  CALLI  a b c    r[a-1] = (*r[b])(r[a] .. r[a+c-1])
+//  RET    a        RETV
+//  TCALL  a b c    TCALLI a b c  同 CALL/CALLI, 被调函数换掉当前帧, 返回值直接交给调用者的调用者 (尾调用)
+//  ADDL4  a b c    r[a] = r[b] + *(int *)(fp + c)  (load-add)
+//  SX1 SX2  a b    r[a] = (char) r[b] / (short) r[b]  (返回值截断到返回类型)
+//  AND    a b c    r[a] = r[b] & r[c]
+// 打包指令 (向量化), 向量寄存器 va 为 r[a] r[a+1] 两个寄存器共 16 字节, 按 n 字节的元素逐个运算:
+//  VLD    a b c    va = 16 字节 *(r[b] + c)     VST a b c    16 字节 *(r[b] + c) = va
+//  PADDn PSUBn PMULn  a b c    va = vb op vc    PSPLATn a b  va 的每个元素 = (intn) r[b]
+//  PAND   a b c    va = vb & vc  (按位运算, 与元素宽度无关)
+//  PROF   b c      ((long long *) &sym[b])[c] += 1  (插桩的计数器)
+//  JTAB   a b c    跳转表: k = r[a] - b, 0 <= k < 表长时 goto 其后第 k 条 JTE 的 c, 否则 goto c
+//  JTE    b c      跳转表的一项, b 为表长; 只由 JTAB 取用, 不会执行到
+#define OPCODES(_) \
+    _(NOP) _(MOVI) _(MOV) \
+    _(ADD) _(SUB) _(MUL) _(DIV) _(MOD) _(ADDI) _(MULI) _(NEG) \
+    _(EQ) _(NE) _(LT) _(LE) _(GT) _(GE) \
+    _(LD1) _(LD2) _(LD4) _(LD8) _(ST1) _(ST2) _(ST4) _(ST8) \
+    _(LDL1) _(LDL2) _(LDL4) _(LDL8) _(STL1) _(STL2) _(STL4) _(STL8) \
+    _(LEAL) _(LEAG) _(MCPY) \
+    _(JMP) _(JZ) _(JNZ) \
+    _(JEQ) _(JNE) _(JLT) _(JLE) _(JGT) _(JGE) \
+    _(JEQI) _(JNEI) _(JLTI) _(JLEI) _(JGTI) _(JGEI) \
+    _(CALL) _(CALLI) _(RET) _(RETV) \
+    _(ADDL4) \
+    _(VLD) _(VST) _(PADD1) _(PADD2) _(PADD4) _(PSUB1) _(PSUB2) _(PSUB4) \
+    _(PMUL1) _(PMUL2) _(PMUL4) _(PSPLAT1) _(PSPLAT2) _(PSPLAT4) \
+    _(PROF) _(TCALL) _(TCALLI) _(JTAB) _(JTE) _(SX1) _(SX2) _(AND) _(PAND)
+
+#define OP_ENUM(name) OP_##name,
+#define OP_NAME(name) #name,
+
+enum e_OpCode {
+    OPCODES(OP_ENUM)
+    OP_COUNT
+};
+
+char *op_names[] = {OPCODES(OP_NAME)};
+
+typedef struct Insn {
+    unsigned short op;
+    unsigned short a;
+    int b;
+    int c;
+} Insn;
+
+typedef long long (*NativeFunc)(long long *args, int nargs);
+
+// 指令的源位置: 每个语句开始处记一项, 指令取它之前最近的一项; 只在 -inline-report -vec-report 时记录
+typedef struct InsnLoc {
+    int pos;
+    SrcLoc loc;
+} InsnLoc;
+
+int opt_insn_locs = 0;
+
+typedef struct BcFunc {
+    char *name;
+    int nparams;
+    int nregs;
+    int frame_size;         // 局部变量区字节数
+    int frame_words;        // 寄存器 + 局部变量区, 8字节为单位
+    Insn *code;
+    int ncode;
+    int capcode;
+    NativeFunc native;
+    int flags;              // LF_xxx, 内联时判断能否展开; -flto 时随目标文件带到链接时
+    int nprof;              // 插桩的计数器个数, 窥孔优化删去的计数器也算在内
+    InsnLoc *locs;          // 按指令序号有序, 改动指令位置的优化随之修正
+    int nlocs, caplocs;
+} BcFunc;
+
+enum e_BcFuncFlag {
+    LF_PROTO = 1,           // 有函数符号 (不是只在别处声明的外部函数)
+    LF_VARIADIC = 2,
+    LF_STDCALL = 4,
+};
+
+enum e_BcSymKind {
+    BS_UNDEF,
+    BS_FUNC,
+    BS_DATA,
+    BS_RODATA,
+};
+
+// 模块符号: 函数 全局变量 字符串常量
+typedef struct BcSym {
+    char *name;
+    int kind;
+    int offset;             // data/rodata 段偏移
+    int size;
+    int align;
+    int common;             // 无初值的全局变量, 链接时可与同名变量合并
+    BcFunc *func;
+} BcSym;
+
+typedef struct BcModule {
+    DynArray syms;
+    DynString data;         // 全局变量初值
+    DynString rodata;       // 字符串常量
+    BcFunc *init;           // 全局变量初始化代码
+} BcModule;
+
+BcModule module;
+BcFunc *cur_func;
+Type func_ret_type;         // 正在编译的函数的返回类型
+int loc;
+int loc_max;                // 已结束的语句块里局部变量区的最大长度, 兄弟语句块的局部变量共用同一段
+
+BcFunc *bc_func_new(char *name) {
+    BcFunc *f = (BcFunc *) mallocz(sizeof(BcFunc), MEM_CODE);
+    f->name = name;
+    f->capcode = 16;
+    f->code = (Insn *) mem_alloc(sizeof(Insn) * f->capcode, MEM_CODE);
+    return f;
+}
+
+int bc_sym_add(char *name, int kind) {
+    BcSym *s = (BcSym *) mallocz(sizeof(BcSym), MEM_MODULE);
+    s->name = name;
+    s->kind = kind;
+    dynArray_add(&module.syms, s);
+    return module.syms.count - 1;
+}
+
+BcSym *bc_sym(int i) {
+    return (BcSym *) module.syms.data[i];
+}
+
+int section_alloc(DynString *sec, int size, int align) {
+    int offset = calc_align(sec->count, align);
+    int need = offset + size;
+
+    while (need >= sec->capacity * 0.75) {
+        dynstring_realloc(sec, sec->capacity * 2);
+    }
+    memset(sec->data + sec->count, 0, need - sec->count);
+    sec->count = need;
+    return offset;
+}
+
+// 字符串常量池: 内容相同的字符串常量共用一个模块符号, 散列表项记散列值和模块符号序号 + 1, 0 表示空位;
+// 编译结束时按逆序的内容排序, 是另一个串后缀的 ("bar" 与 "foobar") 指向其尾部, 重新排布 .rodata
+typedef struct StrSlot {
+    unsigned int hash;
+    int sym;
+} StrSlot;
+
+StrSlot *str_table;
+int str_cap, str_count;
+
+unsigned int str_hash(char *p, int size) {
+    return (unsigned int) hash64(p, size, 0x5354);
+}
+
+void str_pool_grow() {
+    StrSlot *old = str_table;
+    int cap = str_cap, i, j;
+
+    str_cap = cap ? cap * 2 : 1024;
+    str_table = (StrSlot *) mallocz(sizeof(StrSlot) * str_cap, MEM_MODULE);
+    for (i = 0; i < cap; i++) {
+        if (old[i].sym) {
+            for (j = old[i].hash & (str_cap - 1); str_table[j].sym; j = (j + 1) & (str_cap - 1));
+            str_table[j] = old[i];
+        }
+    }
+    if (old) {
+        mem_free(old, MEM_MODULE);
+    }
+}
+
+// 登记一个字符串常量 (含结尾的 '\0'), 返回模块符号序号
+int str_pool_add(char *p, int size) {
+    BcSym *bs;
+    unsigned int h = str_hash(p, size);
+    int i, addr;
+
+    stats.str_literals++;
+    if (str_count * 2 >= str_cap) {
+        str_pool_grow();
+    }
+    for (i = h & (str_cap - 1); str_table[i].sym; i = (i + 1) & (str_cap - 1)) {
+        if (str_table[i].hash != h) {
+            continue;
+        }
+        bs = bc_sym(str_table[i].sym - 1);
+        if (bs->size == size && !memcmp(module.rodata.data + bs->offset, p, size)) {
+            return str_table[i].sym - 1;
+        }
+    }
+    addr = bc_sym_add(NULL, BS_RODATA);
+    bs = bc_sym(addr);
+    bs->size = size;
+    bs->offset = section_alloc(&module.rodata, size, 1);
+    memcpy(module.rodata.data + bs->offset, p, size);
+    str_table[i].hash = h;
+    str_table[i].sym = addr + 1;
+    str_count++;
+    return addr;
+}
+
+// 排序键: 末尾 8 个字节倒过来拼成整数, 大多数比较不用回到 .rodata 里去
+typedef struct StrKey {
+    unsigned long long tail;
+    int sym;
+} StrKey;
+
+// 从末尾往前比较; 一个串是另一个的后缀时排在它前面
+int str_rcmp(const void *x, const void *y) {
+    StrKey *ka = (StrKey *) x, *kb = (StrKey *) y;
+    BcSym *a, *b;
+    unsigned char *p, *q;
+    int n, i;
+
+    if (ka->tail != kb->tail) {
+        return ka->tail < kb->tail ? -1 : 1;
+    }
+    a = bc_sym(ka->sym);
+    b = bc_sym(kb->sym);
+    p = (unsigned char *) module.rodata.data + a->offset + a->size;
+    q = (unsigned char *) module.rodata.data + b->offset + b->size;
+    n = a->size < b->size ? a->size : b->size;
+    for (i = 1; i <= n; i++) {
+        if (p[-i] != q[-i]) {
+            return p[-i] - q[-i];
+        }
+    }
+    return a->size - b->size;
+}
+
+// 按排序键做 8 趟基数排序, 键相同的一段再用 str_rcmp 细排
+void str_sort(StrKey *keys, int n) {
+    StrKey *tmp = (StrKey *) mem_alloc(sizeof(StrKey) * (n + 1), MEM_MODULE), *from = keys, *to = tmp, *t;
+    int count[256], pass, i, j, sum;
+
+    for (pass = 0; pass < 8; pass++) {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; i++) {
+            count[(from[i].tail >> (pass * 8)) & 255]++;
+        }
+        for (i = 0, sum = 0; i < 256; i++) {
+            j = count[i];
+            count[i] = sum;
+            sum += j;
+        }
+        for (i = 0; i < n; i++) {
+            to[count[(from[i].tail >> (pass * 8)) & 255]++] = from[i];
+        }
+        t = from;
+        from = to;
+        to = t;
+    }
+    // 趟数为偶数, 结果已在 keys 里
+    for (i = 0; i < n; i = j) {
+        for (j = i + 1; j < n && keys[j].tail == keys[i].tail; j++);
+        if (j - i > 1) {
+            qsort(keys + i, j - i, sizeof(StrKey), str_rcmp);
+        }
+    }
+    mem_free(tmp, MEM_MODULE);
+}
+
+// 后缀合并: 排序后一个串若是下一个串的后缀, 就是下一个串所在的最长串的后缀; 从后往前排布
+void str_pool_finish() {
+    StrKey *keys;
+    int *idx, *host, n = 0, i, j, off;
+    BcSym *a, *b;
+    DynString pool;
+
+    keys = (StrKey *) mem_alloc(sizeof(StrKey) * (module.syms.count + 1), MEM_MODULE);
+    for (i = 0; i < module.syms.count; i++) {
+        a = bc_sym(i);
+        if (a->kind == BS_RODATA) {
+            keys[n].tail = 0;
+            for (j = 1; j <= 8; j++) {
+                keys[n].tail = keys[n].tail << 8
+                               | (j <= a->size ? (unsigned char) module.rodata.data[a->offset + a->size - j] : 0);
+            }
+            keys[n++].sym = i;
+        }
+    }
+    str_sort(keys, n);
+    idx = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_MODULE);
+    host = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_MODULE);
+    for (i = 0; i < n; i++) {
+        idx[i] = keys[i].sym;
+    }
+    mem_free(keys, MEM_MODULE);
+    dynstring_init(&pool, module.rodata.count + 8, MEM_MODULE);
+    for (i = n - 1; i >= 0; i--) {
+        a = bc_sym(idx[i]);
+        b = i + 1 < n ? bc_sym(host[i + 1]) : NULL;
+        if (b && a->size <= b->size
+            && !memcmp(module.rodata.data + a->offset, module.rodata.data + b->offset + b->size - a->size, a->size)) {
+            host[i] = host[i + 1];
+            stats.str_merged++;
+        } else {
+            host[i] = idx[i];
+        }
+    }
+    // 先放各个最长串, 再让并入的串指向其尾部
+    for (i = n - 1; i >= 0; i--) {
+        if (host[i] == idx[i]) {
+            a = bc_sym(idx[i]);
+            off = section_alloc(&pool, a->size, 1);
+            memcpy(pool.data + off, module.rodata.data + a->offset, a->size);
+            a->offset = off;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        if (host[i] != idx[i]) {
+            a = bc_sym(idx[i]);
+            b = bc_sym(host[i]);
+            a->offset = b->offset + b->size - a->size;
+        }
+    }
+    stats.str_unique = n;
+    stats.str_bytes = module.rodata.count;
+    stats.str_pool_bytes = pool.count;
+    dynstring_free(&module.rodata);
+    module.rodata = pool;
+    mem_free(idx, MEM_MODULE);
+    mem_free(host, MEM_MODULE);
+}
+
+int gen_insn(int op, int a, int b, int c) {
+    BcFunc *f = cur_func;
+    Insn *p;
+
+    if (f->ncode >= f->capcode) {
+        f->capcode *= 2;
+        p = (Insn *) mem_realloc(f->code, sizeof(Insn) * f->capcode, MEM_CODE);
+        f->code = p;
+    }
+    p = &f->code[f->ncode];
+    p->op = op;
+    p->a = a;
+    p->b = b;
+    p->c = c;
+    return f->ncode++;
+}
+
+// 此后生成的指令来自 loc 处的语句; 同一位置先记的是外层语句, 留后记的
+void insn_loc(SrcLoc loc) {
+    BcFunc *f = cur_func;
+
+    if (!opt_insn_locs || !loc) {
+        return;
+    }
+    src_pin(loc);
+    if (f->nlocs && f->locs[f->nlocs - 1].pos == f->ncode) {
+        f->locs[f->nlocs - 1].loc = loc;
+        return;
+    }
+    if (f->nlocs == f->caplocs) {
+        f->caplocs = f->caplocs * 2 + 16;
+        f->locs = (InsnLoc *) mem_realloc(f->locs, sizeof(InsnLoc) * f->caplocs, MEM_CODE);
+    }
+    f->locs[f->nlocs].pos = f->ncode;
+    f->locs[f->nlocs++].loc = loc;
+}
+
+// 指令重排或删除后按新旧位置对照表修正, newpos 含原长度一项; 位置相同的留后面的
+void insn_loc_remap(BcFunc *f, int *newpos) {
+    InsnLoc t;
+    int i, j, k;
+
+    for (i = 0; i < f->nlocs; i++) {
+        f->locs[i].pos = newpos[f->locs[i].pos];
+    }
+    for (i = 1; i < f->nlocs; i++) {
+        t = f->locs[i];
+        for (j = i; j > 0 && f->locs[j - 1].pos > t.pos; j--) {
+            f->locs[j] = f->locs[j - 1];
+        }
+        f->locs[j] = t;
+    }
+    for (i = k = 0; i < f->nlocs; i++) {
+        if (k && f->locs[k - 1].pos == f->locs[i].pos) {
+            k--;
+        }
+        f->locs[k++] = f->locs[i];
+    }
+    f->nlocs = k;
+}
+
+// 指令 i 的源位置 "文件:行", 不知道时返回 NULL
+char *insn_where(BcFunc *f, int i) {
+    static char buf[PATH_MAX + 32];
+    long long line, col;
+    char *name;
+    int lo = 0, hi = f->nlocs - 1, mid;
+
+    if (!f->nlocs || f->locs[0].pos > i) {
+        return NULL;
+    }
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (f->locs[mid].pos <= i) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (!src_where(f->locs[lo].loc, &name, &line, &col)) {
+        return NULL;
+    }
+    snprintf(buf, sizeof(buf), "%s:%lld", name, line);
+    return buf;
+}
+
+// 代码生成
+// 操作数栈: 第n个操作数固定使用寄存器n, 需要时才生成装入指令
+typedef struct Operand {
+    Type type;
+    int r;                  // 存储类型 | SC_LVAL | SC_SYM
+    int value;              // 常量值 / 栈偏移 / 地址偏移 / 比较的立即数
+    int sym;                // SC_SYM 的模块符号索引
+    int cmp;                // SC_CMP 的比较运算
+} Operand;
+
+#define OPSTACK_SIZE 256
+#define CMP_IMM 0x100
+
+Operand opstack[OPSTACK_SIZE];
+Operand *optop = opstack - 1;
+
+int opd_reg(Operand *opd) {
+    return (int) (opd - opstack);
+}
+
+int is_const(Operand *opd) {
+    return (opd->r & (SC_VALMASK | SC_LVAL | SC_SYM)) == SC_GLOBAL;
+}
+
+void load_1(Operand *opd);
+
+void operand_push(Type *type, int r, int value) {
+    if (optop >= opstack + OPSTACK_SIZE - 3) {
+        error("表达式过于复杂");
+    }
+    if (optop >= opstack && (optop->r & SC_VALMASK) == SC_CMP) {
+        load_1(optop);
+    }
+    optop++;
+    optop->type = *type;
+    optop->r = r;
+    optop->value = value;
+    optop->sym = 0;
+    optop->cmp = 0;
+    if (opd_reg(optop) + 2 > cur_func->nregs) {
+        cur_func->nregs = opd_reg(optop) + 2;
+    }
+}
+
+void operand_push_sym(Symbol *s) {
+    if (s->r & SC_SYM) {
+        operand_push(&s->type, s->r, 0);
+        optop->sym = s->c;
+    } else {
+        operand_push(&s->type, s->r, s->c);
+    }
+}
+
+void operand_pop() {
+    optop--;
+}
+
+int mem_op(int base, int size) {
+    switch (size) {
+        case 1:
+            return base;
+        case 2:
+            return base + 1;
+        case 4:
+            return base + 2;
+        default:
+            return base + 3;
+    }
+}
+
+// 把操作数的值装入它自己的寄存器
+void load_1(Operand *opd) {
+    int d = opd_reg(opd), v = opd->r & SC_VALMASK, size, align;
+
+    if ((opd->type.t & T_BTYPE) == T_STRUCT) {
+        // 结构体以地址表示
+        opd->r &= ~SC_LVAL;
+    }
+    if (opd->r & SC_LVAL) {
+        size = type_size(&opd->type, &align);
+        if (v == SC_LOCAL) {
+            gen_insn(mem_op(OP_LDL1, size), d, opd->value, 0);
+        } else if (v == SC_GLOBAL) {
+            gen_insn(OP_LEAG, d, opd->sym, opd->value);
+            gen_insn(mem_op(OP_LD1, size), d, d, 0);
+        } else {
+            gen_insn(mem_op(OP_LD1, size), d, v, opd->value);
+        }
+    } else if (v == SC_CMP) {
+        if (opd->cmp & CMP_IMM) {
+            gen_insn(OP_MOVI, d + 1, opd->value, 0);
+        }
+        gen_insn(OP_EQ + ((opd->cmp & ~CMP_IMM) - TK_EQ), d, d, d + 1);
+    } else if (v == SC_LOCAL) {
+        gen_insn(OP_LEAL, d, opd->value, 0);
+    } else if (v == SC_GLOBAL) {
+        if (opd->r & SC_SYM) {
+            gen_insn(OP_LEAG, d, opd->sym, opd->value);
+        } else {
+            gen_insn(OP_MOVI, d, opd->value, 0);
+        }
+    } else if (opd->value) {
+        gen_insn(OP_ADDI, d, v, opd->value);
+    } else if (v != d) {
+        gen_insn(OP_MOV, d, v, 0);
+    }
+    opd->r = d;
+    opd->value = 0;
+}
+
+void check_lvalue() {
+    if (!(optop->r & SC_LVAL)) {
+        expect("左值");
+    }
+}
+
+void cancel_lvalue() {
+    check_lvalue();
+    optop->r &= ~SC_LVAL;
+}
+
+void indirection() {
+    if ((optop->type.t & T_BTYPE) != T_PTR) {
+        if ((optop->type.t & T_BTYPE) == T_FUNC) {
+            return;
+        }
+        expect("指针");
+    }
+    if ((optop->r & SC_LVAL) || is_const(optop)) {
+        load_1(optop);
+    }
+    optop->type = *pointed_type(&optop->type);
+    if (!(optop->type.t & T_ARRAY) && (optop->type.t & T_BTYPE) != T_FUNC) {
+        optop->r |= SC_LVAL;
+    }
+}
+
+// 整数运算, 操作数为栈顶两个
+void gen_opi(int op) {
+    Operand *a = optop - 1, *b = optop;
+    int d = opd_reg(a), x, y;
+
+    if (is_const(a) && is_const(b)) {
+        x = a->value;
+        y = b->value;
+        switch (op) {
+            case TK_PLUS: x += y; break;
+            case TK_MINUS: x -= y; break;
+            case TK_STAR: x *= y; break;
+            case TK_AND: x &= y; break;
+            case TK_DIVIDE:
+            case TK_MOD:
+                if (y == 0) {
+                    error("除数为零");
+                }
+                // 按 64 位算再截断, 与虚拟机一致; INT_MIN / -1 在 int 上会让编译器自己溢出出错
+                x = (int) (op == TK_DIVIDE ? (long long) x / y : (long long) x % y);
+                break;
+            case TK_EQ: x = x == y; break;
+            case TK_NEQ: x = x != y; break;
+            case TK_LT: x = x < y; break;
+            case TK_LEQ: x = x <= y; break;
+            case TK_GT: x = x > y; break;
+            case TK_GEQ: x = x >= y; break;
+        }
+        a->type = int_type;
+        a->value = x;
+        operand_pop();
+        return;
+    }
+    load_1(a);
+    if (op >= TK_EQ && op <= TK_GEQ) {
+        if (is_const(b)) {
+            a->value = b->value;
+            a->cmp = op | CMP_IMM;
+        } else {
+            load_1(b);
+            a->cmp = op;
+        }
+        a->r = SC_CMP;
+    } else if (is_const(b) && (op == TK_PLUS || op == TK_MINUS)) {
+        gen_insn(OP_ADDI, d, d, op == TK_PLUS ? b->value : -b->value);
+    } else if (is_const(b) && op == TK_STAR) {
+        gen_insn(OP_MULI, d, d, b->value);
+    } else if (op == TK_PLUS && b->r == (SC_LOCAL | SC_LVAL) && (b->type.t & T_BTYPE) == T_INT
+               && !(b->type.t & T_ARRAY)) {
+        gen_insn(OP_ADDL4, d, d, b->value);
+    } else {
+        load_1(b);
+        switch (op) {
+            case TK_PLUS: gen_insn(OP_ADD, d, d, d + 1); break;
+            case TK_MINUS: gen_insn(OP_SUB, d, d, d + 1); break;
+            case TK_STAR: gen_insn(OP_MUL, d, d, d + 1); break;
+            case TK_DIVIDE: gen_insn(OP_DIV, d, d, d + 1); break;
+            case TK_MOD: gen_insn(OP_MOD, d, d, d + 1); break;
+            case TK_AND: gen_insn(OP_AND, d, d, d + 1); break;
+        }
+    }
+    a->type = int_type;
+    operand_pop();
+}
+
+void gen_op(int op) {
+    Operand *a = optop - 1, *b = optop;
+    int bt1 = a->type.t & T_BTYPE, bt2 = b->type.t & T_BTYPE, d = opd_reg(a), size;
+    Type type;
+
+    if (bt1 == T_STRUCT || bt2 == T_STRUCT || bt1 == T_VOID || bt2 == T_VOID) {
+        error("操作数类型不能参与运算");
+    }
+    if (bt1 != T_PTR && bt2 != T_PTR) {
+        gen_opi(op);
+        return;
+    }
+    if (op >= TK_EQ && op <= TK_GEQ) {
+        gen_opi(op);
+        return;
+    }
+    if (bt1 == T_PTR && bt2 == T_PTR) {
+        if (op != TK_MINUS) {
+            error("指针之间只能相减");
+        }
+        size = pointed_size(&a->type);
+        gen_opi(TK_MINUS);
+        if (size > 1) {
+            operand_push(&int_type, SC_GLOBAL, size);
+            gen_opi(TK_DIVIDE);
+        }
+        return;
+    }
+    if (op != TK_PLUS && op != TK_MINUS) {
+        error("指针只能进行加减运算");
+    }
+    if (bt2 == T_PTR) {
+        // 整数 + 指针
+        if (op == TK_MINUS) {
+            error("整数不能减指针");
+        }
+        type = b->type;
+        size = pointed_size(&type);
+        load_1(a);
+        if (size > 1) {
+            gen_insn(OP_MULI, d, d, size);
+        }
+        load_1(b);
+        gen_insn(OP_ADD, d, d, d + 1);
+    } else {
+        type = a->type;
+        size = pointed_size(&type);
+        if (a->r & SC_LVAL) {
+            load_1(a);
+        }
+        if (is_const(b)) {
+            // 地址形式的操作数直接累加偏移
+            a->value += (op == TK_PLUS ? b->value : -b->value) * size;
+        } else {
+            if ((a->r & SC_VALMASK) >= SC_GLOBAL) {
+                load_1(a);
+            }
+            load_1(b);
+            if (size > 1) {
+                gen_insn(OP_MULI, d + 1, d + 1, size);
+            }
+            gen_insn(op == TK_PLUS ? OP_ADD : OP_SUB, d, a->r & SC_VALMASK, d + 1);
+            a->r = d;
+        }
+    }
+    if (type.t & T_ARRAY) {
+        type = *pointed_type(&type);
+        mk_pointer(&type);
+    }
+    a->type = type;
+    operand_pop();
+}
+
+void gen_neg() {
+    if (is_const(optop)) {
+        optop->value = -optop->value;
+        return;
+    }
+    load_1(optop);
+    gen_insn(OP_NEG, opd_reg(optop), opd_reg(optop), 0);
+    optop->type = int_type;
+}
+
+// 赋值: 次栈顶为左值, 栈顶为右值; 结果保留左值
+void store0_1() {
+    Operand *a = optop - 1, *b = optop;
+    int d = opd_reg(a), v, size, align;
+
+    if (!(a->r & SC_LVAL)) {
+        expect("左值");
+    }
+    size = type_size(&a->type, &align);
+    if ((a->type.t & T_BTYPE) == T_STRUCT) {
+        if (!type_equal(&a->type, &b->type)) {
+            error("结构体类型不匹配");
+        }
+        load_1(b);
+        load_1(a);
+        gen_insn(OP_MCPY, d, d + 1, size);
+        a->r |= SC_LVAL;
+    } else {
+        load_1(b);
+        v = a->r & SC_VALMASK;
+        if (v == SC_LOCAL) {
+            gen_insn(mem_op(OP_STL1, size), d + 1, a->value, 0);
+        } else if (v == SC_GLOBAL) {
+            gen_insn(OP_LEAG, d, a->sym, a->value);
+            gen_insn(mem_op(OP_ST1, size), d + 1, d, 0);
+            a->r = d | SC_LVAL;
+            a->value = 0;
+        } else {
+            gen_insn(mem_op(OP_ST1, size), d + 1, v, a->value);
+        }
+    }
+    operand_pop();
+}
+
+int cmp_negate(int op) {
+    switch (op) {
+        case TK_EQ: return TK_NEQ;
+        case TK_NEQ: return TK_EQ;
+        case TK_LT: return TK_GEQ;
+        case TK_GEQ: return TK_LT;
+        case TK_LEQ: return TK_GT;
+        default: return TK_LEQ;
+    }
+}
+
+// 生成条件跳转, inv为0时条件为假跳转, 为1时条件为真跳转; 返回跳转链
+int gen_jcc(int t, int inv) {
+    Operand *opd = optop;
+    int d = opd_reg(opd), c;
+
+    if ((opd->r & SC_VALMASK) == SC_CMP) {
+        c = opd->cmp & ~CMP_IMM;
+        if (!inv) {
+            c = cmp_negate(c);
+        }
+        if (opd->cmp & CMP_IMM) {
+            t = gen_insn(OP_JEQI + (c - TK_EQ), d, opd->value, t);
+        } else {
+            t = gen_insn(OP_JEQ + (c - TK_EQ), d, d + 1, t);
+        }
+    } else if (is_const(opd)) {
+        if ((opd->value != 0) == inv) {
+            t = gen_insn(OP_JMP, 0, 0, t);
+        }
+    } else {
+        load_1(opd);
+        t = gen_insn(inv ? OP_JNZ : OP_JZ, d, 0, t);
+    }
+    operand_pop();
+    return t;
+}
+
+int gen_jmpforward(int t) {
+    return gen_insn(OP_JMP, 0, 0, t);
+}
+
+void gen_jmpbackward(int a) {
+    gen_insn(OP_JMP, 0, 0, a);
+}
+
+void backpatch(int t, int a) {
+    int n;
+    while (t != -1) {
+        n = cur_func->code[t].c;
+        cur_func->code[t].c = a;
+        t = n;
+    }
+}
+
+// sym 为函数符号, 形参的名字和类型取自它的 next 链
+void gen_prolog(Symbol *sym) {
+    Symbol *p;
+    int n = 0, size, align;
+
+    for (p = sym->next; p; p = p->next) {
+        n++;
+    }
+    cur_func->nparams = n;
+    if (cur_func->nregs < n + 1) {
+        cur_func->nregs = n + 1;
+    }
+    n = 0;
+    for (p = sym->next; p; p = p->next, n++) {
+        size = type_size(&p->type, &align);
+        loc = calc_align(loc, align);
+        sym_push(p->v & ~SC_PARAMS, &p->type, SC_LOCAL | SC_LVAL, loc);
+        if ((p->type.t & T_BTYPE) == T_STRUCT) {
+            gen_insn(OP_LEAL, cur_func->nparams, loc, 0);
+            gen_insn(OP_MCPY, cur_func->nparams, n, size);
+        } else {
+            gen_insn(mem_op(OP_STL1, size), n, loc, 0);
+        }
+        loc += size;
+    }
+}
+
+// 窥孔优化: 每个函数生成完后做一遍, 时间与指令数成正比, 总是打开
+// 1. 跳转穿透: 跳到 JMP 的改跳最终目标, JMP 到返回指令的直接返回; 条件跳转只越过一条 JMP 时取反条件, 改跳 JMP 的目标
+// 2. 顺序扫描, 指令逐条追加到输出末尾, 按新指令的操作码查规则表, 与前一条 (个别规则再看前一条) 合并改写;
+//    跳转目标处开始新的窗口, 不跨过它合并. 跳到下一条的跳转, JMP/RET 之后到下一个跳转目标之前的指令删去
+// 3. 按新旧位置对照表修正跳转目标
+// 寄存器是操作数栈的位置, 条件跳转弹出操作数, 所以比较结果只被紧随其后的 JZ/JNZ 使用
+enum e_PeepFlag {
+    PF_WA = 1,              // 写 r[a]
+    PF_RA = 2,              // 读 r[a]
+    PF_RB = 4,              // 读 r[b]
+    PF_RC = 8,              // 读 r[c]
+    PF_PURE = 16,           // 除写 r[a] 外没有别的作用
+    PF_JUMP = 32,           // c 为跳转目标
+    PF_END = 64,            // 不会顺序执行到下一条
+};
+
+#define PF_ARITH (PF_WA | PF_RB | PF_RC | PF_PURE)
+
+// CALL/CALLI 读写的寄存器不止 a b c, 不标记, 规则不会把它们当作纯指令
+// JTE 不会执行到, 但按可顺序执行到下一条标记, 数据流分析偏保守; 跳转表不能拆开, 跳到下一条时也不删
+unsigned char peep_flags[OP_COUNT] = {
+    [OP_NOP] = 0,
+    [OP_MOVI] = PF_WA | PF_PURE,
+    [OP_MOV] = PF_WA | PF_RB | PF_PURE,
+    [OP_ADD] = PF_ARITH, [OP_SUB] = PF_ARITH, [OP_MUL] = PF_ARITH,
+    [OP_DIV] = PF_WA | PF_RB | PF_RC, [OP_MOD] = PF_WA | PF_RB | PF_RC,
+    [OP_ADDI] = PF_WA | PF_RB | PF_PURE, [OP_MULI] = PF_WA | PF_RB | PF_PURE, [OP_NEG] = PF_WA | PF_RB | PF_PURE,
+    [OP_EQ] = PF_ARITH, [OP_NE] = PF_ARITH, [OP_LT] = PF_ARITH,
+    [OP_LE] = PF_ARITH, [OP_GT] = PF_ARITH, [OP_GE] = PF_ARITH,
+    [OP_LD1] = PF_WA | PF_RB | PF_PURE, [OP_LD2] = PF_WA | PF_RB | PF_PURE,
+    [OP_LD4] = PF_WA | PF_RB | PF_PURE, [OP_LD8] = PF_WA | PF_RB | PF_PURE,
+    [OP_ST1] = PF_RA | PF_RB, [OP_ST2] = PF_RA | PF_RB, [OP_ST4] = PF_RA | PF_RB, [OP_ST8] = PF_RA | PF_RB,
+    [OP_LDL1] = PF_WA | PF_PURE, [OP_LDL2] = PF_WA | PF_PURE, [OP_LDL4] = PF_WA | PF_PURE, [OP_LDL8] = PF_WA | PF_PURE,
+    [OP_STL1] = PF_RA, [OP_STL2] = PF_RA, [OP_STL4] = PF_RA, [OP_STL8] = PF_RA,
+    [OP_LEAL] = PF_WA | PF_PURE, [OP_LEAG] = PF_WA | PF_PURE,
+    [OP_MCPY] = PF_RA | PF_RB,
+    [OP_JMP] = PF_JUMP | PF_END,
+    [OP_JZ] = PF_RA | PF_JUMP, [OP_JNZ] = PF_RA | PF_JUMP,
+    [OP_JEQ] = PF_RA | PF_RB | PF_JUMP, [OP_JNE] = PF_RA | PF_RB | PF_JUMP, [OP_JLT] = PF_RA | PF_RB | PF_JUMP,
+    [OP_JLE] = PF_RA | PF_RB | PF_JUMP, [OP_JGT] = PF_RA | PF_RB | PF_JUMP, [OP_JGE] = PF_RA | PF_RB | PF_JUMP,
+    [OP_JEQI] = PF_RA | PF_JUMP, [OP_JNEI] = PF_RA | PF_JUMP, [OP_JLTI] = PF_RA | PF_JUMP,
+    [OP_JLEI] = PF_RA | PF_JUMP, [OP_JGTI] = PF_RA | PF_JUMP, [OP_JGEI] = PF_RA | PF_JUMP,
+    [OP_CALL] = 0, [OP_CALLI] = 0,
+    [OP_RET] = PF_RA | PF_END, [OP_RETV] = PF_END, [OP_TCALL] = PF_END, [OP_TCALLI] = PF_END,
+    [OP_ADDL4] = PF_WA | PF_RB | PF_PURE,
+    [OP_VLD] = PF_WA | PF_RB | PF_PURE, [OP_VST] = PF_RA | PF_RB,
+    [OP_PADD1] = PF_ARITH, [OP_PADD2] = PF_ARITH, [OP_PADD4] = PF_ARITH,
+    [OP_PSUB1] = PF_ARITH, [OP_PSUB2] = PF_ARITH, [OP_PSUB4] = PF_ARITH,
+    [OP_PMUL1] = PF_ARITH, [OP_PMUL2] = PF_ARITH, [OP_PMUL4] = PF_ARITH,
+    [OP_PSPLAT1] = PF_WA | PF_RB | PF_PURE, [OP_PSPLAT2] = PF_WA | PF_RB | PF_PURE,
+    [OP_PSPLAT4] = PF_WA | PF_RB | PF_PURE,
+    [OP_JTAB] = PF_RA | PF_JUMP, [OP_JTE] = PF_JUMP,
+    [OP_SX1] = PF_WA | PF_RB | PF_PURE, [OP_SX2] = PF_WA | PF_RB | PF_PURE,
+    [OP_AND] = PF_ARITH, [OP_PAND] = PF_ARITH,
+};
+
+// 比较 EQ NE LT LE GT GE 取反后的序号
+int cmp_inverse[6] = {1, 0, 5, 4, 3, 2};
+
+// 条件跳转取反
+int jcc_negate(int op) {
+    if (op == OP_JZ || op == OP_JNZ) {
+        return op == OP_JZ ? OP_JNZ : OP_JZ;
+    }
+    if (op >= OP_JEQI) {
+        return OP_JEQI + cmp_inverse[op - OP_JEQI];
+    }
+    return OP_JEQ + cmp_inverse[op - OP_JEQ];
+}
+
+// r[x] 与立即数 y 比较, cmp 为比较的序号
+int cmp_eval(int cmp, long long x, long long y) {
+    switch (cmp) {
+        case 0: return x == y;
+        case 1: return x != y;
+        case 2: return x < y;
+        case 3: return x <= y;
+        case 4: return x > y;
+        default: return x >= y;
+    }
+}
+
+int peep_reads(Insn *p, int r) {
+    int fl = peep_flags[p->op];
+
+    if (p->op == OP_CALL || p->op == OP_CALLI) {
+        return 1;
+    }
+    return ((fl & PF_RA) && p->a == r) || ((fl & PF_RB) && p->b == r) || ((fl & PF_RC) && p->c == r);
+}
+
+int fits_int(long long v) {
+    return v >= INT_MIN && v <= INT_MAX;
+}
+
+void insn_set(Insn *p, int op, int a, int b, int c) {
+    p->op = op;
+    p->a = a;
+    p->b = b;
+    p->c = c;
+}
+
+// 规则: p 指向改写的第一条 (两条的规则 p[1] 为新追加的指令), room 为窗口内 p 之前的指令数;
+// 改写后返回剩下的指令数, 不适用时返回 -1
+
+int peep_nop(Insn *p, int room) {
+    return 0;
+}
+
+// ADDI a, b, 0 / MULI a, b, 1 -> MOV a, b;  MULI a, b, 0 -> MOVI a, 0
+int peep_identity(Insn *p, int room) {
+    if (p->op == OP_MULI && p->c == 0) {
+        insn_set(p, OP_MOVI, p->a, 0, 0);
+        return 1;
+    }
+    if (p->c != (p->op == OP_MULI)) {
+        return -1;
+    }
+    if (p->a == p->b) {
+        return 0;
+    }
+    insn_set(p, OP_MOV, p->a, p->b, 0);
+    return 1;
+}
+
+int peep_mov_self(Insn *p, int room) {
+    return p->a == p->b ? 0 : -1;
+}
+
+// MOV a, b; MOV b, a -> MOV a, b
+int peep_mov_back(Insn *p, int room) {
+    return p[1].a == p[0].b && p[1].b == p[0].a ? 1 : -1;
+}
+
+// 写了没用到又被覆盖: X a ..; Y a .. (Y 不读 r[a]) -> Y a ..
+int peep_dead(Insn *p, int room) {
+    if (!(peep_flags[p[0].op] & PF_PURE) || !(peep_flags[p[1].op] & PF_WA) || p[1].a != p[0].a
+        || peep_reads(&p[1], p[0].a)) {
+        return -1;
+    }
+    p[0] = p[1];
+    return 1;
+}
+
+// 常量折叠: MOVI a, k; ADDI/MULI/NEG x, a .. -> MOVI x, k'
+int peep_const(Insn *p, int room) {
+    long long v = p[0].b;
+
+    if (p[1].b != p[0].a) {
+        return -1;
+    }
+    switch (p[1].op) {
+        case OP_ADDI: v += p[1].c; break;
+        case OP_MULI: v *= p[1].c; break;
+        case OP_NEG: v = -v; break;
+        case OP_SX1: v = (signed char) v; break;
+        case OP_SX2: v = (short) v; break;
+        default: return -1;
+    }
+    if (!fits_int(v)) {
+        return -1;
+    }
+    insn_set(&p[1], OP_MOVI, p[1].a, (int) v, 0);
+    if (p[1].a == p[0].a) {
+        p[0] = p[1];
+        return 1;
+    }
+    return 2;
+}
+
+// 地址运算并入后一条 (相当于 lea): LEAL a, o; ADDI a, a, c -> LEAL a, o+c;  LEAG 同理;
+// ADDI a, b, c1; ADDI a, a, c2 -> ADDI a, b, c1+c2
+int peep_addr_add(Insn *p, int room) {
+    long long v;
+
+    if (p[1].a != p[0].a || p[1].b != p[0].a) {
+        return -1;
+    }
+    v = (long long) (p[0].op == OP_LEAL ? p[0].b : p[0].c) + p[1].c;
+    if (!fits_int(v)) {
+        return -1;
+    }
+    if (p[0].op == OP_LEAL) {
+        p[0].b = (int) v;
+    } else {
+        p[0].c = (int) v;
+    }
+    return 1;
+}
+
+// 地址并入装入指令的偏移: LEAL a, o; LDn a, a, k -> LDLn a, o+k;  ADDI a, b, c; LDn a, a, k -> LDn a, b, c+k
+int peep_addr_load(Insn *p, int room) {
+    long long v = (long long) (p[0].op == OP_LEAL ? p[0].b : p[0].c) + p[1].c;
+
+    if (p[1].a != p[0].a || p[1].b != p[0].a || !fits_int(v)) {
+        return -1;
+    }
+    if (p[0].op == OP_LEAL) {
+        insn_set(&p[0], OP_LDL1 + (p[1].op - OP_LD1), p[1].a, (int) v, 0);
+    } else {
+        insn_set(&p[0], p[1].op, p[1].a, p[0].b, (int) v);
+    }
+    return 1;
+}
+
+// 比较与条件跳转合并: EQ a, b, c; JNZ a, L -> JEQ b, c, L (JZ 取反); 比较结果只用于这次跳转
+int peep_cmp_branch(Insn *p, int room) {
+    int cmp = p[0].op - OP_EQ;
+
+    if (p[1].a != p[0].a) {
+        return -1;
+    }
+    if (p[1].op == OP_JZ) {
+        cmp = cmp_inverse[cmp];
+    }
+    insn_set(&p[0], OP_JEQ + cmp, p[0].b, p[0].c, p[1].c);
+    return 1;
+}
+
+// 常量条件: MOVI a, k; JZ/JNZ/JccI a .. -> 去掉或改为 JMP; 跳转弹出了 r[a], MOVI 一并去掉
+int peep_const_branch(Insn *p, int room) {
+    int taken;
+
+    if (p[1].a != p[0].a) {
+        return -1;
+    }
+    if (p[1].op == OP_JZ || p[1].op == OP_JNZ) {
+        taken = (p[0].b != 0) == (p[1].op == OP_JNZ);
+    } else {
+        taken = cmp_eval(p[1].op - OP_JEQI, p[0].b, p[1].b);
+    }
+    if (!taken) {
+        return 0;
+    }
+    insn_set(&p[0], OP_JMP, 0, 0, p[1].c);
+    return 1;
+}
+
+// 存入后马上装入同一个局部变量:
+// MOVI r, k; STLn r, o; LDLn x, o -> MOVI r, k; STLn r, o; MOVI x, (intn) k;  8 字节且 x == r 时去掉装入
+int peep_store_load(Insn *p, int room) {
+    long long k;
+
+    if (p[1].b != p[0].b || p[1].op - OP_LDL1 != p[0].op - OP_STL1) {
+        return -1;
+    }
+    if (p[0].op == OP_STL8 && p[1].a == p[0].a) {
+        return 1;
+    }
+    if (room < 1 || p[-1].op != OP_MOVI || p[-1].a != p[0].a) {
+        return -1;
+    }
+    k = p[-1].b;
+    switch (p[0].op) {
+        case OP_STL1: k = (signed char) k; break;
+        case OP_STL2: k = (short) k; break;
+        case OP_STL4: k = (int) k; break;
+        default: break;
+    }
+    insn_set(&p[1], OP_MOVI, p[1].a, (int) k, 0);
+    return 2;
+}
+
+typedef struct PeepRule {
+    int op, op_end;         // 新追加指令的操作码范围
+    int prev, prev_end;     // 前一条指令的操作码范围, -1 为只看一条
+    int (*apply)(Insn *p, int room);
+    char *name;
+    long long hits;
+} PeepRule;
+
+PeepRule peep_rules[] = {
+    {OP_NOP, OP_NOP, -1, -1, peep_nop, "nop"},
+    {OP_ADDI, OP_ADDI, -1, -1, peep_identity, "identity"},
+    {OP_MULI, OP_MULI, -1, -1, peep_identity, "identity"},
+    {OP_MOV, OP_MOV, -1, -1, peep_mov_self, "self-move"},
+    {OP_MOV, OP_MOV, OP_MOV, OP_MOV, peep_mov_back, "move-back"},
+    {OP_ADDI, OP_ADDI, OP_MOVI, OP_MOVI, peep_const, "const-fold"},
+    {OP_MULI, OP_NEG, OP_MOVI, OP_MOVI, peep_const, "const-fold"},
+    {OP_SX1, OP_SX2, OP_MOVI, OP_MOVI, peep_const, "const-fold"},
+    {OP_ADDI, OP_ADDI, OP_ADDI, OP_ADDI, peep_addr_add, "add-fold"},
+    {OP_ADDI, OP_ADDI, OP_LEAL, OP_LEAG, peep_addr_add, "lea-fold"},
+    {OP_LD1, OP_LD8, OP_ADDI, OP_ADDI, peep_addr_load, "load-offset"},
+    {OP_LD1, OP_LD8, OP_LEAL, OP_LEAL, peep_addr_load, "load-offset"},
+    {OP_JZ, OP_JNZ, OP_EQ, OP_GE, peep_cmp_branch, "cmp-branch"},
+    {OP_JZ, OP_JNZ, OP_MOVI, OP_MOVI, peep_const_branch, "const-branch"},
+    {OP_JEQI, OP_JGEI, OP_MOVI, OP_MOVI, peep_const_branch, "const-branch"},
+    {OP_LDL1, OP_LDL8, OP_STL1, OP_STL8, peep_store_load, "store-load"},
+    {0, OP_COUNT - 1, 0, OP_COUNT - 1, peep_dead, "dead-def"},
+};
+
+#define PEEP_NRULES ((int) (sizeof(peep_rules) / sizeof(peep_rules[0])))
+
+// 按新追加指令的操作码索引的规则表
+PeepRule *peep_index[OP_COUNT][PEEP_NRULES + 1];
+int peep_ready;
+
+void peep_init() {
+    int i, op, n;
+
+    for (op = 0; op < OP_COUNT; op++) {
+        for (i = n = 0; i < PEEP_NRULES; i++) {
+            if (op >= peep_rules[i].op && op <= peep_rules[i].op_end) {
+                peep_index[op][n++] = &peep_rules[i];
+            }
+        }
+        peep_index[op][n] = NULL;
+    }
+    peep_ready = 1;
+}
+
+// 对窗口 [base, *w) 的末尾试一次规则, 改写了返回 1
+int peep_rewrite(Insn *code, int base, int *w) {
+    Insn *q = &code[*w - 1];
+    PeepRule **r;
+    int m;
+
+    if (*w <= base) {
+        return 0;
+    }
+    for (r = peep_index[q->op]; *r; r++) {
+        if ((*r)->prev < 0) {
+            m = (*r)->apply(q, *w - 1 - base);
+            if (m >= 0) {
+                *w += m - 1;
+                (*r)->hits++;
+                return 1;
+            }
+        } else if (*w - 2 >= base && q[-1].op >= (*r)->prev && q[-1].op <= (*r)->prev_end) {
+            m = (*r)->apply(q - 1, *w - 2 - base);
+            if (m >= 0) {
+                *w += m - 2;
+                (*r)->hits++;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// 各规则命中次数, 同名的相邻规则合并
+void peep_stats(FILE *fp, int json) {
+    int i, n = 0;
+    long long hits;
+
+    for (i = 0; i < PEEP_NRULES; i++) {
+        hits = peep_rules[i].hits;
+        while (i + 1 < PEEP_NRULES && !strcmp(peep_rules[i + 1].name, peep_rules[i].name)) {
+            hits += peep_rules[++i].hits;
+        }
+        if (json) {
+            fprintf(fp, "%s\"%s\": %lld", n++ ? ", " : "", peep_rules[i].name, hits);
+        } else if (hits) {
+            fprintf(fp, " %s %lld", peep_rules[i].name, hits);
+        }
+    }
+}
+
+void peep_labels(Insn *code, int n, char *label) {
+    int i;
+
+    memset(label, 0, n + 1);
+    for (i = 0; i < n; i++) {
+        if ((peep_flags[code[i].op] & PF_JUMP) && code[i].c >= 0 && code[i].c <= n) {
+            label[code[i].c] = 1;
+        }
+    }
+}
+
+void peephole(BcFunc *f) {
+    Insn *code = f->code, insn;
+    int n = f->ncode, *newpos, i, k, t, w, base;
+    char *label;
+
+    if (!peep_ready) {
+        peep_init();
+    }
+    newpos = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_CODE);
+    label = (char *) mem_alloc(n + 1, MEM_CODE);
+
+    // 1. 跳转穿透; 被穿过的 JMP 都是跳转目标, 不会被取反时删去
+    peep_labels(code, n, label);
+    for (i = 0; i < n; i++) {
+        if (!(peep_flags[code[i].op] & PF_JUMP)) {
+            continue;
+        }
+        if (code[i].op >= OP_JZ && code[i].op <= OP_JGEI && code[i].c == i + 2 && code[i + 1].op == OP_JMP
+            && !label[i + 1]) {
+            code[i].op = jcc_negate(code[i].op);
+            code[i].c = code[i + 1].c;
+            code[i + 1].op = OP_NOP;
+            stats.peep_threaded++;
+        }
+        t = code[i].c;
+        for (k = 0; k < 8 && t >= 0 && t < n && code[t].op == OP_JMP && code[t].c != t; k++) {
+            t = code[t].c;
+        }
+        if (t != code[i].c) {
+            code[i].c = t;
+            stats.peep_threaded++;
+        }
+        if (code[i].op == OP_JMP && t >= 0 && t < n && (code[t].op == OP_RET || code[t].op == OP_RETV)) {
+            code[i] = code[t];
+            stats.peep_threaded++;
+        }
+    }
+
+    // 2. 滑动窗口, 就地压缩
+    peep_labels(code, n, label);
+    w = base = 0;
+    for (i = 0; i < n; i++) {
+        insn = code[i];
+        if (label[i]) {
+            while (w > base && (peep_flags[code[w - 1].op] & PF_JUMP) && code[w - 1].c == i
+                   && code[w - 1].op != OP_JTAB && code[w - 1].op != OP_JTE) {
+                w--;
+            }
+            base = w;
+        } else if (w > base && (peep_flags[code[w - 1].op] & PF_END)) {
+            newpos[i] = w;
+            continue;
+        }
+        newpos[i] = w;
+        code[w++] = insn;
+        for (k = 0; k < 8 && peep_rewrite(code, base, &w); k++);
+    }
+    newpos[n] = w;
+
+    // 3. 修正跳转目标
+    for (i = 0; i < w; i++) {
+        if ((peep_flags[code[i].op] & PF_JUMP) && code[i].c >= 0 && code[i].c <= n) {
+            code[i].c = newpos[code[i].c];
+        }
+    }
+    stats.peep_insns += n;
+    stats.peep_removed += n - w;
+    f->ncode = w;
+    insn_loc_remap(f, newpos);
+    mem_free(newpos, MEM_CODE);
+    mem_free(label, MEM_CODE);
+}
+
+// 剖析反馈优化 (PGO)
+// -fprofile-generate 在函数入口和 if/for 产生的每条边上插入计数指令 PROF, 计数器按函数放在数据段的 "__prof.函数名" 数组里,
+// 插桩的程序结束时把计数累加进 profile 文件; -fprofile-use 读回计数, 用于 if 两臂的排布 内联和循环优化的寄存器预算.
+// 计数器按源码结构编号: 1 为函数入口, 之后每个 if 两个 (then 边, else 边), 每个 for 两个 (循环体, 出口),
+// 源码不变时两次编译的编号一致; 个数对不上的函数报警告并忽略其计数.
+// profile 是文本文件: 首行 PROF_MAGIC, 之后每行 "函数名 n c1 .. cn"
+int opt_prof_gen = 0;
+char *prof_gen_file = NULL, *prof_use_file = NULL;
+
+#define PROF_MAGIC "sc-profile 1"
+#define PROF_DEFAULT_FILE "sc.prof"
+#define PROF_HOT_RATIO 16           // 入口次数不少于最热函数的 1/16 为热函数
+#define PROF_COLD_RATIO 8           // if 的一臂次数不超过另一臂的 1/8 为冷代码
+
+typedef struct ProfFunc {
+    char *name;
+    int n;
+    int stale;              // 与源文件对不上
+    long long *counts;      // counts[1..n]
+} ProfFunc;
+
+ProfFunc *prof_table;       // 开放定址散列表, name 为 NULL 的是空位
+int prof_cap, prof_nfuncs;
+long long prof_max;         // 最热函数的入口次数
+
+ProfFunc *prof_find(char *name, int add) {
+    ProfFunc *old = prof_table;
+    unsigned int h;
+    int i, cap = prof_cap;
+
+    if (add && (prof_nfuncs + 1) * 2 > prof_cap) {
+        prof_cap = prof_cap ? prof_cap * 2 : 64;
+        prof_table = (ProfFunc *) mallocz(sizeof(ProfFunc) * prof_cap, MEM_MODULE);
+        prof_nfuncs = 0;
+        for (i = 0; i < cap; i++) {
+            if (old[i].name) {
+                *prof_find(old[i].name, 1) = old[i];
+            }
+        }
+        mem_free(old, MEM_MODULE);
+    }
+    if (!prof_cap) {
+        return NULL;
+    }
+    h = (unsigned int) hash64(name, strlen(name), 0x5052);
+    for (i = h & (prof_cap - 1); prof_table[i].name; i = (i + 1) & (prof_cap - 1)) {
+        if (!strcmp(prof_table[i].name, name)) {
+            return &prof_table[i];
+        }
+    }
+    if (!add) {
+        return NULL;
+    }
+    prof_table[i].name = name;
+    prof_nfuncs++;
+    return &prof_table[i];
+}
+
+// 把 name 的 n 个计数累加进表; 个数与表里的不同时 (源文件改过) 以新的为准
+void prof_add(char *name, int n, long long *counts) {
+    ProfFunc *p = prof_find(name, 0);
+    int k;
+
+    if (!p) {
+        p = prof_find(mem_strdup(name, MEM_MODULE), 1);
+    }
+    if (p->n != n) {
+        mem_free(p->counts, MEM_MODULE);
+        p->n = n;
+        p->counts = (long long *) mallocz(sizeof(long long) * (n + 1), MEM_MODULE);
+    }
+    for (k = 1; k <= n; k++) {
+        p->counts[k] += counts[k];
+    }
+    if (p->counts[1] > prof_max) {
+        prof_max = p->counts[1];
+    }
+}
+
+// 读入 profile 文件, 累加进表; 文件不存在返回 0, 格式不对返回 -1
+int prof_read(char *path) {
+    char name[256], magic[32];
+    long long *counts = NULL;
+    int n, k, ret = 1;
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        return 0;
+    }
+    if (!fgets(magic, sizeof(magic), fp) || strncmp(magic, PROF_MAGIC, strlen(PROF_MAGIC))) {
+        fclose(fp);
+        return -1;
+    }
+    while (ret > 0 && fscanf(fp, "%255s %d", name, &n) == 2) {
+        if (n <= 0 || n > (1 << 24)) {
+            ret = -1;
+            break;
+        }
+        counts = (long long *) mem_realloc(counts, sizeof(long long) * (n + 1), MEM_MODULE);
+        for (k = 1; k <= n; k++) {
+            if (fscanf(fp, "%lld", &counts[k]) != 1) {
+                ret = -1;
+                break;
+            }
+        }
+        if (ret > 0) {
+            prof_add(name, n, counts);
+        }
+    }
+    mem_free(counts, MEM_MODULE);
+    fclose(fp);
+    return ret;
+}
+
+// 函数的冷热: 1 热, -1 训练时没执行过, 0 其余或没有计数
+int prof_temp(char *name) {
+    ProfFunc *p = prof_use_file ? prof_find(name, 0) : NULL;
+
+    if (!p || p->stale) {
+        return 0;
+    }
+    if (!p->counts[1]) {
+        return -1;
+    }
+    return p->counts[1] * PROF_HOT_RATIO >= prof_max;
+}
+
+// 函数内联
+// 翻译单元结束后, 对本文件定义的函数按调用图自底向上处理: 先处理被调函数, 再把合算的函数体复制到调用处.
+// 调用图的强连通分量 (Tarjan) 是相互递归的一组函数, 分量内的调用都不内联, 分量之间按被调在先的次序处理.
+// 被调函数的寄存器 k 映射到调用处的实参寄存器 a+k (调用后 a 及以上的寄存器都不再使用), 返回值写入 r[a-1];
+// 局部变量区接在调用者的局部变量区之后, 各调用处不会同时执行, 共用一块, 大小取最大的一个.
+// 有 profile 时热的被调函数按循环里的上限处理, 训练时没执行过的调用者和被调函数不内联
+int opt_inline = 1, opt_inline_report = 0;
+
+#define INLINE_CALL_COST 6          // 一次调用折合的指令数: CALL RET 复制实参 建立和撤销调用帧
+#define INLINE_LIMIT 8              // 内联后调用处增加的指令数上限
+#define INLINE_LOOP_LIMIT 40        // 在循环里的调用处
+#define INLINE_LEAF_BONUS 8         // 被调函数是叶函数时上限再放宽: 内联后整个调用都消失, 调用者可能也成为叶函数
+#define INLINE_GROWTH 4             // 调用者最多长到原来的几倍, 另加 INLINE_LOOP_LIMIT
+
+typedef struct InlineInfo {
+    int index;              // 深度优先的访问次序, 0 为未访问
+    int low;                // 经过栈上的函数能回到的最小访问次序
+    int on_stack;
+    int scc;                // 所在强连通分量的编号
+    int leaf;               // 处理完后不再调用其他函数
+} InlineInfo;
+
+InlineInfo *inl;
+int *inl_stack, inl_sp, inl_index, inl_nscc;
+
+int inline_defined(int s) {
+    BcSym *bs = bc_sym(s);
+    return bs->kind == BS_FUNC && bs->func && bs->func != module.init && !bs->func->native;
+}
+
+// 去掉末尾 RETV 后的指令数
+int inline_size(BcFunc *g) {
+    return g->ncode - (g->ncode && g->code[g->ncode - 1].op == OP_RETV);
+}
+
+// 调用处能否内联, 不能时返回原因; cost 为内联后增加的指令数, scc 为调用者所在的分量
+char *inline_reject(Insn *p, int scc, int in_loop, int room, int *cost) {
+    InlineInfo *ii = &inl[p->b];
+    BcFunc *g = bc_sym(p->b)->func;
+    int limit = in_loop ? INLINE_LOOP_LIMIT : INLINE_LIMIT, hot;
+    static char buf[64];
+
+    *cost = 0;
+    if (!inline_defined(p->b)) {
+        return "not defined in this file";
+    }
+    if (ii->scc == scc) {
+        return "recursive";
+    }
+    if (!(g->flags & LF_PROTO) || (g->flags & LF_VARIADIC)) {
+        return "variadic";
+    }
+    if (p->c < g->nparams) {
+        return "too few arguments";
+    }
+    // __stdcall 由被调函数按形参个数清理实参, 个数不符时保持原来的调用
+    if ((g->flags & LF_STDCALL) && p->c != g->nparams) {
+        return "__stdcall argument count mismatch";
+    }
+    *cost = inline_size(g) - INLINE_CALL_COST;
+    hot = prof_temp(g->name);
+    if (hot < 0) {
+        return "never called in profile";
+    }
+    if (hot > 0 && limit < INLINE_LOOP_LIMIT) {
+        limit = INLINE_LOOP_LIMIT;
+    }
+    if (ii->leaf) {
+        limit += INLINE_LEAF_BONUS;
+    }
+    if (*cost > limit) {
+        sprintf(buf, "too large (cost %d > %d)", *cost, limit);
+        return buf;
+    }
+    if (inline_size(g) > room) {
+        return "caller too large";
+    }
+    return NULL;
+}
+
+// 把 g 的函数体展开在 out[w..], a 为调用处的实参寄存器, fb 为局部变量区的起点; 返回展开后的指令数
+int inline_expand(Insn *out, int w, BcFunc *g, int a, int fb, int *gpos) {
+    Insn q;
+    int j, n, fl, end;
+
+    for (j = n = 0; j < g->ncode; j++) {
+        gpos[j] = w + n;
+        n += g->code[j].op == OP_RET ? 2 : 1;
+    }
+    end = gpos[g->ncode] = w + n;
+    for (j = 0; j < g->ncode; j++) {
+        q = g->code[j];
+        fl = peep_flags[q.op];
+        switch (q.op) {
+            case OP_RET:
+                insn_set(&out[w++], OP_MOV, a - 1, a + q.a, 0);
+                insn_set(&q, OP_JMP, 0, 0, end);
+                break;
+            case OP_RETV:
+                insn_set(&q, OP_JMP, 0, 0, end);
+                break;
+            case OP_CALL:
+                q.a += a;
+                break;
+            case OP_CALLI:
+                q.a += a;
+                q.b += a;
+                break;
+            default:
+                if (fl & (PF_WA | PF_RA)) {
+                    q.a += a;
+                }
+                if (fl & PF_RB) {
+                    q.b += a;
+                }
+                if (fl & PF_RC) {
+                    q.c += a;
+                }
+                if (q.op == OP_LEAL || (q.op >= OP_LDL1 && q.op <= OP_STL8)) {
+                    q.b += fb;
+                } else if (q.op == OP_ADDL4) {
+                    q.c += fb;
+                } else if (fl & PF_JUMP) {
+                    q.c = gpos[q.c];
+                }
+                break;
+        }
+        out[w++] = q;
+    }
+    return n;
+}
+
+void inline_calls(BcFunc *f, int scc) {
+    Insn *p, *out;
+    BcFunc *g;
+    int n = f->ncode, i, j, w, k, cost, area = 0, room, fb = f->frame_size, site = 0;
+    int *depth, *newpos, *fix, nfix = 0, *gpos, maxg = 0, total = n, ntake = 0, cold = prof_temp(f->name) < 0;
+    char *reason, *take, *where;
+
+    // 在循环里: 被某个向后跳转的范围覆盖
+    depth = (int *) mallocz(sizeof(int) * (n + 1), MEM_CODE);
+    for (i = 0; i < n; i++) {
+        p = &f->code[i];
+        if ((peep_flags[p->op] & PF_JUMP) && p->c >= 0 && p->c <= i) {
+            depth[p->c]++;
+            depth[i + 1]--;
+        }
+    }
+    take = (char *) mallocz(n, MEM_CODE);
+    room = n * (INLINE_GROWTH - 1) + INLINE_LOOP_LIMIT;
+    for (i = 0, k = 0; i < n; i++) {
+        k += depth[i];
+        p = &f->code[i];
+        if (p->op != OP_CALL && p->op != OP_CALLI) {
+            continue;
+        }
+        site++;
+        if (p->op == OP_CALLI) {
+            reason = "indirect call";
+        } else if (cold) {
+            reason = "caller never ran in profile";
+        } else {
+            reason = inline_reject(p, scc, k > 0, room, &cost);
+        }
+        if (!reason) {
+            g = bc_sym(p->b)->func;
+            take[i] = 1;
+            ntake++;
+            room -= inline_size(g);
+            total += 2 * g->ncode;
+            maxg = g->ncode > maxg ? g->ncode : maxg;
+            area = g->frame_size > area ? g->frame_size : area;
+            if (f->nregs < p->a + g->nregs) {
+                f->nregs = p->a + g->nregs;
+            }
+            stats.inline_sites++;
+        }
+        if (opt_inline_report) {
+            where = insn_where(f, i);
+            fprintf(stderr, "[INLINE] %s: call #%d to %s at %s: ", f->name, site,
+                    p->op == OP_CALL ? bc_sym(p->b)->name : "(pointer)", where ? where : "?");
+            if (reason) {
+                fprintf(stderr, "not inlined, %s\n", reason);
+            } else {
+                fprintf(stderr, "inlined, cost %d%s%s%s\n", cost, inl[p->b].leaf ? ", leaf" : "",
+                        k > 0 ? ", in loop" : "", prof_temp(bc_sym(p->b)->name) > 0 ? ", hot" : "");
+            }
+        }
+        stats.inline_calls++;
+    }
+    if (!ntake) {
+        mem_free(depth, MEM_CODE);
+        mem_free(take, MEM_CODE);
+        return;
+    }
+
+    // 展开; 调用者自己的跳转先记下, 最后按新旧位置对照表修正
+    out = (Insn *) mem_alloc(sizeof(Insn) * (total + 1), MEM_CODE);
+    newpos = depth;
+    fix = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_CODE);
+    gpos = (int *) mem_alloc(sizeof(int) * (maxg + 1), MEM_CODE);
+    for (i = w = 0; i < n; i++) {
+        newpos[i] = w;
+        p = &f->code[i];
+        if (take[i]) {
+            w += inline_expand(out, w, bc_sym(p->b)->func, p->a, fb, gpos);
+            continue;
+        }
+        if (peep_flags[p->op] & PF_JUMP) {
+            fix[nfix++] = w;
+        }
+        out[w++] = *p;
+    }
+    newpos[n] = w;
+    for (j = 0; j < nfix; j++) {
+        p = &out[fix[j]];
+        if (p->c >= 0 && p->c <= n) {
+            p->c = newpos[p->c];
+        }
+    }
+    mem_free(f->code, MEM_CODE);
+    f->code = out;
+    f->ncode = w;
+    f->capcode = total + 1;
+    insn_loc_remap(f, newpos);
+    f->frame_size = fb + area;
+    f->frame_words = f->nregs + f->frame_size / 8;
+    mem_free(depth, MEM_CODE);
+    mem_free(take, MEM_CODE);
+    mem_free(fix, MEM_CODE);
+    mem_free(gpos, MEM_CODE);
+    peephole(f);
+}
+
+void inline_func(int s) {
+    BcFunc *f = bc_sym(s)->func;
+    Insn *p;
+    int i, t, first, clean;
+
+    inl[s].index = inl[s].low = ++inl_index;
+    inl[s].on_stack = 1;
+    inl_stack[inl_sp++] = s;
+    for (i = 0; i < f->ncode; i++) {
+        p = &f->code[i];
+        if (p->op != OP_CALL || !inline_defined(p->b)) {
+            continue;
+        }
+        t = p->b;
+        if (!inl[t].index) {
+            inline_func(t);
+            inl[s].low = inl[t].low < inl[s].low ? inl[t].low : inl[s].low;
+        } else if (inl[t].on_stack) {
+            inl[s].low = inl[t].index < inl[s].low ? inl[t].index : inl[s].low;
+        }
+    }
+    if (inl[s].low != inl[s].index) {
+        return;
+    }
+    // s 是分量的根, 分量里的函数在栈上 s 及其之上; 它们调用的其他分量都已处理完
+    inl_nscc++;
+    for (first = inl_sp; inl_stack[--first] != s;);
+    for (i = first; i < inl_sp; i++) {
+        inl[inl_stack[i]].scc = inl_nscc;
+        inl[inl_stack[i]].on_stack = 0;
+    }
+    // 增量编译沿用了整个分量上次的内联结果时不再内联
+    clean = incr_scc_clean(inl_stack + first, inl_sp - first);
+    for (i = first; i < inl_sp; i++) {
+        t = inl_stack[i];
+        f = bc_sym(t)->func;
+        if (!clean) {
+            inline_calls(f, inl_nscc);
+        }
+        inl[t].leaf = 1;
+        for (p = f->code; p < f->code + f->ncode; p++) {
+            if (p->op == OP_CALL || p->op == OP_CALLI) {
+                inl[t].leaf = 0;
+            }
+        }
+    }
+    inl_sp = first;
+}
+
+// 翻译单元结束时从函数符号取调用约定和是否变参
+void func_flags() {
+    Symbol *s, *fn;
+    BcSym *bs;
+    int i;
+
+    for (i = 0; i < global_sym_stack.count; i++) {
+        s = (Symbol *) global_sym_stack.data[i];
+        if (!(s->r & SC_SYM) || (s->type.t & T_BTYPE) != T_FUNC || s->c >= module.syms.count) {
+            continue;
+        }
+        bs = bc_sym(s->c);
+        if (bs->kind == BS_FUNC && bs->func) {
+            fn = s->type.ref;
+            bs->func->flags = LF_PROTO | (fn->c ? LF_VARIADIC : 0) | (fn->r == KW_STDCALL ? LF_STDCALL : 0);
+        }
+    }
+}
+
+void inline_module() {
+    int i, n = module.syms.count;
+
+    inl = (InlineInfo *) mallocz(sizeof(InlineInfo) * (n + 1), MEM_CODE);
+    inl_stack = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_CODE);
+    inl_sp = inl_index = inl_nscc = 0;
+    for (i = 0; i < n; i++) {
+        if (inline_defined(i) && !inl[i].index) {
+            inline_func(i);
+        }
+    }
+    mem_free(inl, MEM_CODE);
+    mem_free(inl_stack, MEM_CODE);
+    inl = NULL;
+}
+
+// 循环优化
+// 翻译单元结束后 (内联之后) 对每个函数做:
+// 1. 在字节码的控制流图上找循环: 向后跳转 e -> h 是到 h 的唯一回边, 循环外的跳转不进入 (h, e]
+// 2. 由内向外处理每个循环, 在 h 之前插入前置块:
+//    循环不变量 (输入都与循环无关的计算) 在前置块算一次放进新寄存器, 循环里改为 MOV;
+//    归纳变量 (只在循环末尾加常数的局部变量, 如 for 的 i) 的线性函数 (如 a[i] 的地址 i * 4 + a) 在前置块算出初值,
+//    放进新寄存器, 每次循环在归纳变量加步长的地方加上自己的步长, 乘法变成加法
+// 3. 活跃分析后做复制传播和死代码删除, 不再使用的派生归纳变量不再加步长
+// 4. 次数是编译期常数的最内层小循环展开 2/4/8 次, 省去中间的条件判断
+// 局部变量按帧内偏移识别; 取过地址 (LEAL) 的对象及其后的偏移可能经指针读写, 不当作独立的变量
+int opt_loop = 1;
+
+#define UNROLL_LIMIT 96             // 展开后循环体的指令数上限
+#define LOOP_REG_LIMIT 128          // 每个函数新增寄存器的上限, profile 里的热函数加倍
+#define LOOP_COPY_WINDOW 8          // 复制传播向后找使用者的指令数
+#define LOOP_DEPTH_LIMIT 8          // 嵌套更深的函数不做, 活跃分析的迭代次数随嵌套层数增长
+
+enum e_LoopValKind {
+    LV_INV,                 // 循环不变量
+    LV_IV,                  // 归纳变量本身, 不单独替换
+    LV_DERIVED,             // 归纳变量的线性函数
+};
+
+typedef struct Loop {
+    int h, e;               // 循环头, 回边所在的跳转
+} Loop;
+
+// 前置块里算出的值, 按算法和输入去重
+typedef struct LoopVal {
+    int op, x, y, imm;
+    int r;                  // 存放的新寄存器
+    int kind, step;         // 派生归纳变量每次循环的增量
+    int nofault;            // LEAG/LEAL 得到的地址, 经它装入不会出错
+    int known, k;           // MOVI 的常数
+} LoopVal;
+
+typedef struct LoopIv {
+    int r, loop;            // 派生归纳变量的寄存器, 所在的循环
+} LoopIv;
+
+typedef unsigned long long Bits;
+
+Loop *loops;
+int nloops;
+LoopVal *lvals;
+int nlvals, lval_cap;
+LoopIv *livs;
+int nlivs, liv_cap;
+int *lreg, *lgen, lgen_cur, lreg_cap;
+int loop_reg_max;
+int *lstores, nlstores, lstore_cap;     // 当前循环里 STL 的位置
+
+// 指令读写的寄存器; 返回读的个数, def 为写的寄存器 (没有为 -1)
+int insn_regs(Insn *p, int *use, int *def) {
+    int fl = peep_flags[p->op], n = 0, k;
+
+    *def = -1;
+    if (p->op == OP_CALL || p->op == OP_CALLI) {
+        for (k = 0; k < p->c; k++) {
+            use[n++] = p->a + k;
+        }
+        if (p->op == OP_CALLI) {
+            use[n++] = p->b;
+        }
+        *def = p->a - 1;
+        return n;
+    }
+    if (fl & PF_RA) {
+        use[n++] = p->a;
+    }
+    if (fl & PF_RB) {
+        use[n++] = p->b;
+    }
+    if (fl & PF_RC) {
+        use[n++] = p->c;
+    }
+    if (fl & PF_WA) {
+        *def = p->a;
+    }
+    return n;
+}
+
+int insn_reads(Insn *p, int r, int *use) {
+    int n, def, k;
+
+    n = insn_regs(p, use, &def);
+    for (k = 0; k < n; k++) {
+        if (use[k] == r) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 指令 i 之后活跃的寄存器
+void live_out(BcFunc *f, Bits *live, int words, int i, Bits *out) {
+    Insn *p = &f->code[i];
+    int k, fl = peep_flags[p->op];
+
+    memset(out, 0, sizeof(Bits) * words);
+    if (!(fl & PF_END) && i + 1 < f->ncode) {
+        for (k = 0; k < words; k++) {
+            out[k] |= live[(i + 1) * words + k];
+        }
+    }
+    if ((fl & PF_JUMP) && p->c >= 0 && p->c < f->ncode) {
+        for (k = 0; k < words; k++) {
+            out[k] |= live[p->c * words + k];
+        }
+    }
+}
+
+// 寄存器 r 在指令 i 之后是否活跃
+int live_after(BcFunc *f, Bits *live, int words, int i, int r) {
+    Insn *p = &f->code[i];
+    Bits bit = 1ULL << (r % 64);
+    int fl = peep_flags[p->op];
+
+    if (!(fl & PF_END) && i + 1 < f->ncode && (live[(i + 1) * words + r / 64] & bit)) {
+        return 1;
+    }
+    return (fl & PF_JUMP) && p->c >= 0 && p->c < f->ncode && (live[p->c * words + r / 64] & bit);
+}
+
+// 每条指令入口处活跃的寄存器, 逆序迭代到不动点
+void liveness(BcFunc *f, Bits *live, int words, int *use) {
+    Bits *out = (Bits *) mem_alloc(sizeof(Bits) * words, MEM_CODE);
+    int i, k, n, def, changed;
+
+    memset(live, 0, sizeof(Bits) * words * (f->ncode + 1));
+    do {
+        changed = 0;
+        for (i = f->ncode - 1; i >= 0; i--) {
+            live_out(f, live, words, i, out);
+            n = insn_regs(&f->code[i], use, &def);
+            if (def >= 0) {
+                out[def / 64] &= ~(1ULL << (def % 64));
+            }
+            for (k = 0; k < n; k++) {
+                out[use[k] / 64] |= 1ULL << (use[k] % 64);
+            }
+            if (memcmp(out, live + i * words, sizeof(Bits) * words)) {
+                memcpy(live + i * words, out, sizeof(Bits) * words);
+                changed = 1;
+            }
+        }
+    } while (changed);
+    mem_free(out, MEM_CODE);
+}
+
+// 找出只有一条回边 且只从循环头进入的循环, 小的 (内层的) 在前
+void find_loops(BcFunc *f) {
+    Insn *code = f->code;
+    int n = f->ncode, i, j, t, ok;
+    Loop l;
+
+    nloops = 0;
+    for (i = 0; i < n; i++) {
+        t = code[i].c;
+        if (!(peep_flags[code[i].op] & PF_JUMP) || t < 0 || t > i) {
+            continue;
+        }
+        ok = 1;
+        for (j = 0; j < n && ok; j++) {
+            if (j != i && (peep_flags[code[j].op] & PF_JUMP)
+                && (code[j].c == t ? j >= t && j <= i : code[j].c > t && code[j].c <= i && (j < t || j > i))) {
+                ok = 0;
+            }
+        }
+        if (ok) {
+            loops[nloops].h = t;
+            loops[nloops++].e = i;
+        }
+    }
+    for (i = 1; i < nloops; i++) {
+        l = loops[i];
+        for (j = i; j > 0 && loops[j - 1].e - loops[j - 1].h > l.e - l.h; j--) {
+            loops[j] = loops[j - 1];
+        }
+        loops[j] = l;
+    }
+}
+
+// 在 at 之前插入 n 条不含跳转的指令; 跳到 at 的, 来自循环 cur 之内的改跳插入的指令之后, 其他的跳到插入的第一条
+void loop_insert(BcFunc *f, int at, Insn *ins, int n, int cur) {
+    Loop *c = cur >= 0 ? &loops[cur] : NULL;
+    int i, j;
+
+    if (!n) {
+        return;
+    }
+    if (f->ncode + n > f->capcode) {
+        f->capcode = f->ncode + n + 16;
+        f->code = (Insn *) mem_realloc(f->code, sizeof(Insn) * f->capcode, MEM_CODE);
+    }
+    memmove(f->code + at + n, f->code + at, sizeof(Insn) * (f->ncode - at));
+    memcpy(f->code + at, ins, sizeof(Insn) * n);
+    f->ncode += n;
+    for (i = 0; i < f->nlocs; i++) {
+        if (f->locs[i].pos > at) {
+            f->locs[i].pos += n;
+        }
+    }
+    for (i = 0; i < f->ncode; i++) {
+        if ((i >= at && i < at + n) || !(peep_flags[f->code[i].op] & PF_JUMP)) {
+            continue;
+        }
+        j = i < at ? i : i - n;
+        if (f->code[i].c > at || (f->code[i].c == at && c && j >= c->h && j <= c->e)) {
+            f->code[i].c += n;
+        }
+    }
+    for (i = 0; i < nloops; i++) {
+        if (loops[i].h > at || (loops[i].h == at && i == cur)) {
+            loops[i].h += n;
+        }
+        if (loops[i].e >= at) {
+            loops[i].e += n;
+        }
+    }
+}
+
+int lv_of(int r) {
+    return r < lreg_cap && lgen[r] == lgen_cur ? lreg[r] : -1;
+}
+
+void lv_set(int r, int v) {
+    int n;
+
+    if (r >= lreg_cap) {
+        n = r * 2 + 16;
+        lreg = (int *) mem_realloc(lreg, sizeof(int) * n, MEM_CODE);
+        lgen = (int *) mem_realloc(lgen, sizeof(int) * n, MEM_CODE);
+        memset(lgen + lreg_cap, 0, sizeof(int) * (n - lreg_cap));
+        lreg_cap = n;
+    }
+    lreg[r] = v;
+    lgen[r] = lgen_cur;
+}
+
+// 登记前置块里的一个值, 相同的算法和输入只算一次; 返回序号, 寄存器用完时返回 -1
+int lv_add(BcFunc *f, int op, int x, int y, int imm, int kind, int step) {
+    LoopVal *v;
+    int i;
+
+    for (i = 0; i < nlvals; i++) {
+        v = &lvals[i];
+        if (v->op == op && v->x == x && v->y == y && v->imm == imm && v->kind == kind) {
+            return i;
+        }
+    }
+    if (f->nregs >= loop_reg_max) {
+        return -1;
+    }
+    if (nlvals == lval_cap) {
+        lval_cap = lval_cap * 2 + 16;
+        lvals = (LoopVal *) mem_realloc(lvals, sizeof(LoopVal) * lval_cap, MEM_CODE);
+    }
+    v = &lvals[nlvals];
+    memset(v, 0, sizeof(LoopVal));
+    v->op = op;
+    v->x = x;
+    v->y = y;
+    v->imm = imm;
+    v->kind = kind;
+    v->step = step;
+    v->r = f->nregs++;
+    v->nofault = op == OP_LEAG || op == OP_LEAL;
+    v->known = op == OP_MOVI;
+    v->k = x;
+    return nlvals++;
+}
+
+// 前置块里的指令: x y 为输入寄存器, imm 为立即数或偏移
+void lv_insn(LoopVal *v, Insn *p) {
+    switch (v->op) {
+        case OP_MOVI: case OP_LEAL:
+            insn_set(p, v->op, v->r, v->x, 0);
+            break;
+        case OP_LEAG:
+            insn_set(p, v->op, v->r, v->x, v->imm);
+            break;
+        case OP_LDL1: case OP_LDL2: case OP_LDL4: case OP_LDL8:
+            insn_set(p, v->op, v->r, v->imm, 0);
+            break;
+        case OP_ADDI: case OP_MULI: case OP_NEG: case OP_ADDL4:
+        case OP_LD1: case OP_LD2: case OP_LD4: case OP_LD8:
+            insn_set(p, v->op, v->r, v->x, v->imm);
+            break;
+        default:
+            insn_set(p, v->op, v->r, v->x, v->y);
+            break;
+    }
+}
+
+// 循环里除 skip 之外的 STL 是否写到 [off, off+size)
+int loop_stored(Insn *code, int off, int size, int skip) {
+    Insn *p;
+    int i;
+
+    for (i = 0; i < nlstores; i++) {
+        p = &code[lstores[i]];
+        if (lstores[i] != skip && p->b < off + size && p->b + (1 << (p->op - OP_STL1)) > off) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int fits_step(long long s) {
+    return s != 0 && fits_int(s);
+}
+
+int loop_transform(BcFunc *f, int li, int min_leal, char *label) {
+    Insn *code = f->code, *p, *pre;
+    Loop *l = &loops[li];
+    int h = l->h, e = l->e, i, j, k = -1, ivoff = 0, ivsize = 0, ivstep = 0, n, size;
+    int mem_write = 0, unsafe_store = 0, x, y, vx, vy, v, nrepl = 0, op;
+    long long s;
+    LoopVal *a, *b;
+
+    // 循环里的写操作
+    nlstores = 0;
+    for (i = h; i <= e; i++) {
+        op = code[i].op;
+        if ((op >= OP_ST1 && op <= OP_ST8) || op == OP_VST || op == OP_MCPY || op == OP_CALL || op == OP_CALLI) {
+            mem_write = 1;
+        }
+        if (op >= OP_STL1 && op <= OP_STL8) {
+            if (nlstores == lstore_cap) {
+                lstore_cap = lstore_cap * 2 + 16;
+                lstores = (int *) mem_realloc(lstores, sizeof(int) * lstore_cap, MEM_CODE);
+            }
+            lstores[nlstores++] = i;
+            if (code[i].b + (1 << (op - OP_STL1)) > min_leal) {
+                unsafe_store = 1;
+            }
+        }
+    }
+
+    // 归纳变量: 回边之前 LDLn t, v; ADDI t, t, c; STLn t, v, 其后到回边没有跳转和跳转目标
+    for (i = e - 1; i >= h + 2 && !label[i + 1] && !(peep_flags[code[i].op] & PF_JUMP); i--) {
+        p = &code[i];
+        if (p->op >= OP_STL1 && p->op <= OP_STL8 && p[-2].op == p->op - OP_STL1 + OP_LDL1 && p[-2].b == p->b
+            && p[-2].a == p->a && p[-1].op == OP_ADDI && p[-1].a == p->a && p[-1].b == p->a && p[-1].c
+            && !label[i] && !label[i - 1] && p->b + (1 << (p->op - OP_STL1)) <= min_leal) {
+            k = i - 2;
+            ivoff = p->b;
+            ivsize = 1 << (p->op - OP_STL1);
+            ivstep = p[-1].c;
+            break;
+        }
+    }
+    if (k >= 0 && (ivsize < 4 || loop_stored(code, ivoff, ivsize, k + 2))) {
+        k = -1;
+    }
+
+    for (i = h; i <= e; i++) {
+        p = &code[i];
+        op = p->op;
+        if (i == h || label[i]) {
+            lgen_cur++;
+        }
+        v = -1;
+        x = (peep_flags[op] & PF_RB) ? lv_of(p->b) : -1;
+        y = (peep_flags[op] & PF_RC) ? lv_of(p->c) : -1;
+        a = x >= 0 ? &lvals[x] : NULL;
+        b = y >= 0 ? &lvals[y] : NULL;
+        // 归纳变量加步长之后 (循环末尾) 只找不变量
+        if (k < 0 || i >= k) {
+            if ((a && a->kind != LV_INV) || (b && b->kind != LV_INV)) {
+                a = b = NULL;
+            }
+        }
+        vx = a ? a->r : -1;
+        vy = b ? b->r : -1;
+        switch (op) {
+            case OP_MOVI:
+                v = lv_add(f, op, p->b, -1, 0, LV_INV, 0);
+                break;
+            case OP_LEAL:
+                v = lv_add(f, op, p->b, -1, 0, LV_INV, 0);
+                break;
+            case OP_LEAG:
+                v = lv_add(f, op, p->b, -1, p->c, LV_INV, 0);
+                break;
+            case OP_LDL1: case OP_LDL2: case OP_LDL4: case OP_LDL8:
+                size = 1 << (op - OP_LDL1);
+                if (k >= 0 && i < k && p->b == ivoff && size == ivsize) {
+                    v = lv_add(f, op, -1, -1, p->b, LV_IV, ivstep);
+                    break;
+                }
+                if (!loop_stored(code, p->b, size, -1) && (p->b + size <= min_leal || !mem_write)) {
+                    v = lv_add(f, op, -1, -1, p->b, LV_INV, 0);
+                }
+                break;
+            case OP_ADDL4:
+                if (a && a->kind == LV_INV && !loop_stored(code, p->c, 4, -1) && (p->c + 4 <= min_leal || !mem_write)) {
+                    v = lv_add(f, op, vx, -1, p->c, LV_INV, 0);
+                }
+                break;
+            case OP_LD1: case OP_LD2: case OP_LD4: case OP_LD8:
+                if (a && a->kind == LV_INV && a->nofault && !mem_write && !unsafe_store) {
+                    v = lv_add(f, op, vx, -1, p->c, LV_INV, 0);
+                }
+                break;
+            case OP_MOV:
+                if (a) {
+                    v = x;
+                }
+                break;
+            case OP_ADDI: case OP_MULI: case OP_NEG:
+                if (!a) {
+                    break;
+                }
+                if (a->kind == LV_INV) {
+                    v = lv_add(f, op, vx, -1, op == OP_NEG ? 0 : p->c, LV_INV, 0);
+                    break;
+                }
+                s = op == OP_ADDI ? a->step : op == OP_MULI ? (long long) a->step * p->c : -(long long) a->step;
+                if (fits_step(s)) {
+                    v = lv_add(f, op, vx, -1, op == OP_NEG ? 0 : p->c, LV_DERIVED, (int) s);
+                }
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_AND:
+            case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+            case OP_DIV: case OP_MOD:
+                if (!a || !b) {
+                    break;
+                }
+                if (a->kind == LV_INV && b->kind == LV_INV) {
+                    if ((op == OP_DIV || op == OP_MOD) && (!b->known || b->k == 0 || b->k == -1)) {
+                        break;
+                    }
+                    v = lv_add(f, op, vx, vy, 0, LV_INV, 0);
+                    break;
+                }
+                if (op == OP_ADD) {
+                    s = (long long) (a->kind == LV_INV ? 0 : a->step) + (b->kind == LV_INV ? 0 : b->step);
+                } else if (op == OP_SUB) {
+                    s = (long long) (a->kind == LV_INV ? 0 : a->step) - (b->kind == LV_INV ? 0 : b->step);
+                } else if (op == OP_MUL && a->kind == LV_INV && a->known) {
+                    s = (long long) a->k * b->step;
+                } else if (op == OP_MUL && b->kind == LV_INV && b->known) {
+                    s = (long long) a->step * b->k;
+                } else {
+                    break;
+                }
+                if (fits_step(s)) {
+                    v = lv_add(f, op, vx, vy, 0, LV_DERIVED, (int) s);
+                }
+                break;
+            default:
+                break;
+        }
+        // 常数和地址不替换, 只作为其他不变量的输入
+        if (v >= 0 && lvals[v].kind != LV_IV && op != OP_MOVI && op != OP_LEAL && op != OP_LEAG
+            && !(op == OP_MOV && p->b == lvals[v].r)) {
+            insn_set(p, OP_MOV, p->a, lvals[v].r, 0);
+            nrepl++;
+        }
+        if (op == OP_CALL || op == OP_CALLI) {
+            lv_set(p->a - 1, -1);
+        } else if (peep_flags[op] & PF_WA) {
+            lv_set(p->a, v);
+        }
+    }
+    if (!nrepl) {
+        f->nregs -= nlvals;
+        return 0;
+    }
+
+    // 派生归纳变量加步长, 接在归纳变量的 STL 之后
+    n = nlvals;
+    pre = (Insn *) mem_alloc(sizeof(Insn) * n, MEM_CODE);
+    for (i = j = 0; i < n; i++) {
+        if (lvals[i].kind == LV_DERIVED) {
+            insn_set(&pre[j++], OP_ADDI, lvals[i].r, lvals[i].r, lvals[i].step);
+            if (nlivs == liv_cap) {
+                liv_cap = liv_cap * 2 + 16;
+                livs = (LoopIv *) mem_realloc(livs, sizeof(LoopIv) * liv_cap, MEM_CODE);
+            }
+            livs[nlivs].r = lvals[i].r;
+            livs[nlivs++].loop = li;
+            stats.loop_ivs++;
+        } else if (lvals[i].kind == LV_INV) {
+            stats.loop_hoisted++;
+        }
+    }
+    if (j) {
+        loop_insert(f, k + 3, pre, j, li);
+    }
+    for (i = 0; i < n; i++) {
+        lv_insn(&lvals[i], &pre[i]);
+    }
+    loop_insert(f, loops[li].h, pre, n, li);
+    mem_free(pre, MEM_CODE);
+    return 1;
+}
+
+// 复制传播和死代码删除, 删去只自增的派生归纳变量; 被删的指令改为 NOP, 由窥孔优化去掉
+void loop_cleanup(BcFunc *f, char *label) {
+    int words = (f->nregs + 63) / 64, i, j, def, changed, round, reads, *use;
+    Bits *live;
+    Insn *p, *q;
+    Loop *l;
+
+    use = (int *) mem_alloc(sizeof(int) * (f->nregs + 3), MEM_CODE);
+    live = (Bits *) mem_alloc(sizeof(Bits) * words * (f->ncode + 1), MEM_CODE);
+    for (round = 0; round < 8; round++) {
+        changed = 0;
+        peep_labels(f->code, f->ncode, label);
+        liveness(f, live, words, use);
+        for (i = 0; i < f->ncode; i++) {
+            p = &f->code[i];
+            // MOV t, s; ..; X ..t..  且 t 在 X 之后不再使用 -> ..; X ..s..  中间不跳转 不写 t s
+            if (p->op == OP_MOV && p->a != p->b) {
+                for (j = i + 1, q = NULL; j < f->ncode && j <= i + LOOP_COPY_WINDOW && !label[j]; j++) {
+                    if (f->code[j].op == OP_CALL || f->code[j].op == OP_CALLI) {
+                        break;
+                    }
+                    if (insn_reads(&f->code[j], p->a, use)) {
+                        q = &f->code[j];
+                        break;
+                    }
+                    insn_regs(&f->code[j], use, &def);
+                    if ((peep_flags[f->code[j].op] & (PF_JUMP | PF_END)) || def == p->a || def == p->b) {
+                        break;
+                    }
+                }
+                if (q) {
+                    insn_regs(q, use, &def);
+                }
+                if (q && (def == p->a || !live_after(f, live, words, j, p->a))) {
+                    if ((peep_flags[q->op] & PF_RA) && q->a == p->a) {
+                        q->a = p->b;
+                    }
+                    if ((peep_flags[q->op] & PF_RB) && q->b == p->a) {
+                        q->b = p->b;
+                    }
+                    if ((peep_flags[q->op] & PF_RC) && q->c == p->a) {
+                        q->c = p->b;
+                    }
+                    p->op = OP_NOP;
+                    changed = 1;
+                    continue;
+                }
+            }
+            if ((peep_flags[p->op] & PF_PURE) && (peep_flags[p->op] & PF_WA) && !live_after(f, live, words, i, p->a)) {
+                p->op = OP_NOP;
+                changed = 1;
+            }
+        }
+        // 派生归纳变量在循环里只有自增在用它
+        for (j = 0; j < nlivs; j++) {
+            if (livs[j].r < 0) {
+                continue;
+            }
+            l = &loops[livs[j].loop];
+            for (i = l->h, reads = 0; i <= l->e && !reads; i++) {
+                p = &f->code[i];
+                if (!(p->op == OP_ADDI && p->a == livs[j].r && p->b == livs[j].r)) {
+                    reads = insn_reads(p, livs[j].r, use);
+                }
+            }
+            if (!reads) {
+                for (i = l->h; i <= l->e; i++) {
+                    p = &f->code[i];
+                    if (p->op == OP_ADDI && p->a == livs[j].r && p->b == livs[j].r) {
+                        p->op = OP_NOP;
+                    }
+                }
+                livs[j].r = -1;
+                stats.loop_ivs--;
+                changed = 1;
+            }
+        }
+        if (!changed) {
+            break;
+        }
+    }
+    mem_free(use, MEM_CODE);
+    mem_free(live, MEM_CODE);
+}
+
+// 次数是常数的循环的次数, 不能确定时返回 0; 循环体至少执行一次 (否则已被窥孔优化删去)
+long long trip_count(int op, long long k0, long long bound, long long c) {
+    long long d;
+
+    switch (op) {
+        case OP_JLEI: bound++;
+        case OP_JLTI:
+            return c > 0 ? (k0 < bound ? (bound - k0 + c - 1) / c : 1) : 0;
+        case OP_JGEI: bound--;
+        case OP_JGTI:
+            return c < 0 ? (k0 > bound ? (k0 - bound - c - 1) / -c : 1) : 0;
+        case OP_JNEI:
+            d = bound - k0;
+            return d % c == 0 && d / c > 0 ? d / c : 0;
+        default:
+            return 0;
+    }
+}
+
+// 展开最内层循环 l: [h, e-2] 为循环体 (含归纳变量加步长), e-1 e 为 LDLn x, v; JccI x, N, h
+int loop_unroll(BcFunc *f, Loop *l, int min_leal, char *label) {
+    Insn *code = f->code, *out, *p, *q;
+    int h = l->h, e = l->e, i, s, u, U, body, d, n = f->ncode, ivoff, ivsize;
+    long long k0, trips, c;
+
+    p = &code[e];
+    if (p->op < OP_JEQI || p->op > OP_JGEI || e - 1 <= h || code[e - 1].op < OP_LDL1 || code[e - 1].op > OP_LDL8
+        || code[e - 1].a != p->a || label[e - 1] || label[e]) {
+        return 0;
+    }
+    ivoff = code[e - 1].b;
+    ivsize = 1 << (code[e - 1].op - OP_LDL1);
+    if (ivsize < 4 || ivoff + ivsize > min_leal) {
+        return 0;
+    }
+    // 加步长: 之后到 e-1 只有派生归纳变量的自增
+    for (s = e - 2; s > h && code[s].op == OP_ADDI && code[s].a == code[s].b && !label[s]; s--);
+    if (s - 2 < h || code[s].op != OP_STL1 + (code[e - 1].op - OP_LDL1) || code[s].b != ivoff || label[s]
+        || code[s - 1].op != OP_ADDI || code[s - 1].a != code[s].a || code[s - 1].b != code[s].a || label[s - 1]
+        || code[s - 2].op != code[e - 1].op || code[s - 2].b != ivoff || code[s - 2].a != code[s].a) {
+        return 0;
+    }
+    c = code[s - 1].c;
+    // 循环里的跳转不回到 h 也不跳到 e-1 e, 也没有其他对 v 的写
+    for (i = h; i < e - 1; i++) {
+        p = &code[i];
+        if ((peep_flags[p->op] & PF_JUMP) && (p->c == h || p->c == e - 1 || p->c == e)) {
+            return 0;
+        }
+        if (i != s && p->op >= OP_STL1 && p->op <= OP_STL8 && p->b < ivoff + ivsize
+            && p->b + (1 << (p->op - OP_STL1)) > ivoff) {
+            return 0;
+        }
+    }
+    // 只从前面顺序执行进入 h
+    for (i = 0; i < n; i++) {
+        if ((i < h || i > e) && (peep_flags[code[i].op] & PF_JUMP) && code[i].c == h) {
+            return 0;
+        }
+    }
+    // 初值: 进入循环前的直线代码里最后一次 MOVI t, k0; STLn t, v
+    for (i = h - 1; ; i--) {
+        if (i < 1 || (i + 1 < h && label[i + 1]) || (peep_flags[code[i].op] & PF_END)
+            || code[i].op == OP_CALL || code[i].op == OP_CALLI) {
+            return 0;
+        }
+        p = &code[i];
+        if (p->op >= OP_STL1 && p->op <= OP_STL8 && p->b < ivoff + ivsize && p->b + (1 << (p->op - OP_STL1)) > ivoff) {
+            if (p->b != ivoff || 1 << (p->op - OP_STL1) != ivsize || p[-1].op != OP_MOVI || p[-1].a != p->a
+                || label[i]) {
+                return 0;
+            }
+            k0 = p[-1].b;
+            break;
+        }
+    }
+    trips = trip_count(code[e].op, k0, code[e].b, c);
+    body = e - 1 - h;
+    for (U = 8; U > 1 && (trips % U || trips < U || body * U > UNROLL_LIMIT); U /= 2);
+    if (U < 2 || !fits_int(k0 + trips * c)) {
+        return 0;
+    }
+
+    // 循环体复制 U 份, 循环内的跳转指向本份, 跳到循环之后的加上增加的长度
+    d = (U - 1) * body;
+    out = (Insn *) mem_alloc(sizeof(Insn) * (n + d + 1), MEM_CODE);
+    for (i = 0; i < n; i++) {
+        for (u = 0; u < (i >= h && i < e - 1 ? U : 1); u++) {
+            q = &out[i < h ? i : i < e - 1 ? i + u * body : i + d];
+            *q = code[i];
+            if (!(peep_flags[q->op] & PF_JUMP)) {
+                continue;
+            }
+            if (q->c >= e - 1) {
+                q->c += d;
+            } else if (q->c > h) {
+                q->c += u * body;
+            }
+        }
+    }
+    mem_free(f->code, MEM_CODE);
+    f->code = out;
+    f->ncode = n + d;
+    f->capcode = n + d + 1;
+    // 复制出的循环体算作第一份所在的语句
+    for (i = 0; i < f->nlocs; i++) {
+        if (f->locs[i].pos >= e - 1) {
+            f->locs[i].pos += d;
+        }
+    }
+    stats.loop_unrolled++;
+    return 1;
+}
+
+void loop_opt(BcFunc *f) {
+    char *label;
+    int i, j, n, min_leal = INT_MAX, changed = 0;
+
+    for (i = n = 0; i < f->ncode; i++) {
+        if ((peep_flags[f->code[i].op] & PF_JUMP) && f->code[i].c <= i) {
+            n++;
+        }
+        if (f->code[i].op == OP_LEAL && f->code[i].b < min_leal) {
+            min_leal = f->code[i].b;
+        }
+    }
+    if (!n) {
+        return;
+    }
+    loops = (Loop *) mem_alloc(sizeof(Loop) * n, MEM_CODE);
+    loop_reg_max = f->nregs + (LOOP_REG_LIMIT << (prof_temp(f->name) > 0));
+    find_loops(f);
+    for (i = 0; i < nloops; i++) {
+        for (j = i + 1, n = 1; j < nloops; j++) {
+            n += loops[j].h <= loops[i].h && loops[j].e >= loops[i].e;
+        }
+        if (n > LOOP_DEPTH_LIMIT) {
+            mem_free(loops, MEM_CODE);
+            loops = NULL;
+            return;
+        }
+    }
+    stats.loops += nloops;
+    nlvals = nlivs = 0;
+    label = (char *) mem_alloc(f->ncode + 1, MEM_CODE);
+    for (i = 0; i < nloops; i++) {
+        label = (char *) mem_realloc(label, f->ncode + 1, MEM_CODE);
+        peep_labels(f->code, f->ncode, label);
+        nlvals = 0;
+        changed |= loop_transform(f, i, min_leal, label);
+    }
+    if (changed) {
+        label = (char *) mem_realloc(label, f->ncode + 1, MEM_CODE);
+        loop_cleanup(f, label);
+        peephole(f);
+    }
+    // 展开: 最内层循环互不相交, 按位置从后往前做, 前面的循环位置不变
+    label = (char *) mem_realloc(label, f->ncode + 1, MEM_CODE);
+    find_loops(f);
+    peep_labels(f->code, f->ncode, label);
+    for (i = 0; i < nloops; i++) {
+        for (j = 0; j < nloops; j++) {
+            if (j != i && loops[j].h >= loops[i].h && loops[j].e <= loops[i].e) {
+                loops[i].h = -1;
+                break;
+            }
+        }
+    }
+    for (;;) {
+        for (i = 0, j = -1; i < nloops; i++) {
+            if (loops[i].h >= 0 && (j < 0 || loops[i].h > loops[j].h)) {
+                j = i;
+            }
+        }
+        if (j < 0) {
+            break;
+        }
+        if (loop_unroll(f, &loops[j], min_leal, label)) {
+            changed = 1;
+            label = (char *) mem_realloc(label, f->ncode + 1, MEM_CODE);
+            peep_labels(f->code, f->ncode, label);
+        }
+        loops[j].h = -1;
+    }
+    if (changed) {
+        peephole(f);
+    }
+    f->frame_words = f->nregs + f->frame_size / 8;
+    mem_free(label, MEM_CODE);
+    mem_free(loops, MEM_CODE);
+    loops = NULL;
+}
+
+// 向量化
+// 循环优化之前对每个函数的最内层循环做: 循环体是一个基本块, 归纳变量 i 步长为 1, 条件为 i < N 或 i <= N,
+// N 为常数或循环里不变的变量, 循环体里的存储都是 a[i] = 表达式, 表达式只由同宽度的 b[i] 常数 不变量和 + - * 组成.
+// 这样的循环改成每次处理 16 字节 (16 个 char / 8 个 short / 4 个 int) 的打包指令;
+// 按补码运算时结果的低 n 字节只取决于操作数的低 n 字节, 打包运算与逐个运算后截断的结果相同.
+// 向量循环放在原循环之前, 剩下不足 16 字节的元素和运行时别名检查失败时仍走原来的循环
+int opt_vector = 1, opt_vector_report = 0;
+
+#define VEC_BYTES 16
+#define VEC_CHECK_LIMIT 6           // 运行时别名检查的对数上限
+
+enum e_VecKind {
+    VN_CONST,               // 常数 c
+    VN_INV,                 // 循环里不变的变量, op 为装入它的指令, 局部变量 (VB_LOCAL) c 为帧内偏移
+    VN_ADDR,                // 地址或下标 base + i * scale + c
+    VN_LOAD,                // 从地址 a 装入 size 字节
+    VN_BIN,                 // a op b, op 为 ADD SUB MUL AND
+    VN_STORE,               // 把 b 存入地址 a, size 字节
+};
+
+enum e_VecBase {
+    VB_NONE,                // 只是下标
+    VB_GLOBAL,              // 全局变量 base, c 为偏移
+    VB_LOCAL,               // 局部数组, c 为帧内偏移
+    VB_PTR,                 // 帧内偏移 base 处的指针变量, c 为偏移
+};
+
+typedef struct VecNode {
+    int kind, op, a, b, size;
+    int bkind, base;
+    long long scale, c;
+    int reg;                // 生成的向量寄存器 标量寄存器或指针寄存器, -1 为还没有
+} VecNode;
+
+typedef struct InsnBuf {
+    Insn *code;
+    int n, cap;
+} InsnBuf;
+
+VecNode *vnodes;
+int nvnodes, vnode_cap;
+int *vreg_node;             // 寄存器 -> 节点, -1 为循环里还没写过
+int vec_ivop, vec_ivoff, vec_min_leal;
+char vec_reason[64];
+
+int vec_new(int kind, int op, int a, int b, int size) {
+    VecNode *v;
+
+    if (nvnodes == vnode_cap) {
+        vnode_cap = vnode_cap * 2 + 64;
+        vnodes = (VecNode *) mem_realloc(vnodes, sizeof(VecNode) * vnode_cap, MEM_CODE);
+    }
+    v = &vnodes[nvnodes];
+    memset(v, 0, sizeof(VecNode));
+    v->kind = kind;
+    v->op = op;
+    v->a = a;
+    v->b = b;
+    v->size = size;
+    v->reg = -1;
+    return nvnodes++;
+}
+
+int vec_addr(int bkind, int base, long long scale, long long c) {
+    int n = vec_new(VN_ADDR, 0, -1, -1, 0);
+
+    vnodes[n].bkind = bkind;
+    vnodes[n].base = base;
+    vnodes[n].scale = scale;
+    vnodes[n].c = c;
+    return n;
+}
+
+int vec_const(long long c) {
+    int n = vec_new(VN_CONST, 0, -1, -1, 0);
+
+    vnodes[n].c = c;
+    return n;
+}
+
+int vec_is_value(int n) {
+    return vnodes[n].kind != VN_ADDR && vnodes[n].kind != VN_STORE;
+}
+
+void ibuf_add(InsnBuf *b, int op, int x, int y, int z) {
+    if (b->n == b->cap) {
+        b->cap = b->cap * 2 + 32;
+        b->code = (Insn *) mem_realloc(b->code, sizeof(Insn) * b->cap, MEM_CODE);
+    }
+    insn_set(&b->code[b->n++], op, x, y, z);
+}
+
+// ADD SUB MUL AND 的符号运算, 地址按 base + i * scale + c 合并; AND 不参与地址
+char *vec_arith(int op, int x, int y, int *out) {
+    VecNode *a, *b, *t;
+    long long scale, c;
+
+    if (x < 0 || y < 0) {
+        return "uses a value computed before the loop";
+    }
+    a = &vnodes[x];
+    b = &vnodes[y];
+    if (a->kind == VN_CONST && b->kind == VN_CONST) {
+        c = op == OP_ADD ? a->c + b->c : op == OP_SUB ? a->c - b->c : op == OP_AND ? a->c & b->c : a->c * b->c;
+        if (!fits_int(c)) {
+            return "constant overflows";
+        }
+        *out = vec_const(c);
+        return NULL;
+    }
+    if (a->kind != VN_ADDR && b->kind != VN_ADDR) {
+        *out = vec_new(VN_BIN, op, x, y, 0);
+        return NULL;
+    }
+    if (a->kind != VN_ADDR || (op == OP_ADD && b->kind == VN_ADDR && b->bkind != VB_NONE)) {
+        t = a;
+        a = b;
+        b = t;
+    }
+    if (op == OP_ADD && b->kind == VN_ADDR) {
+        if (a->bkind != VB_NONE && b->bkind != VB_NONE) {
+            return "adds two addresses";
+        }
+        scale = a->scale + b->scale;
+        c = a->c + b->c;
+    } else if (op == OP_ADD && b->kind == VN_CONST) {
+        scale = a->scale;
+        c = a->c + b->c;
+    } else if (op == OP_ADD && b->kind == VN_INV && a->bkind == VB_NONE && b->bkind == VB_LOCAL && b->op == OP_LDL8) {
+        // 指针变量加下标
+        if (!fits_int(a->c)) {
+            return "index constant overflows";
+        }
+        *out = vec_addr(VB_PTR, (int) b->c, a->scale, a->c);
+        return NULL;
+    } else if (op == OP_SUB && a == &vnodes[x] && b->kind == VN_CONST) {
+        scale = a->scale;
+        c = a->c - b->c;
+    } else if (op == OP_MUL && a->bkind == VB_NONE && b->kind == VN_CONST) {
+        scale = a->scale * b->c;
+        c = a->c * b->c;
+    } else if (a->bkind == VB_NONE && b->kind != VN_ADDR) {
+        return "uses i as a value or combines it with a variable";
+    } else {
+        return "address is not linear in i";
+    }
+    if (!fits_int(scale) || !fits_int(c)) {
+        return "index constant overflows";
+    }
+    *out = vec_addr(a->bkind, a->base, scale, c);
+    return NULL;
+}
+
+// 读局部变量 off: 归纳变量 i 或不变量
+char *vec_local(int op, int off, int *out) {
+    int n = 1 << (op - OP_LDL1);
+
+    if (off == vec_ivoff && op == vec_ivop) {
+        *out = vec_addr(VB_NONE, 0, 1, 0);
+        return NULL;
+    }
+    if (off < vec_ivoff + (1 << (vec_ivop - OP_LDL1)) && off + n > vec_ivoff) {
+        return "reads part of the induction variable";
+    }
+    if (off + n > vec_min_leal) {
+        return "reads a local variable whose address is taken";
+    }
+    *out = vec_new(VN_INV, op, -1, -1, n);
+    vnodes[*out].bkind = VB_LOCAL;
+    vnodes[*out].c = off;
+    return NULL;
+}
+
+// 一条指令的符号执行, out 为得到的节点 (没有为 -1); 不能向量化时返回原因
+char *vec_step(Insn *p, int *out) {
+    int op = p->op, n, x, y;
+    VecNode *a;
+    char *reason;
+
+    *out = -1;
+    x = (peep_flags[op] & PF_RB) ? vreg_node[p->b] : -1;
+    y = (peep_flags[op] & PF_RC) ? vreg_node[p->c] : -1;
+    switch (op) {
+        case OP_NOP:
+            return NULL;
+        case OP_MOVI:
+            *out = vec_const(p->b);
+            return NULL;
+        case OP_MOV:
+            *out = x;
+            return x < 0 ? "uses a value computed before the loop" : NULL;
+        case OP_LEAG:
+            *out = vec_addr(VB_GLOBAL, p->b, 0, p->c);
+            return NULL;
+        case OP_LEAL:
+            *out = vec_addr(VB_LOCAL, 0, 0, p->b);
+            return NULL;
+        case OP_LDL1: case OP_LDL2: case OP_LDL4: case OP_LDL8:
+            return vec_local(op, p->b, out);
+        case OP_ADDL4:
+            reason = vec_local(OP_LDL4, p->c, &y);
+            return reason ? reason : vec_arith(OP_ADD, x, y, out);
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_AND:
+            return vec_arith(op, x, y, out);
+        case OP_ADDI:
+            return vec_arith(OP_ADD, x, vec_const(p->c), out);
+        case OP_MULI:
+            return vec_arith(OP_MUL, x, vec_const(p->c), out);
+        case OP_NEG:
+            return vec_arith(OP_SUB, vec_const(0), x, out);
+        case OP_LD1: case OP_LD2: case OP_LD4: case OP_LD8:
+            n = 1 << (op - OP_LD1);
+            if (x < 0 || vnodes[x].kind != VN_ADDR || vnodes[x].bkind == VB_NONE) {
+                return x < 0 ? "uses a value computed before the loop" : "loads through a computed pointer";
+            }
+            a = &vnodes[x];
+            if (!fits_int(a->c + p->c)) {
+                return "index constant overflows";
+            }
+            if (a->scale == 0 && a->bkind == VB_GLOBAL) {
+                *out = vec_new(VN_INV, op, -1, -1, n);
+                vnodes[*out].bkind = VB_GLOBAL;
+                vnodes[*out].base = vnodes[x].base;
+                vnodes[*out].c = vnodes[x].c + p->c;
+                return NULL;
+            }
+            if (a->scale == 0) {
+                return "loads memory that does not move with i";
+            }
+            if (a->scale != n) {
+                return "element stride is not the element size";
+            }
+            y = vec_addr(a->bkind, a->base, a->scale, a->c + p->c);
+            *out = vec_new(VN_LOAD, op, y, -1, n);
+            return NULL;
+        case OP_ST1: case OP_ST2: case OP_ST4: case OP_ST8:
+            n = 1 << (op - OP_ST1);
+            x = vreg_node[p->a];
+            y = vreg_node[p->b];
+            if (x < 0 || y < 0) {
+                return "uses a value computed before the loop";
+            }
+            a = &vnodes[y];
+            if (a->kind != VN_ADDR || a->bkind == VB_NONE || !fits_int(a->c + p->c)) {
+                return "stores through a computed pointer";
+            }
+            if (a->scale != n) {
+                return a->scale ? "element stride is not the element size" : "stores to memory that does not move with i";
+            }
+            if (!vec_is_value(x)) {
+                return vnodes[x].bkind == VB_NONE ? "stores the induction variable" : "stores an address";
+            }
+            y = vec_addr(a->bkind, a->base, a->scale, a->c + p->c);
+            *out = vec_new(VN_STORE, op, y, x, n);
+            return NULL;
+        case OP_STL1: case OP_STL2: case OP_STL4: case OP_STL8:
+            return "assigns a local variable (reduction or temporary)";
+        case OP_CALL: case OP_CALLI:
+            return "calls a function";
+        case OP_MCPY:
+            return "copies a struct";
+        default:
+            sprintf(vec_reason, "unsupported operation %s", op_names[op]);
+            return vec_reason;
+    }
+}
+
+// 节点树里的装入都是 size 字节
+int vec_sized(int n, int size) {
+    VecNode *v = &vnodes[n];
+
+    if (v->kind == VN_LOAD) {
+        return v->size == size;
+    }
+    if (v->kind == VN_BIN) {
+        return vec_sized(v->a, size) && vec_sized(v->b, size);
+    }
+    return 1;
+}
+
+int vec_same_addr(VecNode *a, VecNode *b) {
+    return a->bkind == b->bkind && a->base == b->base && a->c == b->c;
+}
+
+// 每个不同的地址一个指针寄存器, 指向当前 i 的元素
+int vec_ptr(BcFunc *f, int n, InsnBuf *pre, int ti) {
+    VecNode *a = &vnodes[n];
+    int k, r;
+
+    for (k = 0; k < nvnodes; k++) {
+        if (vnodes[k].kind == VN_ADDR && vnodes[k].reg >= 0 && vec_same_addr(&vnodes[k], a)) {
+            return a->reg = vnodes[k].reg;
+        }
+    }
+    r = a->reg = f->nregs++;
+    if (a->bkind == VB_GLOBAL) {
+        ibuf_add(pre, OP_LEAG, r, a->base, (int) a->c);
+    } else if (a->bkind == VB_LOCAL) {
+        ibuf_add(pre, OP_LEAL, r, (int) a->c, 0);
+    } else {
+        ibuf_add(pre, OP_LDL8, r, a->base, 0);
+        if (a->c) {
+            ibuf_add(pre, OP_ADDI, r, r, (int) a->c);
+        }
+    }
+    ibuf_add(pre, OP_ADD, r, r, ti);
+    return r;
+}
+
+// 常数和不变量的标量值
+void vec_scalar(VecNode *v, int r, InsnBuf *b) {
+    if (v->kind == VN_CONST) {
+        ibuf_add(b, OP_MOVI, r, (int) v->c, 0);
+    } else if (v->bkind == VB_LOCAL) {
+        ibuf_add(b, v->op, r, (int) v->c, 0);
+    } else {
+        ibuf_add(b, OP_LEAG, r, v->base, (int) v->c);
+        ibuf_add(b, v->op, r, r, 0);
+    }
+}
+
+// 值节点的向量寄存器, 常数和不变量在循环前广播到各元素
+int vec_value(BcFunc *f, int n, int size, InsnBuf *pre) {
+    VecNode *v = &vnodes[n];
+    int s;
+
+    if (v->reg < 0) {
+        s = f->nregs++;
+        v->reg = f->nregs;
+        f->nregs += 2;
+        vec_scalar(v, s, pre);
+        ibuf_add(pre, OP_PSPLAT1 + (size == 2) + (size == 4) * 2, v->reg, s, 0);
+    }
+    return v->reg;
+}
+
+int vectorize_loop(BcFunc *f, Loop *l, char *label, char **why, int *nchecks) {
+    Insn *code = f->code, *p;
+    int h = l->h, e = l->e, cs, k, i, j, n, x, op, size = 0, bound, incl, W, nbody, *inode;
+    int ri, rb, rl, ti, rlen, t, vh, m, ck, *pairs, npairs = 0;
+    InsnBuf pre = {0}, splat = {0}, body = {0};
+    VecNode *a, *b;
+    char *reason = NULL;
+
+    // 条件: LDLn x, i; JccI x, N, h  或  LDLn x, i; <取 N>; Jcc x, y, h
+    p = &code[e];
+    if (p->op != OP_JLTI && p->op != OP_JLEI && p->op != OP_JLT && p->op != OP_JLE) {
+        *why = "condition is not i < N or i <= N";
+        return 0;
+    }
+    incl = p->op == OP_JLEI || p->op == OP_JLE;
+    for (cs = e - 1; cs > h && !(code[cs].op >= OP_LDL1 && code[cs].op <= OP_LDL8 && code[cs].a == p->a); cs--);
+    k = cs - 3;
+    if (cs <= h || k < h || (code[cs].op != OP_LDL4 && code[cs].op != OP_LDL8)) {
+        *why = "no counted induction variable";
+        return 0;
+    }
+    vec_ivop = code[cs].op;
+    vec_ivoff = code[cs].b;
+    n = 1 << (vec_ivop - OP_LDL1);
+    if (code[k].op != vec_ivop || code[k].b != vec_ivoff || code[k + 1].op != OP_ADDI || code[k + 1].a != code[k].a
+        || code[k + 1].b != code[k].a || code[k + 2].op != OP_STL1 + (vec_ivop - OP_LDL1)
+        || code[k + 2].b != vec_ivoff || code[k + 2].a != code[k].a) {
+        *why = "no counted induction variable";
+        return 0;
+    }
+    if (code[k + 1].c != 1) {
+        *why = "induction variable step is not 1";
+        return 0;
+    }
+    if (vec_ivoff + n > vec_min_leal) {
+        *why = "induction variable has its address taken";
+        return 0;
+    }
+    for (i = h; i < e; i++) {
+        if ((i > h && label[i]) || (peep_flags[code[i].op] & (PF_JUMP | PF_END))) {
+            *why = "loop body has control flow";
+            return 0;
+        }
+    }
+
+    // 符号执行循环体和条件
+    nvnodes = 0;
+    for (i = 0; i < f->nregs; i++) {
+        vreg_node[i] = -1;
+    }
+    nbody = k - h;
+    inode = (int *) mem_alloc(sizeof(int) * (nbody + 1), MEM_CODE);
+    for (i = h; i < k && !reason; i++) {
+        reason = vec_step(&code[i], &inode[i - h]);
+        if ((peep_flags[code[i].op] & PF_WA) && !reason) {
+            vreg_node[code[i].a] = inode[i - h];
+        }
+    }
+    for (i = 0; i < f->nregs; i++) {
+        vreg_node[i] = -1;
+    }
+    for (i = cs + 1; i < e && !reason; i++) {
+        reason = vec_step(&code[i], &x);
+        if ((peep_flags[code[i].op] & PF_WA) && !reason) {
+            vreg_node[code[i].a] = x;
+        }
+    }
+    bound = -1;
+    if (!reason) {
+        bound = p->op == OP_JLTI || p->op == OP_JLEI ? vec_const(p->b) : vreg_node[p->b];
+        if (bound < 0 || (vnodes[bound].kind != VN_CONST && vnodes[bound].kind != VN_INV)) {
+            reason = "loop bound is not invariant";
+        }
+    }
+
+    // 元素宽度一致, 不变量不会被循环里的存储改写, 不同迭代之间没有依赖
+    pairs = (int *) mem_alloc(sizeof(int) * 2 * VEC_CHECK_LIMIT, MEM_CODE);
+    for (i = 0; i < nbody && !reason; i++) {
+        if (inode[i] < 0 || vnodes[inode[i]].kind != VN_STORE) {
+            continue;
+        }
+        a = &vnodes[vnodes[inode[i]].a];
+        if (!size) {
+            size = vnodes[inode[i]].size;
+        }
+        if (vnodes[inode[i]].size != size || size > 4) {
+            reason = size > 4 ? "elements wider than 4 bytes" : "mixed element sizes";
+            break;
+        }
+        for (j = 0; j < nvnodes && !reason; j++) {
+            b = &vnodes[j];
+            if (b->kind == VN_LOAD && b->size != size) {
+                reason = "mixed element sizes";
+            } else if (b->kind == VN_INV && b->bkind == VB_GLOBAL
+                       && (a->bkind == VB_PTR || (a->bkind == VB_GLOBAL && a->base == b->base))) {
+                reason = "a store may change a variable read as invariant";
+            }
+        }
+        for (j = 0; j < nbody && !reason; j++) {
+            x = inode[j];
+            if (j == i || x < 0 || (vnodes[x].kind != VN_LOAD && vnodes[x].kind != VN_STORE)) {
+                continue;
+            }
+            b = &vnodes[vnodes[x].a];
+            if (vec_same_addr(a, b)
+                || (a->bkind == VB_GLOBAL && b->bkind == VB_GLOBAL && a->base != b->base)
+                || (a->bkind == VB_GLOBAL && b->bkind == VB_LOCAL) || (a->bkind == VB_LOCAL && b->bkind == VB_GLOBAL)) {
+                continue;
+            }
+            if (a->bkind == b->bkind && a->base == b->base && a->bkind != VB_LOCAL) {
+                reason = "elements depend on other iterations";
+                break;
+            }
+            for (ck = 0; ck < npairs; ck++) {
+                if ((vec_same_addr(&vnodes[pairs[2 * ck]], a) && vec_same_addr(&vnodes[pairs[2 * ck + 1]], b))
+                    || (vec_same_addr(&vnodes[pairs[2 * ck]], b) && vec_same_addr(&vnodes[pairs[2 * ck + 1]], a))) {
+                    break;
+                }
+            }
+            if (ck == npairs) {
+                if (npairs == VEC_CHECK_LIMIT) {
+                    reason = "too many possibly aliasing pointers";
+                    break;
+                }
+                pairs[2 * npairs] = vnodes[inode[i]].a;
+                pairs[2 * npairs++ + 1] = vnodes[x].a;
+            }
+        }
+    }
+    if (!reason && !size) {
+        reason = "no array store";
+    }
+    if (!reason && vnodes[bound].kind == VN_INV && vnodes[bound].bkind == VB_GLOBAL) {
+        for (i = 0; i < nbody && !reason; i++) {
+            x = inode[i];
+            if (x >= 0 && vnodes[x].kind == VN_STORE) {
+                a = &vnodes[vnodes[x].a];
+                if (a->bkind == VB_PTR || (a->bkind == VB_GLOBAL && a->base == vnodes[bound].base)) {
+                    reason = "a store may change the loop bound";
+                }
+            }
+        }
+    }
+    if (reason) {
+        *why = reason;
+        mem_free(inode, MEM_CODE);
+        mem_free(pairs, MEM_CODE);
+        return 0;
+    }
+
+    // 循环前: ri = i, rb = 上界 (不含), rl = rb - W; ri <= rl 时还能再做一整个向量
+    W = VEC_BYTES / size;
+    ri = f->nregs++;
+    rb = f->nregs++;
+    rl = f->nregs++;
+    ti = f->nregs++;
+    ibuf_add(&pre, vec_ivop, ri, vec_ivoff, 0);
+    vec_scalar(&vnodes[bound], rb, &pre);
+    if (incl) {
+        ibuf_add(&pre, OP_ADDI, rb, rb, 1);
+    }
+    ibuf_add(&pre, OP_ADDI, rl, rb, -W);
+    ibuf_add(&pre, OP_MULI, ti, ri, size);
+    for (i = 0; i < nbody; i++) {
+        x = inode[i];
+        if (x >= 0 && (vnodes[x].kind == VN_LOAD || vnodes[x].kind == VN_STORE)) {
+            vec_ptr(f, vnodes[x].a, &pre, ti);
+        }
+    }
+    // 别名检查: 两段 [P, P + len) 相同或不相交, 否则走原来的循环
+    if (npairs) {
+        rlen = f->nregs++;
+        t = f->nregs++;
+        ibuf_add(&pre, OP_SUB, rlen, rb, ri);
+        ibuf_add(&pre, OP_MULI, rlen, rlen, size);
+        for (ck = 0; ck < npairs; ck++) {
+            x = vnodes[pairs[2 * ck]].reg;
+            j = vnodes[pairs[2 * ck + 1]].reg;
+            m = h + pre.n;
+            ibuf_add(&pre, OP_JEQ, x, j, m + 6);
+            ibuf_add(&pre, OP_ADD, t, j, rlen);
+            ibuf_add(&pre, OP_JGE, x, t, m + 6);
+            ibuf_add(&pre, OP_ADD, t, x, rlen);
+            ibuf_add(&pre, OP_JGE, j, t, m + 6);
+            ibuf_add(&pre, OP_JMP, 0, 0, -1);       // 原来的循环, 位置最后填
+        }
+    }
+    ck = pre.n;
+    ibuf_add(&pre, OP_JGT, ri, rl, -1);
+
+    // 循环体按原来的顺序生成: 装入 运算 存储
+    for (i = 0; i < nbody; i++) {
+        x = inode[i];
+        if (x < 0 || vnodes[x].reg >= 0) {
+            continue;
+        }
+        a = &vnodes[x];
+        op = size == 1 ? 0 : size == 2 ? 1 : 2;
+        if (a->kind == VN_LOAD) {
+            a->reg = f->nregs;
+            f->nregs += 2;
+            ibuf_add(&body, OP_VLD, a->reg, vnodes[a->a].reg, 0);
+        } else if (a->kind == VN_BIN) {
+            j = vec_value(f, a->a, size, &splat);
+            t = vec_value(f, a->b, size, &splat);
+            a = &vnodes[x];
+            a->reg = f->nregs;
+            f->nregs += 2;
+            if (a->op == OP_AND) {
+                ibuf_add(&body, OP_PAND, a->reg, j, t);
+            } else {
+                ibuf_add(&body, (a->op == OP_ADD ? OP_PADD1 : a->op == OP_SUB ? OP_PSUB1 : OP_PMUL1) + op, a->reg, j, t);
+            }
+        } else if (a->kind == VN_STORE) {
+            j = vnodes[a->a].reg;
+            t = vec_value(f, a->b, size, &splat);
+            ibuf_add(&body, OP_VST, t, j, 0);
+        }
+    }
+    for (i = 0; i < nvnodes; i++) {
+        if (vnodes[i].kind == VN_ADDR && vnodes[i].reg >= 0) {
+            for (j = 0; j < i && !(vnodes[j].kind == VN_ADDR && vnodes[j].reg == vnodes[i].reg); j++);
+            if (j == i) {
+                ibuf_add(&body, OP_ADDI, vnodes[i].reg, vnodes[i].reg, VEC_BYTES);
+            }
+        }
+    }
+    ibuf_add(&body, OP_ADDI, ri, ri, W);
+
+    // 拼接: pre splat 向量循环 尾部 (写回 i, 做完了跳过原来的循环); 一个向量也做不了时直接走原来的循环
+    vh = h + pre.n + splat.n;
+    m = vh + body.n + 3 - h;
+    for (i = 0; i < splat.n; i++) {
+        ibuf_add(&pre, splat.code[i].op, splat.code[i].a, splat.code[i].b, splat.code[i].c);
+    }
+    for (i = 0; i < body.n; i++) {
+        ibuf_add(&pre, body.code[i].op, body.code[i].a, body.code[i].b, body.code[i].c);
+    }
+    ibuf_add(&pre, OP_JLE, ri, rl, vh);
+    ibuf_add(&pre, OP_STL1 + (vec_ivop - OP_LDL1), ri, vec_ivoff, 0);
+    ibuf_add(&pre, OP_JGE, ri, rb, e + 1 + m);
+    for (i = 0; i <= ck; i++) {
+        if (pre.code[i].op == OP_JMP || i == ck) {
+            pre.code[i].c = h + m;
+        }
+    }
+    loop_insert(f, h, pre.code, m, (int) (l - loops));
+    *nchecks = npairs;
+    mem_free(inode, MEM_CODE);
+    mem_free(pairs, MEM_CODE);
+    mem_free(pre.code, MEM_CODE);
+    mem_free(splat.code, MEM_CODE);
+    mem_free(body.code, MEM_CODE);
+    return size;
+}
+
+void vectorize(BcFunc *f) {
+    static char *types[] = {"", "char", "short", "", "int"};
+    char *label, *why, *state, *where;
+    int i, j, n, size, nchecks = 0, done = 0;
+
+    for (i = n = 0; i < f->ncode; i++) {
+        if ((peep_flags[f->code[i].op] & PF_JUMP) && f->code[i].c <= i) {
+            n++;
+        }
+    }
+    if (!n) {
+        return;
+    }
+    vec_min_leal = INT_MAX;
+    for (i = 0; i < f->ncode; i++) {
+        if (f->code[i].op == OP_LEAL && f->code[i].b < vec_min_leal) {
+            vec_min_leal = f->code[i].b;
+        }
+    }
+    loops = (Loop *) mem_alloc(sizeof(Loop) * n, MEM_CODE);
+    find_loops(f);
+    label = (char *) mem_alloc(f->ncode + 1, MEM_CODE);
+    // state: 0 最内层 1 含有其他循环 2 已处理
+    state = (char *) mem_alloc(nloops + 1, MEM_CODE);
+    for (j = 0; j < nloops; j++) {
+        for (i = 0, n = 1; i < nloops; i++) {
+            n += i != j && loops[i].h <= loops[j].h && loops[i].e >= loops[j].e;
+        }
+        for (i = 0; i < nloops && (i == j || loops[i].h < loops[j].h || loops[i].e > loops[j].e); i++);
+        state[j] = i < nloops;
+        if (n > LOOP_DEPTH_LIMIT) {
+            nloops = 0;
+        }
+    }
+    peep_labels(f->code, f->ncode, label);
+    // 按位置从后往前, 前面的循环位置不变
+    for (;;) {
+        for (i = 0, j = -1; i < nloops; i++) {
+            if (state[i] != 2 && (j < 0 || loops[i].h > loops[j].h)) {
+                j = i;
+            }
+        }
+        if (j < 0) {
+            break;
+        }
+        where = insn_where(f, loops[j].e);
+        size = 0;
+        why = "contains another loop";
+        if (!state[j]) {
+            stats.vec_loops++;
+            vreg_node = (int *) mem_realloc(vreg_node, sizeof(int) * (f->nregs + 1), MEM_CODE);
+            size = vectorize_loop(f, &loops[j], label, &why, &nchecks);
+        }
+        if (size) {
+            label = (char *) mem_realloc(label, f->ncode + 1, MEM_CODE);
+            peep_labels(f->code, f->ncode, label);
+            done = 1;
+            stats.vec_done++;
+            stats.vec_checks += nchecks;
+        }
+        if (opt_vector_report) {
+            fprintf(stderr, "[VECTORIZE] %s: loop at %s: ", f->name, where ? where : "?");
+            if (size) {
+                fprintf(stderr, "vectorized, %s x%d%s\n", types[size], VEC_BYTES / size,
+                        nchecks ? ", with alias checks" : "");
+            } else {
+                fprintf(stderr, "not vectorized, %s\n", why);
+            }
+        }
+        state[j] = 2;
+    }
+    if (done) {
+        peephole(f);
+    }
+    f->frame_words = f->nregs + f->frame_size / 8;
+    mem_free(label, MEM_CODE);
+    mem_free(state, MEM_CODE);
+    mem_free(loops, MEM_CODE);
+    loops = NULL;
+}
+
+// 向量化在循环优化之前, 看到的还是原来的下标计算; profile 里没执行过的函数都不做
+void loop_func(BcFunc *f) {
+    if (prof_temp(f->name) < 0) {
+        return;
+    }
+    if (opt_vector) {
+        vectorize(f);
+    }
+    if (opt_loop) {
+        loop_opt(f);
+    }
+}
+
+void loop_module() {
+    int i;
+
+    for (i = 0; i < module.syms.count; i++) {
+        if (inline_defined(i) && !incr_clean(i)) {
+            loop_func(bc_sym(i)->func);
+        }
+    }
+}
+
+// 尾调用: 紧跟 RET (或 MOV; RET) 返回其结果的调用改为 TCALL/TCALLI, 被调函数换掉当前帧, 栈不随尾调用的层数增长.
+// 只在没有 LEAL 的函数里做: 局部变量的地址没有传出去, 换掉帧后不会有指针指向它. RET 留着, 可能是别处的跳转目标
+int opt_tail_call = 1;
+
+void tail_calls(BcFunc *f) {
+    Insn *p, *q, *end = f->code + f->ncode;
+
+    for (p = f->code; p < end; p++) {
+        if (p->op == OP_LEAL) {
+            return;
+        }
+    }
+    for (p = f->code; p + 1 < end; p++) {
+        if (p->op != OP_CALL && p->op != OP_CALLI) {
+            continue;
+        }
+        // 内联后结果可能先 MOV 到别的寄存器再返回
+        q = p[1].op == OP_MOV && p[1].b == p->a - 1 && p + 2 < end ? p + 2 : p + 1;
+        if (q->op == OP_RET && q->a == (q == p + 1 ? p->a - 1 : p[1].a)) {
+            p->op = p->op == OP_CALL ? OP_TCALL : OP_TCALLI;
+            stats.tail_calls++;
+        }
+    }
+}
+
+void tail_module() {
+    int i;
+
+    for (i = 0; i < module.syms.count; i++) {
+        if (inline_defined(i) && !incr_clean(i)) {
+            tail_calls(bc_sym(i)->func);
+        }
+    }
+}
+
+// 插桩和按 profile 排布, 编译函数体时的状态
+enum e_ProfAct {
+    PA_SWAP,                // if 的两臂对调: 热的 then 放到后面作为跳转目标, 不再执行它末尾跳过 else 的 JMP
+    PA_COLD,                // 冷的一臂移到函数末尾, 热路径顺序执行
+};
+
+typedef struct ProfAct {
+    int kind, s, m, e;      // then 为 [s, m), else 为 [m, e); PA_COLD 移动 [s, e)
+} ProfAct;
+
+ProfFunc *prof_cur;         // 当前函数的计数
+int prof_sym, prof_next;    // 当前函数的模块符号 下一个计数器编号
+SrcLoc prof_loc;            // 当前函数的位置, 函数体结束时已读到下一个单词
+int prof_loop;              // 所在 for 的层数
+ProfAct *prof_acts;
+int nprof_acts, prof_acts_cap;
+
+// 分配 n 个连续的计数器, 返回第一个的编号
+int prof_site(int n) {
+    prof_next += n;
+    return prof_next - n;
+}
+
+// 插桩时生成计数器 k 加一; PROF 的 b 先记函数符号, 翻译单元结束时改为计数器数组
+void prof_count(int k) {
+    if (opt_prof_gen) {
+        gen_insn(OP_PROF, 0, prof_sym, k);
+    }
+}
+
+// 计数器 k 的次数, 没有计数时为 -1
+long long prof_get(int k) {
+    return prof_cur && k <= prof_cur->n ? prof_cur->counts[k] : -1;
+}
+
+void prof_begin(int sym) {
+    prof_sym = sym;
+    prof_next = 1;
+    prof_loc = tok_loc;
+    prof_loop = 0;
+    nprof_acts = 0;
+    prof_cur = prof_use_file ? prof_find(bc_sym(sym)->name, 0) : NULL;
+    if (prof_cur) {
+        src_pin(prof_loc);
+    }
+    prof_count(prof_site(1));
+}
+
+// 计数器个数与 profile 对不上时源文件改过, 不用它的计数
+void prof_end() {
+    SrcLoc save = tok_loc;
+
+    if (opt_prof_gen) {
+        cur_func->nprof = prof_next - 1;
+    }
+    if (!prof_cur) {
+        return;
+    }
+    if (prof_cur->n != prof_next - 1) {
+        tok_loc = prof_loc;
+        warning("'%s'的profile与源文件不符, 忽略", prof_cur->name);
+        tok_loc = save;
+        prof_cur->stale = 1;
+        nprof_acts = 0;
+    } else {
+        stats.prof_funcs++;
+    }
+}
+
+void prof_act(int kind, int s, int m, int e) {
+    if (nprof_acts == prof_acts_cap) {
+        prof_acts_cap = prof_acts_cap * 2 + 16;
+        prof_acts = (ProfAct *) mem_realloc(prof_acts, sizeof(ProfAct) * prof_acts_cap, MEM_CODE);
+    }
+    prof_acts[nprof_acts].kind = kind;
+    prof_acts[nprof_acts].s = s;
+    prof_acts[nprof_acts].m = m;
+    prof_acts[nprof_acts++].e = e;
+}
+
+// if 语句结束时决定两臂的排布; 没有 else 时 m 为 -1, k 为 then 边和 else 边的计数器.
+// 循环里的臂不移出循环, 否则循环有了从外面回来的入口, 循环优化不再处理它
+void prof_if(int s, int m, int e, int k) {
+    long long t = prof_get(k), f = prof_get(k + 1);
+
+    if (t < 0 || f < 0 || t + f == 0) {
+        return;
+    }
+    if (m >= 0 && t > f && (prof_loop || f * PROF_COLD_RATIO > t)) {
+        prof_act(PA_SWAP, s, m, e);
+    } else if (!prof_loop && m >= 0 && m < e && f * PROF_COLD_RATIO <= t) {
+        prof_act(PA_COLD, m, m, e);
+    } else if (!prof_loop && t * PROF_COLD_RATIO <= f && s < (m >= 0 ? m : e)) {
+        prof_act(PA_COLD, s, s, m >= 0 ? m : e);
+    }
+}
+
+// 按记录的动作重排函数体: 每条指令的次序键为 (冷, 位置), 对调的两臂整体平移位置, 内层的先记录先平移.
+// 原来顺序执行到下一条的指令, 新次序里下一条变了时: 条件跳转正好跳到新的下一条就取反, 否则补一条 JMP
+void prof_layout(BcFunc *f) {
+    int n = f->ncode, i, j, k, w, *pos, *ord, *newpos;
+    char *cold;
+    Insn *out, *p;
+    ProfAct *a;
+
+    pos = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_CODE);
+    ord = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_CODE);
+    newpos = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_CODE);
+    cold = (char *) mallocz(n + 1, MEM_CODE);
+    for (i = 0; i < n; i++) {
+        pos[i] = i;
+    }
+    for (a = prof_acts; a < prof_acts + nprof_acts; a++) {
+        stats.prof_swapped += a->kind == PA_SWAP;
+        stats.prof_cold += a->kind == PA_COLD;
+        for (i = a->s; i < a->e; i++) {
+            if (a->kind == PA_COLD) {
+                cold[i] = 1;
+            } else {
+                pos[i] += i < a->m ? a->e - a->m : a->s - a->m;
+            }
+        }
+    }
+    for (i = 0; i < n; i++) {
+        newpos[pos[i]] = i;
+    }
+    // 热的在前, 冷的按原来的次序接在后面
+    for (k = j = 0; k < 2; k++) {
+        for (i = 0; i < n; i++) {
+            if (cold[newpos[i]] == k) {
+                ord[j++] = newpos[i];
+            }
+        }
+    }
+    out = (Insn *) mem_alloc(sizeof(Insn) * (2 * n + 1), MEM_CODE);
+    for (j = w = 0; j < n; j++) {
+        i = ord[j];
+        newpos[i] = w;
+        p = &out[w++];
+        *p = f->code[i];
+        if (i + 1 >= n || (peep_flags[p->op] & PF_END) || (j + 1 < n && ord[j + 1] == i + 1)) {
+            continue;
+        }
+        if (p->op >= OP_JZ && p->op <= OP_JGEI && j + 1 < n && p->c == ord[j + 1]) {
+            p->op = jcc_negate(p->op);
+            p->c = i + 1;
+        } else {
+            insn_set(&out[w++], OP_JMP, 0, 0, i + 1);
+        }
+    }
+    newpos[n] = w;
+    for (i = 0; i < w; i++) {
+        if (peep_flags[out[i].op] & PF_JUMP) {
+            out[i].c = newpos[out[i].c];
+        }
+    }
+    mem_free(f->code, MEM_CODE);
+    f->code = out;
+    f->ncode = w;
+    f->capcode = 2 * n + 1;
+    insn_loc_remap(f, newpos);
+    nprof_acts = 0;
+    mem_free(pos, MEM_CODE);
+    mem_free(ord, MEM_CODE);
+    mem_free(newpos, MEM_CODE);
+    mem_free(cold, MEM_CODE);
+}
+
+// 翻译单元结束时给插桩的函数分配计数器数组 "__prof.函数名", 第 0 个字为计数器个数.
+// 个数取编译函数体时分配的, 常量条件的 if 删去了一臂的计数器, 仍要与 -fprofile-use 时数出的个数一致
+void prof_finish() {
+    int i, j, n, k, count = module.syms.count;
+    BcSym *bs, *cs;
+    BcFunc *f;
+    char *name;
+
+    for (i = 0; i < count; i++) {
+        bs = bc_sym(i);
+        if (bs->kind != BS_FUNC || !bs->func || bs->func->native) {
+            continue;
+        }
+        f = bs->func;
+        n = f->nprof;
+        if (!n) {
+            continue;
+        }
+        name = (char *) mem_alloc(strlen(bs->name) + 8, MEM_MODULE);
+        sprintf(name, "__prof.%s", bs->name);
+        k = bc_sym_add(name, BS_DATA);
+        cs = bc_sym(k);
+        cs->size = 8 * (n + 1);
+        cs->align = 8;
+        cs->offset = section_alloc(&module.data, cs->size, 8);
+        *(long long *) (module.data.data + cs->offset) = n;
+        for (j = 0; j < f->ncode; j++) {
+            if (f->code[j].op == OP_PROF) {
+                f->code[j].b = k;
+            }
+        }
+        stats.prof_counters += n;
+    }
+}
+
+void gen_epilog() {
+    gen_insn(OP_RETV, 0, 0, 0);
+    if (nprof_acts) {
+        prof_layout(cur_func);
+    }
+    peephole(cur_func);
+    cur_func->frame_size = calc_align(loc > loc_max ? loc : loc_max, 8);
+    loc_max = 0;
+    cur_func->frame_words = cur_func->nregs + cur_func->frame_size / 8;
+}
+
+void init_codegen() {
+    dynArray_init(&global_sym_stack, 8, MEM_SYMBOL);
+    dynArray_init(&local_sym_stack, 8, MEM_SYMBOL);
+    dynArray_init(&module.syms, 8, MEM_MODULE);
+    dynstring_init(&module.data, 8, MEM_MODULE);
+    dynstring_init(&module.rodata, 8, MEM_MODULE);
+    module.init = bc_func_new("__init");
+    cur_func = module.init;
+
+    dynArray_init(&type_nodes, 64, MEM_SYMBOL);
+    int_type.t = T_INT;
+    char_pointer_type.t = T_CHAR;
+    mk_pointer(&char_pointer_type);
+    default_func_type = int_type;
+    mk_func(&default_func_type, KW_CDECL, 1, NULL);
+}
+
+// 翻译单元 --> {外部声明}文件结束符
+void translation_unit();
+
+// <外部声明> --> <函数定义>|<声明>
+void external_declaration(int);
+
+// <函数定义> --> <类型区分符><声明符><函数体>
+// <函数体> --> <复合语句>
+// <声明> --> <类型区分符>[<初值声明符表>]<分号>
+// <初值声明符表> --> <初值声明符>{<逗号><初值声明符>}
+// <初值声明符> --> <声明符>|<声明符><赋值运算符'='><初值符>
+// 变换文法定义到LL(1) ==>> 提取共有左部<类型区分符>
+// <外部声明> --> <类型区分符>(<声明符><函数体>|[<初值声明符表>]<分号>)
+// 扩展 <外部声明> --> <类型区分符>(<声明符><函数体>|<分号>|
+// <声明符>[<赋值运算符'='><初值符>]{<逗号><声明符>[<赋值运算符'='><初值符>]}<分号>)
+
+//<类型区分符> --> <数据类型>|<结构区分符>
+int type_specifier(Type *);
+
+//<声明符> --> {<指针>}[<调用约定>][<结构成员对齐>]<直接声明符>
+void declarator(Type *, int *, int *);
+
+//<调用约定> --> <__cdecl>|<__stdcall>
+void function_calling_convention(int *);
+
+//<结构成员对齐> --> <__align>'('<整数常量>')'
+void struct_member_alignment(int *);
+
+//<直接声明符> --> <标识符><直接声明符后缀>
+void direct_declarator(Type *, int *, int);
+
+//<直接声明符后缀> --> {'['']'|'['<整数常量>']'|'('')'|'('<形参表>')'}
+void direct_declarator_postfix(Type *, int);
+
+//<形参表> --> <参数表>|<参数表>',''...'
+//<参数表> --> <参数声明>{','<参数声明>}
+//<参数声明> --> <类型区分符>{<声明符>}
+void parameter_type_list(Type *, int);
+
+// 最近一个形参表带名字的形参链; 函数类型结点里的形参不带名字
+Symbol *func_params;
+
+//<函数体> --> <复合语句>
+void funcbody(Symbol *);
+
+// 增量编译, 见后文
+char *incr_src;
+int incr_capture;                   // 正在编译要记录的函数体
+void incr_decl_begin();
+void incr_funcbody(Symbol *);
+void incr_log_sym(int addr);
+void incr_opt_begin();
+void incr_opt_mid();
+void incr_finish();
+
+// 链接时优化, 见后文
+int opt_lto;                        // -flto: 目标文件带上链接时优化所需的信息, 跨函数的优化推迟到链接时
+
+// 并行编译, 见后文
+char *par_src;
+int par_capture;                    // 工作进程正在编译分给自己的函数体
+SrcLoc block_end;                   // 最近一个复合语句的 '}' 的位置
+void par_funcbody(Symbol *);
+void par_log(int addr);
+void par_finish();
+
+//<复合语句> --> '{' {<声明>}{<语句>} '}'
+void compound_statement(int *, int *);
+
+//<初值符> --> <赋值表达式>
+void initializer(Symbol *);
+
+void assignment_expression();
+
+//<结构区分符> --> <struct关键字><标识符>'{'<结构声明表>'}'|<struct关键字><标识符>
+void struct_specifier(Type *);
+
+//<结构声明表> --> <结构声明>{<结构声明>}
+void struct_declaration_list(Type *);
+
+//<结构声明> --> <类型区分符>{<结构声明符表>}';'
+//<结构声明符表> --> <声明符>{','<声明符>}
+void struct_declaration(int *, int *, Symbol ***);
+
+// ......
+void translation_unit() {
+    while (token != TK_EOF) {
+        if (incr_src) {
+            incr_decl_begin();
+        }
+        external_declaration(SC_GLOBAL);
+    }
+    if (par_src) {
+        par_finish();
+    }
+    // 初始化代码没有局部变量, 不沿用最后一个函数的局部变量区
+    cur_func = module.init;
+    loc = 0;
+    gen_epilog();
+    if (opt_prof_gen) {
+        prof_finish();
+    }
+    func_flags();
+    if (incr_src) {
+        incr_opt_begin();
+    }
+    // -flto: 跨函数的优化留到链接时对所有文件一起做
+    if (opt_inline && !opt_lto) {
+        inline_module();
+    }
+    if (incr_src) {
+        incr_opt_mid();
+    }
+    if ((opt_loop || opt_vector) && !opt_lto) {
+        loop_module();
+    }
+    if (opt_tail_call && !opt_lto) {
+        tail_module();
+    }
+    if (incr_src) {
+        incr_finish();
+    }
+    str_pool_finish();
+}
+
+// 函数符号: 原型和定义共用一个模块符号; next 为最近一次声明带名字的形参链, 函数体用它登记形参
+Symbol *func_sym_push(int v, Type *type) {
+    Symbol *s = sym_search(v);
+
+    if (s && (s->type.t & T_BTYPE) == T_FUNC && (s->r & SC_SYM)) {
+        // 类型结点唯一, 比较指针即可; 隐式声明可以被任何原型取代
+        if (!type_equal(&s->type, type) && s->type.ref != default_func_type.ref) {
+            error("'%s'的类型与之前的声明不一致", get_tkstr(v));
+        }
+        s->type = *type;
+        s->next = type == &default_func_type ? NULL : func_params;
+        return s;
+    }
+    if (s && !local_sym_stack.count) {
+        error("'%s'重定义", get_tkstr(v));
+    }
+    s = sym_push(v, type, SC_GLOBAL | SC_SYM, bc_sym_add(get_tkstr(v), BS_UNDEF));
+    s->next = type == &default_func_type ? NULL : func_params;
+    if (par_capture) {
+        par_log(s->c);
+    } else if (incr_capture) {
+        incr_log_sym(s->c);
+    }
+    return s;
+}
+
+// 分配变量存储空间并登记符号
+Symbol *var_sym_put(Type *type, int r, int v) {
+    int size, align, addr;
+    BcSym *bs;
+
+    size = type_size(type, &align);
+    if (size < 0 || (size == 0 && !(type->t & T_ARRAY))) {
+        error("'%s'的类型尺寸未知", get_tkstr(v));
+    }
+    if ((r & SC_VALMASK) == SC_LOCAL) {
+        loc = calc_align(loc, align);
+        addr = loc;
+        loc += size;
+        return sym_push(v, type, r, addr);
+    }
+    if (sym_search(v)) {
+        error("'%s'重定义", get_tkstr(v));
+    }
+    addr = bc_sym_add(get_tkstr(v), BS_DATA);
+    bs = bc_sym(addr);
+    bs->offset = section_alloc(&module.data, size, align);
+    bs->size = size;
+    bs->align = align;
+    bs->common = 1;
+    return sym_push(v, type, r | SC_SYM, addr);
+}
+
+void external_declaration(int l) {
+    Type btype, type;
+    int v, r, has_init;
+    Symbol *sym;
+
+    if (!type_specifier(&btype)) {
+        expect("<类型区分符>");
+    }
+
+    if (token == TK_SEMICOLON) {
+        get_token();
+        return;
+    }
+    while (1) {
+        type = btype;
+        declarator(&type, &v, NULL);
+        if (token == TK_BEGIN) {
+            if (l == SC_LOCAL) {
+                error("不支持嵌套定义");
+            }
+            if ((type.t & T_BTYPE) != T_FUNC) {
+                expect("<函数定义>");
+            }
+            sym = func_sym_push(v, &type);
+            if (incr_src) {
+                incr_funcbody(sym);
+            } else if (par_src) {
+                par_funcbody(sym);
+            } else {
+                funcbody(sym);
+            }
+            break;
+        } else {
+            if ((type.t & T_BTYPE) == T_FUNC) {
+                func_sym_push(v, &type);
+            } else {
+                r = l;
+                if (!(type.t & T_ARRAY)) {
+                    r |= SC_LVAL;
+                }
+                has_init = token == TK_ASSIGN;
+                if (has_init) {
+                    get_token();
+                    // char s[] = "..." 由字符串确定数组长度
+                    if ((type.t & T_ARRAY) && type.ref->c < 0 && token == TK_CSTR) {
+                        type = *pointed_type(&type);
+                        mk_array(&type, (int) tkstr.count);
+                    }
+                }
+                sym = var_sym_put(&type, r, v);
+                if (has_init) {
+                    initializer(sym);
+                }
+            }
+            if (token == TK_COMMA) {
+                get_token();
+            } else {
+                skip(TK_SEMICOLON);
+                break;
+            }
+        }
+    }
+}
+
+int type_specifier(Type *type) {
+    int t = 0, type_found = 0;
+    Type type1;
+
+    switch (token) {
+        case KW_CHAR:
+            t = T_CHAR;
+            type_found = 1;
+            get_token();
+            break;
+        case KW_SHORT:
+            t = T_SHORT;
+            type_found = 1;
+            get_token();
+            break;
+        case KW_VOID:
+            t = T_VOID;
+            type_found = 1;
+            get_token();
+            break;
+        case KW_INT:
+            t = T_INT;
+            type_found = 1;
+            get_token();
+            break;
+        case KW_STRUCT:
+            struct_specifier(&type1);
+            type->ref = type1.ref;
+            t = T_STRUCT;
+            type_found = 1;
+            break;
+        default:
+            break;
+    }
+    if (t != T_STRUCT) {
+        type->ref = NULL;
+    }
+    type->t = t;
+    return type_found;
+}
+
+void struct_specifier(Type *type) {
+    int v;
+    Symbol *s;
+    Type type1;
+
+    get_token();
+    v = token;
+    get_token();
+    if (v < TK_IDENT) {
+        expect("结构体名字不能是关键字");
+    }
+    s = struct_search(v);
+    if (!s) {
+        type1.t = KW_STRUCT;
+        type1.ref = NULL;
+        s = sym_push(v | SC_STRUCT, &type1, 0, -1);
+        s->r = 0;
+    }
+    type->t = T_STRUCT;
+    type->ref = s;
+    if (token == TK_BEGIN) {
+        struct_declaration_list(type);
+    }
+}
+
+void struct_declaration_list(Type *type) {
+    int maxalign, offset;
+    Symbol *s, **ps;
+
+    s = type->ref;
+    if (s->c != -1) {
+        error("结构体已定义");
+    }
+    get_token();
+    maxalign = 1;
+    offset = 0;
+    ps = &s->next;
+    while (token != TK_END) {
+        struct_declaration(&maxalign, &offset, &ps);
+    }
+    skip(TK_END);
+    s->c = calc_align(offset, maxalign);
+    s->r = maxalign;
+}
+
+void struct_declaration(int *maxalign, int *offset, Symbol ***ps) {
+    int v, size, align, force_align;
+    Symbol *ss;
+    Type type1, btype;
+
+    type_specifier(&btype);
+    while (1) {
+        type1 = btype;
+        declarator(&type1, &v, &force_align);
+        size = type_size(&type1, &align);
+        if (size < 0) {
+            error("结构体成员'%s'的类型尚未定义", get_tkstr(v));
+        }
+        if (force_align & ALIGN_SET) {
+            align = force_align & ~ALIGN_SET;
+        }
+        *offset = calc_align(*offset, align);
+        if (align > *maxalign) {
+            *maxalign = align;
+        }
+        ss = sym_push(v | SC_MEMBER, &type1, 0, *offset);
+        *offset += size;
+        **ps = ss;
+        *ps = &ss->next;
+        if (token == TK_SEMICOLON) {
+            break;
+        }
+        skip(TK_COMMA);
+    }
+    skip(TK_SEMICOLON);
+}
+
+void function_calling_convention(int *fc) {
+    *fc = KW_CDECL;
+    if (token == KW_CDECL || token == KW_STDCALL) {
+        *fc = token;
+        get_token();
+    }
+}
+
+void struct_member_alignment(int *force_align) {
+    int align = 1;
+
+    *force_align = 1;
+    if (token == KW_ALIGN) {
+        get_token();
+        skip(TK_OPENPA);
+        if (token == TK_CINT) {
+            align = tkvalue;
+            get_token();
+        } else {
+            expect("常数整亮");
+        }
+        skip(TK_CLOSEPA);
+        if (align != 1 && align != 2 && align != 4 && align != 8) {
+            warning("__align只支持1 2 4 8, 按1处理");
+            align = 1;
+        }
+        *force_align = align | ALIGN_SET;
+    }
+}
+
+void declarator(Type *type, int *v, int *force_align) {
+    int fc, align;
+
+    while (token == TK_STAR) {
+        mk_pointer(type);
+        get_token();
+    }
+    function_calling_convention(&fc);
+    struct_member_alignment(force_align ? force_align : &align);
+    direct_declarator(type, v, fc);
+}
+
+void direct_declarator(Type *type, int *v, int fc) {
+    if (token >= TK_IDENT) {
+        *v = token;
+        get_token();
+    } else {
+        expect("标识符");
+    }
+    direct_declarator_postfix(type, fc);
+}
+
+void direct_declarator_postfix(Type *type, int fc) {
+    int n;
+
+    if (token == TK_OPENPA) {
+        parameter_type_list(type, fc);
+    } else if (token == TK_OPENBR) {
+        get_token();
+        n = -1;
+        if (token == TK_CINT) {
+            n = tkvalue;
+            get_token();
+        }
+        skip(TK_CLOSEBR);
+        direct_declarator_postfix(type, fc);
+        mk_array(type, n);
+    }
+}
+
+void parameter_type_list(Type *type, int fc) {
+    int n, variadic = 0;
+    Symbol **plast, *s, *first;
+    Type pt;
+
+    get_token();
+    first = NULL;
+    plast = &first;
+    while (token != TK_CLOSEPA) {
+        if (token == TK_ELLIPSIS) {
+            get_token();
+            variadic = 1;
+            break;
+        }
+        if (!type_specifier(&pt)) {
+            error("无效类型标识符");
+        }
+        declarator(&pt, &n, NULL);
+        if (pt.t & T_ARRAY) {
+            // 数组形参退化为指针
+            pt = *pointed_type(&pt);
+            mk_pointer(&pt);
+        }
+        s = sym_push(n | SC_PARAMS, &pt, 0, 0);
+        *plast = s;
+        plast = &s->next;
+        if (token == TK_CLOSEPA) {
+            break;
+        }
+        skip(TK_COMMA);
+    }
+    skip(TK_CLOSEPA);
+    mk_func(type, fc, variadic, first);
+    func_params = first;
+}
+
+void funcbody(Symbol *sym) {
+    BcSym *bs = bc_sym(sym->c);
+
+    if (bs->kind == BS_FUNC) {
+        error("'%s'重定义", bs->name);
+    }
+    bs->kind = BS_FUNC;
+    bs->func = bc_func_new(bs->name);
+    cur_func = bs->func;
+    func_ret_type = sym->type.ref->type;
+    insn_loc(tok_loc);
+    loc = 0;
+    // 局部符号栈非空表示进入函数作用域
+    sym_direct_push(&local_sym_stack, SC_ANOM, &int_type, 0);
+    gen_prolog(sym);
+    prof_begin(sym->c);
+    compound_statement(NULL, NULL);
+    prof_end();
+    gen_epilog();
+    sym_pop(&local_sym_stack, NULL);
+    cur_func = module.init;
+}
+
+void initializer(Symbol *sym) {
+    BcFunc *save = cur_func;
+    BcSym *bs = NULL;
+    int n, size, align;
+
+    if (sym->r & SC_SYM) {
+        // 全局变量: 常量直接写入数据段, 其余生成初始化代码
+        bs = bc_sym(sym->c);
+        bs->common = 0;
+        cur_func = module.init;
+    }
+    if ((sym->type.t & T_ARRAY) && token == TK_CSTR
+        && (pointed_type(&sym->type)->t & T_BTYPE) == T_CHAR) {
+        size = type_size(&sym->type, &align);
+        n = tkstr.count < size ? tkstr.count : size;
+        if (bs) {
+            memcpy(module.data.data + bs->offset, tkstr.data, n);
+            get_token();
+        } else {
+            operand_push(&int_type, SC_LOCAL, sym->c);
+            load_1(optop);
+            assignment_expression();
+            load_1(optop);
+            gen_insn(OP_MCPY, opd_reg(optop) - 1, opd_reg(optop), n);
+            operand_pop();
+            operand_pop();
+        }
+        cur_func = save;
+        return;
+    }
+    if (sym->type.t & T_ARRAY) {
+        error("数组只能用字符串初始化");
+    }
+    operand_push_sym(sym);
+    n = cur_func->ncode;
+    assignment_expression();
+    if (bs && is_const(optop) && cur_func->ncode == n && (sym->type.t & T_BTYPE) != T_STRUCT) {
+        size = type_size(&sym->type, &align);
+        memcpy(module.data.data + bs->offset, &optop->value, size);
+        operand_pop();
+    } else {
+        store0_1();
+    }
+    operand_pop();
+    cur_func = save;
+}
+
+//<语句> --> {<复合语句>|<if>|<for>|<switch>|<case>|
+// <break>|<continue>|<return>|<表达式语句>}
+void statement(int *, int *);
+
+//<复合语句> --> '{' {<声明>}{<语句>} '}'
+void compound_statement(int *, int *);
+
+//<if> --> 'if''('<表达式>')'<语句>['else'<语句>]
+void if_statement(int *, int *);
+
+//<for> --> 'for''('<表达式语句><表达式语句><表达式语句>')'<语句>
+void for_statement(int *, int *);
+
+//<switch> --> 'switch''('<表达式>')'<语句>
+void switch_statement(int *);
+
+//<case> --> 'case'<相等类表达式>':'[<语句>]|'default'':'[<语句>]
+void case_statement(int *, int *);
+
+//<break> --> 'break' ';'
+void break_statement(int *);
+
+//<continue> --> 'continue' ';'
+void continue_statement(int *);
+
+//<return> --> 'return' <expression> ';'
+void return_statement();
+
+//<表达式语句> --> [<expression>]';'
+void expression_statement();
+
+int is_type_specifier(int);
+
+//<表达式> --> <赋值表达式>{','<赋值表达式>}
+void expression();
+
+//<赋值表达式> --> <按位与表达式>|<一元表达式>'='<赋值表达式>
+//<按位与表达式> ==>>(n) <一元表达式> ......
+// 非等价变换后 <赋值表达式> --> <按位与表达式>|<一元表达式>'='<赋值表达式>
+// 有隐患 但在语义分析阶段处理
+void assignment_expression();
+
+//<按位与表达式> --> <相等类表达式>{'&'<相等类表达式>}
+void and_expression();
+
+//<相等类表达式> --> <关系表达式>{'=='<关系表达式>|'!='<关系表达式>}
+void equality_expression();
+
+//<关系表达式> --> <加减类表达式>{'<'<加减类表达式>|'>'<加减类表达式>|
+// '<='<加减类表达式>|'>='<加减类表达式>}
+void relational_expression();
+
+//<加减类表达式> --> <乘除类表达式>{'+'<乘除类表达式>|'-'<乘除类表达式>}
+void additive_expression();
+
+//<乘除表达式> --> <一元表达式>{'*'<一元表达式>|'/'<一元表达式>|'%'<一元表达式>}
+void multiplicative_expression();
+
+//<一元表达式> --> <后缀表达式>|'&'<一元表达式>|'*'<一元表达式>|'+'<一元表达式>|'-'<一元表达式>|<sizeof表达式>
+void unary_expression();
+
+//<后缀表达式> --> <初等表达式>{'['<expression>']'|'('')'|'('<实参表达式>')'
+//|'.'IDENTIFIER|'->'IDENTIFIER}
+void postfix_expression();
+// <初等表达式> --> <标识符>|<整数常量>|<字符串常量>|<字符常量>|(<表达式>)
+void primary_expression();
+// <实参表达式> --> <赋值表达式>{','<赋值表达式>}
+void argument_expression_list();
+//<sizeof表达式> ==>> 'struct''('<类型区别符>')'
+void sizeof_expression();
+
+
+void statement(int *bsym, int *csym) {
+    insn_loc(tok_loc);
+    switch (token) {
+        case TK_BEGIN:
+            compound_statement(bsym, csym);
+            break;
+        case KW_IF:
+            if_statement(bsym, csym);
+            break;
+        case KW_FOR:
+            for_statement(bsym, csym);
+            break;
+        case KW_SWITCH:
+            switch_statement(csym);
+            break;
+        case KW_CASE:
+        case KW_DEFAULT:
+            case_statement(bsym, csym);
+            break;
+        case KW_BREAK:
+            break_statement(bsym);
+            break;
+        case KW_CONTINUE:
+            continue_statement(csym);
+            break;
+        case KW_RETURN:
+            return_statement();
+            break;
+        default:
+            expression_statement();
+            break;
+    }
+}
+
+void compound_statement(int *bsym, int *csym) {
+    Symbol *s = sym_top(&local_sym_stack);
+    int save = loc;
+
+    get_token();
+    while (is_type_specifier(token)) {
+        insn_loc(tok_loc);
+        external_declaration(SC_LOCAL);
+    }
+    while (token != TK_END) {
+        statement(bsym, csym);
+    }
+    sym_pop(&local_sym_stack, s);
+    // 出了语句块它的局部变量不再使用, 后面的兄弟语句块从同一位置分配
+    if (loc > loc_max) {
+        loc_max = loc;
+    }
+    loc = save;
+    block_end = tok_loc;
+    get_token();
+}
+
+int is_type_specifier(int v) {
+    switch (v) {
+        case KW_CHAR:
+        case KW_SHORT:
+        case KW_INT:
+        case KW_VOID:
+        case KW_STRUCT:
+            return 1;
+        default:
+            break;
+    }
+    return 0;
+}
+
+void expression_statement() {
+    if (token != TK_SEMICOLON) {
+        expression();
+        operand_pop();
+    }
+    skip(TK_SEMICOLON);
+}
+
+void if_statement(int *bsym, int *csym) {
+    int a, b, k, s, m = -1;
+
+    get_token();
+    skip(TK_OPENPA);
+    expression();
+    skip(TK_CLOSEPA);
+    a = gen_jcc(-1, 0);
+    k = prof_site(2);
+    s = cur_func->ncode;
+    prof_count(k);
+    statement(bsym, csym);
+    if (token == KW_ELSE) {
+        get_token();
+        b = gen_jmpforward(-1);
+        backpatch(a, cur_func->ncode);
+        m = cur_func->ncode;
+        prof_count(k + 1);
+        statement(bsym, csym);
+        backpatch(b, cur_func->ncode);
+    } else if (opt_prof_gen) {
+        // 插桩时为条件不成立的边建一个块
+        b = gen_jmpforward(-1);
+        backpatch(a, cur_func->ncode);
+        prof_count(k + 1);
+        backpatch(b, cur_func->ncode);
+    } else {
+        backpatch(a, cur_func->ncode);
+    }
+    prof_if(s, m, cur_func->ncode, k);
+}
+
+// 把 [start, ncode) 的指令移出, 返回副本
+Insn *code_cut(int start, int *n) {
+    Insn *p;
+
+    *n = cur_func->ncode - start;
+    p = (Insn *) mem_alloc(sizeof(Insn) * (*n + 1), MEM_CODE);
+    memcpy(p, cur_func->code + start, sizeof(Insn) * *n);
+    cur_func->ncode = start;
+    return p;
+}
+
+void code_paste(Insn *p, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        gen_insn(p[i].op, p[i].a, p[i].b, p[i].c);
+    }
+}
+
+// 循环条件放到循环体之后, 每次迭代只执行一次比较跳转:
+//   init; cond; JF exit; body: stmt; cont: incr; cond; JT body; exit:
+// 条件和增量表达式不含跳转, 可以整体搬移
+void for_statement(int *bsym, int *csym) {
+    int a = -1, b = -1, body, ncond = 0, nincr = 0, has_cond = 0, k = prof_site(2);
+    Insn *cond = NULL, *incr = NULL;
+    Operand test;
+    SrcLoc floc = tok_loc;
+
+    get_token();
+    skip(TK_OPENPA);
+    if (token != TK_SEMICOLON) {
+        expression();
+        operand_pop();
+    }
+    skip(TK_SEMICOLON);
+    if (token != TK_SEMICOLON) {
+        body = cur_func->ncode;
+        expression();
+        if ((optop->r & SC_VALMASK) != SC_CMP && !is_const(optop)) {
+            load_1(optop);
+        }
+        test = *optop;
+        cond = code_cut(body, &ncond);
+        code_paste(cond, ncond);
+        a = gen_jcc(-1, 0);
+        has_cond = 1;
+    }
+    skip(TK_SEMICOLON);
+    if (token != TK_CLOSEPA) {
+        body = cur_func->ncode;
+        expression();
+        operand_pop();
+        incr = code_cut(body, &nincr);
+    }
+    skip(TK_CLOSEPA);
+    body = cur_func->ncode;
+    prof_count(k);
+    prof_loop++;
+    statement(&a, &b);
+    prof_loop--;
+    backpatch(b, cur_func->ncode);
+    // 循环体之后的增量 条件和回边属于 for 本身, 循环优化和向量化的报告按回边取位置
+    insn_loc(floc);
+    code_paste(incr, nincr);
+    if (has_cond) {
+        code_paste(cond, ncond);
+        *++optop = test;
+        backpatch(gen_jcc(-1, 1), body);
+    } else {
+        gen_jmpbackward(body);
+    }
+    backpatch(a, cur_func->ncode);
+    prof_count(k + 1);
+    mem_free(cond, MEM_CODE);
+    mem_free(incr, MEM_CODE);
+}
+
+// switch 语句
+// 值留在操作数栈上, 它的寄存器在语句体内不会被占用. 分派放在语句体之后, 语句体之前跳过去:
+//   值; JMP 分派; 语句体; JMP 出口; 分派; 出口:
+// case 值排序后划成簇: 足够密的一段 (不少于 SWITCH_TABLE_MIN 个值, 密度不低于 SWITCH_DENSITY%) 用一张跳转表,
+// 其余每个值单独一簇; 簇数最少的划分由动态规划求出. 簇之间按值二分查找, 只剩几个单值时依次比较
+#define SWITCH_TABLE_MIN 4
+#define SWITCH_DENSITY 40
+#define SWITCH_TABLE_MAX 65536      // 跳转表最多的项数
+#define SWITCH_LINEAR 3             // 不多于这么多个单值时不再二分
+
+typedef struct SwitchCase {
+    int v;
+    int pos;                // case 标号处的指令序号
+    SrcLoc loc;             // case 的源位置, 值重复时在后一个处报错
+} SwitchCase;
+
+typedef struct SwitchCtx {
+    SwitchCase *cases;
+    int n, cap;
+    int def;                // default 处的指令序号, 没有为 -1
+} SwitchCtx;
+
+SwitchCtx *cur_switch;      // 最内层的 switch, 不在 switch 中为 NULL
+
+// 按值排序, 值相同的按源位置
+int switch_case_cmp(const void *a, const void *b) {
+    SwitchCase *x = (SwitchCase *) a, *y = (SwitchCase *) b;
+    if (x->v != y->v) {
+        return x->v < y->v ? -1 : 1;
+    }
+    return x->loc < y->loc ? -1 : x->loc > y->loc;
+}
+
+// 把排好序的 n 个 case 划成簇, 返回簇数; 簇 k 为 cs[st[k]] .. cs[st[k + 1] - 1], tab[k] 为 1 时用跳转表
+int switch_clusters(SwitchCase *cs, int n, int *st, char *tab) {
+    int *best = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_CODE);
+    int *next = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_CODE);
+    int i, j, k, lim = n - 1;
+
+    // best[i]: cs[i..] 最少的簇数; 一张表的值域不超过 SWITCH_TABLE_MAX, i 减小时 lim 只会减小
+    best[n] = 0;
+    for (i = n - 1; i >= 0; i--) {
+        while ((long long) cs[lim].v - cs[i].v >= SWITCH_TABLE_MAX) {
+            lim--;
+        }
+        best[i] = best[i + 1] + 1;
+        next[i] = i + 1;
+        for (j = lim; j >= i + SWITCH_TABLE_MIN - 1 && best[i] > 1; j--) {
+            if (((long long) cs[j].v - cs[i].v + 1) * SWITCH_DENSITY <= (long long) (j - i + 1) * 100
+                && best[j + 1] + 1 < best[i]) {
+                best[i] = best[j + 1] + 1;
+                next[i] = j + 1;
+            }
+        }
+    }
+    for (i = k = 0; i < n; i = next[i], k++) {
+        st[k] = i;
+        tab[k] = next[i] - i > 1;
+    }
+    st[k] = n;
+    mem_free(best, MEM_CODE);
+    mem_free(next, MEM_CODE);
+    return k;
+}
+
+// 簇 a..b 的分派, r 为 switch 值的寄存器, 都不匹配时跳到 def
+void switch_search(SwitchCase *cs, int *st, char *tab, int a, int b, int r, int def) {
+    int k, j, lo, n;
+
+    for (k = a; k <= b && !tab[k]; k++);
+    if (k > b && b - a < SWITCH_LINEAR) {
+        for (k = a; k <= b; k++) {
+            gen_insn(OP_JEQI, r, cs[st[k]].v, cs[st[k]].pos);
+        }
+        gen_insn(OP_JMP, 0, 0, def);
+        stats.switch_compares += b - a + 1;
+        return;
+    }
+    if (a == b) {
+        lo = cs[st[a]].v;
+        n = cs[st[a + 1] - 1].v - lo + 1;
+        gen_insn(OP_JTAB, r, lo, def);
+        for (k = 0, j = st[a]; k < n; k++) {
+            gen_insn(OP_JTE, 0, n, cs[j].v == lo + k ? cs[j++].pos : def);
+        }
+        stats.switch_tables++;
+        return;
+    }
+    k = (a + b + 1) / 2;
+    j = gen_insn(OP_JGEI, r, cs[st[k]].v, -1);
+    stats.switch_compares++;
+    switch_search(cs, st, tab, a, k - 1, r, def);
+    cur_func->code[j].c = cur_func->ncode;
+    switch_search(cs, st, tab, k, b, r, def);
+}
+
+void switch_dispatch(SwitchCtx *sw, int r, int def) {
+    SwitchCase *cs = sw->cases;
+    int n = sw->n, i, *st;
+    char *tab;
+
+    if (!n) {
+        gen_insn(OP_JMP, 0, 0, def);
+        return;
+    }
+    qsort(cs, n, sizeof(SwitchCase), switch_case_cmp);
+    for (i = 1; i < n; i++) {
+        if (cs[i].v == cs[i - 1].v) {
+            tok_loc = cs[i].loc;
+            error("case 值 %d 重复", cs[i].v);
+        }
+    }
+    st = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_CODE);
+    tab = (char *) mem_alloc(n, MEM_CODE);
+    i = switch_clusters(cs, n, st, tab);
+    switch_search(cs, st, tab, 0, i - 1, r, def);
+    mem_free(st, MEM_CODE);
+    mem_free(tab, MEM_CODE);
+}
+
+// switch 内的 break 跳到出口, continue 交给外层循环
+void switch_statement(int *csym) {
+    SwitchCtx sw, *save = cur_switch;
+    int a = -1, d, r;
+
+    get_token();
+    skip(TK_OPENPA);
+    expression();
+    skip(TK_CLOSEPA);
+    if ((optop->type.t & T_BTYPE) > T_SHORT) {
+        error("switch 的表达式须为整数");
+    }
+    load_1(optop);
+    r = opd_reg(optop);
+    d = gen_jmpforward(-1);
+    sw.cases = NULL;
+    sw.n = sw.cap = 0;
+    sw.def = -1;
+    cur_switch = &sw;
+    statement(&a, csym);
+    cur_switch = save;
+    // 没有 default 时不匹配的跳到语句体末尾跳往出口的 JMP, 窥孔优化会穿透它
+    a = gen_jmpforward(a);
+    backpatch(d, cur_func->ncode);
+    switch_dispatch(&sw, r, sw.def >= 0 ? sw.def : a);
+    backpatch(a, cur_func->ncode);
+    operand_pop();
+    stats.switches++;
+    stats.switch_cases += sw.n;
+    mem_free(sw.cases, MEM_CODE);
+}
+
+void case_statement(int *bsym, int *csym) {
+    SwitchCtx *sw = cur_switch;
+    SrcLoc loc = tok_loc;
+    int n = cur_func->ncode;
+
+    if (!sw) {
+        error("此处不能用%s", token == KW_CASE ? "case" : "default");
+    }
+    src_pin(loc);
+    if (token == KW_DEFAULT) {
+        if (sw->def >= 0) {
+            error("default 重复");
+        }
+        sw->def = n;
+        get_token();
+    } else {
+        get_token();
+        and_expression();
+        if (!is_const(optop) || cur_func->ncode != n || (optop->type.t & T_BTYPE) > T_SHORT) {
+            error("case 的值须为整数常量");
+        }
+        if (sw->n == sw->cap) {
+            sw->cap = sw->cap ? sw->cap * 2 : 16;
+            sw->cases = (SwitchCase *) mem_realloc(sw->cases, sizeof(SwitchCase) * sw->cap, MEM_CODE);
+        }
+        sw->cases[sw->n].v = optop->value;
+        sw->cases[sw->n].loc = loc;
+        sw->cases[sw->n++].pos = n;
+        operand_pop();
+    }
+    skip(TK_COLON);
+    if (token != TK_END) {
+        statement(bsym, csym);
+    }
+}
+
+void continue_statement(int *csym) {
+    if (!csym) {
+        error("此处不能用continue");
+    }
+    get_token();
+    *csym = gen_jmpforward(*csym);
+    skip(TK_SEMICOLON);
+}
+
+void break_statement(int *bsym) {
+    if (!bsym) {
+        error("此处不能用break");
+    }
+    get_token();
+    *bsym = gen_jmpforward(*bsym);
+    skip(TK_SEMICOLON);
+}
+
+// 返回值转换为返回类型: char/short 截断后符号扩展. 同样窄的左值装入时已经扩展过, 不再转换
+void ret_convert() {
+    int rt = func_ret_type.t & T_BTYPE, t = optop->type.t & T_BTYPE;
+
+    if (rt != T_CHAR && rt != T_SHORT) {
+        return;
+    }
+    if (is_const(optop)) {
+        optop->value = rt == T_CHAR ? (signed char) optop->value : (short) optop->value;
+        return;
+    }
+    if (t == T_CHAR || (t == T_SHORT && rt == T_SHORT)) {
+        return;
+    }
+    load_1(optop);
+    gen_insn(rt == T_CHAR ? OP_SX1 : OP_SX2, opd_reg(optop), opd_reg(optop), 0);
+}
+
+void return_statement() {
+    get_token();
+    if (token != TK_SEMICOLON) {
+        expression();
+        if ((optop->type.t & T_BTYPE) == T_STRUCT) {
+            error("不支持返回结构体");
+        }
+        ret_convert();
+        load_1(optop);
+        gen_insn(OP_RET, opd_reg(optop), 0, 0);
+        operand_pop();
+    } else {
+        gen_insn(OP_RETV, 0, 0, 0);
+    }
+    skip(TK_SEMICOLON);
+}
+
+void expression() {
+    while (1) {
+        assignment_expression();
+        if (token != TK_COMMA) {
+            break;
+        }
+        operand_pop();
+        get_token();
+    }
+}
+
+void assignment_expression() {
+    and_expression();
+    if (token == TK_ASSIGN) {
+        check_lvalue();
+        get_token();
+        assignment_expression();
+        store0_1();
+    }
+}
+
+void and_expression() {
+    equality_expression();
+    while (token == TK_AND) {
+        get_token();
+        equality_expression();
+        gen_op(TK_AND);
+    }
+}
+
+void equality_expression() {
+    int t;
+    relational_expression();
+    while (token == TK_EQ || token == TK_NEQ) {
+        t = token;
+        get_token();
+        relational_expression();
+        gen_op(t);
+    }
+}
+
+void relational_expression() {
+    int t;
+    additive_expression();
+    while (token == TK_LT || token == TK_LEQ ||
+           token == TK_GT || token == TK_GEQ) {
+        t = token;
+        get_token();
+        additive_expression();
+        gen_op(t);
+    }
+}
+
+void additive_expression() {
+    int t;
+    multiplicative_expression();
+    while (token == TK_PLUS || token == TK_MINUS) {
+        t = token;
+        get_token();
+        multiplicative_expression();
+        gen_op(t);
+    }
+}
+
+void multiplicative_expression() {
+    int t;
+    unary_expression();
+    while (token == TK_STAR || token == TK_DIVIDE || token == TK_MOD) {
+        t = token;
+        get_token();
+        unary_expression();
+        gen_op(t);
+    }
+}
+
+void unary_expression() {
+    switch (token) {
+        case TK_AND:
+            get_token();
+            unary_expression();
+            if ((optop->type.t & T_BTYPE) != T_FUNC && !(optop->type.t & T_ARRAY)) {
+                cancel_lvalue();
+            }
+            mk_pointer(&optop->type);
+            break;
+        case TK_STAR:
+            get_token();
+            unary_expression();
+            indirection();
+            break;
+        case TK_PLUS:
+            get_token();
+            unary_expression();
+            break;
+        case TK_MINUS:
+            get_token();
+            unary_expression();
+            gen_neg();
+            break;
+        case KW_SIZEOF:
+            sizeof_expression();
+            break;
+        default:
+            postfix_expression();
+            break;
+    }
+}
+
+void sizeof_expression() {
+    int size, align;
+    Type type;
+
+    get_token();
+    skip(TK_OPENPA);
+    if (!type_specifier(&type)) {
+        expect("<类型区分符>");
+    }
+    skip(TK_CLOSEPA);
+    size = type_size(&type, &align);
+    if (size < 0) {
+        error("sizeof计算类型尺寸失败");
+    }
+    operand_push(&int_type, SC_GLOBAL, size);
+}
+
+void postfix_expression() {
+    Symbol *s;
+
+    primary_expression();
+    while (1) {
+        if (token == TK_DOT || token == TK_POINTSTO) {
+            if (token == TK_POINTSTO) {
+                indirection();
+            }
+            cancel_lvalue();
+            get_token();
+            if ((optop->type.t & T_BTYPE) != T_STRUCT) {
+                expect("结构体变量");
+            }
+            s = optop->type.ref;
+            token |= SC_MEMBER;
+            while ((s = s->next) != NULL) {
+                if (s->v == token) {
+                    break;
+                }
+            }
+            if (!s) {
+                error("没有此成员变量: %s", get_tkstr(token & ~SC_MEMBER));
+            }
+            // 结构体地址加成员偏移
+            optop->value += s->c;
+            optop->type = s->type;
+            if (!(optop->type.t & T_ARRAY)) {
+                optop->r |= SC_LVAL;
+            }
+            get_token();
+        } else if (token == TK_OPENBR) {
+            get_token();
+            expression();
+            gen_op(TK_PLUS);
+            indirection();
+            skip(TK_CLOSEBR);
+        } else if (token == TK_OPENPA) {
+            argument_expression_list();
+        } else {
+            break;
+        }
+    }
+}
+
+void primary_expression() {
+    int t, addr;
+    SrcLoc loc;
+    Symbol *s;
+    Type type;
+
+    switch (token) {
+        case TK_CINT:
+            operand_push(&int_type, SC_GLOBAL, tkvalue);
+            get_token();
+            break;
+        case TK_CCHAR:
+            type.t = T_CHAR;
+            operand_push(&type, SC_GLOBAL, tkvalue);
+            get_token();
+            break;
+        case TK_CSTR:
+            type.t = T_CHAR;
+            type.ref = NULL;
+            mk_array(&type, (int) tkstr.count);
+            addr = str_pool_add(tkstr.data, (int) tkstr.count);
+            if (par_capture) {
+                par_log(addr);
+            } else if (incr_capture) {
+                incr_log_sym(addr);
+            }
+            operand_push(&type, SC_GLOBAL | SC_SYM, 0);
+            optop->sym = addr;
+            get_token();
+            break;
+        case TK_OPENPA:
+            get_token();
+            expression();
+            skip(TK_CLOSEPA);
+            break;
+        default:
+            t = token;
+            if (t < TK_IDENT) {
+                expect("标识符或常量");
+            }
+            loc = tok_loc;
+            get_token();
+            s = sym_search(t);
+            if (!s) {
+                if (token != TK_OPENPA) {
+                    tok_loc = loc;
+                    error("'%s'未声明", get_tkstr(t));
+                }
+                // 隐式函数声明: int f(...)
+                s = func_sym_push(t, &default_func_type);
+            }
+            operand_push_sym(s);
+            break;
+    }
+}
+
+void argument_expression_list() {
+    Operand *fn = optop;
+    Symbol *s, *param;
+    Type *ftype = &fn->type;
+    int nargs = 0, d = opd_reg(fn);
+
+    if ((ftype->t & T_BTYPE) == T_PTR && (pointed_type(ftype)->t & T_BTYPE) == T_FUNC) {
+        ftype = pointed_type(ftype);
+        load_1(fn);
+    } else if ((ftype->t & T_BTYPE) != T_FUNC) {
+        expect("函数");
+    }
+    s = ftype->ref;
+    param = s->next;
+    get_token();
+    if (token != TK_CLOSEPA) {
+        while (1) {
+            assignment_expression();
+            load_1(optop);
+            nargs++;
+            if (param) {
+                param = param->next;
+            } else if (!s->c) {
+                error("实参个数过多");
+            }
+            if (token == TK_CLOSEPA) {
+                break;
+            }
+            skip(TK_COMMA);
+        }
+    }
+    if (param) {
+        error("实参个数不足");
+    }
+    skip(TK_CLOSEPA);
+    if ((s->type.t & T_BTYPE) == T_STRUCT) {
+        error("不支持返回结构体");
+    }
+    if (fn->r == (SC_GLOBAL | SC_SYM)) {
+        gen_insn(OP_CALL, d + 1, fn->sym, nargs);
+    } else {
+        gen_insn(OP_CALLI, d + 1, d, nargs);
+    }
+    optop = fn;
+    fn->type = s->type;
+    fn->r = d;
+    fn->value = 0;
+}
+
+// 字节码反汇编
+void bc_dump_func(BcFunc *f) {
+    int i;
+    Insn *p;
+
+    printf("func %s: params=%d regs=%d frame=%d\n", f->name, f->nparams, f->nregs, f->frame_size);
+    for (i = 0; i < f->ncode; i++) {
+        p = &f->code[i];
+        printf("%6d  %-6s %d, %d, %d\n", i, op_names[p->op], p->a, p->b, p->c);
+    }
+}
+
+void bc_dump(BcModule *m) {
+    int i;
+    BcSym *s;
+
+    if (m->init->ncode > 1) {
+        bc_dump_func(m->init);
+    }
+    for (i = 0; i < m->syms.count; i++) {
+        s = (BcSym *) m->syms.data[i];
+        if (s->kind == BS_FUNC && s->func != m->init) {
+            bc_dump_func(s->func);
+        }
+    }
+}
+
+// 虚拟机
+// 每个调用帧: [寄存器 nregs 个][局部变量区 frame_size 字节], 实参由调用者复制到被调函数的前几个寄存器
+typedef struct VmFrame {
+    Insn *pc;
+    long long *regs;
+    BcFunc *func;
+    int ret;
+} VmFrame;
+
+typedef struct Vm {
+    char **symaddr;
+    char *data;
+    char *rodata;
+    long long *stack;
+    long long *stack_end;
+    VmFrame *frames;
+    VmFrame *frames_end;
+    long long icount;
+} Vm;
+
+#define VM_STACK_WORDS (1 << 20)
+#define VM_MAX_FRAMES (1 << 16)
+
+long long native_printf(long long *a, int n) {
+    long long v[8] = {0};
+    int i;
+    for (i = 0; i < n && i < 8; i++) {
+        v[i] = a[i];
+    }
+    return printf((char *) v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+}
+
+long long native_putchar(long long *a, int n) {
+    return putchar((int) a[0]);
+}
+
+long long native_puts(long long *a, int n) {
+    return puts((char *) a[0]);
+}
+
+long long native_malloc(long long *a, int n) {
+    return (long long) mem_alloc((size_t) a[0], MEM_VM);
+}
+
+long long native_free(long long *a, int n) {
+    mem_free((void *) a[0], MEM_VM);
+    return 0;
+}
+
+long long native_memset(long long *a, int n) {
+    return (long long) memset((void *) a[0], (int) a[1], (size_t) a[2]);
+}
+
+long long native_memcpy(long long *a, int n) {
+    return (long long) memcpy((void *) a[0], (void *) a[1], (size_t) a[2]);
+}
+
+long long native_strlen(long long *a, int n) {
+    return (long long) strlen((char *) a[0]);
+}
+
+void prof_dump();
+
+long long native_exit(long long *a, int n) {
+    fflush(stdout);
+    prof_dump();
+    exit((int) a[0]);
+}
+
+struct {
+    char *name;
+    NativeFunc fn;
+} natives[] = {
+        {"printf",  native_printf},
+        {"putchar", native_putchar},
+        {"puts",    native_puts},
+        {"malloc",  native_malloc},
+        {"free",    native_free},
+        {"memset",  native_memset},
+        {"memcpy",  native_memcpy},
+        {"strlen",  native_strlen},
+        {"exit",    native_exit},
+        {NULL,      NULL},
+};
+
+int native_exists(char *name) {
+    int i;
+    for (i = 0; natives[i].name; i++) {
+        if (!strcmp(natives[i].name, name)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+BcFunc *native_lookup(char *name) {
+    int i;
+    BcFunc *f;
+
+    for (i = 0; natives[i].name; i++) {
+        if (!strcmp(natives[i].name, name)) {
+            f = bc_func_new(natives[i].name);
+            f->native = natives[i].fn;
+            return f;
+        }
+    }
+    return NULL;
+}
+
+// 为模块分配数据段并解析符号地址
+void vm_load(Vm *vm, BcModule *m) {
+    int i, j, n = m->syms.count;
+    BcSym *s, *t;
+    BcFunc *f;
+
+    vm->data = (char *) mem_alloc(m->data.count + 1, MEM_VM);
+    memcpy(vm->data, m->data.data, m->data.count);
+    vm->rodata = (char *) mem_alloc(m->rodata.count + 1, MEM_VM);
+    memcpy(vm->rodata, m->rodata.data, m->rodata.count);
+    vm->symaddr = (char **) mem_alloc(sizeof(char *) * (n + 1), MEM_VM);
+    for (i = 0; i < n; i++) {
+        s = (BcSym *) m->syms.data[i];
+        switch (s->kind) {
+            case BS_FUNC:
+                vm->symaddr[i] = (char *) s->func;
+                break;
+            case BS_DATA:
+                vm->symaddr[i] = vm->data + s->offset;
+                break;
+            case BS_RODATA:
+                vm->symaddr[i] = vm->rodata + s->offset;
+                break;
+            default:
+                vm->symaddr[i] = NULL;
+                break;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        s = (BcSym *) m->syms.data[i];
+        if (s->kind != BS_UNDEF) {
+            continue;
+        }
+        for (j = 0; j < n; j++) {
+            t = (BcSym *) m->syms.data[j];
+            if (t->kind == BS_FUNC && !strcmp(t->name, s->name)) {
+                vm->symaddr[i] = vm->symaddr[j];
+                break;
+            }
+        }
+        if (j == n) {
+            f = native_lookup(s->name);
+            if (!f) {
+                link_error("undefined reference to '%s'", s->name);
+            }
+            vm->symaddr[i] = (char *) f;
+        }
+    }
+    vm->stack = (long long *) mem_alloc(sizeof(long long) * VM_STACK_WORDS, MEM_VM);
+    vm->stack_end = vm->stack + VM_STACK_WORDS;
+    vm->frames = (VmFrame *) mem_alloc(sizeof(VmFrame) * VM_MAX_FRAMES, MEM_VM);
+    vm->frames_end = vm->frames + VM_MAX_FRAMES;
+    vm->icount = 0;
+}
+
+void vm_free(Vm *vm) {
+    mem_free(vm->data, MEM_VM);
+    mem_free(vm->rodata, MEM_VM);
+    mem_free(vm->symaddr, MEM_VM);
+    mem_free(vm->stack, MEM_VM);
+    mem_free(vm->frames, MEM_VM);
+}
+
+// 打包运算: 16 字节按无符号元素回绕运算, 定长小循环由 C 编译器编成 SSE2 等打包指令
+#define VM_PACKED(T, expr) do { \
+        T x[16 / sizeof(T)], y[16 / sizeof(T)]; \
+        int k; \
+        memcpy(x, &R[i->b], 16); \
+        memcpy(y, &R[i->c], 16); \
+        for (k = 0; k < (int) (16 / sizeof(T)); k++) { \
+            x[k] = (T) (expr); \
+        } \
+        memcpy(&R[i->a], x, 16); \
+    } while (0)
+#define VM_SPLAT(T) do { \
+        T x[16 / sizeof(T)]; \
+        int k; \
+        for (k = 0; k < (int) (16 / sizeof(T)); k++) { \
+            x[k] = (T) R[i->b]; \
+        } \
+        memcpy(&R[i->a], x, 16); \
+    } while (0)
+
+// 解释执行, GCC/Clang 下使用 computed goto 做线索化分派
+#if defined(__GNUC__) && !defined(VM_NO_THREADED)
+#define VM_THREADED 1
+#endif
+
+long long vm_call(Vm *vm, BcFunc *entry) {
+#ifdef VM_THREADED
+#define VM_LABEL(name) &&L_##name,
+    static void *dispatch[] = {OPCODES(VM_LABEL)};
+#define CASE(name) L_##name:
+#define NEXT do { i = pc++; ++icount; goto *dispatch[i->op]; } while (0)
+#else
+#define CASE(name) case OP_##name:
+#define NEXT goto next
+#endif
+    Insn *pc, *i, *code;
+    long long *R, *nr, v = 0;
+    char *FP, **G = vm->symaddr;
+    BcFunc *cur = entry, *f;
+    VmFrame *fp = vm->frames;
+    long long icount = 0;
+    int n;
+
+    R = vm->stack;
+    if (R + cur->frame_words > vm->stack_end) {
+        vm_error("栈溢出");
+    }
+    FP = (char *) (R + cur->nregs);
+    code = pc = cur->code;
+#ifdef VM_THREADED
+    NEXT;
+#else
+    next:
+    i = pc++;
+    ++icount;
+    switch (i->op) {
+#endif
+    CASE(NOP) NEXT;
+    CASE(MOVI) R[i->a] = i->b; NEXT;
+    CASE(MOV) R[i->a] = R[i->b]; NEXT;
+    CASE(ADD) R[i->a] = R[i->b] + R[i->c]; NEXT;
+    CASE(SUB) R[i->a] = R[i->b] - R[i->c]; NEXT;
+    CASE(MUL) R[i->a] = R[i->b] * R[i->c]; NEXT;
+    CASE(DIV)
+        if (R[i->c] == 0) {
+            vm_error("除数为零");
+        }
+        R[i->a] = R[i->b] / R[i->c];
+        NEXT;
+    CASE(MOD)
+        if (R[i->c] == 0) {
+            vm_error("除数为零");
+        }
+        R[i->a] = R[i->b] % R[i->c];
+        NEXT;
+    CASE(ADDI) R[i->a] = R[i->b] + i->c; NEXT;
+    CASE(MULI) R[i->a] = R[i->b] * i->c; NEXT;
+    CASE(NEG) R[i->a] = -R[i->b]; NEXT;
+    CASE(EQ) R[i->a] = R[i->b] == R[i->c]; NEXT;
+    CASE(NE) R[i->a] = R[i->b] != R[i->c]; NEXT;
+    CASE(LT) R[i->a] = R[i->b] < R[i->c]; NEXT;
+    CASE(LE) R[i->a] = R[i->b] <= R[i->c]; NEXT;
+    CASE(GT) R[i->a] = R[i->b] > R[i->c]; NEXT;
+    CASE(GE) R[i->a] = R[i->b] >= R[i->c]; NEXT;
+    CASE(LD1) R[i->a] = *(signed char *) ((char *) R[i->b] + i->c); NEXT;
+    CASE(LD2) R[i->a] = *(short *) ((char *) R[i->b] + i->c); NEXT;
+    CASE(LD4) R[i->a] = *(int *) ((char *) R[i->b] + i->c); NEXT;
+    CASE(LD8) R[i->a] = *(long long *) ((char *) R[i->b] + i->c); NEXT;
+    CASE(ST1) *(char *) ((char *) R[i->b] + i->c) = (char) R[i->a]; NEXT;
+    CASE(ST2) *(short *) ((char *) R[i->b] + i->c) = (short) R[i->a]; NEXT;
+    CASE(ST4) *(int *) ((char *) R[i->b] + i->c) = (int) R[i->a]; NEXT;
+    CASE(ST8) *(long long *) ((char *) R[i->b] + i->c) = R[i->a]; NEXT;
+    CASE(LDL1) R[i->a] = *(signed char *) (FP + i->b); NEXT;
+    CASE(LDL2) R[i->a] = *(short *) (FP + i->b); NEXT;
+    CASE(LDL4) R[i->a] = *(int *) (FP + i->b); NEXT;
+    CASE(LDL8) R[i->a] = *(long long *) (FP + i->b); NEXT;
+    CASE(STL1) *(char *) (FP + i->b) = (char) R[i->a]; NEXT;
+    CASE(STL2) *(short *) (FP + i->b) = (short) R[i->a]; NEXT;
+    CASE(STL4) *(int *) (FP + i->b) = (int) R[i->a]; NEXT;
+    CASE(STL8) *(long long *) (FP + i->b) = R[i->a]; NEXT;
+    CASE(LEAL) R[i->a] = (long long) (FP + i->b); NEXT;
+    CASE(LEAG) R[i->a] = (long long) (G[i->b] + i->c); NEXT;
+    CASE(MCPY) memcpy((char *) R[i->a], (char *) R[i->b], i->c); NEXT;
+    CASE(JMP) pc = code + i->c; NEXT;
+    CASE(JZ) if (!R[i->a]) pc = code + i->c; NEXT;
+    CASE(JNZ) if (R[i->a]) pc = code + i->c; NEXT;
+    CASE(JEQ) if (R[i->a] == R[i->b]) pc = code + i->c; NEXT;
+    CASE(JNE) if (R[i->a] != R[i->b]) pc = code + i->c; NEXT;
+    CASE(JLT) if (R[i->a] < R[i->b]) pc = code + i->c; NEXT;
+    CASE(JLE) if (R[i->a] <= R[i->b]) pc = code + i->c; NEXT;
+    CASE(JGT) if (R[i->a] > R[i->b]) pc = code + i->c; NEXT;
+    CASE(JGE) if (R[i->a] >= R[i->b]) pc = code + i->c; NEXT;
+    CASE(JEQI) if (R[i->a] == i->b) pc = code + i->c; NEXT;
+    CASE(JNEI) if (R[i->a] != i->b) pc = code + i->c; NEXT;
+    CASE(JLTI) if (R[i->a] < i->b) pc = code + i->c; NEXT;
+    CASE(JLEI) if (R[i->a] <= i->b) pc = code + i->c; NEXT;
+    CASE(JGTI) if (R[i->a] > i->b) pc = code + i->c; NEXT;
+    CASE(JGEI) if (R[i->a] >= i->b) pc = code + i->c; NEXT;
+    CASE(JTAB)
+        v = R[i->a] - i->b;
+        pc = code + ((unsigned long long) v < (unsigned long long) i[1].b ? i[1 + v].c : i->c);
+        NEXT;
+    CASE(JTE) pc = code + i->c; NEXT;
+    CASE(SX1) R[i->a] = (signed char) R[i->b]; NEXT;
+    CASE(SX2) R[i->a] = (short) R[i->b]; NEXT;
+    CASE(AND) R[i->a] = R[i->b] & R[i->c]; NEXT;
+    CASE(CALL)
+        f = (BcFunc *) G[i->b];
+        goto do_call;
+    CASE(CALLI)
+        f = (BcFunc *) R[i->b];
+    do_call:
+        if (f->native) {
+            R[i->a - 1] = f->native(R + i->a, i->c);
+            NEXT;
+        }
+        if (fp == vm->frames_end) {
+            vm_error("调用层次过深");
+        }
+        nr = R + cur->frame_words;
+        if (nr + f->frame_words > vm->stack_end) {
+            vm_error("栈溢出");
+        }
+        for (n = 0; n < i->c; n++) {
+            nr[n] = R[i->a + n];
+        }
+        fp->pc = pc;
+        fp->regs = R;
+        fp->func = cur;
+        fp->ret = i->a - 1;
+        fp++;
+        R = nr;
+        cur = f;
+        FP = (char *) (R + f->nregs);
+        code = pc = f->code;
+        NEXT;
+    CASE(TCALL)
+        f = (BcFunc *) G[i->b];
+        goto do_tcall;
+    CASE(TCALLI)
+        f = (BcFunc *) R[i->b];
+    do_tcall:
+        if (f->native) {
+            v = f->native(R + i->a, i->c);
+            goto do_ret;
+        }
+        if (R + f->frame_words > vm->stack_end) {
+            vm_error("栈溢出");
+        }
+        // 实参在 a 之后, 从低往高复制到 R[0] 起不会覆盖未复制的
+        for (n = 0; n < i->c; n++) {
+            R[n] = R[i->a + n];
+        }
+        cur = f;
+        FP = (char *) (R + f->nregs);
+        code = pc = f->code;
+        NEXT;
+    CASE(RET)
+        v = R[i->a];
+        goto do_ret;
+    CASE(RETV)
+        v = 0;
+    do_ret:
+        if (fp == vm->frames) {
+            goto done;
+        }
+        fp--;
+        pc = fp->pc;
+        R = fp->regs;
+        cur = fp->func;
+        code = cur->code;
+        FP = (char *) (R + cur->nregs);
+        R[fp->ret] = v;
+        NEXT;
+    CASE(ADDL4) R[i->a] = R[i->b] + *(int *) (FP + i->c); NEXT;
+    CASE(VLD) memcpy(&R[i->a], (char *) R[i->b] + i->c, 16); NEXT;
+    CASE(VST) memcpy((char *) R[i->b] + i->c, &R[i->a], 16); NEXT;
+    CASE(PADD1) VM_PACKED(unsigned char, x[k] + y[k]); NEXT;
+    CASE(PADD2) VM_PACKED(unsigned short, x[k] + y[k]); NEXT;
+    CASE(PADD4) VM_PACKED(unsigned int, x[k] + y[k]); NEXT;
+    CASE(PSUB1) VM_PACKED(unsigned char, x[k] - y[k]); NEXT;
+    CASE(PSUB2) VM_PACKED(unsigned short, x[k] - y[k]); NEXT;
+    CASE(PSUB4) VM_PACKED(unsigned int, x[k] - y[k]); NEXT;
+    CASE(PMUL1) VM_PACKED(unsigned char, x[k] * y[k]); NEXT;
+    CASE(PMUL2) VM_PACKED(unsigned short, x[k] * y[k]); NEXT;
+    CASE(PMUL4) VM_PACKED(unsigned int, x[k] * y[k]); NEXT;
+    CASE(PAND) VM_PACKED(unsigned int, x[k] & y[k]); NEXT;
+    CASE(PSPLAT1) VM_SPLAT(unsigned char); NEXT;
+    CASE(PSPLAT2) VM_SPLAT(unsigned short); NEXT;
+    CASE(PSPLAT4) VM_SPLAT(unsigned int); NEXT;
+    CASE(PROF) ((long long *) G[i->b])[i->c]++; NEXT;
+#ifndef VM_THREADED
+    default:
+        vm_error("非法指令 %d", i->op);
+    }
+#endif
+    done:
+    vm->icount += icount;
+    return v;
+#undef CASE
+#undef NEXT
+}
+
+// 插桩的程序结束时 (main 返回或调用 exit) 把计数累加进 profile 文件: 读入已有的, 加上本次的, 写临时文件后改名.
+// 文件名取 -fprofile-generate=file, 其次环境变量 SC_PROFILE_FILE, 默认 sc.prof
+Vm *prof_vm;
+BcModule *prof_module;
+
+void prof_dump() {
+    char *path = prof_gen_file ? prof_gen_file : getenv("SC_PROFILE_FILE"), tmp[PATH_MAX + 16];
+    BcModule *m = prof_module;
+    BcSym *s;
+    FILE *fp;
+    int i, k, found = 0;
+
+    if (!prof_vm) {
+        return;
+    }
+    for (i = 0; i < m->syms.count && !found; i++) {
+        s = (BcSym *) m->syms.data[i];
+        found = s->kind == BS_DATA && !strncmp(s->name, "__prof.", 7);
+    }
+    if (!found) {
+        return;
+    }
+    path = path ? path : PROF_DEFAULT_FILE;
+    prof_table = NULL;
+    prof_cap = prof_nfuncs = 0;
+    prof_max = 0;
+    if (prof_read(path) < 0) {
+        fprintf(stderr, "profile %s 格式不对, 重新生成\n", path);
+        prof_table = NULL;
+        prof_cap = prof_nfuncs = 0;
+    }
+    for (i = 0; i < m->syms.count; i++) {
+        s = (BcSym *) m->syms.data[i];
+        if (s->kind == BS_DATA && !strncmp(s->name, "__prof.", 7)) {
+            prof_add(s->name + 7, (int) *(long long *) prof_vm->symaddr[i], (long long *) prof_vm->symaddr[i]);
+        }
+    }
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+    if (!(fp = fopen(tmp, "w"))) {
+        fprintf(stderr, "不能写profile文件 %s\n", tmp);
+        return;
+    }
+    fprintf(fp, "%s\n", PROF_MAGIC);
+    for (i = 0; i < prof_cap; i++) {
+        if (prof_table[i].name) {
+            fprintf(fp, "%s %d", prof_table[i].name, prof_table[i].n);
+            for (k = 1; k <= prof_table[i].n; k++) {
+                fprintf(fp, " %lld", prof_table[i].counts[k]);
+            }
+            fprintf(fp, "\n");
+        }
+    }
+    if (fclose(fp) || rename(tmp, path)) {
+        fprintf(stderr, "不能写profile文件 %s\n", path);
+        unlink(tmp);
+    }
+    prof_vm = NULL;
+}
+
+// 运行 main, 返回其返回值
+int vm_exec(BcModule *m) {
+    Vm vm;
+    BcFunc *entry = NULL;
+    BcSym *s;
+    int i, ret;
+    clock_t start;
+    double secs;
+
+    for (i = 0; i < m->syms.count; i++) {
+        s = (BcSym *) m->syms.data[i];
+        if (s->kind == BS_FUNC && !strcmp(s->name, "main")) {
+            entry = s->func;
+        }
+    }
+    if (!entry) {
+        link_error("undefined reference to 'main'");
+    }
+    vm_load(&vm, m);
+    prof_vm = &vm;
+    prof_module = m;
+    start = clock();
+    vm_call(&vm, m->init);
+    ret = (int) vm_call(&vm, entry);
+    secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+    fflush(stdout);
+    prof_dump();
+    if (opt_bench) {
+        fprintf(stderr, "[VM] %lld insns in %.3f s, %.1f Minsn/s\n",
+                vm.icount, secs, secs > 0 ? vm.icount / secs / 1e6 : 0.0);
+    }
+    vm_free(&vm);
+    return ret;
+}
+
+// 目标文件
+// 用ELF作容器: .sc.text 存字节码, .sc.func 存函数记录, LEAG/CALL 的符号字段以 R_SC_SYM 重定位
+#define SC_ELF_FLAGS 0x53430001
+#define R_SC_SYM 1
+
+typedef struct FuncRec {
+    unsigned int name;      // .strtab 偏移
+    unsigned int code;      // 在 .sc.text 中的起始指令序号
+    unsigned int ncode;
+    unsigned int nparams;
+    unsigned int nregs;
+    unsigned int frame_size;
+} FuncRec;
+
+// 可执行映像的全局符号
+typedef struct ImgSym {
+    unsigned int kind;      // BS_xxx
+    unsigned int offset;    // 段偏移, 函数为函数记录序号
+    unsigned int name;      // .strtab 偏移
+} ImgSym;
+
+typedef struct ElfSec {
+    char *name;
+    int type;
+    void *data;
+    size_t size;
+    int link;
+    int info;
+    int entsize;
+    size_t offset;
+} ElfSec;
+
+int insn_sym_field(int op) {
+    return op == OP_LEAG || op == OP_CALL || op == OP_TCALL || op == OP_PROF;
+}
+
+// 计算布局并写出ELF头 节头表 节名表; out 为 NULL 时只计算, 返回文件长度
+// 数据指针非空的节同时复制内容
+size_t elf_build(char *out, int etype, ElfSec *secs, int n, size_t entry) {
+    Elf64_Ehdr *eh;
+    Elf64_Shdr *sh;
+    size_t off = sizeof(Elf64_Ehdr), shstr_off, shstr_size = 1, shoff, p;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        off = calc_align((int) off, 8);
+        secs[i].offset = off;
+        off += secs[i].size;
+        shstr_size += strlen(secs[i].name) + 1;
+    }
+    shstr_off = off;
+    off = calc_align((int) (shstr_off + shstr_size + sizeof(".shstrtab")), 8);
+    shoff = off;
+    off += sizeof(Elf64_Shdr) * (n + 2);
+    if (!out) {
+        return off;
+    }
+
+    eh = (Elf64_Ehdr *) out;
+    memset(eh, 0, sizeof(*eh));
+    memcpy(eh->e_ident, ELFMAG, SELFMAG);
+    eh->e_ident[EI_CLASS] = ELFCLASS64;
+    eh->e_ident[EI_DATA] = ELFDATA2LSB;
+    eh->e_ident[EI_VERSION] = EV_CURRENT;
+    eh->e_type = etype;
+    eh->e_machine = EM_NONE;
+    eh->e_version = EV_CURRENT;
+    eh->e_entry = entry;
+    eh->e_shoff = shoff;
+    eh->e_flags = SC_ELF_FLAGS;
+    eh->e_ehsize = sizeof(Elf64_Ehdr);
+    eh->e_shentsize = sizeof(Elf64_Shdr);
+    eh->e_shnum = n + 2;
+    eh->e_shstrndx = n + 1;
+
+    sh = (Elf64_Shdr *) (out + shoff);
+    memset(sh, 0, sizeof(Elf64_Shdr) * (n + 2));
+    out[shstr_off] = 0;
+    p = 1;
+    for (i = 0; i < n; i++) {
+        sh[i + 1].sh_name = p;
+        strcpy(out + shstr_off + p, secs[i].name);
+        p += strlen(secs[i].name) + 1;
+        sh[i + 1].sh_type = secs[i].type;
+        sh[i + 1].sh_offset = secs[i].offset;
+        sh[i + 1].sh_size = secs[i].size;
+        sh[i + 1].sh_link = secs[i].link;
+        sh[i + 1].sh_info = secs[i].info;
+        sh[i + 1].sh_addralign = 8;
+        sh[i + 1].sh_entsize = secs[i].entsize;
+        if (secs[i].data && secs[i].size) {
+            memcpy(out + secs[i].offset, secs[i].data, secs[i].size);
+        }
+    }
+    sh[n + 1].sh_name = p;
+    strcpy(out + shstr_off + p, ".shstrtab");
+    sh[n + 1].sh_type = SHT_STRTAB;
+    sh[n + 1].sh_offset = shstr_off;
+    sh[n + 1].sh_size = p + sizeof(".shstrtab");
+    sh[n + 1].sh_addralign = 1;
+    return off;
+}
+
+// 按名字查找节, 返回内容并通过 size 返回长度
+char *elf_section(char *base, char *name, size_t *size) {
+    Elf64_Ehdr *eh = (Elf64_Ehdr *) base;
+    Elf64_Shdr *sh = (Elf64_Shdr *) (base + eh->e_shoff);
+    char *shstr = base + sh[eh->e_shstrndx].sh_offset;
+    int i;
+
+    for (i = 1; i < eh->e_shnum; i++) {
+        if (!strcmp(shstr + sh[i].sh_name, name)) {
+            *size = sh[i].sh_size;
+            return base + sh[i].sh_offset;
+        }
+    }
+    *size = 0;
+    return NULL;
+}
+
+char *elf_section_name(char *base, int idx) {
+    Elf64_Ehdr *eh = (Elf64_Ehdr *) base;
+    Elf64_Shdr *sh = (Elf64_Shdr *) (base + eh->e_shoff);
+
+    if (idx <= 0 || idx >= eh->e_shnum) {
+        return "";
+    }
+    return base + sh[eh->e_shstrndx].sh_offset + sh[idx].sh_name;
+}
+
+int is_sc_elf(char *base, size_t size, int etype) {
+    Elf64_Ehdr *eh = (Elf64_Ehdr *) base;
+    return size >= sizeof(Elf64_Ehdr) && !memcmp(eh->e_ident, ELFMAG, SELFMAG)
+           && eh->e_flags == SC_ELF_FLAGS && eh->e_type == etype;
+}
+
+// 节头表和各节都在文件范围内, 节名在节名字符串表内; 之后 elf_section 等才能放心使用
+int elf_check(char *base, size_t size) {
+    Elf64_Ehdr *eh = (Elf64_Ehdr *) base;
+    Elf64_Shdr *sh;
+    char *shstr;
+    size_t nshstr;
+    int i;
+
+    if (eh->e_shentsize != sizeof(Elf64_Shdr) || eh->e_shnum == 0 || eh->e_shoff > size
+        || (size - eh->e_shoff) / sizeof(Elf64_Shdr) < eh->e_shnum
+        || eh->e_shstrndx == 0 || eh->e_shstrndx >= eh->e_shnum) {
+        return 0;
+    }
+    sh = (Elf64_Shdr *) (base + eh->e_shoff);
+    for (i = 1; i < eh->e_shnum; i++) {
+        if (sh[i].sh_offset > size || sh[i].sh_size > size - sh[i].sh_offset) {
+            return 0;
+        }
+    }
+    shstr = base + sh[eh->e_shstrndx].sh_offset;
+    nshstr = sh[eh->e_shstrndx].sh_size;
+    if (nshstr == 0 || shstr[nshstr - 1]) {
+        return 0;
+    }
+    for (i = 1; i < eh->e_shnum; i++) {
+        if (sh[i].sh_name >= nshstr) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 函数记录依次覆盖全部代码, 名字在字符串表内
+int func_check(FuncRec *funcs, int nfuncs, int ntext, int nstrtab) {
+    unsigned int at = 0;
+    int i;
+
+    for (i = 0; i < nfuncs; i++) {
+        if (funcs[i].code != at || funcs[i].ncode > (unsigned int) ntext - at || funcs[i].name >= (unsigned int) nstrtab) {
+            return 0;
+        }
+        at += funcs[i].ncode;
+    }
+    return nfuncs > 0 && at == (unsigned int) ntext;
+}
+
+int blob_add(DynString *st, void *p, int n) {
+    int off = st->count;
+
+    while (st->count + n >= st->capacity * 0.75) {
+        dynstring_realloc(st, st->capacity * 2);
+    }
+    memcpy(st->data + off, p, n);
+    st->count += n;
+    return off;
+}
+
+int strtab_add(DynString *st, char *s) {
+    return blob_add(st, s, (int) strlen(s) + 1);
+}
+
+// 把模块序列化成可重定位目标文件, 返回缓冲区
+// 符号顺序: 空符号, __init, 字符串常量 (局部), 其余 (全局); 与 ELF 要求一致
+// -flto 时另有 .sc.lto 节, 每个函数记录一个字节的 LF_xxx
+char *obj_build(BcModule *m, size_t *psize) {
+    int i, j, nfuncs = 1, ntext, nsyms, nrela = 0, *elfidx, k, nsecs = opt_lto ? 8 : 7;
+    BcSym *s;
+    BcFunc *f;
+    FuncRec *funcs;
+    Insn *text;
+    Elf64_Sym *syms;
+    Elf64_Rela *rela;
+    DynString strtab;
+    ElfSec secs[8];
+    size_t size;
+    char *out, *lto;
+
+    ntext = m->init->ncode;
+    for (i = 0; i < m->syms.count; i++) {
+        s = (BcSym *) m->syms.data[i];
+        if (s->kind == BS_FUNC) {
+            nfuncs++;
+            ntext += s->func->ncode;
+        }
+    }
+    funcs = (FuncRec *) mallocz(sizeof(FuncRec) * nfuncs, MEM_LINK);
+    lto = (char *) mallocz(nfuncs, MEM_LINK);
+    text = (Insn *) mem_alloc(sizeof(Insn) * (ntext + 1), MEM_LINK);
+    rela = (Elf64_Rela *) mem_alloc(sizeof(Elf64_Rela) * (ntext + 1), MEM_LINK);
+    syms = (Elf64_Sym *) mallocz(sizeof(Elf64_Sym) * (m->syms.count + 2), MEM_LINK);
+    elfidx = (int *) mem_alloc(sizeof(int) * (m->syms.count + 1), MEM_LINK);
+    dynstring_init(&strtab, 64, MEM_LINK);
+    dynstring_chcat(&strtab, '\0');
+
+    // 符号表
+    nsyms = 1;
+    syms[nsyms].st_name = strtab_add(&strtab, "__init");
+    syms[nsyms].st_info = ELF64_ST_INFO(STB_LOCAL, STT_FUNC);
+    syms[nsyms].st_shndx = 2;
+    nsyms++;
+    for (k = 0; k < 2; k++) {
+        for (i = 0; i < m->syms.count; i++) {
+            s = (BcSym *) m->syms.data[i];
+            if ((s->kind == BS_RODATA) != (k == 0)) {
+                continue;
+            }
+            elfidx[i] = nsyms;
+            syms[nsyms].st_name = s->name ? strtab_add(&strtab, s->name) : 0;
+            syms[nsyms].st_size = s->size;
+            switch (s->kind) {
+                case BS_RODATA:
+                    syms[nsyms].st_info = ELF64_ST_INFO(STB_LOCAL, STT_OBJECT);
+                    syms[nsyms].st_shndx = 4;
+                    syms[nsyms].st_value = s->offset;
+                    break;
+                case BS_DATA:
+                    syms[nsyms].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT);
+                    if (s->common) {
+                        syms[nsyms].st_shndx = SHN_COMMON;
+                        syms[nsyms].st_value = s->align;
+                    } else {
+                        syms[nsyms].st_shndx = 3;
+                        syms[nsyms].st_value = s->offset;
+                    }
+                    break;
+                case BS_FUNC:
+                    syms[nsyms].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+                    syms[nsyms].st_shndx = 2;
+                    break;
+                default:
+                    syms[nsyms].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+                    syms[nsyms].st_shndx = SHN_UNDEF;
+                    break;
+            }
+            nsyms++;
+        }
+    }
+
+    // 代码与函数记录, 同时收集重定位
+    ntext = 0;
+    for (i = -1, k = 0; i < m->syms.count; i++) {
+        if (i < 0) {
+            f = m->init;
+        } else {
+            s = (BcSym *) m->syms.data[i];
+            if (s->kind != BS_FUNC) {
+                continue;
+            }
+            f = s->func;
+            syms[elfidx[i]].st_value = k;
+        }
+        funcs[k].name = i < 0 ? syms[1].st_name : syms[elfidx[i]].st_name;
+        funcs[k].code = ntext;
+        funcs[k].ncode = f->ncode;
+        funcs[k].nparams = f->nparams;
+        funcs[k].nregs = f->nregs;
+        funcs[k].frame_size = f->frame_size;
+        lto[k] = (char) f->flags;
+        k++;
+        for (j = 0; j < f->ncode; j++, ntext++) {
+            text[ntext] = f->code[j];
+            if (insn_sym_field(f->code[j].op)) {
+                rela[nrela].r_offset = (size_t) ntext * sizeof(Insn) + offsetof(Insn, b);
+                rela[nrela].r_info = ELF64_R_INFO(elfidx[f->code[j].b], R_SC_SYM);
+                rela[nrela].r_addend = 0;
+                nrela++;
+            }
+        }
+    }
+
+    memset(secs, 0, sizeof(secs));
+    secs[0].name = ".sc.text";
+    secs[0].type = SHT_PROGBITS;
+    secs[0].data = text;
+    secs[0].size = sizeof(Insn) * ntext;
+    secs[0].entsize = sizeof(Insn);
+    secs[1].name = ".sc.func";
+    secs[1].type = SHT_PROGBITS;
+    secs[1].data = funcs;
+    secs[1].size = sizeof(FuncRec) * nfuncs;
+    secs[1].entsize = sizeof(FuncRec);
+    secs[2].name = ".data";
+    secs[2].type = SHT_PROGBITS;
+    secs[2].data = m->data.data;
+    secs[2].size = m->data.count;
+    secs[3].name = ".rodata";
+    secs[3].type = SHT_PROGBITS;
+    secs[3].data = m->rodata.data;
+    secs[3].size = m->rodata.count;
+    secs[4].name = ".symtab";
+    secs[4].type = SHT_SYMTAB;
+    secs[4].data = syms;
+    secs[4].size = sizeof(Elf64_Sym) * nsyms;
+    secs[4].link = 6;
+    secs[4].entsize = sizeof(Elf64_Sym);
+    for (i = 1; i < nsyms && ELF64_ST_BIND(syms[i].st_info) == STB_LOCAL; i++);
+    secs[4].info = i;
+    secs[5].name = ".strtab";
+    secs[5].type = SHT_STRTAB;
+    secs[5].data = strtab.data;
+    secs[5].size = strtab.count;
+    secs[6].name = ".rela.sc.text";
+    secs[6].type = SHT_RELA;
+    secs[6].data = rela;
+    secs[6].size = sizeof(Elf64_Rela) * nrela;
+    secs[6].link = 5;
+    secs[6].info = 1;
+    secs[6].entsize = sizeof(Elf64_Rela);
+    secs[7].name = ".sc.lto";
+    secs[7].type = SHT_PROGBITS;
+    secs[7].data = lto;
+    secs[7].size = nfuncs;
+
+    size = elf_build(NULL, ET_REL, secs, nsecs, 0);
+    out = (char *) mallocz((int) size, MEM_LINK);
+    elf_build(out, ET_REL, secs, nsecs, 0);
+    mem_free(funcs, MEM_LINK);
+    mem_free(lto, MEM_LINK);
+    mem_free(text, MEM_LINK);
+    mem_free(rela, MEM_LINK);
+    mem_free(syms, MEM_LINK);
+    mem_free(elfidx, MEM_LINK);
+    dynstring_free(&strtab);
+    *psize = size;
+    return out;
+}
+
+void write_file(char *path, char *buf, size_t size) {
+    FILE *fp = fopen(path, "wb");
+
+    if (!fp || fwrite(buf, 1, size, fp) != size) {
+        error("不能写文件 %s", path);
+    }
+    fclose(fp);
+}
+
+void obj_write(BcModule *m, char *path) {
+    size_t size;
+    char *out = obj_build(m, &size);
+
+    write_file(path, out, size);
+    mem_free(out, MEM_LINK);
+}
+
+char *map_file(char *path, size_t *size) {
+    struct stat st;
+    char *p;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        link_error("不能打开 %s", path);
+    }
+    *size = st.st_size;
+    p = (char *) mmap(NULL, st.st_size ? st.st_size : 1, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        link_error("不能映射 %s", path);
+    }
+    return p;
+}
+
+// 链接器
+int opt_link_dce = 1;                   // 删去从 main 和各文件 __init 不可达的函数和数据
+
+// 删除无用数据后保留的一段数据段或只读段, 重叠的符号 (字符串尾部合并) 在同一段里
+typedef struct LinkChunk {
+    int rodata;
+    int from, to, size;
+} LinkChunk;
+
+typedef struct ObjFile {
+    char *name;
+    char *base;
+    Insn *text;
+    int ntext;
+    FuncRec *funcs;
+    int nfuncs;
+    char *data;
+    int ndata;
+    char *rodata;
+    int nrodata;
+    Elf64_Sym *syms;
+    int nsyms;
+    char *strtab;
+    int nstrtab;
+    Elf64_Rela *rela;
+    int nrela;
+    unsigned char *lto;     // -flto 编译的目标文件: 各函数记录的 LF_xxx, 否则为 NULL
+
+    int included;
+    int *map;               // 目标文件符号 → 映像符号
+    int text_base, func_base, data_base, rodata_base, str_base;
+
+    char *live;             // 可达的符号
+    int keep_all;           // 全部可达, 各节原样复制
+    int *fnew;              // 函数记录 → 保留后的序号, -1 为删去
+    int *fcode;             // 保留的函数在本文件输出代码中的起点
+    int *value;             // 数据符号在输出数据段/只读段里相对本文件起点的偏移
+    LinkChunk *chunks;
+    int nchunks;
+    int out_text, out_funcs, out_data, out_rodata;
+} ObjFile;
+
+typedef struct LinkSym {
+    char *name;
+    ObjFile *obj;           // 定义所在的目标文件, NULL 表示未定义或只有公共块
+    int idx;
+    int common_size;
+    int common_align;
+    int gidx;
+    int live;               // 未定义或公共块被可达代码引用
+    int lto;                // 链接时优化: 合并模块里的符号序号 + 1
+    int ext;                // 链接时优化: 非 LTO 的目标文件也引用或定义了它
+    struct LinkSym *next;
+} LinkSym;
+
+typedef struct Linker {
+    DynArray objs;
+    LinkSym **table;
+    int nbuckets;
+    ImgSym *gsyms;
+    int ngsyms;
+    char *out;
+    int next_obj;           // 并行重定位的任务计数
+} Linker;
+
+unsigned int link_hash(char *key) {
+    unsigned int h = 0, g;
+    while (*key) {
+        h = (h << 4) + (unsigned char) *key++;
+        g = h & 0xf0000000;
+        if (g) {
+            h ^= g >> 24;
+        }
+        h &= ~g;
+    }
+    return h;
+}
+
+LinkSym *link_sym(Linker *l, char *name, int create) {
+    unsigned int h = link_hash(name) & (l->nbuckets - 1);
+    LinkSym *s;
+
+    for (s = l->table[h]; s; s = s->next) {
+        if (!strcmp(s->name, name)) {
+            return s;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    s = (LinkSym *) mallocz(sizeof(LinkSym), MEM_LINK);
+    s->name = name;
+    s->gidx = -1;
+    s->next = l->table[h];
+    l->table[h] = s;
+    return s;
+}
+
+// 符号 函数记录 重定位里的偏移和序号都不越界, 重定位按偏移有序 (链接时按序查找所在函数)
+int obj_check(ObjFile *o) {
+    Elf64_Ehdr *eh = (Elf64_Ehdr *) o->base;
+    Elf64_Sym *es;
+    Elf64_Rela *r;
+    char *sec;
+    size_t n, at, end = (size_t) o->ntext * sizeof(Insn);
+    int i;
+
+    if (!o->text || !o->funcs || !o->syms || o->nsyms == 0 || !o->strtab || o->nstrtab == 0
+        || o->strtab[o->nstrtab - 1]) {
+        return 0;
+    }
+    if (!func_check(o->funcs, o->nfuncs, o->ntext, o->nstrtab)) {
+        return 0;
+    }
+    for (i = 1; i < o->nsyms; i++) {
+        es = &o->syms[i];
+        if (es->st_name >= (unsigned int) o->nstrtab) {
+            return 0;
+        }
+        if (es->st_shndx == SHN_UNDEF) {
+            continue;
+        }
+        if (es->st_shndx == SHN_COMMON) {
+            // st_value 是对齐
+            if (es->st_value == 0 || es->st_value > 4096 || (es->st_value & (es->st_value - 1))
+                || es->st_size > 0x3fffffff) {
+                return 0;
+            }
+            continue;
+        }
+        if (es->st_shndx >= eh->e_shnum) {
+            return 0;
+        }
+        if (ELF64_ST_TYPE(es->st_info) == STT_FUNC) {
+            if (es->st_value >= (unsigned int) o->nfuncs) {
+                return 0;
+            }
+            continue;
+        }
+        sec = elf_section_name(o->base, es->st_shndx);
+        n = !strcmp(sec, ".rodata") ? (size_t) o->nrodata : !strcmp(sec, ".data") ? (size_t) o->ndata : 0;
+        if (es->st_value > n || es->st_size > n - es->st_value) {
+            return 0;
+        }
+    }
+    for (i = 0, at = 0, r = o->rela; i < o->nrela; i++, r++) {
+        if (r->r_offset < at || r->r_offset >= end || r->r_offset % sizeof(Insn) != offsetof(Insn, b)
+            || ELF64_R_SYM(r->r_info) == 0 || ELF64_R_SYM(r->r_info) >= (unsigned int) o->nsyms) {
+            return 0;
+        }
+        at = r->r_offset;
+    }
+    return 1;
+}
+
+// 取出目标文件的各节并校验, 不是sc目标文件返回 0, 格式有误返回 -1
+int obj_parse(ObjFile *o, char *base, size_t size) {
+    size_t n;
+
+    if (!is_sc_elf(base, size, ET_REL)) {
+        return 0;
+    }
+    if (!elf_check(base, size)) {
+        return -1;
+    }
+    o->base = base;
+    o->text = (Insn *) elf_section(base, ".sc.text", &n);
+    o->ntext = (int) (n / sizeof(Insn));
+    o->funcs = (FuncRec *) elf_section(base, ".sc.func", &n);
+    o->nfuncs = (int) (n / sizeof(FuncRec));
+    o->data = elf_section(base, ".data", &n);
+    o->ndata = (int) n;
+    o->rodata = elf_section(base, ".rodata", &n);
+    o->nrodata = (int) n;
+    o->syms = (Elf64_Sym *) elf_section(base, ".symtab", &n);
+    o->nsyms = (int) (n / sizeof(Elf64_Sym));
+    o->strtab = elf_section(base, ".strtab", &n);
+    o->nstrtab = (int) n;
+    o->rela = (Elf64_Rela *) elf_section(base, ".rela.sc.text", &n);
+    o->nrela = (int) (n / sizeof(Elf64_Rela));
+    o->lto = (unsigned char *) elf_section(base, ".sc.lto", &n);
+    if (n < (size_t) o->nfuncs) {
+        o->lto = NULL;
+    }
+    return obj_check(o) ? 1 : -1;
+}
+
+ObjFile *obj_open(char *name, char *base, size_t size) {
+    ObjFile *o = (ObjFile *) mallocz(sizeof(ObjFile), MEM_LINK);
+    int r = obj_parse(o, base, size);
+
+    if (r < 0) {
+        link_error("malformed object %s", name);
+    }
+    if (r == 0) {
+        mem_free(o, MEM_LINK);
+        return NULL;
+    }
+    o->name = name;
+    return o;
+}
+
+// 静态库: 逐个成员解析, 只收录我们的目标文件
+void archive_open(Linker *l, char *path, char *base, size_t size) {
+    char *p = base + SARMAG, *longnames = NULL, *name, *end;
+    size_t msize, nlongnames = 0, k;
+    ObjFile *o;
+
+    while (p < base + size) {
+        msize = p + 60 <= base + size ? strtoul(p + 48, NULL, 10) : 0;
+        if (p + 60 > base + size || msize > (size_t) (base + size - (p + 60))) {
+            link_error("malformed object %s", path);
+        }
+        name = (char *) mallocz(strlen(path) + 64, MEM_LINK);
+        if (p[0] == '/' && p[1] == '/') {
+            longnames = p + 60;
+            nlongnames = msize;
+        } else if (p[0] != '/' || (p[1] >= '0' && p[1] <= '9')) {
+            if (p[0] == '/' && longnames) {
+                k = strtoul(p + 1, NULL, 10);
+                end = k < nlongnames ? memchr(longnames + k, '/', nlongnames - k) : NULL;
+                if (!end) {
+                    link_error("malformed object %s", path);
+                }
+                sprintf(name, "%s(%.*s)", path, end - (longnames + k) < 48 ? (int) (end - (longnames + k)) : 48,
+                        longnames + k);
+            } else {
+                end = memchr(p, '/', 16);
+                sprintf(name, "%s(%.*s)", path, end ? (int) (end - p) : 16, p);
+            }
+            o = obj_open(name, p + 60, msize);
+            if (o) {
+                dynArray_add(&l->objs, o);
+            } else {
+                warning("%s 不是sc目标文件, 忽略", name);
+            }
+        }
+        p += 60 + msize + (msize & 1);
+    }
+}
+
+void link_define(Linker *l, ObjFile *o) {
+    int i;
+    Elf64_Sym *es;
+    LinkSym *s;
+
+    o->included = 1;
+    for (i = 1; i < o->nsyms; i++) {
+        es = &o->syms[i];
+        if (ELF64_ST_BIND(es->st_info) != STB_GLOBAL) {
+            continue;
+        }
+        s = link_sym(l, o->strtab + es->st_name, 1);
+        if (es->st_shndx == SHN_UNDEF) {
+            continue;
+        }
+        if (es->st_shndx == SHN_COMMON) {
+            if ((int) es->st_size > s->common_size) {
+                s->common_size = (int) es->st_size;
+            }
+            if ((int) es->st_value > s->common_align) {
+                s->common_align = (int) es->st_value;
+            }
+            continue;
+        }
+        if (s->obj) {
+            link_error("multiple definition of '%s' (%s, %s)", s->name, s->obj->name, o->name);
+        }
+        s->obj = o;
+        s->idx = i;
+    }
+}
+
+// 静态库成员只在能解决未定义符号时才收录, 直到不再变化
+int link_pull(Linker *l) {
+    int i, j, changed = 0;
+    ObjFile *o;
+    Elf64_Sym *es;
+    LinkSym *s;
+
+    for (i = 0; i < l->objs.count; i++) {
+        o = (ObjFile *) l->objs.data[i];
+        if (o->included) {
+            continue;
+        }
+        for (j = 1; j < o->nsyms; j++) {
+            es = &o->syms[j];
+            if (ELF64_ST_BIND(es->st_info) != STB_GLOBAL || es->st_shndx == SHN_UNDEF
+                || es->st_shndx == SHN_COMMON) {
+                continue;
+            }
+            s = link_sym(l, o->strtab + es->st_name, 0);
+            if (s && !s->obj && !s->common_size) {
+                link_define(l, o);
+                changed = 1;
+                break;
+            }
+        }
+    }
+    return changed;
+}
+
+// 标记可达: 全局符号的引用转到定义它的目标文件; 函数沿其代码的重定位继续
+void link_mark(Linker *l, ObjFile *o, int i, ObjFile **stk, int *stki, int *n) {
+    Elf64_Sym *es = &o->syms[i];
+    LinkSym *s;
+
+    if (es->st_shndx == SHN_UNDEF || es->st_shndx == SHN_COMMON) {
+        s = link_sym(l, o->strtab + es->st_name, 0);
+        if (!s->obj) {
+            s->live = 1;
+            return;
+        }
+        o = s->obj;
+        i = s->idx;
+    }
+    if (!o->live[i]) {
+        o->live[i] = 1;
+        stk[*n] = o;
+        stki[(*n)++] = i;
+    }
+}
+
+// 可达性分析: 根为 main 和各文件的 __init (全局变量初始化代码里取地址的函数和数据由此可达)
+void link_gc(Linker *l, int total) {
+    ObjFile *o, **stk;
+    Elf64_Sym *es;
+    Elf64_Rela *r, *end;
+    LinkSym *s;
+    int i, k, n = 0, *stki;
+    unsigned long from;
+
+    stk = (ObjFile **) mem_alloc(sizeof(ObjFile *) * (total + 1), MEM_LINK);
+    stki = (int *) mem_alloc(sizeof(int) * (total + 1), MEM_LINK);
+    for (k = 0; k < l->objs.count; k++) {
+        o = (ObjFile *) l->objs.data[k];
+        if (!o->included) {
+            continue;
+        }
+        o->live = (char *) mallocz(o->nsyms + 1, MEM_LINK);
+        o->fnew = (int *) mem_alloc(sizeof(int) * (o->nfuncs + 1), MEM_LINK);
+        for (i = 0; i < o->nfuncs; i++) {
+            o->fnew[i] = -1;
+        }
+    }
+    for (k = 0; k < l->objs.count; k++) {
+        o = (ObjFile *) l->objs.data[k];
+        for (i = 1; o->included && i < o->nsyms; i++) {
+            es = &o->syms[i];
+            if (!opt_link_dce || (ELF64_ST_TYPE(es->st_info) == STT_FUNC && ELF64_ST_BIND(es->st_info) == STB_LOCAL)) {
+                link_mark(l, o, i, stk, stki, &n);
+            }
+        }
+    }
+    if ((s = link_sym(l, "main", 0)) && s->obj) {
+        link_mark(l, s->obj, s->idx, stk, stki, &n);
+    }
+    while (n > 0) {
+        o = stk[--n];
+        es = &o->syms[stki[n]];
+        if (ELF64_ST_TYPE(es->st_info) != STT_FUNC) {
+            continue;
+        }
+        // 函数的重定位按偏移有序, 二分找到第一条
+        i = (int) es->st_value;
+        o->fnew[i] = 0;
+        from = (unsigned long) o->funcs[i].code * sizeof(Insn);
+        r = o->rela;
+        end = o->rela + o->nrela;
+        for (k = o->nrela; k > 0; k >>= 1) {
+            while (r + k <= end && r[k - 1].r_offset < from) {
+                r += k;
+            }
+        }
+        for (; r < end && r->r_offset < from + o->funcs[i].ncode * sizeof(Insn); r++) {
+            link_mark(l, o, (int) ELF64_R_SYM(r->r_info), stk, stki, &n);
+        }
+    }
+    mem_free(stk, MEM_LINK);
+    mem_free(stki, MEM_LINK);
+}
+
+ObjFile *link_sort_obj;
+
+int link_sym_cmp(const void *a, const void *b) {
+    Elf64_Sym *x = &link_sort_obj->syms[*(int *) a], *y = &link_sort_obj->syms[*(int *) b];
+
+    if (x->st_shndx != y->st_shndx) {
+        return x->st_shndx < y->st_shndx ? -1 : 1;
+    }
+    return x->st_value < y->st_value ? -1 : x->st_value > y->st_value;
+}
+
+// 本文件保留部分的布局: 函数按原顺序紧排; 数据按符号覆盖的区间分段, 保留有可达符号的段,
+// 新偏移保持原偏移的对齐 (最多 8)
+void link_layout(ObjFile *o) {
+    Elf64_Sym *es;
+    LinkChunk *c;
+    int i, j, n = 0, *idx, off, align, pos[2] = {0, 0};
+
+    o->keep_all = 1;
+    for (i = 1; i < o->nsyms; i++) {
+        es = &o->syms[i];
+        if (es->st_shndx == SHN_UNDEF || es->st_shndx == SHN_COMMON) {
+            continue;
+        }
+        o->keep_all &= o->live[i];
+        if (ELF64_ST_TYPE(es->st_info) != STT_FUNC) {
+            stats.link_data++;
+            stats.link_data_kept += o->live[i];
+        }
+    }
+    for (i = 0; i < o->nfuncs; i++) {
+        o->keep_all &= o->fnew[i] >= 0;
+    }
+    if (o->keep_all) {
+        for (i = 0; i < o->nfuncs; i++) {
+            o->fnew[i] = i;
+        }
+        o->out_text = o->ntext;
+        o->out_funcs = o->nfuncs;
+        o->out_data = o->ndata;
+        o->out_rodata = o->nrodata;
+        return;
+    }
+    o->fcode = (int *) mem_alloc(sizeof(int) * (o->nfuncs + 1), MEM_LINK);
+    for (i = 0; i < o->nfuncs; i++) {
+        if (o->fnew[i] >= 0) {
+            o->fnew[i] = o->out_funcs++;
+            o->fcode[i] = o->out_text;
+            o->out_text += o->funcs[i].ncode;
+            stats.link_funcs_kept++;
+            stats.link_text_kept += o->funcs[i].ncode;
+        }
+    }
+
+    idx = (int *) mem_alloc(sizeof(int) * (o->nsyms + 1), MEM_LINK);
+    o->value = (int *) mem_alloc(sizeof(int) * (o->nsyms + 1), MEM_LINK);
+    for (i = 1; i < o->nsyms; i++) {
+        es = &o->syms[i];
+        if (es->st_shndx != SHN_UNDEF && es->st_shndx != SHN_COMMON && ELF64_ST_TYPE(es->st_info) != STT_FUNC) {
+            idx[n++] = i;
+        }
+    }
+    link_sort_obj = o;
+    qsort(idx, n, sizeof(int), link_sym_cmp);
+    o->chunks = (LinkChunk *) mem_alloc(sizeof(LinkChunk) * (n + 1), MEM_LINK);
+    for (i = 0; i < n; i = j) {
+        es = &o->syms[idx[i]];
+        c = &o->chunks[o->nchunks];
+        c->rodata = !strcmp(elf_section_name(o->base, es->st_shndx), ".rodata");
+        c->from = (int) es->st_value;
+        c->size = 0;
+        off = c->from + (int) es->st_size;
+        for (j = i; j < n && o->syms[idx[j]].st_shndx == es->st_shndx && (int) o->syms[idx[j]].st_value < off + (i == j); j++) {
+            if ((int) (o->syms[idx[j]].st_value + o->syms[idx[j]].st_size) > off) {
+                off = (int) (o->syms[idx[j]].st_value + o->syms[idx[j]].st_size);
+            }
+            if (o->live[idx[j]]) {
+                c->size = 1;
+            }
+        }
+        if (!c->size) {
+            continue;
+        }
+        c->size = off - c->from;
+        for (align = 8; align > 1 && c->from % align; align >>= 1);
+        c->to = pos[c->rodata] = calc_align(pos[c->rodata], align);
+        pos[c->rodata] += c->size;
+        for (; i < j; i++) {
+            o->value[idx[i]] = c->to + (int) o->syms[idx[i]].st_value - c->from;
+        }
+        o->nchunks++;
+    }
+    o->out_data = pos[0];
+    o->out_rodata = pos[1];
+    mem_free(idx, MEM_LINK);
+}
+
+int link_gsym(Linker *l, int kind, int offset, int name) {
+    l->gsyms[l->ngsyms].kind = kind;
+    l->gsyms[l->ngsyms].offset = offset;
+    l->gsyms[l->ngsyms].name = name;
+    return l->ngsyms++;
+}
+
+// 复制一个目标文件的各节到输出, 并修正其代码中的符号引用
+void link_relocate(Linker *l, ObjFile *o, size_t *offs) {
+    Insn *text = (Insn *) (l->out + offs[0]) + o->text_base;
+    FuncRec *funcs = (FuncRec *) (l->out + offs[1]) + o->func_base;
+    Elf64_Rela *r;
+    LinkChunk *c;
+    int i, f = 0, at;
+
+    memcpy(l->out + offs[6] + o->str_base, o->strtab, o->nstrtab);
+    if (o->keep_all) {
+        memcpy(text, o->text, sizeof(Insn) * o->ntext);
+        memcpy(l->out + offs[2] + o->data_base, o->data, o->ndata);
+        memcpy(l->out + offs[3] + o->rodata_base, o->rodata, o->nrodata);
+    } else {
+        for (c = o->chunks; c < o->chunks + o->nchunks; c++) {
+            memcpy(l->out + offs[c->rodata ? 3 : 2] + (c->rodata ? o->rodata_base : o->data_base) + c->to,
+                   (c->rodata ? o->rodata : o->data) + c->from, c->size);
+        }
+    }
+    for (i = 0; i < o->nfuncs; i++) {
+        if (o->fnew[i] < 0) {
+            continue;
+        }
+        at = o->keep_all ? (int) o->funcs[i].code : o->fcode[i];
+        if (!o->keep_all) {
+            memcpy(text + at, o->text + o->funcs[i].code, sizeof(Insn) * o->funcs[i].ncode);
+        }
+        funcs[o->fnew[i]] = o->funcs[i];
+        funcs[o->fnew[i]].code = o->text_base + at;
+        funcs[o->fnew[i]].name += o->str_base;
+    }
+    for (i = 0, r = o->rela; i < o->nrela; i++, r++) {
+        if (ELF64_R_TYPE(r->r_info) != R_SC_SYM) {
+            link_error("%s: 未知重定位类型 %d", o->name, (int) ELF64_R_TYPE(r->r_info));
+        }
+        if (o->keep_all) {
+            *(int *) ((char *) text + r->r_offset) = o->map[ELF64_R_SYM(r->r_info)];
+            continue;
+        }
+        // 重定位按偏移有序, 所在函数随之前进; 删去的函数里的跳过
+        at = (int) (r->r_offset / sizeof(Insn));
+        while (at >= (int) (o->funcs[f].code + o->funcs[f].ncode)) {
+            f++;
+        }
+        if (o->fnew[f] >= 0) {
+            *(int *) ((char *) (text + o->fcode[f] + at - o->funcs[f].code) + r->r_offset % sizeof(Insn))
+                = o->map[ELF64_R_SYM(r->r_info)];
+        }
+    }
+}
+
+typedef struct LinkJob {
+    Linker *l;
+    ObjFile **objs;
+    int nobjs;
+    size_t *offs;
+} LinkJob;
+
+void *link_worker(void *arg) {
+    LinkJob *job = (LinkJob *) arg;
+    int i;
+
+    while ((i = __sync_fetch_and_add(&job->l->next_obj, 1)) < job->nobjs) {
+        link_relocate(job->l, job->objs[i], job->offs);
+    }
+    return NULL;
+}
+
+// 链接时优化, 见后文
+void lto_link(Linker *l);
+
+// 合并目标文件和静态库, 输出可执行映像
+void link_files(char **inputs, int ninputs, char *path) {
+    Linker l;
+    ObjFile *o, **objs;
+    LinkSym *s;
+    Elf64_Sym *es;
+    int *inits, ninits = 0;
+    int i, j, k, nobjs = 0, ntext = 0, nfuncs = 0, ndata = 0, nrodata = 0, nstr = 0, total = 0;
+    int nthreads, fd, main_idx = -1;
+    size_t size, fsize, offs[7];
+    ElfSec secs[7];
+    char *base;
+    pthread_t *threads;
+    LinkJob job;
+
+    memset(&l, 0, sizeof(l));
+    dynArray_init(&l.objs, 8, MEM_LINK);
+    for (i = 0; i < ninputs; i++) {
+        base = map_file(inputs[i], &fsize);
+        if (fsize >= SARMAG && !memcmp(base, ARMAG, SARMAG)) {
+            archive_open(&l, inputs[i], base, fsize);
+        } else if ((o = obj_open(inputs[i], base, fsize)) != NULL) {
+            o->included = 1;
+            dynArray_add(&l.objs, o);
+        } else {
+            link_error("%s 不是sc目标文件或静态库", inputs[i]);
+        }
+    }
+    for (i = 0; i < l.objs.count; i++) {
+        total += ((ObjFile *) l.objs.data[i])->nsyms;
+    }
+    for (l.nbuckets = 64; l.nbuckets < total; l.nbuckets <<= 1);
+    l.table = (LinkSym **) mallocz(sizeof(LinkSym *) * l.nbuckets, MEM_LINK);
+
+    // 符号解析
+    for (i = 0; i < l.objs.count; i++) {
+        o = (ObjFile *) l.objs.data[i];
+        if (o->included) {
+            link_define(&l, o);
+        }
+    }
+    while (link_pull(&l));
+    lto_link(&l);
+    for (i = 0, total = 0; i < l.objs.count; i++) {
+        total += ((ObjFile *) l.objs.data[i])->nsyms;
+    }
+    link_gc(&l, total);
+
+    // 布局
+    objs = (ObjFile **) mem_alloc(sizeof(ObjFile *) * (l.objs.count + 1), MEM_LINK);
+    for (i = 0; i < l.objs.count; i++) {
+        o = (ObjFile *) l.objs.data[i];
+        if (!o->included) {
+            continue;
+        }
+        objs[nobjs++] = o;
+        link_layout(o);
+        stats.link_funcs += o->nfuncs;
+        stats.link_text += o->ntext;
+        if (o->keep_all) {
+            stats.link_funcs_kept += o->nfuncs;
+            stats.link_text_kept += o->ntext;
+        }
+        o->text_base = ntext;
+        o->func_base = nfuncs;
+        o->data_base = ndata = calc_align(ndata, 8);
+        o->rodata_base = nrodata = calc_align(nrodata, 8);
+        o->str_base = nstr;
+        ntext += o->out_text;
+        nfuncs += o->out_funcs;
+        ndata += o->out_data;
+        nrodata += o->out_rodata;
+        nstr += o->nstrtab;
+    }
+    l.gsyms = (ImgSym *) mallocz(sizeof(ImgSym) * (total + 1), MEM_LINK);
+    inits = (int *) mem_alloc(sizeof(int) * (nobjs + 1), MEM_LINK);
+    for (k = 0; k < nobjs; k++) {
+        o = objs[k];
+        o->map = (int *) mem_alloc(sizeof(int) * (o->nsyms + 1), MEM_LINK);
+        for (i = 1; i < o->nsyms; i++) {
+            es = &o->syms[i];
+            o->map[i] = -1;
+            if (es->st_shndx == SHN_UNDEF || es->st_shndx == SHN_COMMON || !o->live[i]) {
+                continue;
+            }
+            if (ELF64_ST_TYPE(es->st_info) == STT_FUNC) {
+                j = link_gsym(&l, BS_FUNC, o->func_base + o->fnew[es->st_value], o->str_base + es->st_name);
+                if (ELF64_ST_BIND(es->st_info) == STB_LOCAL) {
+                    inits[ninits++] = j;
+                } else if (!strcmp(o->strtab + es->st_name, "main")) {
+                    main_idx = j;
+                }
+            } else if (strcmp(elf_section_name(o->base, es->st_shndx), ".rodata") == 0) {
+                j = link_gsym(&l, BS_RODATA, o->rodata_base + (o->keep_all ? (int) es->st_value : o->value[i]), 0);
+            } else {
+                j = link_gsym(&l, BS_DATA, o->data_base + (o->keep_all ? (int) es->st_value : o->value[i]),
+                              o->str_base + es->st_name);
+            }
+            o->map[i] = j;
+            if (ELF64_ST_BIND(es->st_info) == STB_GLOBAL) {
+                link_sym(&l, o->strtab + es->st_name, 0)->gidx = j;
+            }
+        }
+    }
+    for (k = 0; k < nobjs; k++) {
+        o = objs[k];
+        for (i = 1; i < o->nsyms; i++) {
+            es = &o->syms[i];
+            if (o->map[i] >= 0 || (es->st_shndx != SHN_UNDEF && es->st_shndx != SHN_COMMON)) {
+                continue;
+            }
+            s = link_sym(&l, o->strtab + es->st_name, 0);
+            if (s->gidx < 0 && !s->obj) {
+                if (s->common_size) {
+                    if (!s->live) {
+                        continue;
+                    }
+                    // 未初始化的公共块放在数据段末尾
+                    ndata = calc_align(ndata, s->common_align);
+                    s->gidx = link_gsym(&l, BS_DATA, ndata, o->str_base + es->st_name);
+                    ndata += s->common_size;
+                } else {
+                    if (!native_exists(s->name)) {
+                        link_error("undefined reference to '%s' (%s)", s->name, o->name);
+                    }
+                    if (!s->live) {
+                        continue;
+                    }
+                    s->gidx = link_gsym(&l, BS_UNDEF, 0, o->str_base + es->st_name);
+                }
+            }
+            o->map[i] = s->gidx;
+        }
+    }
+    if (main_idx < 0) {
+        link_error("undefined reference to 'main'");
+    }
+
+    // 输出: 一次 mmap, 各目标文件并行复制并重定位
+    memset(secs, 0, sizeof(secs));
+    secs[0].name = ".sc.text";
+    secs[0].size = sizeof(Insn) * ntext;
+    secs[0].entsize = sizeof(Insn);
+    secs[1].name = ".sc.func";
+    secs[1].size = sizeof(FuncRec) * nfuncs;
+    secs[1].entsize = sizeof(FuncRec);
+    secs[2].name = ".data";
+    secs[2].size = ndata;
+    secs[3].name = ".rodata";
+    secs[3].size = nrodata;
+    secs[4].name = ".sc.gsym";
+    secs[4].data = l.gsyms;
+    secs[4].size = sizeof(ImgSym) * l.ngsyms;
+    secs[4].entsize = sizeof(ImgSym);
+    secs[5].name = ".sc.init";
+    secs[5].size = sizeof(unsigned int) * ninits;
+    secs[6].name = ".strtab";
+    secs[6].type = SHT_STRTAB;
+    secs[6].size = nstr;
+    for (i = 0; i < 6; i++) {
+        secs[i].type = SHT_PROGBITS;
+    }
+    size = elf_build(NULL, ET_EXEC, secs, 7, main_idx);
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0755);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        link_error("不能创建 %s", path);
+    }
+    l.out = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (l.out == MAP_FAILED) {
+        link_error("不能映射 %s", path);
+    }
+    elf_build(l.out, ET_EXEC, secs, 7, main_idx);
+    for (i = 0; i < 7; i++) {
+        offs[i] = secs[i].offset;
+    }
+    for (i = 0; i < ninits; i++) {
+        ((unsigned int *) (l.out + offs[5]))[i] = inits[i];
+    }
+
+    nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > nobjs) {
+        nthreads = nobjs;
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    job.l = &l;
+    job.objs = objs;
+    job.nobjs = nobjs;
+    job.offs = offs;
+    threads = (pthread_t *) mem_alloc(sizeof(pthread_t) * nthreads, MEM_LINK);
+    for (i = 1; i < nthreads; i++) {
+        pthread_create(&threads[i], NULL, link_worker, &job);
+    }
+    link_worker(&job);
+    for (i = 1; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    munmap(l.out, size);
+    close(fd);
+    mem_free(threads, MEM_LINK);
+    mem_free(objs, MEM_LINK);
+    mem_free(inits, MEM_LINK);
+}
+
+// 映像里的函数记录 全局符号 初始化函数 以及代码引用的符号序号都不越界
+int image_check(Insn *text, int ntext, FuncRec *funcs, int nfuncs, ImgSym *gs, int ngs, unsigned int *inits,
+                int ninits, char *strtab, int nstrtab, BcModule *m) {
+    int i, k;
+
+    if (!text || !strtab || nstrtab == 0 || strtab[nstrtab - 1] || !func_check(funcs, nfuncs, ntext, nstrtab)) {
+        return 0;
+    }
+    for (i = 0; i < ngs; i++) {
+        if (gs[i].name >= (unsigned int) nstrtab
+            || (gs[i].kind == BS_FUNC && gs[i].offset >= (unsigned int) nfuncs)
+            || (gs[i].kind == BS_DATA && gs[i].offset > (unsigned int) m->data.count)
+            || (gs[i].kind == BS_RODATA && gs[i].offset > (unsigned int) m->rodata.count)
+            || gs[i].kind > BS_RODATA) {
+            return 0;
+        }
+    }
+    for (i = 0; i < ninits; i++) {
+        if (inits[i] >= (unsigned int) ngs || gs[inits[i]].kind != BS_FUNC) {
+            return 0;
+        }
+    }
+    // 操作码和跳转目标也不越界; 寄存器和内存访问照旧由编译器保证, 这里不做字节码校验
+    for (i = 0, k = 0; i < ntext; i++) {
+        if (i == (int) (funcs[k].code + funcs[k].ncode)) {
+            k++;
+        }
+        if (text[i].op >= OP_COUNT || (insn_sym_field(text[i].op) && (unsigned int) text[i].b >= (unsigned int) ngs)
+            || ((peep_flags[text[i].op] & PF_JUMP) && (unsigned int) text[i].c >= funcs[k].ncode)
+            || (text[i].op == OP_JTAB && (i + 1 >= ntext || (unsigned int) text[i + 1].b
+                                          > funcs[k].code + funcs[k].ncode - (unsigned int) i - 1))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 装入链接好的映像, 构造出与编译结果相同形式的模块
+void image_load(BcModule *m, char *path) {
+    char *base, *strtab;
+    size_t size, n;
+    Insn *text;
+    FuncRec *funcs;
+    ImgSym *gs;
+    unsigned int *inits;
+    BcFunc **fs, *f;
+    BcSym *s;
+    int i, ntext, nfuncs, ngs, ninits, nstrtab;
+
+    base = map_file(path, &size);
+    if (!is_sc_elf(base, size, ET_EXEC)) {
+        link_error("%s 不是sc可执行映像", path);
+    }
+    if (!elf_check(base, size)) {
+        link_error("malformed object %s", path);
+    }
+    text = (Insn *) elf_section(base, ".sc.text", &n);
+    ntext = (int) (n / sizeof(Insn));
+    funcs = (FuncRec *) elf_section(base, ".sc.func", &n);
+    nfuncs = (int) (n / sizeof(FuncRec));
+    gs = (ImgSym *) elf_section(base, ".sc.gsym", &n);
+    ngs = (int) (n / sizeof(ImgSym));
+    inits = (unsigned int *) elf_section(base, ".sc.init", &n);
+    ninits = (int) (n / sizeof(unsigned int));
+    strtab = elf_section(base, ".strtab", &n);
+    nstrtab = (int) n;
+    m->data.data = elf_section(base, ".data", &n);
+    m->data.count = (int) n;
+    m->rodata.data = elf_section(base, ".rodata", &n);
+    m->rodata.count = (int) n;
+    if (!image_check(text, ntext, funcs, nfuncs, gs, ngs, inits, ninits, strtab, nstrtab, m)) {
+        link_error("malformed object %s", path);
+    }
+
+    fs = (BcFunc **) mem_alloc(sizeof(BcFunc *) * (nfuncs + 1), MEM_CODE);
+    for (i = 0; i < nfuncs; i++) {
+        f = (BcFunc *) mallocz(sizeof(BcFunc), MEM_CODE);
+        f->name = strtab + funcs[i].name;
+        f->code = text + funcs[i].code;
+        f->ncode = funcs[i].ncode;
+        f->nparams = funcs[i].nparams;
+        f->nregs = funcs[i].nregs;
+        f->frame_size = funcs[i].frame_size;
+        f->frame_words = f->nregs + f->frame_size / 8;
+        fs[i] = f;
+    }
+    dynArray_init(&m->syms, ngs + 8, MEM_MODULE);
+    for (i = 0; i < ngs; i++) {
+        s = (BcSym *) mallocz(sizeof(BcSym), MEM_MODULE);
+        s->kind = gs[i].kind;
+        s->offset = gs[i].offset;
+        s->name = strtab + gs[i].name;
+        if (s->kind == BS_FUNC) {
+            s->func = fs[s->offset];
+            s->name = s->func->name;
+        }
+        dynArray_add(&m->syms, s);
+    }
+    // 依次调用各目标文件的 __init
+    m->init = bc_func_new("__init");
+    cur_func = m->init;
+    loc = 0;
+    for (i = 0; i < ninits; i++) {
+        gen_insn(OP_CALL, 1, inits[i], 0);
+    }
+    m->init->nregs = 2;
+    gen_epilog();
+    mem_free(fs, MEM_CODE);
+}
+
+// 从目标文件恢复模块, ELF 符号 i 对应模块符号 i-1 (编译缓存命中时使用)
+void obj_load(BcModule *m, char *name, char *base, size_t size) {
+    ObjFile *o = obj_open(name, base, size);
+    Insn *text;
+    Elf64_Sym *es;
+    Elf64_Rela *r;
+    BcFunc **fs, *f;
+    BcSym *s;
+    int i, ndata;
+
+    if (!o) {
+        link_error("%s 不是sc目标文件", name);
+    }
+    text = (Insn *) mem_alloc(sizeof(Insn) * (o->ntext + 1), MEM_CODE);
+    memcpy(text, o->text, sizeof(Insn) * o->ntext);
+    for (i = 0, r = o->rela; i < o->nrela; i++, r++) {
+        *(int *) ((char *) text + r->r_offset) = (int) ELF64_R_SYM(r->r_info) - 1;
+    }
+    fs = (BcFunc **) mem_alloc(sizeof(BcFunc *) * (o->nfuncs + 1), MEM_CODE);
+    for (i = 0; i < o->nfuncs; i++) {
+        f = (BcFunc *) mallocz(sizeof(BcFunc), MEM_CODE);
+        f->name = o->strtab + o->funcs[i].name;
+        f->code = text + o->funcs[i].code;
+        f->ncode = o->funcs[i].ncode;
+        f->nparams = o->funcs[i].nparams;
+        f->nregs = o->funcs[i].nregs;
+        f->frame_size = o->funcs[i].frame_size;
+        f->frame_words = f->nregs + f->frame_size / 8;
+        fs[i] = f;
+    }
+    // 公共块放在数据段末尾
+    ndata = o->ndata;
+    for (i = 1; i < o->nsyms; i++) {
+        es = &o->syms[i];
+        if (es->st_shndx == SHN_COMMON) {
+            ndata = calc_align(ndata, (int) es->st_value) + (int) es->st_size;
+        }
+    }
+    m->data.data = (char *) mallocz(ndata + 1, MEM_MODULE);
+    m->data.tag = MEM_MODULE;
+    memcpy(m->data.data, o->data, o->ndata);
+    m->data.count = o->ndata;
+    m->rodata.data = o->rodata;
+    m->rodata.count = o->nrodata;
+    dynArray_init(&m->syms, o->nsyms + 8, MEM_MODULE);
+    for (i = 1; i < o->nsyms; i++) {
+        es = &o->syms[i];
+        s = (BcSym *) mallocz(sizeof(BcSym), MEM_MODULE);
+        s->name = o->strtab + es->st_name;
+        s->size = (int) es->st_size;
+        if (es->st_shndx == SHN_UNDEF) {
+            s->kind = BS_UNDEF;
+        } else if (es->st_shndx == SHN_COMMON) {
+            s->kind = BS_DATA;
+            s->offset = m->data.count = calc_align(m->data.count, (int) es->st_value);
+            m->data.count += s->size;
+        } else if (ELF64_ST_TYPE(es->st_info) == STT_FUNC) {
+            s->kind = BS_FUNC;
+            s->func = fs[es->st_value];
+        } else if (!strcmp(elf_section_name(base, es->st_shndx), ".rodata")) {
+            s->kind = BS_RODATA;
+            s->offset = (int) es->st_value;
+        } else {
+            s->kind = BS_DATA;
+            s->offset = (int) es->st_value;
+        }
+        dynArray_add(&m->syms, s);
+    }
+    m->init = fs[0];
+    mem_free(fs, MEM_CODE);
+    mem_free(o, MEM_LINK);
+}
+
+// 编译缓存
+// 键: 源文件内容 + 编译器版本 + 影响输出的选项, 128位; 值: 包含文件列表 + 目标文件
+// 包含文件事先不知道, 存入条目: 每个文件的路径和内容散列, 命中前逐个校验, 有变化即未命中
+// 一个条目一个文件, 命中时更新 mtime, 超出容量时按 mtime 淘汰最旧的条目
+#define SC_VERSION "sc-0.4 " __DATE__ " " __TIME__
+#define CACHE_MAGIC 0x32434353      // "SCC2"
+
+typedef struct CacheHdr {
+    unsigned int magic;
+    unsigned int tkcount;           // 命中时复现语法分析的输出
+    unsigned long long srcsize;
+    unsigned long long objsize;
+    unsigned int ndeps;             // 包含文件数
+    unsigned int depsize;           // 包含文件列表的字节数, 8 字节对齐
+} CacheHdr;
+
+char *cache_dir = NULL;
+long long cache_limit = 256LL << 20;
+char cache_flags[4096] = "";        // 影响输出的编译选项, 参与计算键
+char cache_path[1024];
+size_t cache_srcsize;
+
+// 每次处理8字节的乘法/移位散列
+unsigned long long hash64(char *p, size_t n, unsigned long long seed) {
+    unsigned long long h = seed ^ (n * 0x9e3779b97f4a7c15ULL), k;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        memcpy(&k, p + i, 8);
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 32;
+        h = (h ^ k) * 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 29;
+    }
+    k = 0;
+    memcpy(&k, p + i, n - i);
+    h = (h ^ k) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void cache_key(char *src, size_t n) {
+    unsigned long long h1 = hash64(src, n, 0x5343), h2 = hash64(src, n, 0x3cb5);
+
+    h1 = hash64(SC_VERSION, sizeof(SC_VERSION), h1);
+    h1 = hash64(cache_flags, strlen(cache_flags), h1);
+    h2 = hash64(SC_VERSION, sizeof(SC_VERSION), h2);
+    h2 = hash64(cache_flags, strlen(cache_flags), h2);
+    snprintf(cache_path, sizeof(cache_path), "%s/%016llx%016llx.sco", cache_dir, h1, h2);
+}
+
+// 累计命中/未命中/淘汰次数, 多个编译进程共享, 用 flock 串行化
+void cache_count(int hits, int misses, int evictions) {
+    char path[1024], buf[128];
+    long long c[3] = {0, 0, 0};
+    int fd, n;
+
+    snprintf(path, sizeof(path), "%s/stats", cache_dir);
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return;
+    }
+    flock(fd, LOCK_EX);
+    n = (int) read(fd, buf, sizeof(buf) - 1);
+    buf[n > 0 ? n : 0] = '\0';
+    sscanf(buf, "%lld %lld %lld", &c[0], &c[1], &c[2]);
+    n = snprintf(buf, sizeof(buf), "%lld %lld %lld\n", c[0] + hits, c[1] + misses, c[2] + evictions);
+    if (ftruncate(fd, 0) == 0 && pwrite(fd, buf, n, 0) != n) {
+        warning("不能写 %s", path);
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+void cache_print_stats() {
+    char path[1024];
+    long long c[3] = {0, 0, 0}, total = 0, n = 0;
+    FILE *fp;
+    DIR *d;
+    struct dirent *e;
+    struct stat st;
+
+    snprintf(path, sizeof(path), "%s/stats", cache_dir);
+    fp = fopen(path, "r");
+    if (fp) {
+        if (fscanf(fp, "%lld %lld %lld", &c[0], &c[1], &c[2]) != 3) {
+            c[0] = c[1] = c[2] = 0;
+        }
+        fclose(fp);
+    }
+    d = opendir(cache_dir);
+    while (d && (e = readdir(d))) {
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, e->d_name);
+        if (strstr(e->d_name, ".sco") && stat(path, &st) == 0) {
+            total += st.st_size;
+            n++;
+        }
+    }
+    if (d) {
+        closedir(d);
+    }
+    printf("cache %s: %lld entries, %.1f/%.1f MB, hits %lld, misses %lld, evictions %lld, hit rate %.1f%%\n",
+           cache_dir, n, total / 1048576.0, cache_limit / 1048576.0, c[0], c[1], c[2],
+           c[0] + c[1] ? 100.0 * c[0] / (c[0] + c[1]) : 0.0);
+}
+
+void cache_flag(char *opt, char *val) {
+    int n = (int) strlen(cache_flags);
+    snprintf(cache_flags + n, sizeof(cache_flags) - n, " %s%s", opt, val);
+}
+
+// 包含文件的内容与存入时相同
+int cache_deps_ok(char *p, size_t size, int ndeps) {
+    unsigned long long hash;
+    struct stat st;
+    char *q, *end = p + size;
+    int i, fd, ok;
+
+    for (i = 0; i < ndeps; i++) {
+        if (end - p < 9 || !memchr(p + 8, 0, end - p - 8)) {
+            return 0;
+        }
+        memcpy(&hash, p, 8);
+        p += 8;
+        fd = open(p, O_RDONLY);
+        p += strlen(p) + 1;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return 0;
+        }
+        q = (char *) mmap(NULL, st.st_size ? st.st_size : 1, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (q == MAP_FAILED) {
+            return 0;
+        }
+        ok = hash64(q, st.st_size, 0) == hash;
+        munmap(q, st.st_size ? st.st_size : 1);
+        if (!ok) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 查缓存, 命中时返回映射的目标文件
+char *cache_fetch(char *file, size_t *objsize, int *tkcount) {
+    char *src, *p;
+    size_t srcsize, size;
+    CacheHdr *h;
+    ObjFile o;
+    struct stat st;
+    int fd;
+
+    mkdir(cache_dir, 0755);
+    src = map_file(file, &srcsize);
+    cache_key(src, srcsize);
+    munmap(src, srcsize ? srcsize : 1);
+    cache_srcsize = srcsize;
+    // 要报告时不取缓存 (命中时不做优化, 也就没有报告), 只算出键, 编译结果照常存入
+    fd = opt_inline_report || opt_vector_report ? -1 : open(cache_path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(CacheHdr)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        cache_count(0, 1, 0);
+        return NULL;
+    }
+    size = st.st_size;
+    p = (char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    h = (CacheHdr *) p;
+    memset(&o, 0, sizeof(o));
+    if (p == MAP_FAILED || h->magic != CACHE_MAGIC || h->srcsize != srcsize
+        || h->objsize > size || h->depsize > size || h->objsize + h->depsize + sizeof(CacheHdr) != size
+        || obj_parse(&o, p + sizeof(CacheHdr) + h->depsize, h->objsize) <= 0
+        || !cache_deps_ok(p + sizeof(CacheHdr), h->depsize, h->ndeps)) {
+        // 损坏 散列冲突 或包含文件有变化的条目当作未命中, 稍后覆盖
+        if (p != MAP_FAILED) {
+            munmap(p, size);
+        }
+        cache_count(0, 1, 0);
+        return NULL;
+    }
+    utimes(cache_path, NULL);
+    cache_count(1, 0, 0);
+    *objsize = h->objsize;
+    *tkcount = h->tkcount;
+    return p + sizeof(CacheHdr) + h->depsize;
+}
+
+typedef struct CacheEnt {
+    char *name;
+    long long mtime;                // 纳秒
+    long long size;
+} CacheEnt;
+
+int cache_ent_cmp(const void *a, const void *b) {
+    long long x = ((CacheEnt *) a)->mtime, y = ((CacheEnt *) b)->mtime;
+    return x < y ? -1 : x > y;
+}
+
+// 总量超出限制时删除最久未用的条目
+void cache_evict() {
+    DIR *d = opendir(cache_dir);
+    struct dirent *e;
+    struct stat st;
+    CacheEnt *ents = NULL;
+    char path[1024];
+    long long total = 0;
+    int n = 0, cap = 0, i, evicted = 0;
+
+    while (d && (e = readdir(d))) {
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, e->d_name);
+        if (!strstr(e->d_name, ".sco") || strstr(e->d_name, ".tmp") || stat(path, &st) < 0) {
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            ents = (CacheEnt *) mem_realloc(ents, sizeof(CacheEnt) * cap, MEM_CACHE);
+        }
+        ents[n].name = mem_strdup(e->d_name, MEM_CACHE);
+        ents[n].mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        ents[n].size = st.st_size;
+        total += st.st_size;
+        n++;
+    }
+    if (d) {
+        closedir(d);
+    }
+    if (total > cache_limit) {
+        qsort(ents, n, sizeof(CacheEnt), cache_ent_cmp);
+        for (i = 0; i < n && total > cache_limit; i++) {
+            snprintf(path, sizeof(path), "%s/%s", cache_dir, ents[i].name);
+            if (unlink(path) == 0) {
+                total -= ents[i].size;
+                evicted++;
+            }
+        }
+    }
+    for (i = 0; i < n; i++) {
+        mem_free(ents[i].name, MEM_CACHE);
+    }
+    mem_free(ents, MEM_CACHE);
+    if (evicted) {
+        cache_count(0, 0, evicted);
+    }
+}
+
+// 写入新条目: 先写临时文件再 rename, 并发编译同一文件也不会读到半个条目
+void cache_store(char *obj, size_t objsize, int tkcount) {
+    char tmp[1100];
+    CacheHdr h;
+    DynString deps;
+    IncFile *inc;
+    FILE *fp;
+
+    dynstring_init(&deps, 256, MEM_CACHE);
+    h.ndeps = 0;
+    for (inc = pp_incs; inc; inc = inc->next) {
+        blob_add(&deps, &inc->hash, 8);
+        blob_add(&deps, inc->path, strlen(inc->path) + 1);
+        h.ndeps++;
+    }
+    while (deps.count % 8) {
+        dynstring_chcat(&deps, '\0');
+    }
+    h.magic = CACHE_MAGIC;
+    h.tkcount = tkcount;
+    h.srcsize = cache_srcsize;
+    h.objsize = objsize;
+    h.depsize = deps.count;
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", cache_path, (int) getpid());
+    fp = fopen(tmp, "wb");
+    if (!fp) {
+        dynstring_free(&deps);
+        warning("不能写缓存 %s", tmp);
+        return;
+    }
+    if (fwrite(&h, sizeof(h), 1, fp) != 1 || fwrite(deps.data, 1, deps.count, fp) != (size_t) deps.count
+        || fwrite(obj, 1, objsize, fp) != objsize) {
+        fclose(fp);
+        unlink(tmp);
+        dynstring_free(&deps);
+        warning("不能写缓存 %s", tmp);
+        return;
+    }
+    dynstring_free(&deps);
+    fclose(fp);
+    rename(tmp, cache_path);
+    cache_evict();
+}
+
+// 增量编译
+// 记录每个外部声明的字节范围 记号范围 内容散列, 函数定义另存字节码; 重新编译时
+// 函数体及其之前的全部声明文本 (不含其他函数体) 都没变的函数直接沿用上次的字节码, 跳过词法/语法分析.
+// 函数体内新登记的模块符号 (字符串常量 隐式声明的函数) 按原顺序重新登记, 符号编号与全量编译相同.
+// 函数还另存内联之后和全部优化之后的字节码: 沿用的函数调用的本文件函数也都沿用了优化结果时, 跳过内联 循环优化和尾调用
+#define INCR_MAGIC 0x34494353       // "SCI4"
+
+typedef struct IncrHdr {
+    unsigned int magic;
+    unsigned int ndecls, ncode, nlocs, nrefs, nstr;
+    unsigned long long version;
+} IncrHdr;
+
+// 优化之后的字节码
+#define INCR_SAME 0xffffffffu       // IncrCode.code: 与前一阶段的字节码相同, 不另存
+
+typedef struct IncrCode {
+    unsigned int code, ncode, nregs, frame_size;
+    unsigned int refs, nrefs;
+} IncrCode;
+
+typedef struct IncrDecl {
+    unsigned int start, end;        // 字节范围 [start, end)
+    unsigned int tok_start, tok_end;// 记号范围
+    unsigned long long hash;        // 内容散列, 函数定义只算函数体
+    unsigned long long ctx;         // 函数体之前全部声明文本的散列
+    unsigned int func;              // 是否函数定义
+    unsigned int ntoks;             // 函数体的单词数
+    unsigned int code, ncode, nregs, nparams, frame_size, nprof;
+    unsigned int locs, nlocs;       // 指令的源位置, 相对声明的起点
+    unsigned int refs, nrefs;
+    unsigned int body;              // 函数体的字节数
+    unsigned int nlog;              // 引用表的前 nlog 项是函数体内新登记的模块符号, 按登记顺序
+    unsigned int opt;               // 下面的优化结果有效
+    unsigned long long callees;     // 调用的本文件函数的名字散列
+    IncrCode mid, fin;              // 内联之后 (内联进调用者的就是它) 和全部优化之后的字节码
+} IncrDecl;
+
+enum e_IncrRefKind {
+    IR_NAME,                // 具名符号, 按名字找
+    IR_RODATA,              // 字符串常量, 按内容重新登记
+    IR_LOG,                 // 别的函数体内登记的符号: str 为那个函数的声明序号, size 为它在引用表中的序号
+};
+
+// 字节码中的符号引用
+typedef struct IncrRef {
+    unsigned int kind;              // IR_xxx
+    unsigned int str;               // 名字或内容在串表中的偏移
+    unsigned int size;
+} IncrRef;
+
+typedef struct IncrFunc {
+    int sym;                        // 模块符号
+    int decl;                       // 本次记录中的声明序号
+    int old;                        // 沿用的上次记录中的声明序号, 重新编译的为 -1
+} IncrFunc;
+
+typedef struct IncrSlot {
+    int gen;                        // 等于 incr_gen 时有效
+    int ref;
+} IncrSlot;
+
+enum e_IncrOptState {
+    IO_DIRTY,               // 照常优化
+    IO_READY,               // 有上次的优化结果, 调用的函数也都沿用时才能用
+    IO_CLEAN,               // 已装上内联之后的字节码, 跳过其余优化
+};
+
+// 翻译单元结束后优化期间每个模块符号的状态
+typedef struct IncrOpt {
+    int state;                      // IO_xxx
+    int owner, slot;                // 函数体内登记的符号: 登记它的函数的声明序号和引用序号, 其余 owner 为 -1
+    unsigned long long callees;
+    unsigned long long hash;        // 照常优化的函数: 前一阶段字节码的散列
+    IncrDecl *old;                  // 沿用的函数在上次记录中的声明
+    BcFunc *mid, *fin;              // 取回的内联之后和全部优化之后的字节码, 与前一阶段相同的为 NULL
+} IncrOpt;
+
+size_t incr_size;
+char *incr_path;
+unsigned int incr_mark;             // 已计入 incr_ctx 的字节数
+unsigned long long incr_ctx;
+DynString incr_decls, incr_code, incr_locs, incr_refs, incr_str;
+DynString incr_addrs;               // 本次记录每个引用对应的模块符号
+DynString incr_log;                 // 当前函数体内新登记的模块符号
+DynString incr_funcs;               // 本次记录了字节码的函数, IncrFunc
+IncrSlot *incr_map;                 // 模块符号序号 -> 当前引用表序号
+int incr_map_cap, incr_gen;
+int *incr_renum;                    // 上次记录的声明序号 -> 本次的, 没有沿用的为 -1
+IncrOpt *incr_opt;                  // 翻译单元结束后优化期间有效
+IncrHdr *incr_old;                  // 上次的记录
+IncrDecl *incr_old_decls;
+Insn *incr_old_code;
+InsnLoc *incr_old_locs;
+IncrRef *incr_old_refs;
+char *incr_old_str;
+int *incr_table, incr_nbuckets;
+int incr_nfuncs, incr_reused;
+int incr_clean_funcs;               // 沿用了优化结果的函数数
+int incr_pp_decl;                   // 当前声明从包含文件或宏展开开始, 不参与增量
+
+// 记录源位置与否 (-inline-report -vec-report) 也算在内, 沿用的函数才有源位置
+unsigned long long incr_version() {
+    return hash64(cache_flags, strlen(cache_flags), hash64(SC_VERSION, sizeof(SC_VERSION), opt_insn_locs));
+}
+
+void incr_open(char *file) {
+    IncrHdr *h;
+    IncrDecl *d;
+    struct stat st;
+    size_t size;
+    int fd, i, j;
+    char *p;
+
+    incr_src = map_file(file, &incr_size);
+    incr_path = (char *) mem_alloc(strlen(file) + 5, MEM_CACHE);
+    sprintf(incr_path, "%s.sci", file);
+    dynstring_init(&incr_decls, 1024, MEM_CACHE);
+    dynstring_init(&incr_code, 1024, MEM_CACHE);
+    dynstring_init(&incr_locs, 1024, MEM_CACHE);
+    dynstring_init(&incr_refs, 1024, MEM_CACHE);
+    dynstring_init(&incr_str, 1024, MEM_CACHE);
+    dynstring_init(&incr_addrs, 1024, MEM_CACHE);
+    dynstring_init(&incr_log, 256, MEM_CACHE);
+    dynstring_init(&incr_funcs, 1024, MEM_CACHE);
+    fd = open(incr_path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(IncrHdr)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    size = st.st_size;
+    p = (char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    h = (IncrHdr *) p;
+    if (p == MAP_FAILED || h->magic != INCR_MAGIC || h->version != incr_version()
+        || sizeof(IncrHdr) + (size_t) h->ndecls * sizeof(IncrDecl) + (size_t) h->ncode * sizeof(Insn)
+           + (size_t) h->nlocs * sizeof(InsnLoc) + (size_t) h->nrefs * sizeof(IncrRef) + h->nstr != size) {
+        return;
+    }
+    incr_old = h;
+    incr_old_decls = (IncrDecl *) (h + 1);
+    incr_old_code = (Insn *) (incr_old_decls + h->ndecls);
+    incr_old_locs = (InsnLoc *) (incr_old_code + h->ncode);
+    incr_old_refs = (IncrRef *) (incr_old_locs + h->nlocs);
+    incr_old_str = (char *) (incr_old_refs + h->nrefs);
+    incr_renum = (int *) mem_alloc(sizeof(int) * (h->ndecls + 1), MEM_CACHE);
+    memset(incr_renum, -1, sizeof(int) * (h->ndecls + 1));
+    // 以 ctx 为键的开放寻址表
+    for (incr_nbuckets = 16; incr_nbuckets < (int) h->ndecls * 2; incr_nbuckets *= 2);
+    incr_table = (int *) mem_alloc(sizeof(int) * incr_nbuckets, MEM_CACHE);
+    memset(incr_table, -1, sizeof(int) * incr_nbuckets);
+    for (i = 0; i < (int) h->ndecls; i++) {
+        d = &incr_old_decls[i];
+        if (!d->func) {
+            continue;
+        }
+        j = (int) (d->ctx & (incr_nbuckets - 1));
+        while (incr_table[j] >= 0) {
+            j = (j + 1) & (incr_nbuckets - 1);
+        }
+        incr_table[j] = i;
     }
 }
 
-void init_lex() {
-    TkWord *tp;
-    static TkWord keywords[] = {
-            {TK_PLUS,      NULL, "+",           NULL, NULL},
-            {TK_MINUS,     NULL, "-",           NULL, NULL},
-            {TK_STAR,      NULL, "*",           NULL, NULL},
-            {TK_DIVIDE,    NULL, "/",           NULL, NULL},
-            {TK_MOD,       NULL, "%",           NULL, NULL},
-            {TK_EQ,        NULL, "==",          NULL, NULL},
-            {TK_NEQ,       NULL, "!=",          NULL, NULL},
-            {TK_LT,        NULL, "<",           NULL, NULL},
-            {TK_LEQ,       NULL, "<=",          NULL, NULL},
-            {TK_GT,        NULL, ">",           NULL, NULL},
-            {TK_GEQ,       NULL, ">=",          NULL, NULL},
-            {TK_ASSIGN,    NULL, "=",           NULL, NULL},
-            {TK_POINTSTO,  NULL, "->",          NULL, NULL},
-            {TK_DOT,       NULL, ".",           NULL, NULL},
-            {TK_AND,       NULL, "&",           NULL, NULL},
-            {TK_OPENPA,    NULL, "(",           NULL, NULL},
-            {TK_CLOSEPA,   NULL, ")",           NULL, NULL},
-            {TK_OPENBR,    NULL, "[",           NULL, NULL},
-            {TK_CLOSEBR,   NULL, "]",           NULL, NULL},
-            {TK_BEGIN,     NULL, "{",           NULL, NULL},
-            {TK_END,       NULL, "}",           NULL, NULL},
-            {TK_SEMICOLON, NULL, ";",           NULL, NULL},
-            {TK_COMMA,     NULL, ",",           NULL, NULL},
-            {TK_ELLIPSIS,  NULL, "...",         NULL, NULL},
-            {TK_EOF,       NULL, "End_Of_File", NULL, NULL},
+// 找上次记录中 ctx 相同 从 b 开始的函数体文本也相同的函数
+IncrDecl *incr_find(unsigned long long ctx, unsigned int b) {
+    IncrDecl *d;
+    int j;
 
-            {TK_CINT,      NULL, "int",         NULL, NULL},
-            {TK_CCHAR,     NULL, "char",        NULL, NULL},
-            {TK_CSTR,      NULL, "string",      NULL, NULL},
+    if (!incr_old) {
+        return NULL;
+    }
+    for (j = (int) (ctx & (incr_nbuckets - 1)); incr_table[j] >= 0; j = (j + 1) & (incr_nbuckets - 1)) {
+        d = &incr_old_decls[incr_table[j]];
+        if (d->ctx == ctx && d->body <= incr_size - b && hash64(incr_src + b, d->body, 0) == d->hash) {
+            return d;
+        }
+    }
+    return NULL;
+}
 
+IncrDecl *incr_cur() {
+    return (IncrDecl *) (incr_decls.data + incr_decls.count) - 1;
+}
 
-            {KW_CHAR,      NULL, "char",        NULL, NULL},
-            {KW_SHORT,     NULL, "short",       NULL, NULL},
-            {KW_INT,       NULL, "int",         NULL, NULL},
-            {KW_VOID,      NULL, "void",        NULL, NULL},
-            {KW_STRUCT,    NULL, "struct",      NULL, NULL},
-            {KW_IF,        NULL, "if",          NULL, NULL},
-            {KW_ELSE,      NULL, "else",        NULL, NULL},
-            {KW_FOR,       NULL, "for",         NULL, NULL},
-            {KW_CONTINUE,  NULL, "continue",    NULL, NULL},
-            {KW_BREAK,     NULL, "break",       NULL, NULL},
-            {KW_RETURN,    NULL, "return",      NULL, NULL},
-            {KW_SIZEOF,    NULL, "sizeof",      NULL, NULL},
-            {KW_CDECL,     NULL, "__cdecl",     NULL, NULL},
-            {KW_STDCALL,   NULL, "__stdcall",   NULL, NULL},
-            {KW_ALIGN,     NULL, "__align",     NULL, NULL},
+// 当前单词是外部声明的第一个关键字, ch 紧跟在它后面
+unsigned int incr_tok_pos() {
+    return (unsigned int) (src_tell() - strlen(get_tkstr(token)));
+}
 
-            {0,            NULL, NULL,          NULL, NULL},
-    };
+// 结束上一个声明的范围
+void incr_decl_close(unsigned int end) {
+    IncrDecl *d;
 
-    dynArray_init(&tktable, 50);
-    for (tp = &keywords[0]; tp->spelling != NULL; tp++) {
-        tkWord_direct_insert(tp);
+    if (!incr_decls.count) {
+        return;
+    }
+    d = incr_cur();
+    d->end = end;
+    d->tok_end = tk_count - 1;
+    if (!d->func) {
+        d->hash = hash64(incr_src + d->start, end - d->start, 0);
     }
 }
 
-void preprocess() {
-    while (1) {
-        if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
-            skip_white_space();
-        } else if (ch == '/') {
-            getch();
-            if (ch == '*' || ch == '/') {
-                parse_comment();
-            } else {
-                ungetc(ch, fin);
-                ch = '/';
+void incr_decl_begin() {
+    IncrDecl d;
+
+    // 来自包含文件或宏展开的声明并入上一个声明, 其内容已经计入 incr_ctx
+    incr_pp_decl = pp_depth > 0;
+    if (incr_pp_decl) {
+        return;
+    }
+    memset(&d, 0, sizeof(d));
+    d.start = incr_tok_pos();
+    d.tok_start = tk_count - 1;
+    incr_decl_close(d.start);
+    blob_add(&incr_decls, &d, sizeof(d));
+}
+
+// 在源文本 text 中从 '{' 开始找到匹配的 '}', 返回其后的偏移; 不完整或含预处理指令时返回 0
+unsigned int body_end(char *text, size_t size, unsigned int b) {
+    char *p = text + b, *end = text + size, *t, q;
+    int depth = 0;
+
+    while (p < end) {
+        switch (*p++) {
+            case '{':
+                depth++;
                 break;
-            }
+            case '}':
+                if (--depth == 0) {
+                    return (unsigned int) (p - text);
+                }
+                break;
+            case '#':
+                // 函数体内有预处理指令, 不沿用
+                for (t = p - 2; t >= text && (*t == ' ' || *t == '\t'); t--);
+                if (t < text || *t == '\n') {
+                    return 0;
+                }
+                break;
+            case '"':
+            case '\'':
+                q = p[-1];
+                while (p < end && *p != q && *p != '\n') {
+                    if (*p == '\\') {
+                        p++;
+                    }
+                    p++;
+                }
+                p++;
+                break;
+            case '/':
+                if (p < end && *p == '/') {
+                    while (p < end && *p != '\n') {
+                        p++;
+                    }
+                } else if (p < end && *p == '*') {
+                    for (p++; p + 1 < end && !(p[0] == '*' && p[1] == '/'); p++);
+                    p += 2;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return 0;
+}
+
+// 按名字找全局声明的模块符号, 没有时返回 -1
+int incr_global(char *name) {
+    int save = token;
+    TkWord *tp = tkWord_find(name);
+    Symbol *s;
+
+    token = save;
+    for (s = tp ? tp->sym_identifier : NULL; s; s = s->prev_tok) {
+        if (s->r & SC_SYM) {
+            return s->c;
+        }
+    }
+    return -1;
+}
+
+// 按名字找模块符号, 没有全局声明的 (隐式声明的函数) 新建未定义符号; fresh 时总是新建
+int incr_sym(char *name, int fresh) {
+    int save = token, addr = fresh ? -1 : incr_global(name);
+    TkWord *tp;
+
+    if (addr >= 0) {
+        return addr;
+    }
+    tp = tkWord_find(name);
+    token = save;
+    return bc_sym_add(tp ? tp->spelling : name, BS_UNDEF);
+}
+
+// 函数体内登记了一个字符串常量或隐式声明的函数
+void incr_log_sym(int addr) {
+    blob_add(&incr_log, &addr, sizeof(addr));
+}
+
+// 解析引用用的临时数组
+int *incr_scratch(int n) {
+    static int *p, cap;
+
+    if (n > cap) {
+        cap = n * 2;
+        p = (int *) mem_realloc(p, sizeof(int) * cap, MEM_CACHE);
+    }
+    return p;
+}
+
+// 引用表加一项: 别的函数体内登记的符号记那个函数, 具名符号记名字, 字符串常量记内容
+void incr_ref(int addr, IncrOpt *o) {
+    BcSym *bs = bc_sym(addr);
+    IncrRef ref;
+
+    if (bs->kind == BS_RODATA) {
+        ref.kind = IR_RODATA;
+        ref.str = blob_add(&incr_str, module.rodata.data + bs->offset, bs->size);
+        ref.size = bs->size;
+    } else if (o && o->owner >= 0) {
+        ref.kind = IR_LOG;
+        ref.str = o->owner;
+        ref.size = o->slot;
+    } else {
+        ref.kind = IR_NAME;
+        ref.str = strtab_add(&incr_str, bs->name);
+        ref.size = 0;
+    }
+    blob_add(&incr_refs, &ref, sizeof(ref));
+    blob_add(&incr_addrs, &addr, sizeof(addr));
+}
+
+// 模块符号在当前函数的引用表中的序号, 第一次引用时加一项; post 为优化之后的字节码
+int incr_slot(int addr, unsigned int *nrefs, int post) {
+    int cap = incr_map_cap;
+
+    if (addr >= incr_map_cap) {
+        incr_map_cap = incr_map_cap ? incr_map_cap : 256;
+        while (addr >= incr_map_cap) {
+            incr_map_cap *= 2;
+        }
+        incr_map = (IncrSlot *) mem_realloc(incr_map, sizeof(IncrSlot) * incr_map_cap, MEM_CACHE);
+        memset(incr_map + cap, 0, sizeof(IncrSlot) * (incr_map_cap - cap));
+    }
+    if (incr_map[addr].gen != incr_gen) {
+        incr_map[addr].gen = incr_gen;
+        incr_map[addr].ref = (*nrefs)++;
+        incr_ref(addr, post ? &incr_opt[addr] : NULL);
+    }
+    return incr_map[addr].ref;
+}
+
+// 存入字节码, 符号引用改为记录内的引用序号
+void incr_put_insns(unsigned int *code, unsigned int *nrefs, BcFunc *f, int post) {
+    Insn *p;
+    int i;
+
+    *code = incr_code.count / sizeof(Insn);
+    blob_add(&incr_code, f->code, sizeof(Insn) * f->ncode);
+    p = (Insn *) incr_code.data + *code;
+    for (i = 0; i < f->ncode; i++) {
+        if (insn_sym_field(p[i].op)) {
+            p[i].b = incr_slot(p[i].b, nrefs, post);
+        }
+    }
+}
+
+void incr_func_add(int sym, int old) {
+    IncrFunc fn;
+
+    fn.sym = sym;
+    fn.decl = incr_decls.count / sizeof(IncrDecl) - 1;
+    fn.old = old;
+    blob_add(&incr_funcs, &fn, sizeof(fn));
+    if (old >= 0) {
+        incr_renum[old] = fn.decl;
+    }
+}
+
+// 把编译出的函数字节码存入记录; 函数体内登记的符号排在引用表最前面
+void incr_save_func(IncrDecl *d, BcFunc *f, int sym) {
+    SrcLoc base = (SrcLoc) src.base + d->start;
+    InsnLoc il;
+    int i, *log = (int *) incr_log.data;
+
+    d->locs = incr_locs.count / sizeof(InsnLoc);
+    d->nlocs = 0;
+    for (i = 0; i < f->nlocs; i++) {
+        il = f->locs[i];
+        if (il.loc >= base && il.loc - base < d->end - d->start) {
+            il.loc -= base;
+            blob_add(&incr_locs, &il, sizeof(il));
+            d->nlocs++;
+        }
+    }
+    d->ncode = f->ncode;
+    d->nregs = f->nregs;
+    d->nparams = f->nparams;
+    d->frame_size = f->frame_size;
+    d->nprof = f->nprof;
+    d->refs = incr_refs.count / sizeof(IncrRef);
+    d->nrefs = 0;
+    incr_gen++;
+    for (i = 0; i < incr_log.count / (int) sizeof(int); i++) {
+        incr_slot(log[i], &d->nrefs, 0);
+    }
+    d->nlog = d->nrefs;
+    incr_log.count = 0;
+    incr_put_insns(&d->code, &d->nrefs, f, 0);
+    incr_func_add(sym, -1);
+}
+
+// 复制上次记录中的一段引用, 别的函数体内登记的符号改用本次的声明序号; addrs 为解析出的模块符号, 可为 NULL
+void incr_copy_refs(unsigned int refs, unsigned int nrefs, int *addrs) {
+    IncrRef ref;
+    int i, addr = -1;
+
+    for (i = 0; i < (int) nrefs; i++) {
+        ref = incr_old_refs[refs + i];
+        if (ref.kind == IR_RODATA) {
+            ref.str = blob_add(&incr_str, incr_old_str + ref.str, ref.size);
+        } else if (ref.kind == IR_NAME) {
+            ref.str = strtab_add(&incr_str, incr_old_str + ref.str);
         } else {
-            break;
+            ref.str = incr_renum[ref.str];
         }
+        blob_add(&incr_refs, &ref, sizeof(ref));
+        if (addrs) {
+            addr = addrs[i];
+        }
+        blob_add(&incr_addrs, &addr, sizeof(addr));
     }
 }
 
-void parse_comment() {
-    if (ch == '/') {
-        while (1) {
-            getch();
-            if (ch == '\n') {
-                line_num++;
-                getch();
-                return;
-            } else if (ch == CH_EOF) {
-                error("loss the right end-sign of '*/'");
-                return;
-            }
+// 沿用上次的字节码, 记录原样复制
+void incr_keep_func(IncrDecl *d, IncrDecl *old, int *addrs, int sym) {
+    d->locs = incr_locs.count / sizeof(InsnLoc);
+    d->nlocs = old->nlocs;
+    blob_add(&incr_locs, incr_old_locs + old->locs, sizeof(InsnLoc) * old->nlocs);
+    d->code = incr_code.count / sizeof(Insn);
+    blob_add(&incr_code, incr_old_code + old->code, sizeof(Insn) * old->ncode);
+    d->ncode = old->ncode;
+    d->nregs = old->nregs;
+    d->nparams = old->nparams;
+    d->frame_size = old->frame_size;
+    d->nprof = old->nprof;
+    d->refs = incr_refs.count / sizeof(IncrRef);
+    d->nrefs = old->nrefs;
+    d->nlog = old->nlog;
+    incr_copy_refs(old->refs, old->nrefs, addrs);
+    incr_func_add(sym, (int) (old - incr_old_decls));
+}
+
+// 用上次的字节码生成函数, 重新解析符号引用, 结果留在 addrs; 源位置相对 base
+BcFunc *incr_load_func(IncrDecl *d, BcSym *bs, SrcLoc base, int *addrs) {
+    BcFunc *f = (BcFunc *) mallocz(sizeof(BcFunc), MEM_CODE);
+    IncrRef *ref;
+    int i;
+
+    // 函数体内登记的符号按原顺序重新登记, 编号与重新编译时相同
+    for (i = 0; i < (int) d->nrefs; i++) {
+        ref = &incr_old_refs[d->refs + i];
+        if (ref->kind == IR_RODATA) {
+            addrs[i] = str_pool_add(incr_old_str + ref->str, ref->size);
+        } else {
+            addrs[i] = incr_sym(incr_old_str + ref->str, i < (int) d->nlog);
         }
     }
-    getch();
-    do {
-        do {
-            if (ch == '\n' || ch == '*' || (ch == CH_EOF)) {
-                break;
-            } else {
-                getch();
-            }
-        } while (1);
-        if (ch == '\n') {
-            line_num++;
-            getch();
-        } else if (ch == '*') {
-            getch();
-            if (ch == '/') {
-                getch();
-                return;
-            }
+    f->name = bs->name;
+    f->ncode = f->capcode = d->ncode;
+    f->code = (Insn *) mem_alloc(sizeof(Insn) * (d->ncode + 1), MEM_CODE);
+    memcpy(f->code, incr_old_code + d->code, sizeof(Insn) * d->ncode);
+    f->nregs = d->nregs;
+    f->nparams = d->nparams;
+    f->frame_size = d->frame_size;
+    f->nprof = d->nprof;
+    f->frame_words = f->nregs + f->frame_size / 8;
+    if (d->nlocs) {
+        f->nlocs = f->caplocs = d->nlocs;
+        f->locs = (InsnLoc *) mem_alloc(sizeof(InsnLoc) * d->nlocs, MEM_CODE);
+        for (i = 0; i < f->nlocs; i++) {
+            f->locs[i].pos = incr_old_locs[d->locs + i].pos;
+            f->locs[i].loc = incr_old_locs[d->locs + i].loc + base;
+        }
+    }
+    for (i = 0; i < f->ncode; i++) {
+        if (insn_sym_field(f->code[i].op)) {
+            f->code[i].b = addrs[f->code[i].b];
+        }
+    }
+    return f;
+}
+
+// 字节码连同寄存器数和局部变量区大小的散列, 判断优化有没有改动它
+unsigned long long incr_code_hash(BcFunc *f) {
+    return hash64((char *) f->code, sizeof(Insn) * f->ncode, ((unsigned long long) f->nregs << 32) | f->frame_size);
+}
+
+// 存入优化之后的字节码, 与前一阶段相同的只记一个标记
+void incr_put_code(IncrCode *c, BcFunc *f, IncrOpt *o) {
+    unsigned long long h = incr_code_hash(f);
+
+    memset(c, 0, sizeof(*c));
+    if (h == o->hash) {
+        c->code = INCR_SAME;
+        return;
+    }
+    o->hash = h;
+    c->ncode = f->ncode;
+    c->nregs = f->nregs;
+    c->frame_size = f->frame_size;
+    c->refs = incr_refs.count / sizeof(IncrRef);
+    incr_gen++;
+    incr_put_insns(&c->code, &c->nrefs, f, 1);
+}
+
+// 沿用的优化结果原样复制
+void incr_keep_code(IncrCode *c, IncrCode *old) {
+    *c = *old;
+    if (old->code == INCR_SAME) {
+        return;
+    }
+    c->code = incr_code.count / sizeof(Insn);
+    blob_add(&incr_code, incr_old_code + old->code, sizeof(Insn) * old->ncode);
+    c->refs = incr_refs.count / sizeof(IncrRef);
+    incr_copy_refs(old->refs, old->nrefs, NULL);
+}
+
+// 取回上次优化之后的字节码, 与前一阶段相同时 *out 为 NULL; 引用的符号都已登记过, 有找不到的返回 0
+int incr_get_code(IncrCode *c, BcFunc **out) {
+    BcFunc *g;
+    IncrDecl *owner;
+    IncrRef *ref;
+    int i, k, *addrs = incr_scratch(c->nrefs + 1);
+
+    *out = NULL;
+    if (c->code == INCR_SAME) {
+        return 1;
+    }
+    for (i = 0; i < (int) c->nrefs; i++) {
+        ref = &incr_old_refs[c->refs + i];
+        if (ref->kind == IR_RODATA) {
+            addrs[i] = str_pool_add(incr_old_str + ref->str, ref->size);
+        } else if (ref->kind == IR_NAME) {
+            addrs[i] = incr_global(incr_old_str + ref->str);
+        } else if ((k = ref->str < incr_old->ndecls ? incr_renum[ref->str] : -1) >= 0) {
+            owner = (IncrDecl *) incr_decls.data + k;
+            addrs[i] = ref->size < owner->nlog ? ((int *) incr_addrs.data)[owner->refs + ref->size] : -1;
         } else {
-            error("loss the right end-sign of '*/'");
-            return;
+            addrs[i] = -1;
         }
-    } while (1);
+        if (addrs[i] < 0) {
+            return 0;
+        }
+    }
+    g = (BcFunc *) mallocz(sizeof(BcFunc), MEM_CODE);
+    g->ncode = g->capcode = c->ncode;
+    g->code = (Insn *) mem_alloc(sizeof(Insn) * (c->ncode + 1), MEM_CODE);
+    memcpy(g->code, incr_old_code + c->code, sizeof(Insn) * c->ncode);
+    for (i = 0; i < g->ncode; i++) {
+        if (insn_sym_field(g->code[i].op)) {
+            g->code[i].b = addrs[g->code[i].b];
+        }
+    }
+    g->nregs = c->nregs;
+    g->frame_size = c->frame_size;
+    *out = g;
+    return 1;
 }
 
-void skip_white_space() {
-    while (1) {
-        if (ch == ' ' || ch == '\t') {
-            getch();
-            continue;
+// 换上取回的字节码
+void incr_install(BcFunc *f, BcFunc *g) {
+    mem_free(f->code, MEM_CODE);
+    f->code = g->code;
+    f->ncode = g->ncode;
+    f->capcode = g->capcode;
+    f->nregs = g->nregs;
+    f->frame_size = g->frame_size;
+    f->frame_words = f->nregs + f->frame_size / 8;
+    mem_free(g, MEM_CODE);
+}
+
+void incr_drop(BcFunc *g) {
+    if (g) {
+        mem_free(g->code, MEM_CODE);
+        mem_free(g, MEM_CODE);
+    }
+}
+
+// 调用的本文件函数 (可能内联进来的) 的名字散列
+unsigned long long incr_callees(BcFunc *f) {
+    unsigned long long h = 0;
+    Insn *p;
+
+    for (p = f->code; p < f->code + f->ncode; p++) {
+        if (p->op == OP_CALL && inline_defined(p->b)) {
+            h = hash64(bc_sym(p->b)->name, strlen(bc_sym(p->b)->name), h);
         }
-#if __APPLE__
-        if (ch == '\n') {
-            line_num++;
-            getch();
-            continue;
+    }
+    return h;
+}
+
+// 取回沿用的函数上次内联之后和全部优化之后的字节码
+int incr_opt_fetch(int s) {
+    IncrOpt *o = &incr_opt[s];
+
+    if (incr_get_code(&o->old->mid, &o->mid) && incr_get_code(&o->old->fin, &o->fin)) {
+        return 1;
+    }
+    incr_drop(o->mid);
+    o->mid = NULL;
+    return 0;
+}
+
+// 装上内联之后的字节码, 全部优化之后的留到最后
+void incr_opt_install(int s) {
+    if (incr_opt[s].mid) {
+        incr_install(bc_sym(s)->func, incr_opt[s].mid);
+        incr_opt[s].mid = NULL;
+    }
+    incr_opt[s].state = IO_CLEAN;
+}
+
+// 照常优化; 记下优化前字节码的散列, 优化没有改动的不另存
+void incr_opt_dirty(int s) {
+    IncrOpt *o = &incr_opt[s];
+
+    incr_drop(o->mid);
+    incr_drop(o->fin);
+    o->mid = o->fin = NULL;
+    o->state = IO_DIRTY;
+    o->hash = incr_code_hash(bc_sym(s)->func);
+}
+
+// 翻译单元结束后, 优化之前: 找出有上次优化结果可用的函数.
+// 记源位置 (-inline-report -vec-report) 插桩 (-fprofile-generate) 和 -flto 时不用也不记
+void incr_opt_begin() {
+    IncrFunc *fn = (IncrFunc *) incr_funcs.data, *end = fn + incr_funcs.count / sizeof(IncrFunc);
+    IncrDecl *d;
+    IncrOpt *o;
+    int i, addr;
+
+    if (opt_insn_locs || opt_prof_gen || opt_lto) {
+        return;
+    }
+    incr_opt = (IncrOpt *) mallocz(sizeof(IncrOpt) * (module.syms.count + 1), MEM_CACHE);
+    for (i = 0; i < module.syms.count; i++) {
+        incr_opt[i].owner = -1;
+    }
+    for (; fn < end; fn++) {
+        d = (IncrDecl *) incr_decls.data + fn->decl;
+        for (i = 0; i < (int) d->nlog; i++) {
+            addr = ((int *) incr_addrs.data)[d->refs + i];
+            incr_opt[addr].owner = fn->decl;
+            incr_opt[addr].slot = i;
         }
-#elif __linux__
-        if (ch == '\n') {
-            line_num++;
-            getch();
-            continue;
+        o = &incr_opt[fn->sym];
+        o->callees = incr_callees(bc_sym(fn->sym)->func);
+        o->old = fn->old >= 0 ? incr_old_decls + fn->old : NULL;
+        if (o->old && o->old->opt && o->old->callees == o->callees) {
+            o->state = IO_READY;
         }
-#else
-        if (ch == '\r') {
-            getch();
-            if (ch != '\n') {
-                return;
+    }
+    // 不内联时每个函数单独看
+    if (!opt_inline) {
+        for (fn = (IncrFunc *) incr_funcs.data; fn < end; fn++) {
+            if (incr_opt[fn->sym].state == IO_READY && incr_opt_fetch(fn->sym)) {
+                incr_opt_install(fn->sym);
+            } else {
+                incr_opt_dirty(fn->sym);
             }
-            line_num++;
-            getch();
-            continue;
         }
-#endif
-        break;
     }
 }
 
-int is_nodigit(char c) {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c == '_');
+// 内联处理到一个强连通分量: 成员都有上次的优化结果, 调用的其他分量也都沿用了, 就装上内联之后的字节码
+int incr_scc_clean(int *members, int n) {
+    BcFunc *f;
+    Insn *p;
+    int i;
+
+    if (!incr_opt) {
+        return 0;
+    }
+    for (i = 0; i < n; i++) {
+        if (incr_opt[members[i]].state != IO_READY) {
+            goto dirty;
+        }
+        f = bc_sym(members[i])->func;
+        for (p = f->code; p < f->code + f->ncode; p++) {
+            if (p->op == OP_CALL && inline_defined(p->b) && inl[p->b].scc != inl[members[i]].scc
+                && incr_opt[p->b].state != IO_CLEAN) {
+                goto dirty;
+            }
+        }
+    }
+    for (i = 0; i < n; i++) {
+        if (!incr_opt_fetch(members[i])) {
+            goto dirty;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        incr_opt_install(members[i]);
+    }
+    return 1;
+dirty:
+    for (i = 0; i < n; i++) {
+        incr_opt_dirty(members[i]);
+    }
+    return 0;
+}
+
+// 装上了上次的优化结果, 不再做循环优化和尾调用
+int incr_clean(int s) {
+    return incr_opt && incr_opt[s].state == IO_CLEAN;
 }
 
-int is_digit(char c) {
-    return c >= '0' && c <= '9';
-}
+// 内联之后: 记下每个函数此时的字节码
+void incr_opt_mid() {
+    IncrFunc *fn = (IncrFunc *) incr_funcs.data, *end = fn + incr_funcs.count / sizeof(IncrFunc);
+    IncrDecl *d;
+    IncrOpt *o;
 
-void parse_identifier() {
-    dynstring_reset(&tkstr);
-    dynstring_chcat(&tkstr, ch);
-    getch();
-    while (is_nodigit(ch) || is_digit(ch)) {
-        dynstring_chcat(&tkstr, ch);
-        getch();
+    if (!incr_opt) {
+        return;
+    }
+    for (; fn < end; fn++) {
+        d = (IncrDecl *) incr_decls.data + fn->decl;
+        o = &incr_opt[fn->sym];
+        if (o->state == IO_CLEAN) {
+            incr_keep_code(&d->mid, &o->old->mid);
+        } else {
+            incr_put_code(&d->mid, bc_sym(fn->sym)->func, o);
+        }
     }
-    dynstring_chcat(&tkstr, '\0');
 }
 
-// todo: atof
-void parse_num() {
-    dynstring_reset(&tkstr);
-    dynstring_reset(&sourcestr);
-    do {
-        dynstring_chcat(&tkstr, ch);
-        dynstring_chcat(&sourcestr, ch);
-        getch();
-    } while (is_digit(ch));
-    if (ch == '.') {
-        do {
-            dynstring_chcat(&tkstr, ch);
-            dynstring_chcat(&sourcestr, ch);
-            getch();
-        } while (is_digit(ch));
-    }
-    dynstring_chcat(&tkstr, '\0');
-    dynstring_chcat(&sourcestr, '\0');
-    tkvalue = atoi(tkstr.data);
-};
+// 全部优化之后: 沿用的函数装上最终的字节码, 再记下每个函数的
+void incr_opt_end() {
+    IncrFunc *fn = (IncrFunc *) incr_funcs.data, *end = fn + incr_funcs.count / sizeof(IncrFunc);
+    IncrDecl *d;
+    IncrOpt *o;
 
-void parse_string(char sep) {
-    char c;
-    dynstring_reset(&tkstr);
-    dynstring_reset(&sourcestr);
-    dynstring_chcat(&sourcestr, sep);
-    getch();
-    while (1) {
-        if (ch == sep) {
-            break;
-        } else if (ch == '\\') {
-            // change mean
-            dynstring_chcat(&sourcestr, ch);
-            getch();
-            switch (ch) {
-                case '0':
-                    c = '\0';
-                    break;
-                case 'a':
-                    c = '\a';
-                    break;
-                case 'b':
-                    c = '\b';
-                    break;
-                case 't':
-                    c = '\t';
-                    break;
-                case 'n':
-                    c = '\n';
-                    break;
-                case 'v':
-                    c = '\v';
-                    break;
-                case 'f':
-                    c = '\f';
-                    break;
-                case 'r':
-                    c = '\r';
-                    break;
-                case '\"':
-                    c = '\"';
-                    break;
-                case '\'':
-                    c = '\'';
-                    break;
-                case '\\':
-                    c = '\\';
-                    break;
-                default:
-                    c = ch;
-                    if (c >= '!' && c <= '~') {
-                        warning("it's illegal change mean: \'\\%c\'", c);
-                    } else {
-                        warning("it's illegal change mean: \'\\0x%x\'", c);
-                    }
-                    break;
+    if (!incr_opt) {
+        return;
+    }
+    for (; fn < end; fn++) {
+        d = (IncrDecl *) incr_decls.data + fn->decl;
+        o = &incr_opt[fn->sym];
+        if (o->state == IO_CLEAN) {
+            if (o->fin) {
+                incr_install(bc_sym(fn->sym)->func, o->fin);
             }
-            dynstring_chcat(&tkstr, c);
-            dynstring_chcat(&sourcestr, ch);
-            getch();
+            incr_keep_code(&d->fin, &o->old->fin);
+            incr_clean_funcs++;
         } else {
-            dynstring_chcat(&tkstr, ch);
-            dynstring_chcat(&sourcestr, ch);
-            getch();
+            incr_put_code(&d->fin, bc_sym(fn->sym)->func, o);
         }
+        d->callees = o->callees;
+        d->opt = 1;
     }
-    dynstring_chcat(&tkstr, '\0');
-    dynstring_chcat(&sourcestr, sep);
-    dynstring_chcat(&sourcestr, '\0');
-    getch();
+    mem_free(incr_opt, MEM_CACHE);
+    incr_opt = NULL;
 }
 
-void init() {
-    line_num = 1;
-    init_lex();
+// 包含文件的内容和函数体内的预处理指令计入 incr_ctx
+void incr_mix(char *p, long long n) {
+    if (incr_src) {
+        incr_ctx = hash64(p, n, incr_ctx);
+    }
 }
 
-void cleanup() {
-    int i;
-    printf("\n tktable.count=%d\n", tktable.count);
-    for (i = TK_IDENT; i < tktable.count; ++i) {
-        free(tktable.data[i]);
+// 此时 token 是函数体的 '{', ch 是其后的字符
+void incr_funcbody(Symbol *sym) {
+    IncrDecl *d = incr_cur(), *old;
+    BcSym *bs;
+    unsigned int b = (unsigned int) (src_tell() - 1), e;
+    unsigned long long ctx;
+    int t0 = tk_count, *addrs;
+    long long expansions = stats.pp_expansions;
+
+    if (pp_depth || incr_pp_decl || !incr_decls.count || b < incr_mark) {
+        funcbody(sym);
+        return;
+    }
+    // 上次记录里有同样位置 同样文本的函数体时不必找函数体的范围
+    ctx = hash64(incr_src + incr_mark, b - incr_mark, incr_ctx);
+    old = incr_find(ctx, b);
+    e = old ? b + old->body : body_end(incr_src, incr_size, b);
+    if (!e) {
+        funcbody(sym);
+        return;
+    }
+    incr_ctx = ctx;
+    incr_mark = e;
+    d->func = 1;
+    d->ctx = incr_ctx;
+    d->body = e - b;
+    d->hash = old ? old->hash : hash64(incr_src + b, e - b, 0);
+    incr_nfuncs++;
+    if (old) {
+        bs = bc_sym(sym->c);
+        if (bs->kind == BS_FUNC) {
+            error("'%s'重定义", bs->name);
+        }
+        bs->kind = BS_FUNC;
+        addrs = incr_scratch(old->nrefs + 1);
+        bs->func = incr_load_func(old, bs, (SrcLoc) src.base + d->start, addrs);
+        incr_keep_func(d, old, addrs, sym->c);
+        d->ntoks = old->ntoks;
+        tk_count += old->ntoks;
+        src_seek(e);
+        getch();
+        get_token();
+        incr_reused++;
+        return;
+    }
+    incr_capture = 1;
+    funcbody(sym);
+    incr_capture = 0;
+    d = incr_cur();
+    if (stats.pp_expansions != expansions) {
+        // 宏展开后的函数体与源文本的括号未必对应, 不记录; 函数体文本改为计入之后的 incr_ctx
+        d->func = 0;
+        incr_mark = b;
+        incr_log.count = 0;
+        return;
     }
-    free(tktable.data);
+    d->ntoks = tk_count - t0 - 1;
+    incr_save_func(d, bc_sym(sym->c)->func, sym->c);
 }
 
-// 句(语)法分析
-int SC_GLOBAL = 0, SC_LOCAL = 1,SC_MEMBER;
-
-// 翻译单元 --> {外部声明}文件结束符
-void translation_unit();
+// 翻译单元处理完, 写出新记录
+void incr_finish() {
+    IncrHdr h;
+    FILE *fp;
+    char *tmp = (char *) mem_alloc(strlen(incr_path) + 32, MEM_CACHE);
+
+    incr_decl_close((unsigned int) incr_size);
+    incr_opt_end();
+    h.magic = INCR_MAGIC;
+    h.ndecls = incr_decls.count / sizeof(IncrDecl);
+    h.ncode = incr_code.count / sizeof(Insn);
+    h.nlocs = incr_locs.count / sizeof(InsnLoc);
+    h.nrefs = incr_refs.count / sizeof(IncrRef);
+    h.nstr = incr_str.count;
+    h.version = incr_version();
+    sprintf(tmp, "%s.%d.tmp", incr_path, (int) getpid());
+    fp = fopen(tmp, "wb");
+    if (!fp || fwrite(&h, sizeof(h), 1, fp) != 1
+        || fwrite(incr_decls.data, 1, incr_decls.count, fp) != (size_t) incr_decls.count
+        || fwrite(incr_code.data, 1, incr_code.count, fp) != (size_t) incr_code.count
+        || fwrite(incr_locs.data, 1, incr_locs.count, fp) != (size_t) incr_locs.count
+        || fwrite(incr_refs.data, 1, incr_refs.count, fp) != (size_t) incr_refs.count
+        || fwrite(incr_str.data, 1, incr_str.count, fp) != (size_t) incr_str.count) {
+        warning("不能写 %s", incr_path);
+        if (fp) {
+            fclose(fp);
+        }
+        unlink(tmp);
+    } else {
+        fclose(fp);
+        rename(tmp, incr_path);
+    }
+    mem_free(tmp, MEM_CACHE);
+    if (opt_verbose) {
+        fprintf(stderr, "[INCR] %s: %d decls, %d functions, %d reused, %d reparsed, %d reoptimized\n", filename,
+                h.ndecls, incr_nfuncs, incr_reused, incr_nfuncs - incr_reused, incr_nfuncs - incr_clean_funcs);
+    }
+}
 
-// <外部声明> --> <函数定义>|<声明>
-void external_declaration(int);
+// 并行编译 (-j n)
+// 一遍编译的语法分析 语义检查和代码生成共用全局状态, 所以工作单位是进程而不是线程: 读入第一个字符之前
+// fork 出 n 个工作进程, 各自从头分析整个文件, 外部声明每个进程都处理; 能按括号在源文本中找到范围的函数体
+// 依次轮流分给工作进程, 其余进程直接跳过. 工作进程把字节码和诊断信息经管道送回, 符号引用像增量编译一样
+// 按名字和内容记录; 主进程只分析外部声明, 到函数体时按源码顺序取回结果, 并按函数体内原来的顺序登记字符串常量
+// 和隐式声明的函数, 所以模块符号的次序和目标文件与串行编译完全相同. 含预处理指令的函数体每个进程都自己编译;
+// 宏展开使函数体的范围与源文本的括号不一致时停止工作进程, 主进程从该函数起串行编译
+enum e_ParStatus {
+    PAR_OK,
+    PAR_ERROR,                      // 函数体有错误, 错误信息在诊断中
+    PAR_MISMATCH,                   // 函数体的范围与源文本的括号不一致
+};
 
-// <函数定义> --> <类型区分符><声明符><函数体>
-// <函数体> --> <复合语句>
-// <声明> --> <类型区分符>[<初值声明符表>]<分号>
-// <初值声明符表> --> <初值声明符>{<逗号><初值声明符>}
-// <初值声明符> --> <声明符>|<声明符><赋值运算符'='><初值符>
-// 变换文法定义到LL(1) ==>> 提取共有左部<类型区分符>
-// <外部声明> --> <类型区分符>(<声明符><函数体>|[<初值声明符表>]<分号>)
-// 扩展 <外部声明> --> <类型区分符>(<声明符><函数体>|<分号>|
-// <声明符>[<赋值运算符'='><初值符>]{<逗号><声明符>[<赋值运算符'='><初值符>]}<分号>)
+typedef struct ParHdr {
+    int status;
+    int ncode, nregs, nparams, frame_size, nprof;
+    int nlocs;                      // 代码之后是指令的源位置, 工作进程与主进程的源位置编号相同
+    int nlog;                       // 引用表的前 nlog 项按顺序是函数体内登记的模块符号
+    int nrefs, nstr, ndiag;
+    int words;                      // 串表中从此开始是函数体内新出现的单词, 主进程补进单词表
+    long long ntoks;
+} ParHdr;
+
+typedef struct ParMap {
+    int gen;                        // 等于 par_gen 时有效
+    int ref;
+} ParMap;
+
+int par_njobs;                      // 工作进程数, 0 为串行编译
+int par_nfuncs;                     // 已分派的函数体数
+size_t par_size;
+SrcLoc par_base;                    // 主文件的源位置起点
+int *par_fds;                       // 主进程: 各工作进程结果管道的读端; 工作进程: [0] 为写端
+pid_t *par_pids;
+DynString par_code, par_refs, par_str, par_diag;
+ParMap *par_map;                    // 工作进程: 模块符号序号 -> 引用表序号
+int par_map_cap, par_gen;
+int par_words;                      // 工作进程: 函数体开始时的单词表长度
+
+void par_worker(int self, int fd, char *file) {
+    int i, src_fd;
+
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    for (i = 0; i < self; i++) {
+        close(par_fds[i]);
+    }
+    // 不与主进程共用文件偏移
+    src_fd = open(file, O_RDONLY);
+    if (src_fd < 0 || dup2(src_fd, src.fd) < 0) {
+        _exit(1);
+    }
+    close(src_fd);
+    par_self = self;
+    par_fds[0] = fd;
+    dynstring_init(&par_code, 1024, MEM_CODE);
+    dynstring_init(&par_refs, 256, MEM_CODE);
+    dynstring_init(&par_str, 256, MEM_CODE);
+    dynstring_init(&par_diag, 256, MEM_CODE);
+}
 
-//<类型区分符> --> <数据类型>|<结构区分符>
-int type_specifier();
+// 在读入第一个字符之前分出工作进程
+void par_start(char *file) {
+    int i, fds[2];
+    pid_t pid;
 
-//<声明符> --> {<指针>}[<调用约定>][<结构成员对齐>]<直接声明符>
-void declarator();
+    par_src = map_file(file, &par_size);
+    if (par_size >= 0xffffffffULL) {
+        munmap(par_src, par_size);
+        par_src = NULL;
+        return;
+    }
+    par_base = (SrcLoc) src.base;
+    par_fds = (int *) mem_alloc(sizeof(int) * par_njobs, MEM_CODE);
+    par_pids = (pid_t *) mem_alloc(sizeof(pid_t) * par_njobs, MEM_CODE);
+    fflush(stdout);
+    fflush(stderr);
+    for (i = 0; i < par_njobs; i++) {
+        if (pipe(fds) < 0) {
+            break;
+        }
+        pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            break;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            par_worker(i, fds[1], file);
+            return;
+        }
+        close(fds[1]);
+        par_fds[i] = fds[0];
+        par_pids[i] = pid;
+    }
+    par_njobs = i;
+    stats.par_jobs = i;
+}
 
-//<调用约定> --> <__cdecl>|<__stdcall>
-void function_calling_convention(int *);
+// 停止工作进程: 结果已全部取回, 或退回串行编译
+void par_stop() {
+    int i;
 
-//<结构成员对齐> --> <__align>'('<整数常量>')'
-void struct_member_alignment();
+    for (i = 0; i < par_njobs; i++) {
+        kill(par_pids[i], SIGKILL);
+        close(par_fds[i]);
+        waitpid(par_pids[i], NULL, 0);
+    }
+    par_njobs = 0;
+}
 
-//<直接声明符> --> <标识符><直接声明符后缀>
-void direct_declarator();
+// 工作进程: 引用表加一项, 具名符号记名字, 字符串常量记内容
+int par_ref(int addr) {
+    BcSym *bs = bc_sym(addr);
+    IncrRef ref;
 
-//<直接声明符后缀> --> {'['']'|'['<整数常量>']'|'('')'|'('<形参表>')'}
-void direct_declarator_postfix();
+    ref.kind = bs->kind == BS_RODATA ? IR_RODATA : IR_NAME;
+    if (ref.kind == IR_RODATA) {
+        ref.str = blob_add(&par_str, module.rodata.data + bs->offset, bs->size);
+        ref.size = bs->size;
+    } else {
+        ref.str = strtab_add(&par_str, bs->name);
+        ref.size = 0;
+    }
+    blob_add(&par_refs, &ref, sizeof(ref));
+    return par_refs.count / sizeof(IncrRef) - 1;
+}
 
-//<形参表> --> <参数表>|<参数表>',''...'
-//<参数表> --> <参数声明>{','<参数声明>}
-//<参数声明> --> <类型区分符>{<声明符>}
-void parameter_type_list();
+// 工作进程: 函数体内登记了一个字符串常量或隐式声明的函数; 也用于给其余引用编号
+void par_log(int addr) {
+    int cap = par_map_cap;
 
-//<函数体> --> <复合语句>
-void funcbody();
+    if (addr >= par_map_cap) {
+        par_map_cap = par_map_cap ? par_map_cap : 256;
+        while (addr >= par_map_cap) {
+            par_map_cap *= 2;
+        }
+        par_map = (ParMap *) mem_realloc(par_map, sizeof(ParMap) * par_map_cap, MEM_CODE);
+        memset(par_map + cap, 0, sizeof(ParMap) * (par_map_cap - cap));
+    }
+    par_map[addr].gen = par_gen;
+    par_map[addr].ref = par_ref(addr);
+}
 
-//<复合语句> --> '{' {<声明>}{<语句>} '}'
-void compound_statement();
+void par_write(char *p, long long n) {
+    ssize_t k;
 
-//<初值符> --> <赋值表达式>
-void initializer();
+    while (n > 0) {
+        k = write(par_fds[0], p, n);
+        if (k < 0 && errno == EINTR) {
+            continue;
+        }
+        if (k <= 0) {
+            _exit(1);
+        }
+        p += k;
+        n -= k;
+    }
+}
 
-void assignment_expression();
+// 工作进程: 送回一个函数体的结果
+void par_send(int status, BcFunc *f, long long ntoks) {
+    ParHdr h;
+    Insn insn;
+    int i;
 
-//<结构区分符> --> <struct关键字><标识符>'{'<结构声明表>'}'|<struct关键字><标识符>
-void struct_specifier();
+    memset(&h, 0, sizeof(h));
+    h.status = status;
+    if (status == PAR_OK) {
+        h.nlog = par_refs.count / sizeof(IncrRef);
+        for (i = 0; i < f->ncode; i++) {
+            insn = f->code[i];
+            if (insn_sym_field(insn.op)) {
+                if (insn.b >= par_map_cap || par_map[insn.b].gen != par_gen) {
+                    par_log(insn.b);
+                }
+                insn.b = par_map[insn.b].ref;
+            }
+            blob_add(&par_code, &insn, sizeof(insn));
+        }
+        h.ncode = f->ncode;
+        h.nregs = f->nregs;
+        h.nparams = f->nparams;
+        h.frame_size = f->frame_size;
+        h.nprof = f->nprof;
+        h.nlocs = f->nlocs;
+        h.nrefs = par_refs.count / sizeof(IncrRef);
+        h.words = par_str.count;
+        for (i = par_words; i < tktable.count; i++) {
+            strtab_add(&par_str, ((TkWord *) tktable.data[i])->spelling);
+        }
+        h.nstr = par_str.count;
+        h.ntoks = ntoks;
+    }
+    h.ndiag = par_diag.count;
+    par_write((char *) &h, sizeof(h));
+    if (status == PAR_OK) {
+        par_write(par_code.data, par_code.count);
+        par_write((char *) f->locs, sizeof(InsnLoc) * f->nlocs);
+        par_write(par_refs.data, par_refs.count);
+        par_write(par_str.data, par_str.count);
+    }
+    par_write(par_diag.data, par_diag.count);
+    par_code.count = par_refs.count = par_str.count = par_diag.count = 0;
+}
 
-//<结构声明表> --> <结构声明>{<结构声明>}
-void struct_declaration_list();
+// 工作进程的诊断: 在分给自己的函数体内的随结果送回, 其余的主进程自己会报
+void par_report(int level, char *msg) {
+    if (par_capture) {
+        blob_add(&par_diag, msg, (int) strlen(msg));
+        if (level == LEVEL_ERROR) {
+            par_send(PAR_ERROR, NULL, 0);
+        }
+    }
+    if (level == LEVEL_ERROR) {
+        _exit(1);
+    }
+}
 
-//<结构声明> --> <类型区分符>{<结构声明符表>}';'
-//<结构声明符表> --> <声明符>{','<声明符>}
-void struct_declaration(int *, int *);
+int par_read(int fd, char *p, long long n) {
+    ssize_t k;
 
-// ......
-void translation_unit() {
-    while (token != TK_EOF) {
-        external_declaration(SC_GLOBAL);
+    while (n > 0) {
+        k = read(fd, p, n);
+        if (k < 0 && errno == EINTR) {
+            continue;
+        }
+        if (k <= 0) {
+            return 0;
+        }
+        p += k;
+        n -= k;
     }
+    return 1;
 }
 
-void external_declaration(int l) {
-    if (!type_specifier()) {
-        expect("<类型区分符>");
+// 记录中的名字换成单词表里的单词, 模块符号的名字要一直有效
+TkWord *par_word(char *name) {
+    int save = token;
+    TkWord *tp = tkWord_insert(name);
+
+    token = save;
+    return tp;
+}
+
+// 主进程: 用工作进程的结果生成函数, 先按原来的顺序登记函数体内的模块符号, 再解析其余引用
+BcFunc *par_load_func(ParHdr *h, BcSym *bs, char *data) {
+    BcFunc *f = (BcFunc *) mallocz(sizeof(BcFunc), MEM_CODE);
+    Insn *code = (Insn *) data;
+    InsnLoc *locs = (InsnLoc *) (code + h->ncode);
+    IncrRef *refs = (IncrRef *) (locs + h->nlocs);
+    char *str = (char *) (refs + h->nrefs), *p;
+    int *addrs = (int *) mem_alloc(sizeof(int) * (h->nrefs + 1), MEM_CODE);
+    TkWord *tp;
+    Symbol *s;
+    int i;
+
+    // 单词表与串行编译时一样
+    for (p = str + h->words; p < str + h->nstr; p += strlen(p) + 1) {
+        par_word(p);
+    }
+    for (i = 0; i < h->nrefs; i++) {
+        if (refs[i].kind == IR_RODATA) {
+            addrs[i] = str_pool_add(str + refs[i].str, refs[i].size);
+            continue;
+        }
+        tp = par_word(str + refs[i].str);
+        for (s = i < h->nlog ? NULL : tp->sym_identifier; s && !(s->r & SC_SYM); s = s->prev_tok);
+        addrs[i] = s ? s->c : bc_sym_add(tp->spelling, BS_UNDEF);
+    }
+    f->name = bs->name;
+    f->ncode = f->capcode = h->ncode;
+    f->code = (Insn *) mem_alloc(sizeof(Insn) * (h->ncode + 1), MEM_CODE);
+    memcpy(f->code, code, sizeof(Insn) * h->ncode);
+    f->nregs = h->nregs;
+    f->nparams = h->nparams;
+    f->frame_size = h->frame_size;
+    f->nprof = h->nprof;
+    f->frame_words = f->nregs + f->frame_size / 8;
+    if (h->nlocs) {
+        f->nlocs = f->caplocs = h->nlocs;
+        f->locs = (InsnLoc *) mem_alloc(sizeof(InsnLoc) * h->nlocs, MEM_CODE);
+        memcpy(f->locs, locs, sizeof(InsnLoc) * h->nlocs);
+    }
+    for (i = 0; i < f->ncode; i++) {
+        if (insn_sym_field(f->code[i].op)) {
+            f->code[i].b = addrs[f->code[i].b];
+        }
     }
+    mem_free(addrs, MEM_CODE);
+    return f;
+}
 
-    if (token == TK_SEMICOLON) {
-        get_token();
-        return;
+// 主进程: 按源码顺序取回工作进程 w 编译的函数体; 取不到或范围不一致时退回串行编译
+void par_fetch(Symbol *sym, int w, unsigned int e) {
+    BcSym *bs = bc_sym(sym->c);
+    ParHdr h;
+    char *data = NULL;
+    long long n = 0;
+    double t0 = clock_sec(CLOCK_MONOTONIC);
+    int ok;
+
+    if (bs->kind == BS_FUNC) {
+        error("'%s'重定义", bs->name);
     }
-    while (1) {
-        declarator();
-        if (token == TK_BEGIN) {
-            if (l == SC_LOCAL) {
-                error("不支持嵌套定义");
-            }
-            funcbody();
-            break;
-        } else {
-            if (token == TK_ASSIGN) {
-                get_token();
-                initializer();
-            }
-            if (token == TK_COMMA) {
-                get_token();
-            } else {
-                skip(TK_SEMICOLON);
-                break;
-            }
+    ok = par_read(par_fds[w], (char *) &h, sizeof(h));
+    if (ok) {
+        n = (long long) h.ncode * sizeof(Insn) + (long long) h.nlocs * sizeof(InsnLoc)
+            + (long long) h.nrefs * sizeof(IncrRef) + h.nstr + h.ndiag;
+        data = (char *) mem_alloc(n + 1, MEM_CODE);
+        ok = par_read(par_fds[w], data, n);
+    }
+    stats.par_wait += clock_sec(CLOCK_MONOTONIC) - t0;
+    if (ok && h.ndiag) {
+        fwrite(data + n - h.ndiag, 1, h.ndiag, stdout);
+    }
+    if (ok && h.status == PAR_ERROR) {
+        exit(-1);
+    }
+    if (!ok || h.status != PAR_OK) {
+        if (data) {
+            mem_free(data, MEM_CODE);
         }
+        par_stop();
+        funcbody(sym);
+        return;
     }
+    bs->kind = BS_FUNC;
+    bs->func = par_load_func(&h, bs, data);
+    mem_free(data, MEM_CODE);
+    stats.par_funcs++;
+    tk_count += h.ntoks;
+    src_seek(e);
+    getch();
+    get_token();
 }
 
-int type_specifier() {
-    int type_found = 0;
-    switch (token) {
-        case KW_CHAR:
-        case KW_SHORT:
-        case KW_VOID:
-        case KW_INT:
-            type_found = 1;
-            get_token();
-            break;
-        case KW_STRUCT:
-            struct_specifier();
-            type_found = 1;
-            break;
-        default:
-            break;
+// 此时 token 是函数体的 '{', ch 是其后的字符
+void par_funcbody(Symbol *sym) {
+    unsigned int b = (unsigned int) (src_tell() - 1), e;
+    long long t0 = tk_count;
+    int w;
+
+    if (pp_depth || !par_njobs || !(e = body_end(par_src, par_size, b))) {
+        funcbody(sym);
+        return;
+    }
+    w = par_nfuncs++ % par_njobs;
+    if (par_self < 0) {
+        par_fetch(sym, w, e);
+    } else if (w != par_self) {
+        bc_sym(sym->c)->kind = BS_FUNC;
+        src_seek(e);
+        getch();
+        get_token();
+    } else {
+        par_gen++;
+        par_words = tktable.count;
+        par_capture = 1;
+        funcbody(sym);
+        par_capture = 0;
+        if (block_end != par_base + e - 1) {
+            // 宏展开出的括号, 其他进程跳过的范围不对
+            par_send(PAR_MISMATCH, NULL, 0);
+            _exit(0);
+        }
+        par_send(PAR_OK, bc_sym(sym->c)->func, tk_count - t0 - 1);
     }
-    return type_found;
 }
 
-void struct_specifier() {
-    int v;
-    get_token();
-    v = token;
-    get_token();
-    if (v < TK_IDENT) {
-        expect("结构体名字不能是关键字");
+// 全部声明处理完: 工作进程退出, 主进程停止工作进程
+void par_finish() {
+    if (par_self >= 0) {
+        _exit(0);
     }
-    if (token == TK_BEGIN) {
-        struct_declaration_list();
+    if (opt_verbose) {
+        fprintf(stderr, "[PAR] %s: %lld workers, %d functions, %lld compiled by workers\n", filename,
+                stats.par_jobs, par_nfuncs, stats.par_funcs);
     }
+    par_stop();
+    munmap(par_src, par_size ? par_size : 1);
+    par_src = NULL;
+    mem_free(par_fds, MEM_CODE);
+    mem_free(par_pids, MEM_CODE);
 }
 
-void struct_declaration_list() {
-    int maxalign, offset;
-    get_token();
-    while (token != TK_END) {
-        struct_declaration(&maxalign, &offset);
+// 链接时优化 (-flto)
+// -flto 编译的目标文件里是窥孔优化后的字节码, 内联 循环优化 向量化和尾调用推迟到链接时; .sc.lto 节补上内联要用的
+// 函数属性. 目标文件本身可以直接 mmap 读用, 链接时把收录的这类目标文件合并成一个模块:
+// 1. 同名全局符号合一, 各文件的数据段和只读段依次拼接, 各文件的 __init 首尾相接成一个
+// 2. 只读的全局变量: 所有引用都是取地址后立即读出, 读改为常数 (跨文件的常量传播), 之后窥孔优化折叠常数条件
+// 3. 合并的模块上做内联, 调用可以跨文件展开; 相同的字符串常量跨文件合并
+// 4. 按函数分区做循环优化 向量化和尾调用, -j n 时 n 个工作进程各做一个分区. 这些优化用到大量全局的工作数组,
+//    用进程而不是线程; 每个函数独立处理, 结果与串行相同
+// 5. 序列化成一个目标文件代替原来的几个, 之后照常链接; 内联后不再被调用的函数由链接时的无用函数删除去掉
+// 没有 -flto 编译的目标文件照常链接, 它们引用的全局变量不做常量传播
+#define LTO_COUNTERS(_) _(peep_insns) _(peep_removed) _(peep_threaded) _(loops) _(loop_hoisted) _(loop_ivs) \
+    _(loop_unrolled) _(vec_loops) _(vec_done) _(vec_checks) _(tail_calls)
+#define LTO_NCOUNTERS 11
+#define LTO_ZERO(name) stats.name = 0;
+#define LTO_PUT(name) cnt[k++] = stats.name;
+#define LTO_ADD(name) stats.name += cnt[k++];
+
+// 把一个 LTO 目标文件并入 module; 同名全局符号经 LinkSym 的 lto 找到已有的模块符号
+void lto_merge(Linker *l, ObjFile *o) {
+    Insn *text, *p;
+    Elf64_Sym *es;
+    Elf64_Rela *r;
+    BcFunc **fs, *f, *init = module.init;
+    BcSym *s;
+    LinkSym *ls;
+    int i, k, n, *map, data_base, rodata_base;
+
+    data_base = section_alloc(&module.data, o->ndata, 8);
+    if (o->ndata) {
+        memcpy(module.data.data + data_base, o->data, o->ndata);
+    }
+    rodata_base = section_alloc(&module.rodata, o->nrodata, 8);
+    if (o->nrodata) {
+        memcpy(module.rodata.data + rodata_base, o->rodata, o->nrodata);
     }
-    skip(TK_END);
-}
 
-void struct_declaration(int *a, int *b) {
-    type_specifier();
-    while (1) {
-        declarator();
-        if (token == TK_SEMICOLON) {
-            break;
+    // 符号: 字符串常量各文件独立, 全局符号按名字合一, 有定义的取代未定义和公共块
+    map = (int *) mem_alloc(sizeof(int) * (o->nsyms + 1), MEM_LINK);
+    fs = (BcFunc **) mem_alloc(sizeof(BcFunc *) * (o->nfuncs + 1), MEM_LINK);
+    for (k = 0; k < o->nfuncs; k++) {
+        f = bc_func_new(o->strtab + o->funcs[k].name);
+        f->ncode = o->funcs[k].ncode;
+        f->capcode = f->ncode + 1;
+        f->code = (Insn *) mem_realloc(f->code, sizeof(Insn) * f->capcode, MEM_CODE);
+        f->nparams = o->funcs[k].nparams;
+        f->nregs = o->funcs[k].nregs;
+        f->frame_size = o->funcs[k].frame_size;
+        f->frame_words = f->nregs + f->frame_size / 8;
+        f->flags = o->lto[k];
+        fs[k] = f;
+    }
+    for (i = 1; i < o->nsyms; i++) {
+        es = &o->syms[i];
+        map[i] = -1;
+        if (ELF64_ST_BIND(es->st_info) == STB_LOCAL) {
+            if (ELF64_ST_TYPE(es->st_info) != STT_FUNC) {
+                map[i] = bc_sym_add(es->st_name ? o->strtab + es->st_name : NULL, BS_RODATA);
+                s = bc_sym(map[i]);
+                s->offset = rodata_base + (int) es->st_value;
+                s->size = (int) es->st_size;
+            }
+            continue;
+        }
+        ls = link_sym(l, o->strtab + es->st_name, 0);
+        if (!ls->lto) {
+            ls->lto = bc_sym_add(ls->name, BS_UNDEF) + 1;
+        }
+        map[i] = ls->lto - 1;
+        s = bc_sym(map[i]);
+        if (es->st_shndx == SHN_UNDEF) {
+            continue;
+        }
+        if (es->st_shndx == SHN_COMMON) {
+            if (s->kind == BS_UNDEF || s->common) {
+                s->kind = BS_DATA;
+                s->common = 1;
+                s->size = (int) es->st_size > s->size ? (int) es->st_size : s->size;
+                s->align = (int) es->st_value > s->align ? (int) es->st_value : s->align;
+            }
+        } else if (ELF64_ST_TYPE(es->st_info) == STT_FUNC) {
+            s->kind = BS_FUNC;
+            s->common = 0;
+            s->func = fs[es->st_value];
+            stats.lto_funcs++;
+        } else {
+            s->kind = BS_DATA;
+            s->common = 0;
+            s->offset = data_base + (int) es->st_value;
+            s->size = (int) es->st_size;
+            s->align = 8;
         }
-        skip(TK_COMMA);
     }
-    skip(TK_SEMICOLON);
-}
 
-void function_calling_convention(int *fc) {
-    *fc = KW_CDECL;
-    if (token == KW_CDECL || token == KW_STDCALL) {
-        *fc = token;
-        get_token();
+    // 代码: 重定位的符号字段换成合并后的模块符号
+    text = (Insn *) mem_alloc(sizeof(Insn) * (o->ntext + 1), MEM_LINK);
+    memcpy(text, o->text, sizeof(Insn) * o->ntext);
+    for (i = 0, r = o->rela; i < o->nrela; i++, r++) {
+        *(int *) ((char *) text + r->r_offset) = map[ELF64_R_SYM(r->r_info)];
+    }
+    for (k = 0; k < o->nfuncs; k++) {
+        memcpy(fs[k]->code, text + o->funcs[k].code, sizeof(Insn) * fs[k]->ncode);
     }
-}
 
-void struct_member_alignment() {
-    if (token == KW_ALIGN) {
-        get_token();
-        skip(TK_OPENPA);
-        if (token == TK_CINT) {
-            get_token();
-        } else {
-            expect("常数整亮");
+    // __init 接在已有的后面: 跳转目标加上起点, 去掉末尾的 RETV, 中间的返回改为跳到本段末尾
+    f = fs[0];
+    n = f->ncode - (f->ncode && f->code[f->ncode - 1].op == OP_RETV);
+    init->code = (Insn *) mem_realloc(init->code, sizeof(Insn) * (init->ncode + n + 2), MEM_CODE);
+    init->capcode = init->ncode + n + 2;
+    for (k = 0; k < n; k++) {
+        p = &init->code[init->ncode + k];
+        *p = f->code[k];
+        if (p->op == OP_RET || p->op == OP_RETV) {
+            insn_set(p, OP_JMP, 0, 0, n);
+        }
+        if (peep_flags[p->op] & PF_JUMP) {
+            p->c += init->ncode;
         }
-        skip(TK_CLOSEPA);
     }
+    init->ncode += n;
+    init->nregs = f->nregs > init->nregs ? f->nregs : init->nregs;
+    init->frame_size = f->frame_size > init->frame_size ? f->frame_size : init->frame_size;
+    mem_free(f->code, MEM_CODE);
+    mem_free(f, MEM_CODE);
+    mem_free(fs, MEM_LINK);
+    mem_free(text, MEM_LINK);
+    mem_free(map, MEM_LINK);
 }
 
-void declarator() {
-    int fc;
-    while (token == TK_STAR) {
-        get_token();
+// LEAG r, g, c 紧跟 LDn r, r, d 且读的范围在变量内时, 读出的值放入 v
+int lto_load(Insn *p, int next_ok, long long *v) {
+    BcSym *s = bc_sym(p->b);
+    Insn *q = p + 1;
+    char *d;
+    int size, off;
+
+    if (p->op != OP_LEAG || !next_ok || q->op < OP_LD1 || q->op > OP_LD8 || q->a != p->a || q->b != p->a) {
+        return 0;
     }
-    function_calling_convention(&fc);
-    struct_member_alignment();
-    direct_declarator();
+    size = 1 << (q->op - OP_LD1);
+    off = p->c + q->c;
+    if (off < 0 || off + size > s->size) {
+        return 0;
+    }
+    d = module.data.data + s->offset + off;
+    switch (size) {
+        case 1:
+            *v = *(signed char *) d;
+            break;
+        case 2:
+            *v = *(short *) d;
+            break;
+        case 4:
+            *v = *(int *) d;
+            break;
+        default:
+            memcpy(v, d, 8);
+            break;
+    }
+    return fits_int(*v);
 }
 
-void direct_declarator() {
-    if (token >= TK_IDENT) {
-        get_token();
-    } else {
-        expect("标识符");
+// 只读的全局变量: 有初值 (不是公共块), 只有 LTO 文件引用, 每个引用都能由 lto_load 读出常数;
+// 初始化代码或函数里写过它 取过地址的都不满足. 第一遍排除不满足的, 第二遍把读改为 MOVI
+void lto_fold(Linker *l) {
+    int n = module.syms.count, i, j, pass, changed;
+    char *ok, *label = NULL;
+    BcSym *s;
+    BcFunc *f;
+    Insn *p;
+    LinkSym *ls;
+    long long v;
+
+    ok = (char *) mallocz(n + 1, MEM_LINK);
+    for (i = 0; i < n; i++) {
+        s = bc_sym(i);
+        ls = s->kind == BS_DATA && !s->common && s->name ? link_sym(l, s->name, 0) : NULL;
+        ok[i] = ls && !ls->ext;
+    }
+    for (pass = 0; pass < 2; pass++) {
+        for (i = -1; i < n; i++) {
+            f = i < 0 ? module.init : bc_sym(i)->kind == BS_FUNC ? bc_sym(i)->func : NULL;
+            if (!f) {
+                continue;
+            }
+            label = (char *) mem_realloc(label, f->ncode + 1, MEM_LINK);
+            peep_labels(f->code, f->ncode, label);
+            changed = 0;
+            for (j = 0; j < f->ncode; j++) {
+                p = &f->code[j];
+                if (!insn_sym_field(p->op) || !ok[p->b]) {
+                    continue;
+                }
+                if (!lto_load(p, j + 1 < f->ncode && !label[j + 1], &v)) {
+                    ok[p->b] = 0;
+                } else if (pass) {
+                    insn_set(p, OP_MOVI, p->a, (int) v, 0);
+                    insn_set(p + 1, OP_NOP, 0, 0, 0);
+                    j++;
+                    changed = 1;
+                    stats.lto_folded++;
+                }
+            }
+            if (changed) {
+                peephole(f);
+                f->frame_words = f->nregs + f->frame_size / 8;
+            }
+        }
     }
-    direct_declarator_postfix();
+    mem_free(label, MEM_LINK);
+    mem_free(ok, MEM_LINK);
 }
 
-void direct_declarator_postfix() {
-    int n;
-    if (token == TK_OPENPA) {
-        parameter_type_list();
-    } else if (token == TK_OPENBR) {
-        get_token();
-        if (token == TK_CINT) {
-            get_token();
-            n = tkvalue;
-        }
-        skip(TK_CLOSEBR);
-        direct_declarator_postfix();
+void lto_opt(BcFunc *f) {
+    if (opt_loop || opt_vector) {
+        loop_func(f);
+    }
+    if (opt_tail_call) {
+        tail_calls(f);
     }
 }
 
-void parameter_type_list() {
-    get_token();
-    while (token != TK_CLOSEPA) {
-        if (!type_specifier()) {
-            error("无效类型标识符");
+// 分区: 工作进程 w 处理第 w, w + n, ... 个函数, 全部做完后一次送回代码和计数 (含窥孔规则的命中数);
+// 建不起的分区由主进程自己做
+void lto_partitions() {
+    int *fl, nf = 0, n = par_njobs, nw, w, i, k, fds[2], hdr[3], *rfd;
+    long long cnt[LTO_NCOUNTERS + PEEP_NRULES];
+    pid_t *pids;
+    BcFunc *f;
+    DynString out;
+
+    fl = (int *) mem_alloc(sizeof(int) * (module.syms.count + 1), MEM_LINK);
+    for (i = 0; i < module.syms.count; i++) {
+        if (inline_defined(i)) {
+            fl[nf++] = i;
         }
-        declarator();
-        if (token == TK_CLOSEPA) {
+    }
+    // -vec-report 按函数顺序输出, 不分区
+    n = opt_vector_report || n < 1 ? 1 : n > nf ? nf : n;
+    rfd = (int *) mem_alloc(sizeof(int) * (n + 1), MEM_LINK);
+    pids = (pid_t *) mem_alloc(sizeof(pid_t) * (n + 1), MEM_LINK);
+    fflush(stdout);
+    fflush(stderr);
+    for (nw = 0; n > 1 && nw < n; nw++) {
+        if (pipe(fds) < 0) {
             break;
         }
-        skip(TK_COMMA);
-        if (token == TK_ELLIPSIS) {
-            get_token();
+        pids[nw] = fork();
+        if (pids[nw] < 0) {
+            close(fds[0]);
+            close(fds[1]);
             break;
         }
+        if (pids[nw] == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            close(fds[0]);
+            par_fds = fds + 1;
+            LTO_COUNTERS(LTO_ZERO)
+            for (i = 0; i < PEEP_NRULES; i++) {
+                peep_rules[i].hits = 0;
+            }
+            dynstring_init(&out, 4096, MEM_LINK);
+            for (i = nw; i < nf; i += n) {
+                f = bc_sym(fl[i])->func;
+                lto_opt(f);
+                hdr[0] = f->ncode;
+                hdr[1] = f->nregs;
+                hdr[2] = f->frame_size;
+                blob_add(&out, hdr, sizeof(hdr));
+                blob_add(&out, f->code, sizeof(Insn) * f->ncode);
+            }
+            k = 0;
+            LTO_COUNTERS(LTO_PUT)
+            for (i = 0; i < PEEP_NRULES; i++) {
+                cnt[k++] = peep_rules[i].hits;
+            }
+            blob_add(&out, cnt, sizeof(cnt));
+            par_write(out.data, out.count);
+            _exit(0);
+        }
+        close(fds[1]);
+        rfd[nw] = fds[0];
     }
-    skip(TK_CLOSEPA);
+    for (w = nw; w < n; w++) {
+        for (i = w; i < nf; i += n) {
+            lto_opt(bc_sym(fl[i])->func);
+        }
+    }
+    for (w = 0; w < nw; w++) {
+        for (i = w; i < nf; i += n) {
+            f = bc_sym(fl[i])->func;
+            if (!par_read(rfd[w], (char *) hdr, sizeof(hdr))) {
+                break;
+            }
+            f->ncode = hdr[0];
+            f->nregs = hdr[1];
+            f->frame_size = hdr[2];
+            f->frame_words = f->nregs + f->frame_size / 8;
+            f->capcode = f->ncode + 1;
+            f->code = (Insn *) mem_realloc(f->code, sizeof(Insn) * f->capcode, MEM_CODE);
+            if (!par_read(rfd[w], (char *) f->code, sizeof(Insn) * f->ncode)) {
+                break;
+            }
+        }
+        if (i < nf || !par_read(rfd[w], (char *) cnt, sizeof(cnt))) {
+            link_error("链接时优化的工作进程 %d 异常退出", w);
+        }
+        k = 0;
+        LTO_COUNTERS(LTO_ADD)
+        for (i = 0; i < PEEP_NRULES; i++) {
+            peep_rules[i].hits += cnt[k++];
+        }
+        close(rfd[w]);
+        waitpid(pids[w], NULL, 0);
+    }
+    stats.lto_parts = n;
+    mem_free(fl, MEM_LINK);
+    mem_free(rfd, MEM_LINK);
+    mem_free(pids, MEM_LINK);
 }
 
-void funcbody() {
-    compound_statement();
-}
+// 收录的目标文件里有 -flto 编译的: 合并 优化, 换成一个目标文件, 重建全局符号表
+void lto_link(Linker *l) {
+    ObjFile *o;
+    Elf64_Sym *es;
+    int i, k, n = 0;
+    size_t size;
+    char *buf;
+
+    for (k = 0; k < l->objs.count; k++) {
+        o = (ObjFile *) l->objs.data[k];
+        n += o->included && o->lto;
+    }
+    if (!n) {
+        return;
+    }
+    init();
+    for (k = 0; k < l->objs.count; k++) {
+        o = (ObjFile *) l->objs.data[k];
+        for (i = 1; o->included && !o->lto && i < o->nsyms; i++) {
+            es = &o->syms[i];
+            if (ELF64_ST_BIND(es->st_info) == STB_GLOBAL) {
+                link_sym(l, o->strtab + es->st_name, 0)->ext = 1;
+            }
+        }
+    }
+    for (k = 0; k < l->objs.count; k++) {
+        o = (ObjFile *) l->objs.data[k];
+        if (o->included && o->lto) {
+            lto_merge(l, o);
+            o->included = 0;
+            stats.lto_objs++;
+        }
+    }
+    insn_set(&module.init->code[module.init->ncode++], OP_RETV, 0, 0, 0);
+    module.init->frame_words = module.init->nregs + module.init->frame_size / 8;
 
-void initializer() {
-    assignment_expression();
+    lto_fold(l);
+    str_pool_finish();
+    if (opt_inline) {
+        inline_module();
+    }
+    lto_partitions();
+
+    buf = obj_build(&module, &size);
+    o = obj_open("<lto>", buf, size);
+    o->included = 1;
+    dynArray_add(&l->objs, o);
+    memset(l->table, 0, sizeof(LinkSym *) * l->nbuckets);
+    for (k = 0; k < l->objs.count; k++) {
+        o = (ObjFile *) l->objs.data[k];
+        if (o->included) {
+            link_define(l, o);
+        }
+    }
+    if (opt_verbose) {
+        fprintf(stderr, "[LTO] %lld objects, %lld functions merged, %lld global loads folded, %lld partitions\n",
+                stats.lto_objs, stats.lto_funcs, stats.lto_folded, stats.lto_parts);
+    }
 }
 
-//<语句> --> {<复合语句>|<if>|<for>|
-// <break>|<continue>|<return>|<表达式语句>}
-void statement();
-
-//<复合语句> --> '{' {<声明>}{<语句>} '}'
-void compound_statement();
-
-//<if> --> 'if''('<表达式>')'<语句>['else'<语句>]
-void if_statement();
-
-//<for> --> 'for''('<表达式语句><表达式语句><表达式语句>')'<语句>
-void for_statement();
-
-//<break> --> 'break' ';'
-void break_statement();
-
-//<continue> --> 'continue' ';'
-void continue_statement();
-
-//<return> --> 'return' <expression> ';'
-void return_statement();
-
-//<表达式语句> --> [<expression>]';'
-void expression_statement();
-
-int is_type_specifier(int);
-
-//<表达式> --> <赋值表达式>{','<赋值表达式>}
-void expression();
+// 预编译头
+// 处理完公共前缀头文件后, 把单词表 宏 符号 (含结构体布局和类型) 模块符号 字节码和包含文件缓存整体写成一个映像.
+// 映像内的指针按固定基址 PCH_BASE 写出, 另附内部指针的偏移表, 文件本身与位置无关.
+// 使用时 mmap(MAP_PRIVATE) 到 PCH_BASE, 不需要重定位, 对象被访问时才缺页读入, 被修改的页写时复制;
+// 该地址被占用时映射到别处, 按偏移表逐个修正. 指向编译器自身对象 (关键字单词 初始化时建立的符号和类型结点) 的
+// 指针记在外部引用表里, 装入时按编号填入. 恢复时复制的只有单词表 全局符号栈 模块符号表的指针数组 数据段和字符串池,
+// 类型结点重新挂进散列表. 快照过期 (头文件有变化 -I/-D 不同 编译器不同) 时退回到直接包含前缀头文件
+#define PCH_MAGIC 0x32484350        // "PCH2"
+#define PCH_BASE 0x5c0000000000ULL
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
 
-//<赋值表达式> --> <相等类表达式>|<一元表达式>'='<赋值表达式>
-//<相等类表达式> ==>>(n) <一元表达式> ......
-// 非等价变换后 <赋值表达式> --> <相等类表达式>|<一元表达式>'='<赋值表达式>
-// 有隐患 但在语义分析阶段处理
-void assignment_expression();
+// 映像中的对象种类, 决定复制的长度和要修正的指针成员
+enum e_PchKind {
+    PCH_RAW,
+    PCH_STR,
+    PCH_WORD,
+    PCH_SYM,
+    PCH_MACRO,
+    PCH_BCSYM,
+    PCH_FUNC,
+    PCH_INC,
+    PCH_TYPE,
+};
 
-//<相等类表达式> --> <关系表达式>{'=='<关系表达式>|'!='<关系表达式>}
-void equality_expression();
+enum e_PchExt {
+    PCH_EXT_WORD,                   // tktable[index]
+    PCH_EXT_SYM,                    // global_sym_stack[index]
+    PCH_EXT_TYPE,                   // type_nodes[index]
+};
 
-//<关系表达式> --> <加减类表达式>{'<'<加减类表达式>|'>'<加减类表达式>|
-// '<='<加减类表达式>|'>='<加减类表达式>}
-void relational_expression();
+typedef struct PchExt {
+    long long at;                   // 指针在映像中的偏移
+    int kind;
+    int index;
+} PchExt;
+
+// 映像头部, 位于偏移 0; 指针成员同样按基址写出
+typedef struct PchHdr {
+    unsigned int magic;
+    unsigned int nkw;               // 初始化后单词表的长度 (关键字)
+    char version[64];
+    unsigned long long id;          // 映像内容的散列, 参与编译缓存和增量编译的键
+    unsigned long long flags;       // -I -D 的散列
+    long long size;
+    long long gbase;                // 初始化后全局符号栈的长度
+    long long nrelocs, nexts;
+    long long *relocs;
+    PchExt *exts;
+    long long ntk;
+    TkWord **words;                 // tktable[nkw..ntk)
+    TkWord **hashtab;               // tk_hashtable
+    Macro **kwmacros;               // 定义在关键字上的宏
+    long long ngsyms;
+    Symbol **gsyms;                 // global_sym_stack[gbase..)
+    long long tbase, ntypes;        // 初始化后类型结点的个数
+    Symbol **types;                 // type_nodes[tbase..)
+    long long nmsyms;
+    BcSym **msyms;
+    long long ndata, nrodata;
+    char *data, *rodata;
+    long long nstrtab, nstr;
+    StrSlot *strtab;                // 字符串常量池的散列表
+    BcFunc *init;
+    IncFile *incs;
+    char prelude[PATH_MAX];         // 前缀头文件, 快照过期时直接包含它
+} PchHdr;
+
+char *pch_file;                     // -pch
+PchHdr *pch;                        // 装入的映像
+char *pch_stale;                    // 快照过期, 改为直接包含的文件
+
+// 写映像时: 原对象地址 -> 映像偏移, 开放定址; 外部对象为 -2 - (编号 * 4 + 种类)
+DynString pch_img, pch_relocs, pch_exts, pch_work;
+void **pch_keys;
+long long *pch_vals, pch_nkeys, pch_cap;
+
+unsigned long long pch_flags() {
+    unsigned long long h = 0;
+    int i;
 
-//<加减类表达式> --> <乘除类表达式>{'+'<乘除类表达式>|'-'<乘除类表达式>}
-void additive_expression();
+    for (i = 0; i < pp_ndirs; i++) {
+        h = hash64(pp_dirs[i], strlen(pp_dirs[i]) + 1, h);
+    }
+    h ^= 0x4944;
+    for (i = 0; i < pp_ndefs; i++) {
+        h = hash64(pp_defs[i], strlen(pp_defs[i]) + 1, h);
+    }
+    return h;
+}
 
-//<乘除表达式> --> <一元表达式>{'*'<一元表达式>|'/'<一元表达式>|'%'<一元表达式>}
-void multiplicative_expression();
+long long *pch_slot(void *p) {
+    void **keys;
+    long long *vals, cap, i, j;
+
+    if (pch_nkeys * 2 >= pch_cap) {
+        keys = pch_keys;
+        vals = pch_vals;
+        cap = pch_cap;
+        pch_cap = cap ? cap * 2 : 4096;
+        pch_keys = (void **) mallocz(sizeof(void *) * pch_cap, MEM_CACHE);
+        pch_vals = (long long *) mem_alloc(sizeof(long long) * pch_cap, MEM_CACHE);
+        for (i = 0; i < cap; i++) {
+            if (keys[i]) {
+                for (j = (long long) (((unsigned long long) keys[i] * 0x9e3779b97f4a7c15ULL) >> 40) & (pch_cap - 1);
+                     pch_keys[j]; j = (j + 1) & (pch_cap - 1));
+                pch_keys[j] = keys[i];
+                pch_vals[j] = vals[i];
+            }
+        }
+        if (cap) {
+            mem_free(keys, MEM_CACHE);
+            mem_free(vals, MEM_CACHE);
+        }
+    }
+    for (i = (long long) (((unsigned long long) p * 0x9e3779b97f4a7c15ULL) >> 40) & (pch_cap - 1);
+         pch_keys[i] && pch_keys[i] != p; i = (i + 1) & (pch_cap - 1));
+    if (!pch_keys[i]) {
+        pch_keys[i] = p;
+        pch_vals[i] = -1;
+        pch_nkeys++;
+    }
+    return &pch_vals[i];
+}
 
-//<一元表达式> --> <后缀表达式>|'&'<一元表达式>|'*'<一元表达式>|'+'<一元表达式>|'-'<一元表达式>|<sizeof表达式>
-void unary_expression();
+// 在映像偏移 at 处写入指向映像偏移 off 的指针
+void pch_set(long long at, long long off) {
+    unsigned long long addr = PCH_BASE + off;
 
-//<后缀表达式> --> <初等表达式>{'['<expression>']'|'('')'|'('<实参表达式>')'
-//|'.'IDENTIFIER|'->'IDENTIFIER}
-void postfix_expression();
-// <初等表达式> --> <标识符>|<整数常量>|<字符串常量>|<字符常量>|(<表达式>)
-void primary_expression();
-// <实参表达式> --> <赋值表达式>{','<赋值表达式>}
-void argument_expression_list();
-//<sizeof表达式> ==>> 'struct''('<类型区别符>')'
-void sizeof_expression();
+    memcpy(pch_img.data + at, &addr, 8);
+    blob_add(&pch_relocs, &at, 8);
+}
 
+// 复制一个对象, 指针成员排队稍后修正, 不递归
+long long pch_copy(void *p, int kind, long long size) {
+    long long off, w[2];
 
-void statement() {
-    switch (token) {
-        case TK_BEGIN:
-            compound_statement();
+    switch (kind) {
+        case PCH_STR:
+            size = strlen((char *) p) + 1;
             break;
-        case KW_IF:
-            if_statement();
+        case PCH_WORD:
+            size = sizeof(TkWord) + strlen(((TkWord *) p)->spelling) + 1;
             break;
-        case KW_FOR:
-            for_statement();
+        case PCH_SYM:
+            size = sizeof(Symbol);
             break;
-        case KW_BREAK:
-            break_statement();
+        case PCH_MACRO:
+            size = sizeof(Macro);
             break;
-        case KW_CONTINUE:
-            continue_statement();
+        case PCH_BCSYM:
+            size = sizeof(BcSym);
             break;
-        case KW_RETURN:
-            return_statement();
+        case PCH_FUNC:
+            size = sizeof(BcFunc);
             break;
-        default:
-            expression_statement();
+        case PCH_INC:
+            size = sizeof(IncFile);
+            break;
+        case PCH_TYPE:
+            size = sizeof(TypeNode);
             break;
     }
+    off = section_alloc(&pch_img, (int) size, 8);
+    memcpy(pch_img.data + off, p, size);
+    if (kind == PCH_WORD) {
+        // 拼写紧跟在单词后面, 模块符号和函数的名字也指向它
+        *pch_slot(((TkWord *) p)->spelling) = off + sizeof(TkWord);
+    }
+    if (kind > PCH_STR) {
+        w[0] = off;
+        w[1] = kind;
+        blob_add(&pch_work, w, sizeof(w));
+    }
+    return off;
 }
 
-void compound_statement() {
-    get_token();
-    while (is_type_specifier(token)) {
-        external_declaration(SC_LOCAL);
+// 在映像偏移 at 处写入指针 p, p 所指对象第一次出现时复制进映像
+void pch_ptr(long long at, void *p, int kind, long long size) {
+    long long off;
+    PchExt e;
+
+    if (!p) {
+        memset(pch_img.data + at, 0, 8);
+        return;
     }
-    while (token != TK_END) {
-        statement();
+    off = *pch_slot(p);
+    if (off == -1) {
+        off = pch_copy(p, kind, size);
+        *pch_slot(p) = off;
     }
-    get_token();
+    if (off < -1) {
+        e.at = at;
+        e.kind = (int) ((-2 - off) & 3);
+        e.index = (int) ((-2 - off) >> 2);
+        blob_add(&pch_exts, &e, sizeof(e));
+        memset(pch_img.data + at, 0, 8);
+        return;
+    }
+    pch_set(at, off);
 }
 
-int is_type_specifier(int v) {
-    switch (v) {
-        case KW_CHAR:
-        case KW_SHORT:
-        case KW_INT:
-        case KW_VOID:
-        case KW_STRUCT:
-            return 1;
-        default:
-            break;
+// 指针数组
+long long pch_array(long long at, void **p, long long n, int kind) {
+    long long a = section_alloc(&pch_img, (int) (sizeof(void *) * (n ? n : 1)), 8), i;
+
+    pch_set(at, a);
+    for (i = 0; i < n; i++) {
+        pch_ptr(a + i * 8, p[i], kind, 0);
     }
-    return 0;
+    return a;
 }
 
-void expression_statement() {
-    if (token != TK_SEMICOLON) {
-        expression();
+// 修正一个对象的指针成员; 映像会增长搬家, 先把对象取出来
+void pch_fix(long long off, int kind) {
+    TkWord w;
+    Symbol s;
+    Macro m;
+    BcSym b;
+    BcFunc f;
+    IncFile inc;
+    int t;
+
+    switch (kind) {
+        case PCH_WORD:
+            memcpy(&w, pch_img.data + off, sizeof(w));
+            pch_ptr(off + offsetof(TkWord, next), w.next, PCH_WORD, 0);
+            pch_ptr(off + offsetof(TkWord, spelling), w.spelling, PCH_STR, 0);
+            pch_ptr(off + offsetof(TkWord, sym_struct), w.sym_struct, PCH_SYM, 0);
+            pch_ptr(off + offsetof(TkWord, sym_identifier), w.sym_identifier, PCH_SYM, 0);
+            pch_ptr(off + offsetof(TkWord, macro), w.macro, PCH_MACRO, 0);
+            break;
+        case PCH_SYM:
+        case PCH_TYPE:
+            memcpy(&s, pch_img.data + off, sizeof(s));
+            // 基本类型的 ref 没有意义, 可能是任意值; 指针 数组 函数类型指向类型结点
+            t = s.type.t & T_BTYPE;
+            pch_ptr(off + offsetof(Symbol, type.ref), t == T_PTR || t == T_FUNC || t == T_STRUCT ? s.type.ref : NULL,
+                    t == T_STRUCT ? PCH_SYM : PCH_TYPE, 0);
+            pch_ptr(off + offsetof(Symbol, next), s.next, PCH_SYM, 0);
+            // 类型结点的散列链装入时重建
+            pch_ptr(off + offsetof(Symbol, prev_tok), kind == PCH_SYM ? s.prev_tok : NULL, PCH_SYM, 0);
+            break;
+        case PCH_MACRO:
+            memcpy(&m, pch_img.data + off, sizeof(m));
+            if (m.nparams > 0) {
+                pch_array(off + offsetof(Macro, params), (void **) m.params, m.nparams, PCH_STR);
+            } else {
+                pch_ptr(off + offsetof(Macro, params), NULL, PCH_STR, 0);
+            }
+            pch_ptr(off + offsetof(Macro, body), m.body, PCH_STR, 0);
+            break;
+        case PCH_BCSYM:
+            memcpy(&b, pch_img.data + off, sizeof(b));
+            pch_ptr(off + offsetof(BcSym, name), b.name, PCH_STR, 0);
+            pch_ptr(off + offsetof(BcSym, func), b.func, PCH_FUNC, 0);
+            break;
+        case PCH_FUNC:
+            memcpy(&f, pch_img.data + off, sizeof(f));
+            pch_ptr(off + offsetof(BcFunc, name), f.name, PCH_STR, 0);
+            pch_ptr(off + offsetof(BcFunc, code), f.code, PCH_RAW, sizeof(Insn) * f.ncode);
+            // 源位置指向建预编译头时的文件表, 不保存
+            pch_ptr(off + offsetof(BcFunc, locs), NULL, PCH_RAW, 0);
+            ((BcFunc *) (pch_img.data + off))->capcode = f.ncode;
+            ((BcFunc *) (pch_img.data + off))->nlocs = 0;
+            ((BcFunc *) (pch_img.data + off))->caplocs = 0;
+            ((BcFunc *) (pch_img.data + off))->native = NULL;
+            break;
+        case PCH_INC:
+            memcpy(&inc, pch_img.data + off, sizeof(inc));
+            pch_ptr(off + offsetof(IncFile, path), inc.path, PCH_STR, 0);
+            pch_ptr(off + offsetof(IncFile, name), inc.name, PCH_STR, 0);
+            pch_ptr(off + offsetof(IncFile, data), inc.data, PCH_RAW, inc.size);
+            pch_ptr(off + offsetof(IncFile, next), inc.next, PCH_INC, 0);
+            break;
     }
-    skip(TK_SEMICOLON);
 }
 
-void if_statement() {
-    get_token();
-    skip(TK_OPENPA);
-    expression();
-    skip(TK_CLOSEPA);
-    statement();
-    if (token == KW_ELSE) {
-        get_token();
-        statement();
+// 写出快照: 先写临时文件再 rename
+void pch_save(char *path, IncFile *top, int nkw, long long gbase, long long tbase) {
+    char tmp[PATH_MAX + 32];
+    long long i, a, w[2];
+    PchHdr *h;
+    FILE *fp;
+
+    dynstring_init(&pch_img, 1 << 16, MEM_CACHE);
+    dynstring_init(&pch_relocs, 1 << 12, MEM_CACHE);
+    dynstring_init(&pch_exts, 1 << 8, MEM_CACHE);
+    dynstring_init(&pch_work, 1 << 12, MEM_CACHE);
+    section_alloc(&pch_img, sizeof(PchHdr), 8);
+    for (i = 0; i < nkw; i++) {
+        *pch_slot(tktable.data[i]) = -2 - (i * 4 + PCH_EXT_WORD);
+    }
+    for (i = 0; i < gbase; i++) {
+        *pch_slot(global_sym_stack.data[i]) = -2 - (i * 4 + PCH_EXT_SYM);
+    }
+    for (i = 0; i < tbase; i++) {
+        *pch_slot(type_nodes.data[i]) = -2 - (i * 4 + PCH_EXT_TYPE);
+    }
+    // 先放单词, 拼写的地址登记后, 名字都指向单词里的拼写
+    pch_array(offsetof(PchHdr, words), tktable.data + nkw, tktable.count - nkw, PCH_WORD);
+    pch_array(offsetof(PchHdr, hashtab), (void **) tk_hashtable, MAXKEY, PCH_WORD);
+    a = section_alloc(&pch_img, sizeof(void *) * nkw, 8);
+    pch_set(offsetof(PchHdr, kwmacros), a);
+    for (i = 0; i < nkw; i++) {
+        pch_ptr(a + i * 8, ((TkWord *) tktable.data[i])->macro, PCH_MACRO, 0);
+    }
+    pch_array(offsetof(PchHdr, gsyms), global_sym_stack.data + gbase, global_sym_stack.count - gbase, PCH_SYM);
+    pch_array(offsetof(PchHdr, types), type_nodes.data + tbase, type_nodes.count - tbase, PCH_TYPE);
+    pch_array(offsetof(PchHdr, msyms), module.syms.data, module.syms.count, PCH_BCSYM);
+    pch_ptr(offsetof(PchHdr, data), module.data.data, PCH_RAW, module.data.count);
+    pch_ptr(offsetof(PchHdr, rodata), module.rodata.data, PCH_RAW, module.rodata.count);
+    pch_ptr(offsetof(PchHdr, strtab), str_table, PCH_RAW, sizeof(StrSlot) * str_cap);
+    pch_ptr(offsetof(PchHdr, init), module.init, PCH_FUNC, 0);
+    pch_ptr(offsetof(PchHdr, incs), pp_incs, PCH_INC, 0);
+    for (i = 0; i < pch_work.count; i += sizeof(w)) {
+        memcpy(w, pch_work.data + i, sizeof(w));
+        pch_fix(w[0], (int) w[1]);
+    }
+    a = section_alloc(&pch_img, (int) pch_relocs.count, 8);
+    memcpy(pch_img.data + a, pch_relocs.data, pch_relocs.count);
+    i = section_alloc(&pch_img, (int) pch_exts.count, 8);
+    memcpy(pch_img.data + i, pch_exts.data, pch_exts.count);
+    // 表本身的两个指针不在表中, 装入时单独处理
+    h = (PchHdr *) pch_img.data;
+    h->relocs = (long long *) (PCH_BASE + a);
+    h->exts = (PchExt *) (PCH_BASE + i);
+    h->magic = PCH_MAGIC;
+    h->nkw = nkw;
+    snprintf(h->version, sizeof(h->version), "%s", SC_VERSION);
+    h->flags = pch_flags();
+    h->size = pch_img.count;
+    h->gbase = gbase;
+    h->nrelocs = pch_relocs.count / 8;
+    h->nexts = pch_exts.count / sizeof(PchExt);
+    h->ntk = tktable.count;
+    h->ngsyms = global_sym_stack.count - gbase;
+    h->tbase = tbase;
+    h->ntypes = type_nodes.count - tbase;
+    h->nmsyms = module.syms.count;
+    h->ndata = module.data.count;
+    h->nrodata = module.rodata.count;
+    h->nstrtab = str_cap;
+    h->nstr = str_count;
+    snprintf(h->prelude, sizeof(h->prelude), "%s", top->path);
+    h->id = hash64(pch_img.data, pch_img.count, PCH_MAGIC);
+
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int) getpid());
+    fp = fopen(tmp, "wb");
+    if (!fp || fwrite(pch_img.data, 1, pch_img.count, fp) != (size_t) pch_img.count) {
+        error("不能写预编译头 %s", path);
     }
+    fclose(fp);
+    rename(tmp, path);
+    if (opt_verbose) {
+        fprintf(stderr, "[PCH] %s: %lld bytes, %lld words, %lld symbols, %lld module symbols, %lld relocs\n",
+                path, pch_img.count, h->ntk - nkw, h->ngsyms, h->nmsyms, h->nrelocs);
+    }
+    dynstring_free(&pch_img);
+    dynstring_free(&pch_relocs);
+    dynstring_free(&pch_exts);
+    dynstring_free(&pch_work);
+    mem_free(pch_keys, MEM_CACHE);
+    mem_free(pch_vals, MEM_CACHE);
+    pch_keys = NULL;
+    pch_vals = NULL;
+    pch_nkeys = pch_cap = 0;
 }
 
-void for_statement() {
-    get_token();
-    skip(TK_OPENPA);
-    if (token != TK_SEMICOLON) {
-        expression();
-    }
-    skip(TK_SEMICOLON);
-    if (token != TK_SEMICOLON) {
-        expression();
+// sc -pch-out out.pch prelude.h: 处理前缀头文件并写出快照
+int pch_create(char *file, char *out) {
+    IncFile *inc;
+    int nkw;
+    long long gbase, tbase;
+
+    phase_begin(PH_INIT);
+    init();
+    nkw = (int) tktable.count;
+    gbase = global_sym_stack.count;
+    tbase = type_nodes.count;
+    pp_predefine();
+    inc = pp_load(file);
+    if (!inc) {
+        printf("不能打开sc源文件!\n");
+        return 1;
     }
-    skip(TK_SEMICOLON);
-    if (token != TK_SEMICOLON) {
-        expression();
+    phase_begin(PH_PARSE);
+    // 前缀头文件按包含文件处理, 外层是空的输入
+    memset(&src, 0, sizeof(src));
+    src.fd = -1;
+    src.eof = 1;
+    src.mask = -1;
+    src.data = "";
+    ch = CH_EOF;
+    src_push(inc->data, inc->size, 0, NULL, inc);
+    get_token();
+    while (token != TK_EOF) {
+        external_declaration(SC_GLOBAL);
     }
-    skip(TK_CLOSEPA);
-    statement();
+    phase_begin(PH_EMIT);
+    pch_save(out, inc, nkw, gbase, tbase);
+    return 0;
 }
 
-void continue_statement() {
-    get_token();
-    skip(TK_SEMICOLON);
-}
+// -fprofile-use: 读入计数, 内容的散列计入编译缓存的键; 在查缓存之前调用
+void prof_use(char *path) {
+    char buf[32], *p;
+    size_t size;
+    int r = prof_read(path);
 
-void break_statement() {
-    get_token();
-    skip(TK_SEMICOLON);
+    if (r <= 0) {
+        error(r ? "profile文件 %s 格式不对" : "不能读profile文件 %s", path);
+    }
+    p = map_file(path, &size);
+    snprintf(buf, sizeof(buf), "%016llx", hash64(p, size, 0x5052));
+    munmap(p, size);
+    cache_flag("-fprofile-use=", buf);
 }
 
-void return_statement() {
-    get_token();
-    if (token != TK_SEMICOLON) {
-        expression();
+// 只读头部, 取快照的散列计入编译缓存的键; 在查缓存之前调用
+void pch_flag(char *path) {
+    char buf[32];
+    PchHdr h;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || pread(fd, &h, sizeof(h), 0) != sizeof(h) || h.magic != PCH_MAGIC) {
+        error("不能读预编译头 %s", path);
     }
-    skip(TK_SEMICOLON);
+    close(fd);
+    snprintf(buf, sizeof(buf), "%016llx", h.id);
+    cache_flag("-pch", buf);
 }
 
-void expression() {
-    while (1) {
-        assignment_expression();
-        if (token != TK_COMMA) {
-            break;
+// 映像中的包含文件都没变
+int pch_deps_ok(PchHdr *h) {
+    struct stat st;
+    IncFile *inc;
+
+    for (inc = h->incs; inc; inc = inc->next) {
+        if (stat(inc->path, &st) < 0 || st.st_size != inc->fsize
+            || st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec != inc->mtime) {
+            return 0;
         }
-        get_token();
     }
+    return 1;
 }
 
-void assignment_expression() {
-    equality_expression();
-    if (token == TK_ASSIGN) {
-        get_token();
-        assignment_expression();
+// 在 init() 之后 getch() 之前调用; 成功返回 1. 过期返回 0, 并记下前缀头文件由 pch_fallback() 包含
+int pch_load(char *path) {
+    char *p;
+    long long i, delta = 0, *rel;
+    PchHdr hdr, *h;
+    Symbol *s;
+    PchExt *e;
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+        || hdr.magic != PCH_MAGIC || hdr.size != st.st_size) {
+        error("预编译头 %s 已损坏", path);
+    }
+    pch_stale = mem_strdup(hdr.prelude, MEM_PP);
+    if (strcmp(hdr.version, SC_VERSION) || hdr.flags != pch_flags() || hdr.nkw != tktable.count
+        || hdr.gbase != global_sym_stack.count || hdr.tbase != type_nodes.count || module.syms.count) {
+        close(fd);
+        warning("预编译头 %s 与编译器或 -I/-D 选项不符, 直接包含 %s", path, pch_stale);
+        return 0;
+    }
+    p = (char *) mmap((void *) PCH_BASE, hdr.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd, 0);
+    if (p != MAP_FAILED && p != (char *) PCH_BASE) {
+        // 不认识 MAP_FIXED_NOREPLACE 的内核把地址当作提示
+        munmap(p, hdr.size);
+        p = MAP_FAILED;
+    }
+    if (p == MAP_FAILED) {
+        p = (char *) mmap(NULL, hdr.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            error("不能映射预编译头 %s", path);
+        }
+        delta = (long long) (p - (char *) PCH_BASE);
+    }
+    close(fd);
+    h = (PchHdr *) p;
+    if (delta) {
+        h->relocs = (long long *) ((char *) h->relocs + delta);
+        h->exts = (PchExt *) ((char *) h->exts + delta);
+        for (i = 0, rel = h->relocs; i < h->nrelocs; i++) {
+            *(long long *) (p + rel[i]) += delta;
+        }
+    }
+    if (!pch_deps_ok(h)) {
+        munmap(p, hdr.size);
+        warning("预编译头 %s 已过期, 直接包含 %s", path, pch_stale);
+        return 0;
+    }
+    for (i = 0, e = h->exts; i < h->nexts; i++, e++) {
+        *(void **) (p + e->at) = e->kind == PCH_EXT_WORD ? tktable.data[e->index]
+                                 : e->kind == PCH_EXT_SYM ? global_sym_stack.data[e->index] : type_nodes.data[e->index];
+    }
+    mem_free(pch_stale, MEM_PP);
+    pch_stale = NULL;
+    pch = h;
+    pch_lo = p;
+    pch_hi = p + hdr.size;
+
+    for (i = 0; i < h->ntk - h->nkw; i++) {
+        dynArray_add(&tktable, h->words[i]);
+    }
+    memcpy(tk_hashtable, h->hashtab, sizeof(tk_hashtable));
+    for (i = 0; i < h->nkw; i++) {
+        ((TkWord *) tktable.data[i])->macro = h->kwmacros[i];
     }
+    for (i = 0; i < h->ngsyms; i++) {
+        dynArray_add(&global_sym_stack, h->gsyms[i]);
+    }
+    // 散列值含结点的地址, 重新计算
+    for (i = 0; i < h->ntypes; i++) {
+        s = h->types[i];
+        ((TypeNode *) s)->hash = type_hash_of(s->v, &s->type, s->c, s->r, s->next);
+        type_insert(s);
+    }
+    for (i = 0; i < h->nmsyms; i++) {
+        dynArray_add(&module.syms, h->msyms[i]);
+    }
+    i = section_alloc(&module.data, (int) h->ndata, 1);
+    memcpy(module.data.data + i, h->data, h->ndata);
+    i = section_alloc(&module.rodata, (int) h->nrodata, 1);
+    memcpy(module.rodata.data + i, h->rodata, h->nrodata);
+    // 池里记的是模块符号编号, 快照装在空模块上, 编号不变
+    if (h->nstrtab) {
+        str_cap = (int) h->nstrtab;
+        str_count = (int) h->nstr;
+        str_table = (StrSlot *) mem_alloc(sizeof(StrSlot) * str_cap, MEM_MODULE);
+        memcpy(str_table, h->strtab, sizeof(StrSlot) * str_cap);
+    }
+    // 全局变量初始化代码还会追加, 复制到堆上
+    cur_func = module.init;
+    for (i = 0; i < h->init->ncode; i++) {
+        gen_insn(h->init->code[i].op, h->init->code[i].a, h->init->code[i].b, h->init->code[i].c);
+    }
+    module.init->nregs = h->init->nregs;
+    module.init->frame_size = h->init->frame_size;
+    pp_incs = h->incs;
+    if (opt_verbose) {
+        fprintf(stderr, "[PCH] %s: %lld bytes mapped %s, %lld words, %lld symbols, %lld external refs\n",
+                path, h->size, delta ? "elsewhere and relocated" : "at base", h->ntk - h->nkw, h->ngsyms, h->nexts);
+    }
+    return 1;
 }
 
-void equality_expression() {
-    relational_expression();
-    while (token == TK_EQ || token == TK_NEQ) {
-        get_token();
-        relational_expression();
+// 快照过期: 像 #include 一样读入前缀头文件; 在第一次 getch() 之后调用
+void pch_fallback() {
+    IncFile *inc;
+
+    if (!pch_stale) {
+        return;
+    }
+    inc = pp_load(pch_stale);
+    if (!inc) {
+        error("找不到预编译头的前缀文件 %s", pch_stale);
     }
+    stats.pp_includes++;
+    stats.pp_include_bytes += inc->size;
+    incr_mix(inc->data, inc->size);
+    src_push(inc->data, inc->size, 0, NULL, inc);
 }
 
-void relational_expression() {
-    additive_expression();
-    while (token == TK_LT || token == TK_LEQ ||
-           token == TK_GT || token == TK_GEQ) {
-        get_token();
-        additive_expression();
+// 编译服务器
+// 服务器先完成初始化 (单词表 关键字 全局符号栈 代码生成), 再 fork 出若干工作进程共用一个监听套接字;
+// 工作进程每接到一个请求再 fork 一次, 子进程带着热状态编译, 用完即弃, 工作进程的状态不受影响
+// 客户端发送当前目录和参数, 并用 SCM_RIGHTS 传递自己的 stdin/stdout/stderr, 然后等待退出码
+#define SERVER_MSG_MAX 65536
+
+int sc_main(int argc, char **argv);
+
+int server_listen(char *path) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (fd < 0 || strlen(path) >= sizeof(addr.sun_path)) {
+        error("不能创建套接字 %s", path);
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        error("不能监听 %s", path);
     }
+    return fd;
 }
 
-void additive_expression() {
-    multiplicative_expression();
-    while (token == TK_PLUS || token == TK_MINUS) {
-        get_token();
-        multiplicative_expression();
+// 收一个请求: 长度 + 消息体 "cwd\0arg1\0arg2\0...", 三个文件描述符随长度字段一起到达
+int server_recv(int fd, char *buf, int *fds) {
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    char ctl[CMSG_SPACE(sizeof(int) * 3)];
+    unsigned int len;
+    int got = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &len;
+    iov.iov_len = sizeof(len);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl;
+    msg.msg_controllen = sizeof(ctl);
+    if (recvmsg(fd, &msg, MSG_WAITALL) != sizeof(len)) {
+        return -1;
+    }
+    for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS
+            && cm->cmsg_len == CMSG_LEN(sizeof(int) * 3)) {
+            memcpy(fds, CMSG_DATA(cm), sizeof(int) * 3);
+            got = 1;
+        }
+    }
+    if (!got) {
+        return -1;
     }
+    if (len == 0 || len >= SERVER_MSG_MAX || recv(fd, buf, len, MSG_WAITALL) != (ssize_t) len) {
+        close(fds[0]);
+        close(fds[1]);
+        close(fds[2]);
+        return -1;
+    }
+    buf[len] = '\0';
+    return (int) len;
 }
 
-void multiplicative_expression() {
-    unary_expression();
-    while (token == TK_STAR || token == TK_DIVIDE || token == TK_MOD) {
-        get_token();
-        unary_expression();
+// 在子进程中执行一个编译请求, 不返回
+void server_compile(char *buf, int len, int *fds) {
+    char **argv = (char **) mem_alloc(sizeof(char *) * (len + 2), MEM_SERVER);
+    char *p = buf + strlen(buf) + 1;
+    int argc = 0, i;
+
+    for (i = 0; i < 3; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    if (chdir(buf) < 0) {
+        fprintf(stderr, "不能进入目录 %s\n", buf);
+        exit(1);
     }
+    argv[argc++] = "sc";
+    while (p < buf + len) {
+        argv[argc++] = p;
+        p += strlen(p) + 1;
+    }
+    argv[argc] = NULL;
+    exit(sc_main(argc, argv));
 }
 
-void unary_expression() {
-    switch (token) {
-        case TK_AND:
-        case TK_STAR:
-        case TK_PLUS:
-        case TK_MINUS:
-            get_token();
-            unary_expression();
-            break;
-        case KW_SIZEOF:
-            sizeof_expression();
-            break;
-        default:
-            postfix_expression();
-            break;
+void server_worker(int lfd) {
+    char *buf = (char *) mem_alloc(SERVER_MSG_MAX, MEM_SERVER);
+    int cfd, len, fds[3], i, status, code;
+    pid_t pid;
+
+    signal(SIGPIPE, SIG_IGN);
+    while (1) {
+        cfd = accept(lfd, NULL, NULL);
+        if (cfd < 0) {
+            continue;
+        }
+        len = server_recv(cfd, buf, fds);
+        if (len < 0) {
+            close(cfd);
+            continue;
+        }
+        pid = fork();
+        if (pid == 0) {
+            close(lfd);
+            close(cfd);
+            server_compile(buf, len, fds);
+        }
+        for (i = 0; i < 3; i++) {
+            close(fds[i]);
+        }
+        code = 255;
+        if (pid > 0 && waitpid(pid, &status, 0) == pid) {
+            code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
+        if (write(cfd, &code, sizeof(code)) < 0) {
+            warning("客户端已断开");
+        }
+        close(cfd);
     }
 }
 
-void sizeof_expression() {
-    get_token();
-    skip(TK_OPENPA);
-    type_specifier();
-    skip(TK_CLOSEPA);
-}
+pid_t server_spawn(int lfd) {
+    pid_t pid = fork();
 
-void postfix_expression() {
-    primary_expression();
-    while(1){
-        if (token == TK_DOT || token ==TK_POINTSTO){
-            get_token();
-            token |= SC_MEMBER;
-            get_token();
-        }else if (token == TK_OPENBR){
-            get_token();
-            expression();
-            skip(TK_CLOSEBR);
-        }else if (token == TK_OPENPA){
-            argument_expression_list();
-        }else{
-            break;
-        }
+    if (pid == 0) {
+        server_worker(lfd);
+        exit(0);
     }
+    return pid;
 }
 
-void primary_expression(){
-    int t;
-    switch (token) {
-        case TK_CINT:
-        case TK_CCHAR:
-        case TK_CSTR:
-            get_token();
-            break;
-        case TK_OPENPA:
-            get_token();
-            expression();
-            skip(TK_CLOSEPA);
-        default:
-            t = token;
-            get_token();
-            if (t<TK_IDENT){
-                expect("标识符或常量");
-            }
-            break;
+// 常驻服务, 工作进程退出时补上
+void server_run(char *path, int nworkers) {
+    int lfd, i, status;
+
+    init();
+    fflush(stdout);
+    lfd = server_listen(path);
+    if (nworkers < 1) {
+        nworkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    fprintf(stderr, "[SERVER] %s, %d workers\n", path, nworkers);
+    for (i = 0; i < nworkers; i++) {
+        server_spawn(lfd);
+    }
+    while (1) {
+        if (wait(&status) > 0) {
+            server_spawn(lfd);
+        }
     }
 }
 
-void argument_expression_list(){
-    get_token();
-    if (token != TK_CLOSEPA){
-        while(1){
-            assignment_expression();
-            if (token == TK_CLOSEPA){
-                break;
-            }
-            skip(TK_COMMA);
+// 客户端: 连不上服务器时返回 -1, 由调用者在本进程编译
+int client_run(char *path, int argc, char **argv) {
+    struct sockaddr_un addr;
+    struct msghdr msg;
+    struct iovec iov[2];
+    struct cmsghdr *cm;
+    char ctl[CMSG_SPACE(sizeof(int) * 3)], *buf;
+    unsigned int len = 0;
+    int fd, i, code, fds[3] = {0, 1, 2};
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        if (fd >= 0) {
+            close(fd);
         }
+        return -1;
     }
-    skip(TK_CLOSEPA);
+    buf = (char *) mem_alloc(SERVER_MSG_MAX, MEM_SERVER);
+    if (!getcwd(buf, SERVER_MSG_MAX)) {
+        strcpy(buf, ".");
+    }
+    len = strlen(buf) + 1;
+    for (i = 0; i < argc; i++) {
+        if (len + strlen(argv[i]) + 1 >= SERVER_MSG_MAX) {
+            close(fd);
+            mem_free(buf, MEM_SERVER);
+            return -1;
+        }
+        strcpy(buf + len, argv[i]);
+        len += strlen(argv[i]) + 1;
+    }
+    memset(&msg, 0, sizeof(msg));
+    iov[0].iov_base = &len;
+    iov[0].iov_len = sizeof(len);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = len;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = ctl;
+    msg.msg_controllen = sizeof(ctl);
+    cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, 0) != (ssize_t) (sizeof(len) + len)
+        || read(fd, &code, sizeof(code)) != sizeof(code)) {
+        code = 255;
+    }
+    close(fd);
+    mem_free(buf, MEM_SERVER);
+    return code;
 }
 
+// -stats 报告
+char *tk_names[] = {
+        "+", "-", "*", "/", "%", "==", "!=", "<", "<=", ">", ">=", "=", "->", ".", "&",
+        "(", ")", "[", "]", "{", "}", ";", ":", ",", "...", "<eof>", "<int>", "<char>", "<string>",
+        "char", "short", "int", "void", "struct", "if", "else", "for", "continue", "break", "return",
+        "switch", "case", "default", "sizeof", "__cdecl", "__stdcall", "__align", "<ident>",
+};
 
+#define CHAIN_BUCKETS 8             // 链长直方图: 0 1 2 3 4-7 8-15 16-31 32+
 
+int chain_bucket(int n) {
+    int b;
 
-int main(int argc, char **argv) {
-    fin = fopen(argv[1], "rb");
-    if (!fin) {
-        printf("不能打开sc源文件!\n");
-        return 0;
+    if (n < 4) {
+        return n;
     }
-    init();
-    getch();
-    get_token();
-    translation_unit();
-
-    cleanup();
-    fclose(fin);
-    printf("%s 语法分析成功！", argv[1]);
-    return 0;
+    for (b = 4; n >= 8 && b < CHAIN_BUCKETS - 1; n >>= 1, b++);
+    return b;
 }
 
+void stats_report(char *file) {
+    static char *bucket_names[CHAIN_BUCKETS] = {"0", "1", "2", "3", "4-7", "8-15", "16-31", "32+"};
+    long long hist[CHAIN_BUCKETS], total_tokens = 0, entries = 0, collisions = 0;
+    double lex_share, front_cpu, cpu[PH_NUM], wall_total = 0, cpu_total = 0;
+    int i, n, max_chain = 0, json = opt_stats == 2;
+    struct stat st;
+    TkWord *tp;
+    FILE *fp = stderr;
+
+    phase_begin(-1);
+    // 词法分析嵌在语法分析中, 两者的 CPU 时间按墙钟时间比例拆分
+    memcpy(cpu, stats.cpu, sizeof(cpu));
+    front_cpu = cpu[PH_PARSE] + cpu[PH_LEX];
+    lex_share = stats.wall[PH_LEX] + stats.wall[PH_PARSE] > 0
+                ? stats.wall[PH_LEX] / (stats.wall[PH_LEX] + stats.wall[PH_PARSE]) : 0;
+    cpu[PH_LEX] = front_cpu * lex_share;
+    cpu[PH_PARSE] = front_cpu - cpu[PH_LEX];
+    for (i = 0; i < PH_NUM; i++) {
+        wall_total += stats.wall[i];
+        cpu_total += cpu[i];
+    }
+    for (i = 0; i <= TK_IDENT; i++) {
+        total_tokens += stats.tokens[i];
+    }
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i < MAXKEY; i++) {
+        for (n = 0, tp = tk_hashtable[i]; tp; tp = tp->next, n++);
+        hist[chain_bucket(n)]++;
+        entries += n;
+        collisions += n > 1 ? n - 1 : 0;
+        if (n > max_chain) {
+            max_chain = n;
+        }
+    }
+    if (stat(file, &st) < 0) {
+        st.st_size = 0;
+    }
 
+    if (json) {
+        fprintf(fp, "{\n  \"file\": \"%s\",\n  \"bytes\": %lld,\n  \"phases\": {", file, (long long) st.st_size);
+        for (i = 0; i < PH_NUM; i++) {
+            fprintf(fp, "%s\n    \"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f%s}", i ? "," : "", phase_names[i],
+                    stats.wall[i] * 1e3, cpu[i] * 1e3,
+                    i == PH_LEX || i == PH_PARSE ? ", \"cpu_estimated\": true" : "");
+        }
+        fprintf(fp, "\n  },\n  \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f},\n", wall_total * 1e3, cpu_total * 1e3);
+        fprintf(fp, "  \"tokens\": %lld,\n  \"tokens_by_code\": {", total_tokens);
+        for (i = 0, n = 0; i <= TK_IDENT; i++) {
+            if (stats.tokens[i]) {
+                fprintf(fp, "%s\"%s\": %lld", n++ ? ", " : "", tk_names[i], stats.tokens[i]);
+            }
+        }
+        fprintf(fp, "},\n  \"getch_calls\": %lld,\n", stats.getch_calls);
+        fprintf(fp, "  \"tk_hashtable\": {\"buckets\": %d, \"entries\": %lld, \"max_chain\": %d, "
+                    "\"collisions\": %lld, \"lookups\": %lld, \"probes\": %lld, \"chain_histogram\": {",
+                MAXKEY, entries, max_chain, collisions, stats.tk_lookups, stats.tk_probes);
+        for (i = 0; i < CHAIN_BUCKETS; i++) {
+            fprintf(fp, "%s\"%s\": %lld", i ? ", " : "", bucket_names[i], hist[i]);
+        }
+        fprintf(fp, "}},\n  \"dynstring_realloc\": {\"calls\": %lld, \"bytes_moved\": %lld},\n",
+                stats.dynstring_reallocs, stats.dynstring_moved);
+        fprintf(fp, "  \"dynArray_realloc\": {\"calls\": %lld, \"bytes_moved\": %lld},\n",
+                stats.dynarray_reallocs, stats.dynarray_moved);
+        fprintf(fp, "  \"preprocessor\": {\"directives\": %lld, \"expansions\": %lld, \"includes\": %lld, "
+                    "\"include_skips\": %lld, \"include_bytes\": %lld},\n", stats.pp_directives,
+                stats.pp_expansions, stats.pp_includes, stats.pp_include_skips, stats.pp_include_bytes);
+        fprintf(fp, "  \"string_pool\": {\"literals\": %lld, \"pooled\": %lld, \"suffix_merged\": %lld, "
+                    "\"rodata_bytes\": %lld, \"pool_bytes\": %lld},\n", stats.str_literals, stats.str_unique,
+                stats.str_merged, stats.str_bytes, stats.str_pool_bytes);
+        fprintf(fp, "  \"types\": {\"lookups\": %lld, \"nodes\": %lld},\n", stats.type_lookups, stats.type_nodes);
+        fprintf(fp, "  \"switch\": {\"statements\": %lld, \"cases\": %lld, \"jump_tables\": %lld, \"compares\": %lld},\n",
+                stats.switches, stats.switch_cases, stats.switch_tables, stats.switch_compares);
+        fprintf(fp, "  \"parallel\": {\"workers\": %lld, \"functions\": %lld, \"wait_ms\": %.3f},\n",
+                stats.par_jobs, stats.par_funcs, stats.par_wait * 1e3);
+        fprintf(fp, "  \"peephole\": {\"insns\": %lld, \"removed\": %lld, \"jumps_threaded\": %lld, \"rules\": {",
+                stats.peep_insns, stats.peep_removed, stats.peep_threaded);
+        peep_stats(fp, json);
+        fprintf(fp, "}},\n  \"inline\": {\"calls\": %lld, \"inlined\": %lld},\n", stats.inline_calls,
+                stats.inline_sites);
+        fprintf(fp, "  \"loops\": {\"loops\": %lld, \"hoisted\": %lld, \"induction_vars\": %lld, \"unrolled\": %lld},\n",
+                stats.loops, stats.loop_hoisted, stats.loop_ivs, stats.loop_unrolled);
+        fprintf(fp, "  \"vectorize\": {\"loops\": %lld, \"vectorized\": %lld, \"alias_checks\": %lld},\n",
+                stats.vec_loops, stats.vec_done, stats.vec_checks);
+        fprintf(fp, "  \"pgo\": {\"counters\": %lld, \"functions\": %lld, \"swapped\": %lld, \"cold\": %lld},\n",
+                stats.prof_counters, stats.prof_funcs, stats.prof_swapped, stats.prof_cold);
+        fprintf(fp, "  \"tail_calls\": %lld,\n", stats.tail_calls);
+        fprintf(fp, "  \"lto\": {\"objects\": %lld, \"functions\": %lld, \"folded_loads\": %lld, \"partitions\": %lld},\n",
+                stats.lto_objs, stats.lto_funcs, stats.lto_folded, stats.lto_parts);
+        fprintf(fp, "  \"link\": {\"functions\": %lld, \"functions_kept\": %lld, \"data\": %lld, \"data_kept\": %lld, "
+                "\"insns\": %lld, \"insns_kept\": %lld}\n}\n", stats.link_funcs, stats.link_funcs_kept, stats.link_data,
+                stats.link_data_kept, stats.link_text, stats.link_text_kept);
+        return;
+    }
 
-// 'A':case'B':case'C':case'D':case'E':case'F':case'G':case'H':case'I':case'J':case'K':case'L':case'M':case'N':case'O':case'P':case'Q':case'R':case'S':case'T':case'U':case'V':case'W':case'X':case'Y':case'Z'
-// '0':case'1':case'2':case'3':case'4':case'5':case'6':case'7':case'8':case'9'
+    fprintf(fp, "== %s: %lld bytes, %lld tokens\n", file, (long long) st.st_size, total_tokens);
+    fprintf(fp, "%-8s %10s %10s\n", "phase", "wall ms", "cpu ms");
+    for (i = 0; i < PH_NUM; i++) {
+        if (stats.wall[i] > 0 || cpu[i] > 0) {
+            fprintf(fp, "%-8s %10.3f %10.3f%s\n", phase_names[i], stats.wall[i] * 1e3, cpu[i] * 1e3,
+                    i == PH_LEX || i == PH_PARSE ? "*" : "");
+        }
+    }
+    fprintf(fp, "%-8s %10.3f %10.3f\n", "total", wall_total * 1e3, cpu_total * 1e3);
+    fprintf(fp, "  * lex/parse CPU split by wall-time share\n");
+    if (stats.wall[PH_LEX] > 0) {
+        fprintf(fp, "lex: %.1f MB/s, %.2f Mtok/s\n", st.st_size / stats.wall[PH_LEX] / 1e6,
+                total_tokens / stats.wall[PH_LEX] / 1e6);
+    }
+    fprintf(fp, "getch calls: %lld\n", stats.getch_calls);
+    fprintf(fp, "tokens by code:");
+    for (i = 0, n = 0; i <= TK_IDENT; i++) {
+        if (stats.tokens[i]) {
+            fprintf(fp, "%s%s %lld", n++ % 8 ? ", " : "\n  ", tk_names[i], stats.tokens[i]);
+        }
+    }
+    fprintf(fp, "\ntk_hashtable: %d buckets, %lld entries, max chain %d, %lld collisions, "
+                "%lld lookups, %.2f probes/lookup\n", MAXKEY, entries, max_chain, collisions,
+            stats.tk_lookups, stats.tk_lookups ? (double) stats.tk_probes / stats.tk_lookups : 0.0);
+    fprintf(fp, "  chain length:");
+    for (i = 0; i < CHAIN_BUCKETS; i++) {
+        fprintf(fp, " %s:%lld", bucket_names[i], hist[i]);
+    }
+    fprintf(fp, "\ndynstring_realloc: %lld calls, %lld bytes moved\n", stats.dynstring_reallocs,
+            stats.dynstring_moved);
+    fprintf(fp, "dynArray_realloc: %lld calls, %lld bytes moved\n", stats.dynarray_reallocs, stats.dynarray_moved);
+    fprintf(fp, "preprocessor: %lld directives, %lld macro expansions, %lld includes (%lld skipped by guard/once), "
+                "%lld header bytes lexed\n", stats.pp_directives, stats.pp_expansions, stats.pp_includes,
+            stats.pp_include_skips, stats.pp_include_bytes);
+    fprintf(fp, "string pool: %lld literals, %lld pooled, %lld suffix-merged, rodata %lld -> %lld bytes\n",
+            stats.str_literals, stats.str_unique, stats.str_merged, stats.str_bytes, stats.str_pool_bytes);
+    fprintf(fp, "types: %lld derived-type lookups, %lld interned nodes\n", stats.type_lookups, stats.type_nodes);
+    if (stats.switches) {
+        fprintf(fp, "switch: %lld statements, %lld cases, %lld jump tables, %lld search compares\n", stats.switches,
+                stats.switch_cases, stats.switch_tables, stats.switch_compares);
+    }
+    if (stats.par_jobs) {
+        fprintf(fp, "parallel: %lld workers, %lld function bodies from workers, %.3f ms waiting\n",
+                stats.par_jobs, stats.par_funcs, stats.par_wait * 1e3);
+    }
+    fprintf(fp, "peephole: %lld -> %lld instructions, %lld jumps threaded\n  rules:", stats.peep_insns,
+            stats.peep_insns - stats.peep_removed, stats.peep_threaded);
+    peep_stats(fp, json);
+    fprintf(fp, "\ninline: %lld call sites, %lld inlined\n", stats.inline_calls, stats.inline_sites);
+    fprintf(fp, "loops: %lld loops, %lld invariants hoisted, %lld induction variables, %lld unrolled\n", stats.loops,
+            stats.loop_hoisted, stats.loop_ivs, stats.loop_unrolled);
+    fprintf(fp, "vectorize: %lld of %lld innermost loops vectorized, %lld alias checks\n", stats.vec_done,
+            stats.vec_loops, stats.vec_checks);
+    fprintf(fp, "pgo: %lld counters, %lld functions with profile, %lld branches swapped, %lld cold blocks moved\n",
+            stats.prof_counters, stats.prof_funcs, stats.prof_swapped, stats.prof_cold);
+    fprintf(fp, "tail calls: %lld\n", stats.tail_calls);
+    if (stats.lto_objs) {
+        fprintf(fp, "lto: %lld objects, %lld functions merged, %lld global loads folded, %lld partitions\n",
+                stats.lto_objs, stats.lto_funcs, stats.lto_folded, stats.lto_parts);
+    }
+    fprintf(fp, "link: %lld of %lld functions, %lld of %lld data objects kept, %lld -> %lld instructions\n",
+            stats.link_funcs_kept, stats.link_funcs, stats.link_data_kept, stats.link_data, stats.link_text,
+            stats.link_text_kept);
+}
 
+enum e_InputKind {
+    IN_SOURCE,
+    IN_OBJECT,
+    IN_ARCHIVE,
+    IN_IMAGE,
+};
 
+int input_kind(char *path) {
+    char buf[sizeof(Elf64_Ehdr)];
+    size_t n;
+    FILE *fp = fopen(path, "rb");
 
+    if (!fp) {
+        return IN_SOURCE;
+    }
+    n = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    if (n >= SARMAG && !memcmp(buf, ARMAG, SARMAG)) {
+        return IN_ARCHIVE;
+    }
+    if (is_sc_elf(buf, n, ET_REL)) {
+        return IN_OBJECT;
+    }
+    if (is_sc_elf(buf, n, ET_EXEC)) {
+        return IN_IMAGE;
+    }
+    return IN_SOURCE;
+}
 
+// a.c -> a.o
+char *obj_name(char *path) {
+    char *p, *dot;
 
+    if (!strcmp(path, "-")) {
+        return "stdin.o";
+    }
+    p = (char *) mem_alloc(strlen(path) + 3, MEM_SERVER);
+    strcpy(p, path);
+    dot = strrchr(p, '.');
+    if (!dot || strchr(dot, '/')) {
+        dot = p + strlen(p);
+    }
+    strcpy(dot, ".o");
+    return p;
+}
 
+int sc_main(int argc, char **argv) {
+    int i, ret = 0, ninputs = 0, opt_compile = 0, opt_cache_stats = 0, opt_incremental = 0, opt_lex = 0, kind, tkcount;
+    char *file, *out = NULL, **inputs, *obj = NULL, *pch_out = NULL;
+    size_t objsize;
+
+    inputs = (char **) mem_alloc(sizeof(char *) * argc, MEM_SERVER);
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-run")) {
+            opt_run = 1;
+        } else if (!strcmp(argv[i], "-bench")) {
+            opt_run = opt_bench = 1;
+        } else if (!strcmp(argv[i], "-dump")) {
+            opt_dump = 1;
+        } else if (!strcmp(argv[i], "-c")) {
+            opt_compile = 1;
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out = argv[++i];
+        } else if (!strcmp(argv[i], "-cache") && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (!strcmp(argv[i], "-cache-size") && i + 1 < argc) {
+            cache_limit = atoll(argv[++i]) << 20;
+        } else if (!strcmp(argv[i], "-cache-stats")) {
+            opt_cache_stats = 1;
+        } else if (!strcmp(argv[i], "-incremental")) {
+            opt_incremental = 1;
+        } else if (!strcmp(argv[i], "-lex")) {
+            opt_lex = 1;
+        } else if (!strcmp(argv[i], "-stats")) {
+            opt_stats = 1;
+        } else if (!strcmp(argv[i], "-stats=json")) {
+            opt_stats = 2;
+        } else if (!strcmp(argv[i], "-mem-report") || !strcmp(argv[i], "--mem-report")) {
+            opt_mem_report = 1;
+        } else if ((!strcmp(argv[i], "-mem-limit") || !strcmp(argv[i], "--mem-limit")) && i + 1 < argc) {
+            mem_limit = mem_parse_size(argv[++i]);
+        } else if (!strncmp(argv[i], "-I", 2) && (argv[i][2] || i + 1 < argc) && pp_ndirs < 64) {
+            pp_dirs[pp_ndirs] = argv[i][2] ? argv[i] + 2 : argv[++i];
+            cache_flag("-I", pp_dirs[pp_ndirs++]);
+        } else if (!strncmp(argv[i], "-D", 2) && (argv[i][2] || i + 1 < argc) && pp_ndefs < 64) {
+            pp_defs[pp_ndefs] = argv[i][2] ? argv[i] + 2 : argv[++i];
+            cache_flag("-D", pp_defs[pp_ndefs++]);
+        } else if (!strcmp(argv[i], "-pch") && i + 1 < argc) {
+            pch_file = argv[++i];
+        } else if (!strcmp(argv[i], "-pch-out") && i + 1 < argc) {
+            pch_out = argv[++i];
+        } else if (!strncmp(argv[i], "-j", 2) && (argv[i][2] || i + 1 < argc)) {
+            par_njobs = atoi(argv[i][2] ? argv[i] + 2 : argv[++i]);
+            if (par_njobs <= 0) {
+                par_njobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+            }
+        } else if (!strcmp(argv[i], "-no-inline")) {
+            opt_inline = 0;
+            cache_flag("-no-inline", "");
+        } else if (!strcmp(argv[i], "-no-loop-opt")) {
+            opt_loop = 0;
+            cache_flag("-no-loop-opt", "");
+        } else if (!strcmp(argv[i], "-no-tail-call")) {
+            opt_tail_call = 0;
+            cache_flag("-no-tail-call", "");
+        } else if (!strcmp(argv[i], "-no-vectorize")) {
+            opt_vector = 0;
+            cache_flag("-no-vectorize", "");
+        } else if (!strcmp(argv[i], "-inline-report")) {
+            opt_inline_report = opt_insn_locs = 1;
+        } else if (!strcmp(argv[i], "-no-link-dce")) {
+            opt_link_dce = 0;
+        } else if (!strcmp(argv[i], "-flto")) {
+            opt_lto = 1;
+        } else if (!strcmp(argv[i], "-vec-report")) {
+            opt_vector_report = opt_insn_locs = 1;
+        } else if (!strncmp(argv[i], "-fprofile-generate", 18) && (!argv[i][18] || argv[i][18] == '=')) {
+            opt_prof_gen = 1;
+            prof_gen_file = argv[i][18] ? argv[i] + 19 : NULL;
+            cache_flag("-fprofile-generate", "");
+        } else if (!strncmp(argv[i], "-fprofile-use", 13) && (!argv[i][13] || argv[i][13] == '=')) {
+            prof_use_file = argv[i][13] ? argv[i] + 14 : PROF_DEFAULT_FILE;
+        } else if (!strcmp(argv[i], "-v")) {
+            opt_verbose = 1;
+        } else {
+            inputs[ninputs++] = argv[i];
+        }
+    }
+    if (!cache_dir) {
+        cache_dir = getenv("SC_CACHE_DIR");
+    }
+    // 只有 -c 输出的目标文件才推迟优化; 链接时是否优化看目标文件本身
+    if (!opt_compile) {
+        opt_lto = 0;
+    } else if (opt_lto) {
+        cache_flag("-flto", "");
+    }
+    if (opt_cache_stats && cache_dir) {
+        cache_print_stats();
+    }
+    if (!ninputs) {
+        if (opt_cache_stats) {
+            return 0;
+        }
+        printf("usage: %s [-run|-bench|-dump] file.c\n"
+               "       %s -c file.c [-o file.o]\n"
+               "       %s -lex file.c\n"
+               "       gen | %s -run -      (从 stdin 流式读入)\n"
+               "       %s [-o a.out] file.o... lib.a...\n"
+               "       %s -run|-bench a.out\n"
+               "       %s -server sock [-workers n] | -connect sock args...\n"
+               "options: -cache dir  -cache-size MB  -cache-stats  -incremental  -j n  -stats[=json]  -v\n"
+               "         -no-inline  -inline-report  -no-loop-opt  -no-vectorize  -vec-report\n"
+               "         -no-tail-call  -no-link-dce  -flto\n"
+               "         -fprofile-generate[=file]  -fprofile-use[=file]\n"
+               "         -I dir  -D name[=value]  -pch-out file.pch prelude.h  -pch file.pch\n"
+               "         -mem-report  -mem-limit N[K|M|G]\n",
+               argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+        return 0;
+    }
+    file = inputs[0];
+    if (pch_out) {
+        return pch_create(file, pch_out);
+    }
+    kind = input_kind(file);
+    if (kind == IN_IMAGE && opt_run) {
+        phase_begin(PH_LINK);
+        image_load(&module, file);
+        phase_begin(PH_RUN);
+        ret = vm_exec(&module);
+        if (opt_stats) {
+            stats_report(file);
+        }
+        if (opt_mem_report) {
+            mem_report(stderr);
+        }
+        return ret;
+    }
+    if (!opt_compile && (ninputs > 1 || kind != IN_SOURCE)) {
+        phase_begin(PH_LINK);
+        if (prof_use_file) {
+            prof_use(prof_use_file);
+        }
+        link_files(inputs, ninputs, out ? out : "a.out");
+        if (opt_stats) {
+            stats_report(file);
+        }
+        if (opt_mem_report) {
+            mem_report(stderr);
+        }
+        return 0;
+    }
+    if (!src_open(file)) {
+        printf("不能打开sc源文件!\n");
+        return 0;
+    }
+    filename = file;
+    if (!strcmp(file, "-")) {
+        // 流式输入不能回看源文件, 不用缓存和增量编译
+        filename = "<stdin>";
+        cache_dir = NULL;
+        opt_incremental = 0;
+    }
+    if (opt_lex) {
+        // 只做词法分析, 供基准测试单独计时
+        phase_begin(PH_INIT);
+        init();
+        pp_predefine();
+        phase_begin(PH_PARSE);
+        getch();
+        do {
+            get_token();
+        } while (token != TK_EOF);
+        src_close();
+        printf("%s: %lld tokens\n", file, tk_count);
+        if (opt_stats) {
+            stats_report(file);
+        }
+        if (opt_mem_report) {
+            mem_report(stderr);
+        }
+        return 0;
+    }
+    if (pch_file) {
+        pch_flag(pch_file);
+    }
+    if (prof_use_file) {
+        prof_use(prof_use_file);
+    }
+    phase_begin(PH_CACHE);
+    if (cache_dir && (obj = cache_fetch(file, &objsize, &tkcount))) {
+        // 命中: 跳过词法/语法分析和代码生成
+        src_close();
+        obj_load(&module, file, obj, objsize);
+    } else {
+        if (opt_incremental) {
+            incr_open(file);
+        }
+        phase_begin(PH_INIT);
+        init();
+        if (!pch_file || !pch_load(pch_file)) {
+            pp_predefine();
+        }
+        phase_begin(PH_PARSE);
+        if (par_njobs > 0 && !incr_src && strcmp(file, "-")) {
+            par_start(file);
+        }
+        getch();
+        pch_fallback();
+        get_token();
+        translation_unit();
+        src_close();
+        if (cache_dir) {
+            phase_begin(PH_CACHE);
+            obj = obj_build(&module, &objsize);
+            cache_store(obj, objsize, tktable.count);
+        }
+        tkcount = -1;
+    }
 
+    phase_begin(PH_EMIT);
+    if (opt_dump) {
+        bc_dump(&module);
+    }
+    if (opt_compile) {
+        if (obj) {
+            write_file(out ? out : obj_name(file), obj, objsize);
+        } else {
+            obj_write(&module, out ? out : obj_name(file));
+        }
+    }
+    if (opt_run) {
+        phase_begin(PH_RUN);
+        ret = vm_exec(&module);
+    }
+    if (opt_stats) {
+        stats_report(file);
+    }
+    if (opt_mem_report) {
+        mem_report(stderr);
+    }
+    if (tkcount < 0) {
+        cleanup();
+    } else if (!opt_run) {
+        printf("\n tktable.count=%d\n", tkcount);
+    }
+    if (!opt_run) {
+        printf("%s 语法分析成功！", file);
+    }
+    return ret;
+}
 
+int main(int argc, char **argv) {
+    char *server;
+    int ret;
 
+    if (argc >= 3 && !strcmp(argv[1], "-server")) {
+        server_run(argv[2], argc >= 5 && !strcmp(argv[3], "-workers") ? atoi(argv[4]) : 0);
+        return 0;
+    }
+    if (argc >= 3 && !strcmp(argv[1], "-connect")) {
+        ret = client_run(argv[2], argc - 3, argv + 3);
+        return ret >= 0 ? ret : sc_main(argc - 2, argv + 2);
+    }
+    server = getenv("SC_SERVER");
+    if (server && argc > 1 && (ret = client_run(server, argc - 1, argv + 1)) >= 0) {
+        return ret;
+    }
+    return sc_main(argc, argv);
+}
 
 
 
 
+// 'A':case'B':case'C':case'D':case'E':case'F':case'G':case'H':case'I':case'J':case'K':case'L':case'M':case'N':case'O':case'P':case'Q':case'R':case'S':case'T':case'U':case'V':case'W':case'X':case'Y':case'Z'
+// '0':case'1':case'2':case'3':case'4':case'5':case'6':case'7':case'8':case'9'
@@ -0,0 +1,37 @@
+char a[100];
+char b[100];
+int x[64];
+int y[64];
+
+int main() {
+    int i;
+    int s;
+    int m;
+
+    for (i = 0; i < 100; i = i + 1) {
+        a[i] = i * 7;
+        b[i] = i + 3;
+    }
+    for (i = 0; i < 100; i = i + 1) {
+        a[i] = a[i] & b[i];
+    }
+    m = 12;
+    for (i = 0; i < 64; i = i + 1) {
+        x[i] = i * 37;
+    }
+    for (i = 0; i < 64; i = i + 1) {
+        y[i] = x[i] & m;
+    }
+    s = 0;
+    for (i = 0; i < 100; i = i + 1) {
+        s = s + a[i];
+    }
+    for (i = 0; i < 64; i = i + 1) {
+        s = s + y[i];
+    }
+    printf("%d %d %d %d\n", s, 6 & 3, 1 == 1 & 2, -1 & 255);
+    switch (5) {
+        case 7 & 5: printf("five\n");
+    }
+    return 0;
+}
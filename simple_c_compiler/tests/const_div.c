@@ -0,0 +1,11 @@
+int main() {
+    int x;
+    int y;
+
+    x = -2147483647 - 1;
+    y = -1;
+    printf("%d %d\n", (-2147483647 - 1) / -1, (-2147483647 - 1) % -1);
+    printf("%d %d\n", x / y, x % y);
+    printf("%d %d %d %d\n", -7 / 2, -7 % 2, 7 / -2, 7 % -2);
+    return 0;
+}
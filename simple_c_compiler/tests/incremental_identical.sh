@@ -0,0 +1,70 @@
+#!/bin/sh
+# 增量编译写出的目标文件与全量编译逐字节相同: 冷启动 全部命中 改了被内联的函数之后都比较;
+# 改一个函数只重新优化它和调用它的函数
+sc=$1
+tmp=$2
+cat > "$tmp/inc.c" <<'SRC'
+int seed = 3;
+
+int sq(int x) {
+    return x * x;
+}
+
+int show(int v) {
+    printf("v=%d\n", v);
+    puts("show");
+    return v;
+}
+
+int odd(int n);
+
+int even(int n) {
+    if (n == 0) {
+        return 1;
+    }
+    return odd(n - 1);
+}
+
+int odd(int n) {
+    if (n == 0) {
+        return 0;
+    }
+    return even(n - 1);
+}
+
+int sum(int n) {
+    int i;
+    int s;
+
+    s = 0;
+    for (i = 0; i < n; i = i + 1) {
+        s = s + sq(i) + seed;
+    }
+    return s;
+}
+
+int main() {
+    puts("start");
+    show(sum(10) + even(7));
+    printf("%s\n", "done");
+    return 0;
+}
+SRC
+# check 期望的 "命中数 reused, 重新分析数 reparsed, 重新优化数 reoptimized"
+check() {
+    "$sc" -c "$tmp/inc.c" -o "$tmp/full.o" > /dev/null || exit 1
+    "$sc" -v -incremental -c "$tmp/inc.c" -o "$tmp/incr.o" 2> "$tmp/log" > /dev/null || exit 1
+    cat "$tmp/log"
+    grep -q "$1\$" "$tmp/log" || exit 1
+    cmp "$tmp/full.o" "$tmp/incr.o" || exit 1
+}
+check "0 reused, 6 reparsed, 6 reoptimized"
+check "6 reused, 0 reparsed, 0 reoptimized"
+# sq 内联进 sum, sum 内联进 main
+sed -i 's/return x \* x;/return x * x + 1;/' "$tmp/inc.c"
+check "5 reused, 1 reparsed, 3 reoptimized"
+check "6 reused, 0 reparsed, 0 reoptimized"
+sed -i 's/puts("show");/puts("shown");/' "$tmp/inc.c"
+check "5 reused, 1 reparsed, 2 reoptimized"
+"$sc" -incremental -run "$tmp/inc.c" > "$tmp/out" || exit 1
+printf 'start\nv=325\nshown\ndone\n' | cmp - "$tmp/out"
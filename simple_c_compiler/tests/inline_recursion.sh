@@ -0,0 +1,36 @@
+#!/bin/sh
+# 相互递归的两条调用都不内联, 报告给出调用处的文件和行号; 用编译缓存时第二次也照样报告
+sc=$1
+tmp=$2
+cat > "$tmp/rec.c" <<'SRC'
+int odd(int n);
+
+int even(int n) {
+    if (n == 0) {
+        return 1;
+    }
+    return odd(n - 1);
+}
+
+int odd(int n) {
+    if (n == 0) {
+        return 0;
+    }
+    return even(n - 1);
+}
+
+int main() {
+    printf("%d %d\n", even(10), odd(7));
+    return 0;
+}
+SRC
+"$sc" -inline-report -run "$tmp/rec.c" > "$tmp/out" 2> "$tmp/report" || exit 1
+cat "$tmp/report"
+grep -qx "1 1" "$tmp/out" || exit 1
+grep -q "even: call #1 to odd at .*rec\.c:7: not inlined, recursive" "$tmp/report" || exit 1
+grep -q "odd: call #1 to even at .*rec\.c:14: not inlined, recursive" "$tmp/report" || exit 1
+grep -q "main: call #1 to even at .*rec\.c:18: inlined" "$tmp/report" || exit 1
+for i in 1 2; do
+    "$sc" -cache "$tmp/cache" -inline-report -run "$tmp/rec.c" > /dev/null 2> "$tmp/report" || exit 1
+    grep -q "main: call #1 to even at .*rec\.c:18: inlined" "$tmp/report" || exit 1
+done
@@ -0,0 +1,43 @@
+#!/bin/sh
+# 链接时删除无用函数: 只被取地址调用的函数保留, 只被删掉的函数引用的公共块不分配
+sc=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+cd "$2" || exit 1
+cat > b.c <<'SRC'
+int dead_buf[1000];
+int live_buf[4];
+
+int twice(int x) {
+    return x * 2;
+}
+
+int unused(int x) {
+    dead_buf[x] = x;
+    return dead_buf[0];
+}
+
+int apply(int x) {
+    return (&twice)(x);
+}
+SRC
+cat > a.c <<'SRC'
+int live_buf[4];
+
+int apply(int x);
+
+int main() {
+    live_buf[1] = apply(21);
+    printf("%d\n", live_buf[1]);
+    return 0;
+}
+SRC
+"$sc" -c a.c > /dev/null && "$sc" -c b.c > /dev/null || exit 1
+"$sc" -stats -o x a.o b.o 2> stats > /dev/null || exit 1
+grep "link:" stats
+# main apply twice 和两个 __init 保留, 只删 unused
+grep -q "link: 5 of 6 functions" stats || exit 1
+[ "$("$sc" -run x)" = 42 ] || exit 1
+# dead_buf 占 4000 字节, 不分配时整个映像也没有这么大
+[ "$(wc -c < x)" -lt 4000 ] || exit 1
+"$sc" -no-link-dce -o y a.o b.o > /dev/null || exit 1
+[ "$("$sc" -run y)" = 42 ] || exit 1
+[ "$(wc -c < y)" -gt 4000 ] || exit 1
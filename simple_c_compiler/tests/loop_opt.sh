@@ -0,0 +1,53 @@
+#!/bin/sh
+# 循环不变量外提 归纳变量 展开都用上, 结果与 -no-loop-opt 相同
+sc=$1
+tmp=$2
+cat > "$tmp/loop.c" <<'SRC'
+int a[64];
+int b[64];
+int m[8][8];
+int n[8][8];
+int p[8][8];
+
+int main() {
+    int i;
+    int j;
+    int k;
+    int x;
+    int y;
+    int s;
+
+    x = 3;
+    y = 7;
+    for (i = 0; i < 64; i = i + 1) {
+        a[i] = i * (x * y + 1);
+        b[63 - i] = i - x;
+    }
+    s = 0;
+    for (i = 0; i < 16; i = i + 1) {
+        s = s + a[i * 4] - b[i];
+    }
+    for (i = 0; i < 8; i = i + 1) {
+        for (j = 0; j < 8; j = j + 1) {
+            m[i][j] = i + j;
+            n[i][j] = i - j;
+        }
+    }
+    for (i = 0; i < 8; i = i + 1) {
+        for (j = 0; j < 8; j = j + 1) {
+            p[i][j] = 0;
+            for (k = 0; k < 8; k = k + 1) {
+                p[i][j] = p[i][j] + m[i][k] * n[k][j];
+            }
+        }
+    }
+    printf("%d %d %d %d\n", s, a[63], p[0][0], p[7][3]);
+    return 0;
+}
+SRC
+"$sc" -stats -run "$tmp/loop.c" > "$tmp/out" 2> "$tmp/stats" || exit 1
+grep loops "$tmp/stats"
+grep -qx "9720 1386 140 84" "$tmp/out" || exit 1
+grep -q "loops: 7 loops, [1-9][0-9]* invariants hoisted, [1-9][0-9]* induction variables, [1-9][0-9]* unrolled" "$tmp/stats" || exit 1
+"$sc" -no-loop-opt -run "$tmp/loop.c" > "$tmp/out" || exit 1
+grep -qx "9720 1386 140 84" "$tmp/out" || exit 1
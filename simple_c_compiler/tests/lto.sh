@@ -0,0 +1,45 @@
+#!/bin/sh
+# -flto: 跨文件内联, 别的文件里定义的常量全局变量折叠, 内联后没人用的函数链接时删除; 结果与分别编译相同
+sc=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+cd "$2" || exit 1
+cat > b.c <<'SRC'
+int debug = 0;
+int scale = 3;
+
+int add(int x, int y) {
+    return x + y * scale;
+}
+
+int trace(int x) {
+    if (debug) {
+        printf("trace %d\n", x);
+    }
+    return x;
+}
+SRC
+cat > a.c <<'SRC'
+int add(int x, int y);
+int trace(int x);
+
+int main() {
+    int i;
+    int s;
+
+    s = 0;
+    for (i = 0; i < 100; i = i + 1) {
+        s = add(s, i);
+    }
+    printf("%d\n", trace(s));
+    return 0;
+}
+SRC
+"$sc" -c a.c > /dev/null && "$sc" -c b.c > /dev/null && "$sc" -o plain a.o b.o > /dev/null || exit 1
+[ "$("$sc" -run plain)" = 14850 ] || exit 1
+"$sc" -flto -c a.c > /dev/null && "$sc" -flto -c b.c > /dev/null || exit 1
+"$sc" -stats -o lto a.o b.o 2> stats > /dev/null || exit 1
+grep "inline:\|lto:\|link:" stats
+[ "$("$sc" -run lto)" = 14850 ] || exit 1
+# main 里对 add 和 trace 的调用都内联, debug 和 scale 的读出折叠为常数, add 和 trace 本身不再可达
+grep -q "inline: 3 call sites, 2 inlined" stats || exit 1
+grep -q "lto: 2 objects, 3 functions merged, 2 global loads folded" stats || exit 1
+grep -q "link: 2 of 4 functions" stats || exit 1
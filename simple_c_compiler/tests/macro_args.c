@@ -0,0 +1,41 @@
+#define ADD(a, b) ((a) + (b))
+#define NEST ADD(1, ADD(2, 3))
+#define TWICE(f, x) f(f(x, 1), 1)
+#define MAX(a, b) pick((a) > (b), a, b)
+#define ONE 1
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define CAT(a, b) a ## b
+#define XCAT(a, b) CAT(a, b)
+#define VAR ONE_TWO
+#define ID(x) x
+
+int ONE_TWO;
+
+int pick(int c, int a, int b) {
+    if (c) {
+        return a;
+    }
+    return b;
+}
+
+int main() {
+    int a;
+    int b;
+    int c;
+
+    a = 3;
+    b = 9;
+    c = 4;
+    ONE_TWO = 12;
+    printf("%d\n", ADD(ADD(5, 1), 1));
+    printf("%d\n", NEST);
+    printf("%d\n", MAX(a, MAX(b, c)));
+    printf("%d\n", TWICE(ADD, 5));
+    printf("%d\n", ID(ID(ADD(ID(2), ONE))));
+    printf("%s %s\n", STR(ONE), XSTR(ONE));
+    printf("[%s] [%s]\n", STR(  a  +   b  ), STR(f(x,	"a  b" ,  'c')));
+    printf("%d %d\n", CAT(ONE, _TWO), XCAT(V, AR));
+    printf("%d\n", pick(ONE, ADD(ONE, ONE), 0));
+    return 0;
+}
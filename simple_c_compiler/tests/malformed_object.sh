@@ -0,0 +1,29 @@
+#!/bin/sh
+# 损坏或截断的目标文件 静态库 映像要报 malformed object, 不能崩溃或当作空文件
+sc=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+cd "$2" || exit 1
+printf 'int b(int x) {\n    return x + 1;\n}\n' > b.c
+printf 'int b(int x);\n\nint main() {\n    printf("%%d\\n", b(41));\n    return 0;\n}\n' > a.c
+"$sc" -c a.c > /dev/null && "$sc" -c b.c > /dev/null && "$sc" -o x a.o b.o > /dev/null || exit 1
+[ "$("$sc" -run x)" = 42 ] || exit 1
+
+expect() {
+    "$sc" "$@" > out 2>&1
+    rc=$?
+    if [ $rc = 0 ] || [ $rc -ge 128 -a $rc != 255 ] || ! grep -q "malformed object" out; then
+        echo "$* => $rc"
+        cat out
+        exit 1
+    fi
+}
+
+# 节头表偏移 e_shoff 指到文件外
+cp a.o shoff.o
+printf '\377\377\377\177' | dd of=shoff.o bs=1 seek=40 conv=notrunc 2> /dev/null
+expect -o y shoff.o b.o
+head -c 500 a.o > short.o
+expect -o y short.o b.o
+ar rc lib.a a.o b.o && head -c 300 lib.a > short.a
+expect -o y short.a
+head -c 300 x > short.out
+expect -run short.out
@@ -0,0 +1,6 @@
+int main() {
+    printf("%d %d %d %d %d\n", 1u, 2U, 3l, 4L, 5ll);
+    printf("%d %d %d %d %d\n", 6LL, 7ul, 8LU, 9llu, 10ULL);
+    printf("%d %d %d\n", 0x10uL, 017Lu, 0u);
+    return 0;
+}
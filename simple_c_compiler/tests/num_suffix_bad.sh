@@ -0,0 +1,10 @@
+#!/bin/sh
+# 整数常量的后缀: l 与 L 混用 不相邻的 l 三个 l 重复的 u 都报错
+sc=$1
+tmp=$2
+for x in 1lL 1Ll 1lul 1lll 1LLl 1uu 1ulu; do
+    printf 'int main() {\n    return %s;\n}\n' $x > "$tmp/num.c"
+    "$sc" -run "$tmp/num.c" > "$tmp/out" 2>&1 && { echo "$x accepted"; exit 1; }
+    grep -q "整数常量的后缀有误" "$tmp/out" || { cat "$tmp/out"; exit 1; }
+done
+exit 0
@@ -0,0 +1,35 @@
+#!/bin/sh
+# 预编译头与直接包含的结果相同; 前缀头文件改过或 -D 不同时警告并改为直接包含, 用的是新内容
+sc=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+cd "$2" || exit 1
+printf '#define K 5\n\nstruct P {\n    int x;\n    int y;\n};\n\nint area(struct P *p);\n' > prelude.h
+cat > prog.c <<'SRC'
+int area(struct P *p) {
+    return p->x * p->y * K;
+}
+
+int main() {
+    struct P p;
+
+    p.x = 2;
+    p.y = 3;
+    printf("%d\n", area(&p));
+    return 0;
+}
+SRC
+mkdir -p inc
+cp prelude.h inc/
+{ echo '#include "prelude.h"'; cat prog.c; } > inc/prog.c
+"$sc" -pch-out prelude.pch prelude.h > /dev/null || exit 1
+"$sc" -pch prelude.pch -c prog.c -o pch.o > /dev/null && "$sc" -c inc/prog.c -o inc.o > /dev/null || exit 1
+cmp pch.o inc.o || exit 1
+"$sc" -pch prelude.pch -run prog.c > out 2>&1 || exit 1
+[ "$(cat out)" = 30 ] || exit 1
+"$sc" -pch prelude.pch -DX=1 -run prog.c > out 2>&1 || exit 1
+cat out
+grep -q "与编译器或 -I/-D 选项不符" out && grep -qx 30 out || exit 1
+# 长度变了, 不用等修改时间变化
+sed 's/K 5/K 70/' prelude.h > prelude.new && mv prelude.new prelude.h
+"$sc" -pch prelude.pch -run prog.c > out 2>&1 || exit 1
+cat out
+grep -q "预编译头 prelude.pch 已过期" out && grep -qx 420 out || exit 1
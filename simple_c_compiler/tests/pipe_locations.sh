@@ -0,0 +1,21 @@
+#!/bin/sh
+# 管道输入: 报错的行列与文件输入相同, 早已移出读入缓冲区的 case 标号也能报出行号
+sc=$1
+tmp=$2
+awk 'BEGIN {
+    print "int f(int x) {"
+    print "    switch (x) {"
+    print "        case 1: return 1;"
+    for (i = 0; i < 20000; i++) {
+        printf "        case %d: return %d;\n", i + 2, i
+    }
+    print "    }"
+    print "    return 0;"
+    print "}"
+}' > "$tmp/big.c"
+sed 's/case 2: return 0;/case 1: return 0;/' "$tmp/big.c" > "$tmp/dup.c"
+"$sc" -c "$tmp/dup.c" -o "$tmp/a.o" > "$tmp/file.out" 2>&1 && exit 1
+cat "$tmp/dup.c" | "$sc" -c - -o "$tmp/b.o" > "$tmp/pipe.out" 2>&1 && exit 1
+cat "$tmp/pipe.out"
+grep -q "dup.c(line:4, col:9): case 值 1 重复" "$tmp/file.out" || exit 1
+grep -q "<stdin>(line:4, col:9): case 值 1 重复" "$tmp/pipe.out" || exit 1
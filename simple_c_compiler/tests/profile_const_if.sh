@@ -0,0 +1,28 @@
+#!/bin/sh
+# 常量条件的 if 删去了一臂的计数器, 生成的 profile 仍要能用; 源文件改过时警告指向改过的函数
+sc=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+cd "$2" || exit 1
+cat > a.c <<'END'
+int f(int x) {
+    if (1) {
+        x = x + 1;
+    } else {
+        x = x - 1;
+    }
+    return x;
+}
+
+int main() {
+    printf("%d\n", f(1));
+    return 0;
+}
+END
+"$sc" -fprofile-generate=a.prof -run a.c > out 2>&1 || exit 1
+"$sc" -fprofile-use=a.prof -run a.c > out 2>&1 || exit 1
+if grep -q profile out; then
+    cat out
+    exit 1
+fi
+sed 's/x = x + 1;/x = x + 1;\n        if (x) x = 0;/' a.c > b.c
+"$sc" -fprofile-use=a.prof -run b.c > out 2>&1 || exit 1
+grep -q "b.c(line:1, .*'f'的profile与源文件不符" out || { cat out; exit 1; }
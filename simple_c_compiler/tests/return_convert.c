@@ -0,0 +1,32 @@
+// 返回值转换为函数的返回类型: char/short 截断后符号扩展
+char to_char(int x) {
+    return x;
+}
+
+short to_short(int x) {
+    return x;
+}
+
+char same(char c) {
+    return c;
+}
+
+char constant() {
+    return 300;
+}
+
+short widen(int x) {
+    return to_char(x) + x;
+}
+
+char narrow(int x) {
+    return to_short(x);
+}
+
+int main() {
+    printf("%d %d %d\n", to_char(300), to_char(-129), to_char(127));
+    printf("%d %d %d\n", to_short(70000), to_short(-32769), to_short(32767));
+    printf("%d %d\n", same(to_char(200)), constant());
+    printf("%d %d\n", widen(300), narrow(70000));
+    return 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+# 回归测试: tests/*.c 逐个 -run, 标准输出与同名 .out 比较;
+# 有同名 .err 的应当编译失败, 诊断 (标准输出和标准错误) 要包含 .err 的每一行;
+# tests/*.sh 以 sc 和临时目录为参数运行, 退出码为 0 即通过
+# 用法: sh tests/run.sh [sc可执行文件]
+dir=$(dirname "$0")
+sc=${1:-./sc}
+tmp=${TMPDIR:-/tmp}/sc_test.$$
+mkdir -p "$tmp"
+trap 'rm -rf "$tmp"' EXIT
+pass=0
+fail=0
+
+for f in "$dir"/*.c; do
+    name=$(basename "$f" .c)
+    ok=1
+    if [ -f "$dir/$name.err" ]; then
+        "$sc" -run "$f" > "$tmp/out" 2>&1 && ok=0
+        while IFS= read -r line; do
+            grep -qF -- "$line" "$tmp/out" || ok=0
+        done < "$dir/$name.err"
+        [ $ok = 1 ] || head -5 "$tmp/out"
+    else
+        "$sc" -run "$f" > "$tmp/out" 2>&1 || ok=0
+        diff "$dir/$name.out" "$tmp/out" > "$tmp/diff" || ok=0
+        [ $ok = 1 ] || head -10 "$tmp/diff"
+    fi
+    if [ $ok = 1 ]; then
+        pass=$((pass + 1))
+    else
+        fail=$((fail + 1))
+        echo "FAIL $name"
+    fi
+done
+for f in "$dir"/*.sh; do
+    [ "$(basename "$f")" = run.sh ] && continue
+    name=$(basename "$f" .sh)
+    mkdir -p "$tmp/$name"
+    if sh "$f" "$sc" "$tmp/$name" > "$tmp/out" 2>&1; then
+        pass=$((pass + 1))
+    else
+        fail=$((fail + 1))
+        echo "FAIL $name"
+        head -10 "$tmp/out"
+    fi
+done
+echo "tests: $pass passed, $fail failed"
+[ $fail = 0 ]
@@ -0,0 +1,16 @@
+// 相同的字符串常量共用一个地址, 是另一个常量后缀的指向它的尾部
+char *g = "hello, world";
+
+int main() {
+    char *a;
+    char *b;
+    char *c;
+
+    a = "foobar";
+    b = "bar";
+    c = "world";
+    printf("%s %s %s %s\n", a, b, c, g);
+    printf("%d %d %d\n", b == a + 3, c == g + 7, a == "foobar");
+    printf("%d %d\n", "r" == b + 2, "bar" == b);
+    return 0;
+}
@@ -0,0 +1,31 @@
+int main() {
+    {
+        struct A {
+            int a;
+            int b;
+        };
+        struct W {
+            struct A arr[10];
+        };
+        struct W w;
+
+        w.arr[9].b = 7;
+        printf("%d %d\n", sizeof(struct W), w.arr[9].b);
+    }
+    {
+        struct A {
+            int a[10];
+        };
+        struct W {
+            struct A arr[10];
+        };
+        struct W w;
+        int i;
+
+        for (i = 0; i < 10; i = i + 1) {
+            w.arr[i].a[9] = i;
+        }
+        printf("%d %d\n", sizeof(struct W), w.arr[9].a[9]);
+    }
+    return 0;
+}
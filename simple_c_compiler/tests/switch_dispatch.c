@@ -0,0 +1,154 @@
+// 密集 (跳转表) 稀疏 (二分查找) 和成段三种分布, 穿透 中间的 default 嵌套 循环里的 continue/break 和极值
+int dense(int x) {
+    switch (x) {
+        case 0: return 10;
+        case 1: return 11;
+        case 2: return 12;
+        case 3: return 13;
+        case 4: return 14;
+        case 5: return 15;
+        case 7: return 17;
+        case 8: return 18;
+    }
+    return -1;
+}
+
+int sparse(int x) {
+    switch (x) {
+        case -5000: return 1;
+        case -7: return 2;
+        case 3: return 3;
+        case 1009: return 4;
+        case 2018: return 5;
+        case 50000: return 6;
+        case 99991: return 7;
+        case 1000000: return 8;
+    }
+    return 0;
+}
+
+int mixed(int x) {
+    switch (x) {
+        case 100: return 1;
+        case 101: return 2;
+        case 102: return 3;
+        case 103: return 4;
+        case 104: return 5;
+        case 500: return 6;
+        case 900: return 7;
+        case 901: return 8;
+        case 902: return 9;
+        case 903: return 10;
+        case 904: return 11;
+        case 905: return 12;
+        case 7000: return 13;
+    }
+    return 0;
+}
+
+int fall(int x) {
+    int s;
+
+    s = 0;
+    switch (x) {
+        case 1:
+            s = s + 1;
+        case 2:
+            s = s + 10;
+            break;
+        default:
+            s = s + 100;
+        case 3:
+            s = s + 1000;
+        case 4:
+            s = s + 10000;
+            break;
+        case 5:
+            s = s + 100000;
+    }
+    return s;
+}
+
+int nested(int x, int y) {
+    switch (x) {
+        case 0:
+            switch (y) {
+                case 0: return 0;
+                case 1: return 1;
+                default: return 2;
+            }
+        case 1:
+            switch (y) {
+                case 5: return 15;
+                case 6:
+                    break;
+            }
+            return 16;
+        default:
+            return 99;
+    }
+}
+
+int loop(int n) {
+    int i;
+    int s;
+
+    s = 0;
+    for (i = 0; i < n; i = i + 1) {
+        switch (i % 5) {
+            case 0:
+                continue;
+            case 1:
+                s = s + 1;
+                break;
+            case 2:
+                if (i > 10) {
+                    break;
+                }
+                s = s + 100;
+            case 3:
+                s = s + 1000;
+                continue;
+            default:
+                break;
+        }
+        s = s + 10000;
+    }
+    return s;
+}
+
+int limits(int x) {
+    switch (x) {
+        case -2147483647 - 1: return 1;
+        case -2147483647: return 2;
+        case 0: return 3;
+        case 2147483646: return 4;
+        case 2147483647: return 5;
+    }
+    return 0;
+}
+
+int main() {
+    int i;
+
+    for (i = -1; i < 10; i = i + 1) {
+        printf("%d ", dense(i));
+    }
+    printf("\n");
+    printf("%d %d %d %d %d ", sparse(-5000), sparse(-7), sparse(3), sparse(1009), sparse(2018));
+    printf("%d %d %d %d %d\n", sparse(50000), sparse(99991), sparse(1000000), sparse(4), sparse(-2147483647 - 1));
+    for (i = 99; i < 106; i = i + 1) {
+        printf("%d ", mixed(i));
+    }
+    printf("%d %d %d %d %d %d\n", mixed(500), mixed(899), mixed(900), mixed(905), mixed(906), mixed(7000));
+    for (i = 0; i < 7; i = i + 1) {
+        printf("%d ", fall(i));
+    }
+    printf("\n");
+    printf("%d %d %d %d %d %d %d\n", nested(0, 0), nested(0, 1), nested(0, 7), nested(1, 5), nested(1, 6),
+           nested(1, 0), nested(2, 5));
+    printf("%d %d\n", loop(5), loop(23));
+    printf("%d %d %d %d %d %d %d\n", limits(-2147483647 - 1), limits(-2147483647), limits(0), limits(2147483646),
+           limits(2147483647), limits(1), limits(-2147483646));
+    return 0;
+}
@@ -0,0 +1,16 @@
+int f(int x) {
+    switch (x) {
+        case 1:
+            return 10;
+        case 2:
+            return 20;
+        case 1:
+            return 30;
+    }
+    return 0;
+}
+
+int main() {
+    printf("%d\n", f(1));
+    return 0;
+}
@@ -0,0 +1,50 @@
+#!/bin/sh
+# 相互尾递归和自身尾递归改为 TCALL, 递归三百万层也不增长调用栈; 返回 char 的函数不做尾调用, 照样截断
+sc=$1
+tmp=$2
+cat > "$tmp/tc.c" <<'SRC'
+int odd(int n);
+
+int even(int n) {
+    if (n == 0) {
+        return 1;
+    }
+    return odd(n - 1);
+}
+
+int odd(int n) {
+    if (n == 0) {
+        return 0;
+    }
+    return even(n - 1);
+}
+
+int sum(int n, int acc) {
+    if (n == 0) {
+        return acc;
+    }
+    return sum(n - 1, acc + n % 7);
+}
+
+int wide(int x) {
+    return x + 256;
+}
+
+char narrow(int x) {
+    return wide(x);
+}
+
+int main() {
+    printf("%d %d\n", even(3000000), odd(3000001));
+    printf("%d\n", sum(3000000, 0));
+    printf("%d\n", narrow(44));
+    return 0;
+}
+SRC
+"$sc" -stats -run "$tmp/tc.c" > "$tmp/out" 2> "$tmp/stats" || exit 1
+grep "tail calls" "$tmp/stats"
+printf '1 1\n8999997\n44\n' | diff - "$tmp/out" || exit 1
+grep -q "tail calls: 3" "$tmp/stats" || exit 1
+# 不做尾调用时同样的递归深度超出虚拟机的调用栈
+"$sc" -no-tail-call -run "$tmp/tc.c" > "$tmp/out" 2>&1 && exit 1
+grep -q "调用层次过深" "$tmp/out" || exit 1
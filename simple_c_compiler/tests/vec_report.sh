@@ -0,0 +1,24 @@
+#!/bin/sh
+# 按位与的循环向量化, 报告给出循环所在的文件和行号; 用编译缓存时第二次也照样报告
+sc=$1
+tmp=$2
+cat > "$tmp/vec.c" <<'SRC'
+short a[64];
+short b[64];
+
+int main() {
+    int i;
+
+    for (i = 0; i < 64; i = i + 1) {
+        a[i] = a[i] & b[i];
+    }
+    return 0;
+}
+SRC
+"$sc" -vec-report -run "$tmp/vec.c" 2> "$tmp/report" || exit 1
+cat "$tmp/report"
+grep -q "main: loop at .*vec\.c:7: vectorized, short x8" "$tmp/report" || exit 1
+for i in 1 2; do
+    "$sc" -cache "$tmp/cache" -vec-report -run "$tmp/vec.c" 2> "$tmp/report" || exit 1
+    grep -q "main: loop at .*vec\.c:7: vectorized, short x8" "$tmp/report" || exit 1
+done